@@ -0,0 +1,176 @@
+#include "asset_streamer.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <random>
+#include <vector>
+
+// Streams a generated pack file through Asset_Streamer into a Copy_Scheduler whose copies a stub GPU
+// executes right away. Checks every byte that arrives in the destination buffers and reports the
+// throughput of the I/O and decompression stages and the longest update() of a frame.
+
+static constexpr uint32_t ASSET_COUNT = 512;
+static constexpr uint64_t PAGE_SIZE = 1ull << 20;
+static constexpr uint32_t PAGE_COUNT = 8;
+// Streamed bytes handed to the copy queue per frame.
+static constexpr uint64_t FRAME_BYTES = 4 * PAGE_SIZE;
+
+struct Asset
+{
+    std::vector<uint8_t> data;
+    uint64_t file_offset;
+    uint64_t compressed_size;
+    uint32_t compression;
+};
+
+// Runs of repeated bytes and short random stretches, roughly as compressible as texture data.
+static std::vector<uint8_t> generate_asset(std::mt19937_64& random)
+{
+    std::vector<uint8_t> data(4096 + random() % (1u << 20));
+    for (size_t i = 0; i < data.size();)
+    {
+        auto run = std::min<size_t>(data.size() - i, 8 + random() % 64);
+        auto value = uint8_t(random());
+        bool is_noise = random() % 4 == 0;
+        for (size_t j = 0; j < run; ++j)
+        {
+            data[i + j] = is_noise ? uint8_t(random()) : value;
+        }
+        i += run;
+    }
+    return data;
+}
+
+static bool write_pack(const char* path, std::vector<Asset>& assets)
+{
+    std::mt19937_64 random(42);
+    auto file = fopen(path, "wb");
+    if (!file)
+    {
+        return false;
+    }
+    uint64_t offset = 0;
+    for (uint32_t i = 0; i < ASSET_COUNT; ++i)
+    {
+        auto& asset = assets.emplace_back();
+        asset.data = generate_asset(random);
+        asset.file_offset = offset;
+        // Every fourth asset is stored uncompressed.
+        std::vector<uint8_t> compressed;
+        if (i % 4 != 0)
+        {
+            compressed = compress_lz4_block(asset.data);
+        }
+        std::span<const uint8_t> contents = compressed.empty() ? std::span<const uint8_t>(asset.data) : compressed;
+        asset.compression = compressed.empty() ? STREAM_COMPRESSION_NONE : STREAM_COMPRESSION_LZ4;
+        asset.compressed_size = contents.size();
+        fwrite(contents.data(), 1, contents.size(), file);
+        offset += contents.size();
+    }
+    fclose(file);
+    return true;
+}
+
+int main()
+{
+    auto path = (std::filesystem::temp_directory_path() / "asset_streamer_benchmark.pack").string();
+    std::vector<Asset> assets;
+    if (!write_pack(path.c_str(), assets))
+    {
+        printf("can't write %s\n", path.c_str());
+        return 1;
+    }
+
+    std::vector<std::vector<uint8_t>> upload_pages(PAGE_COUNT, std::vector<uint8_t>(PAGE_SIZE));
+    std::vector<uint8_t*> upload_pointers;
+    for (auto& page : upload_pages)
+    {
+        upload_pointers.push_back(page.data());
+    }
+    Copy_Scheduler scheduler({ .page_size = PAGE_SIZE, .max_bytes_per_frame = FRAME_BYTES }, upload_pointers, {});
+    Copy_Scheduler_Stream_Sink sink(scheduler, FRAME_BYTES);
+    Job_System job_system;
+    Asset_Streamer streamer(job_system, sink, { .io_thread_count = 2, .memory_budget = 16ull << 20 });
+    auto file = streamer.open_file(path.c_str());
+    if (file == INVALID_STREAM_FILE)
+    {
+        printf("can't open %s\n", path.c_str());
+        return 1;
+    }
+
+    std::vector<std::vector<uint8_t>> resources(ASSET_COUNT);
+    uint64_t total_size = 0;
+    uint64_t total_compressed_size = 0;
+    for (uint32_t i = 0; i < ASSET_COUNT; ++i)
+    {
+        resources[i].resize(assets[i].data.size());
+        total_size += assets[i].data.size();
+        total_compressed_size += assets[i].compressed_size;
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < ASSET_COUNT; ++i)
+    {
+        streamer.request({
+            .file = file,
+            .file_offset = assets[i].file_offset,
+            .compressed_size = assets[i].compressed_size,
+            .size = assets[i].data.size(),
+            .compression = assets[i].compression,
+            .priority = int32_t(i % 4),
+            .resource = &resources[i],
+            .resource_offset = 0
+        });
+    }
+    // Wrong size for the compressed data, has to fail instead of reaching the sink.
+    streamer.request({
+        .file = file,
+        .file_offset = assets[1].file_offset,
+        .compressed_size = assets[1].compressed_size,
+        .size = assets[1].data.size() + 1,
+        .compression = assets[1].compression,
+        .priority = 0,
+        .resource = nullptr,
+        .resource_offset = 0
+    });
+    uint64_t frame = 0;
+    double max_update_ms = 0.0;
+    while (!streamer.is_idle() || !scheduler.is_idle())
+    {
+        auto update_begin = std::chrono::steady_clock::now();
+        streamer.update(FRAME_BYTES);
+        auto update_end = std::chrono::steady_clock::now();
+        max_update_ms = std::max(max_update_ms, std::chrono::duration<double, std::milli>(update_end - update_begin).count());
+        // Stub GPU, the copies complete within the frame.
+        auto copies = scheduler.build_frame();
+        for (const auto& copy : copies)
+        {
+            memcpy(static_cast<std::vector<uint8_t>*>(copy.resource)->data() + copy.offset,
+                upload_pointers[copy.page] + copy.page_offset, copy.size);
+        }
+        frame += 1;
+        scheduler.end_frame(frame);
+        scheduler.retire(frame);
+        if (copies.empty())
+        {
+            std::this_thread::yield();
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    std::filesystem::remove(path);
+
+    bool success = streamer.get_failed_count() == 1;
+    for (uint32_t i = 0; i < ASSET_COUNT; ++i)
+    {
+        success = success && resources[i] == assets[i].data;
+    }
+    auto seconds = std::chrono::duration<double>(end - begin).count();
+    printf("correctness: %s, %u assets, %.1f MiB (%.1f MiB in the file), %llu frames\n",
+        success ? "ok" : "MISMATCH", ASSET_COUNT, total_size / 1048576.0, total_compressed_size / 1048576.0,
+        (unsigned long long)frame);
+    printf("streamed %.1f MiB/s, longest update %.3f ms, peak staging %.1f MiB of %.1f MiB\n",
+        total_size / 1048576.0 / seconds, max_update_ms,
+        streamer.get_peak_memory() / 1048576.0, streamer.get_settings().memory_budget / 1048576.0);
+    return success ? 0 : 1;
+}
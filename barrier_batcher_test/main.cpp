@@ -0,0 +1,254 @@
+#include "barrier_batcher.h"
+#include "test_check.h"
+#include <cstdint>
+#include <vector>
+
+// Feeds barrier streams through Barrier_Batcher into a command list mock that records every Barrier
+// call, and checks how many calls come out and what they contain.
+
+struct Recorded_Barrier_Call
+{
+    std::vector<D3D12_GLOBAL_BARRIER> global_barriers;
+    std::vector<D3D12_TEXTURE_BARRIER> texture_barriers;
+    std::vector<D3D12_BUFFER_BARRIER> buffer_barriers;
+    uint32_t group_count = 0;
+};
+
+struct Recording_Command_List
+{
+    std::vector<Recorded_Barrier_Call> calls;
+
+    void Barrier(uint32_t group_count, const D3D12_BARRIER_GROUP* groups)
+    {
+        auto& call = calls.emplace_back();
+        call.group_count = group_count;
+        for (uint32_t i = 0; i < group_count; ++i)
+        {
+            const auto& group = groups[i];
+            switch (group.Type)
+            {
+            case D3D12_BARRIER_TYPE_GLOBAL:
+                call.global_barriers.insert(call.global_barriers.end(), group.pGlobalBarriers, group.pGlobalBarriers + group.NumBarriers);
+                break;
+            case D3D12_BARRIER_TYPE_TEXTURE:
+                call.texture_barriers.insert(call.texture_barriers.end(), group.pTextureBarriers, group.pTextureBarriers + group.NumBarriers);
+                break;
+            case D3D12_BARRIER_TYPE_BUFFER:
+                call.buffer_barriers.insert(call.buffer_barriers.end(), group.pBufferBarriers, group.pBufferBarriers + group.NumBarriers);
+                break;
+            }
+        }
+    }
+};
+
+static ID3D12Resource* fake_resource(uintptr_t id)
+{
+    return reinterpret_cast<ID3D12Resource*>(id * 0x100);
+}
+
+static D3D12_BARRIER_SUBRESOURCE_RANGE mip_range(uint32_t first_mip, uint32_t mip_count, uint32_t first_slice = 0, uint32_t slice_count = 1)
+{
+    return {
+        .IndexOrFirstMipLevel = first_mip,
+        .NumMipLevels = mip_count,
+        .FirstArraySlice = first_slice,
+        .NumArraySlices = slice_count,
+        .FirstPlane = 0,
+        .NumPlanes = 1
+    };
+}
+
+static D3D12_TEXTURE_BARRIER texture_barrier(
+    ID3D12Resource* resource, D3D12_BARRIER_LAYOUT before, D3D12_BARRIER_LAYOUT after, D3D12_BARRIER_SUBRESOURCE_RANGE range)
+{
+    auto access = [](D3D12_BARRIER_LAYOUT layout) {
+        switch (layout)
+        {
+        case D3D12_BARRIER_LAYOUT_UNORDERED_ACCESS: return D3D12_BARRIER_ACCESS_UNORDERED_ACCESS;
+        case D3D12_BARRIER_LAYOUT_SHADER_RESOURCE: return D3D12_BARRIER_ACCESS_SHADER_RESOURCE;
+        case D3D12_BARRIER_LAYOUT_COPY_SOURCE: return D3D12_BARRIER_ACCESS_COPY_SOURCE;
+        case D3D12_BARRIER_LAYOUT_COPY_DEST: return D3D12_BARRIER_ACCESS_COPY_DEST;
+        case D3D12_BARRIER_LAYOUT_RENDER_TARGET: return D3D12_BARRIER_ACCESS_RENDER_TARGET;
+        default: return D3D12_BARRIER_ACCESS_NO_ACCESS;
+        }
+    };
+    return {
+        .SyncBefore = before == D3D12_BARRIER_LAYOUT_UNDEFINED ? D3D12_BARRIER_SYNC_NONE : D3D12_BARRIER_SYNC_ALL,
+        .SyncAfter = D3D12_BARRIER_SYNC_ALL,
+        .AccessBefore = access(before),
+        .AccessAfter = access(after),
+        .LayoutBefore = before,
+        .LayoutAfter = after,
+        .pResource = resource,
+        .Subresources = range,
+        .Flags = D3D12_TEXTURE_BARRIER_FLAG_NONE
+    };
+}
+
+static D3D12_BUFFER_BARRIER buffer_barrier(ID3D12Resource* resource, D3D12_BARRIER_ACCESS before, D3D12_BARRIER_ACCESS after)
+{
+    return {
+        .SyncBefore = D3D12_BARRIER_SYNC_ALL,
+        .SyncAfter = D3D12_BARRIER_SYNC_ALL,
+        .AccessBefore = before,
+        .AccessAfter = after,
+        .pResource = resource,
+        .Offset = 0,
+        .Size = UINT64_MAX
+    };
+}
+
+static void test_range_overlap()
+{
+    auto all = D3D12_BARRIER_SUBRESOURCE_RANGE{ ALL_SUBRESOURCES, 0, 0, 0, 0, 0 };
+    auto index_3 = D3D12_BARRIER_SUBRESOURCE_RANGE{ 3, 0, 0, 0, 0, 0 };
+    auto index_4 = D3D12_BARRIER_SUBRESOURCE_RANGE{ 4, 0, 0, 0, 0, 0 };
+    TEST_CHECK(do_subresource_ranges_overlap(all, mip_range(5, 1)));
+    TEST_CHECK(do_subresource_ranges_overlap(mip_range(0, 2), mip_range(1, 3)));
+    TEST_CHECK(!do_subresource_ranges_overlap(mip_range(0, 2), mip_range(2, 3)));
+    TEST_CHECK(!do_subresource_ranges_overlap(mip_range(0, 4, 0, 2), mip_range(0, 4, 2, 4)));
+    TEST_CHECK(do_subresource_ranges_overlap(mip_range(0, 4, 0, 3), mip_range(3, 1, 2, 4)));
+    auto plane_1 = mip_range(0, 1);
+    plane_1.FirstPlane = 1;
+    TEST_CHECK(!do_subresource_ranges_overlap(mip_range(0, 1), plane_1));
+    TEST_CHECK(!do_subresource_ranges_overlap(index_3, index_4));
+    TEST_CHECK(do_subresource_ranges_overlap(index_3, index_3));
+    // The index form can't be decoded without dimensions.
+    TEST_CHECK(do_subresource_ranges_overlap(index_3, mip_range(7, 1)));
+}
+
+static void test_single_call()
+{
+    Recording_Command_List cmd;
+    Barrier_Batcher<Recording_Command_List> batcher(&cmd);
+    auto texture = fake_resource(1);
+    auto other_texture = fake_resource(2);
+    auto buffer = fake_resource(3);
+    // Two separate mips of one texture, another texture, a buffer and two global barriers.
+    batcher.texture(texture_barrier(texture, D3D12_BARRIER_LAYOUT_UNORDERED_ACCESS, D3D12_BARRIER_LAYOUT_SHADER_RESOURCE, mip_range(0, 1)));
+    batcher.texture(texture_barrier(texture, D3D12_BARRIER_LAYOUT_SHADER_RESOURCE, D3D12_BARRIER_LAYOUT_UNORDERED_ACCESS, mip_range(1, 1)));
+    batcher.texture(texture_barrier(texture, D3D12_BARRIER_LAYOUT_COPY_DEST, D3D12_BARRIER_LAYOUT_SHADER_RESOURCE, mip_range(2, 2, 1, 5)));
+    batcher.texture(texture_barrier(other_texture, D3D12_BARRIER_LAYOUT_UNDEFINED, D3D12_BARRIER_LAYOUT_RENDER_TARGET,
+        { ALL_SUBRESOURCES, 0, 0, 0, 0, 0 }));
+    batcher.buffer(buffer_barrier(buffer, D3D12_BARRIER_ACCESS_COPY_DEST, D3D12_BARRIER_ACCESS_SHADER_RESOURCE));
+    batcher.global({ D3D12_BARRIER_SYNC_COPY, D3D12_BARRIER_SYNC_COMPUTE_SHADING, D3D12_BARRIER_ACCESS_COPY_DEST, D3D12_BARRIER_ACCESS_SHADER_RESOURCE });
+    batcher.global({ D3D12_BARRIER_SYNC_RENDER_TARGET, D3D12_BARRIER_SYNC_PIXEL_SHADING, D3D12_BARRIER_ACCESS_RENDER_TARGET, D3D12_BARRIER_ACCESS_NO_ACCESS });
+    TEST_CHECK(cmd.calls.empty());
+    batcher.flush();
+    TEST_CHECK(batcher.empty());
+    TEST_CHECK(cmd.calls.size() == 1);
+    if (cmd.calls.size() != 1)
+    {
+        return;
+    }
+    const auto& call = cmd.calls[0];
+    TEST_CHECK(call.group_count == 3);
+    TEST_CHECK(call.texture_barriers.size() == 4);
+    TEST_CHECK(call.buffer_barriers.size() == 1);
+    TEST_CHECK(call.global_barriers.size() == 1);
+    if (call.global_barriers.size() == 1)
+    {
+        const auto& global = call.global_barriers[0];
+        TEST_CHECK(global.SyncBefore == (D3D12_BARRIER_SYNC_COPY | D3D12_BARRIER_SYNC_RENDER_TARGET));
+        TEST_CHECK(global.SyncAfter == (D3D12_BARRIER_SYNC_COMPUTE_SHADING | D3D12_BARRIER_SYNC_PIXEL_SHADING));
+        TEST_CHECK(global.AccessBefore == (D3D12_BARRIER_ACCESS_COPY_DEST | D3D12_BARRIER_ACCESS_RENDER_TARGET));
+        TEST_CHECK(global.AccessAfter == D3D12_BARRIER_ACCESS_SHADER_RESOURCE);
+    }
+    // Nothing pending, nothing emitted.
+    batcher.flush();
+    TEST_CHECK(cmd.calls.size() == 1);
+}
+
+static void test_merge_and_elide()
+{
+    Recording_Command_List cmd;
+    Barrier_Batcher<Recording_Command_List> batcher(&cmd);
+    auto texture = fake_resource(1);
+    auto buffer = fake_resource(2);
+    // UAV -> COPY_SOURCE -> SRV of the same range folds into UAV -> SRV.
+    batcher.texture(texture_barrier(texture, D3D12_BARRIER_LAYOUT_UNORDERED_ACCESS, D3D12_BARRIER_LAYOUT_COPY_SOURCE, mip_range(0, 3)));
+    batcher.texture(texture_barrier(texture, D3D12_BARRIER_LAYOUT_COPY_SOURCE, D3D12_BARRIER_LAYOUT_SHADER_RESOURCE, mip_range(0, 3)));
+    // SRV -> COPY_SOURCE -> SRV is read to read in the same layout and vanishes.
+    auto other_texture = fake_resource(3);
+    batcher.texture(texture_barrier(other_texture, D3D12_BARRIER_LAYOUT_SHADER_RESOURCE, D3D12_BARRIER_LAYOUT_COPY_SOURCE, mip_range(0, 1)));
+    batcher.texture(texture_barrier(other_texture, D3D12_BARRIER_LAYOUT_COPY_SOURCE, D3D12_BARRIER_LAYOUT_SHADER_RESOURCE, mip_range(0, 1)));
+    // Read to read on a buffer is dropped right away, write to read is kept and then extended.
+    batcher.buffer(buffer_barrier(buffer, D3D12_BARRIER_ACCESS_SHADER_RESOURCE, D3D12_BARRIER_ACCESS_COPY_SOURCE));
+    batcher.buffer(buffer_barrier(buffer, D3D12_BARRIER_ACCESS_UNORDERED_ACCESS, D3D12_BARRIER_ACCESS_SHADER_RESOURCE));
+    batcher.buffer(buffer_barrier(buffer, D3D12_BARRIER_ACCESS_SHADER_RESOURCE, D3D12_BARRIER_ACCESS_INDIRECT_ARGUMENT));
+    batcher.flush();
+    TEST_CHECK(cmd.calls.size() == 1);
+    if (cmd.calls.size() != 1)
+    {
+        return;
+    }
+    const auto& call = cmd.calls[0];
+    TEST_CHECK(call.group_count == 2);
+    TEST_CHECK(call.texture_barriers.size() == 1);
+    if (call.texture_barriers.size() == 1)
+    {
+        TEST_CHECK(call.texture_barriers[0].LayoutBefore == D3D12_BARRIER_LAYOUT_UNORDERED_ACCESS);
+        TEST_CHECK(call.texture_barriers[0].LayoutAfter == D3D12_BARRIER_LAYOUT_SHADER_RESOURCE);
+    }
+    TEST_CHECK(call.buffer_barriers.size() == 1);
+    if (call.buffer_barriers.size() == 1)
+    {
+        TEST_CHECK(call.buffer_barriers[0].AccessBefore == D3D12_BARRIER_ACCESS_UNORDERED_ACCESS);
+        TEST_CHECK(call.buffer_barriers[0].AccessAfter == D3D12_BARRIER_ACCESS_INDIRECT_ARGUMENT);
+    }
+
+    // A stream of only no-ops emits no call at all.
+    batcher.texture(texture_barrier(texture, D3D12_BARRIER_LAYOUT_SHADER_RESOURCE, D3D12_BARRIER_LAYOUT_SHADER_RESOURCE, mip_range(0, 1)));
+    batcher.flush();
+    TEST_CHECK(cmd.calls.size() == 1);
+}
+
+static void test_overlap_flushes()
+{
+    Recording_Command_List cmd;
+    Barrier_Batcher<Recording_Command_List> batcher(&cmd);
+    auto texture = fake_resource(1);
+    // Mips 0-1 and then mips 1-2: mip 1 would be transitioned twice in one call.
+    batcher.texture(texture_barrier(texture, D3D12_BARRIER_LAYOUT_UNORDERED_ACCESS, D3D12_BARRIER_LAYOUT_SHADER_RESOURCE, mip_range(0, 2)));
+    batcher.texture(texture_barrier(texture, D3D12_BARRIER_LAYOUT_SHADER_RESOURCE, D3D12_BARRIER_LAYOUT_COPY_SOURCE, mip_range(1, 2)));
+    TEST_CHECK(cmd.calls.size() == 1);
+    // Disjoint slices of the same texture keep batching after the early flush.
+    batcher.texture(texture_barrier(texture, D3D12_BARRIER_LAYOUT_SHADER_RESOURCE, D3D12_BARRIER_LAYOUT_COPY_DEST, mip_range(0, 4, 1, 2)));
+    // The all form overlaps everything.
+    batcher.texture(texture_barrier(texture, D3D12_BARRIER_LAYOUT_COPY_DEST, D3D12_BARRIER_LAYOUT_SHADER_RESOURCE,
+        { ALL_SUBRESOURCES, 0, 0, 0, 0, 0 }));
+    TEST_CHECK(cmd.calls.size() == 2);
+    // A discard can't fold into the pending transition of the same range.
+    batcher.flush();
+    auto discard = texture_barrier(texture, D3D12_BARRIER_LAYOUT_UNDEFINED, D3D12_BARRIER_LAYOUT_COPY_DEST, mip_range(0, 1));
+    batcher.texture(texture_barrier(texture, D3D12_BARRIER_LAYOUT_SHADER_RESOURCE, D3D12_BARRIER_LAYOUT_UNORDERED_ACCESS, mip_range(0, 1)));
+    discard.Flags = D3D12_TEXTURE_BARRIER_FLAG_DISCARD;
+    batcher.texture(discard);
+    batcher.flush();
+    TEST_CHECK(cmd.calls.size() == 5);
+    if (cmd.calls.size() == 5)
+    {
+        TEST_CHECK(cmd.calls[1].texture_barriers.size() == 2);
+        TEST_CHECK(cmd.calls[2].texture_barriers.size() == 1);
+        TEST_CHECK(cmd.calls[3].texture_barriers.size() == 1);
+        TEST_CHECK(cmd.calls[4].texture_barriers.size() == 1);
+    }
+
+    // Every mip of a 12 mip chain transitioned separately is still a single call.
+    cmd.calls.clear();
+    for (uint32_t mip = 0; mip < 12; ++mip)
+    {
+        batcher.texture(texture_barrier(texture, D3D12_BARRIER_LAYOUT_UNORDERED_ACCESS, D3D12_BARRIER_LAYOUT_SHADER_RESOURCE, mip_range(mip, 1)));
+    }
+    batcher.flush();
+    TEST_CHECK(cmd.calls.size() == 1 && cmd.calls[0].texture_barriers.size() == 12);
+}
+
+int main()
+{
+    test_range_overlap();
+    test_single_call();
+    test_merge_and_elide();
+    test_overlap_flushes();
+    return finish_test();
+}
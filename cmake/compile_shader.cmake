@@ -0,0 +1,51 @@
+# Compiles one shader permutation with DXC and writes a depfile of everything it includes.
+# Run as cmake -P with DXC, SOURCE, OUTPUT, LISTING, DEPFILE, PROFILE and ENTRY set.
+# DEFINES and FLAGS are lists with '|' instead of ';' so they survive the build tool's command line.
+
+string(REPLACE "|" ";" defines "${DEFINES}")
+string(REPLACE "|" ";" flags "${FLAGS}")
+set(define_args)
+foreach(define ${defines})
+    list(APPEND define_args -D ${define})
+endforeach()
+
+execute_process(
+    COMMAND ${DXC} -T ${PROFILE} -E ${ENTRY} ${flags} ${define_args} -Fo ${OUTPUT} -Fc ${LISTING} ${SOURCE}
+    RESULT_VARIABLE compile_result)
+if(NOT compile_result EQUAL 0)
+    file(REMOVE ${OUTPUT} ${LISTING})
+    message(FATAL_ERROR "Compiling ${SOURCE} (${ENTRY}) failed.")
+endif()
+
+# -M prints the make style dependencies of the preprocessed source, "target: dep dep \" with continuations.
+execute_process(
+    COMMAND ${DXC} -T ${PROFILE} -E ${ENTRY} ${flags} ${define_args} -M ${SOURCE}
+    RESULT_VARIABLE dependency_result
+    OUTPUT_VARIABLE dependency_output
+    ERROR_QUIET)
+set(dependencies ${SOURCE})
+if(dependency_result EQUAL 0)
+    string(REPLACE "\\\n" " " dependency_output "${dependency_output}")
+    string(REPLACE "\\ " "<space>" dependency_output "${dependency_output}")
+    string(FIND "${dependency_output}" ": " target_end)
+    if(NOT target_end EQUAL -1)
+        math(EXPR target_end "${target_end} + 2")
+        string(SUBSTRING "${dependency_output}" ${target_end} -1 dependency_output)
+        string(REGEX REPLACE "[ \t\r\n]+" ";" dependency_list "${dependency_output}")
+        foreach(dependency ${dependency_list})
+            string(REPLACE "<space>" " " dependency "${dependency}")
+            file(TO_CMAKE_PATH "${dependency}" dependency)
+            list(APPEND dependencies "${dependency}")
+        endforeach()
+    endif()
+else()
+    message(WARNING "${DXC} can't list dependencies, ${OUTPUT} only rebuilds when ${SOURCE} changes.")
+endif()
+list(REMOVE_DUPLICATES dependencies)
+
+set(depfile_content "${OUTPUT}:")
+foreach(dependency ${dependencies})
+    string(REPLACE " " "\\ " dependency "${dependency}")
+    string(APPEND depfile_content " \\\n  ${dependency}")
+endforeach()
+file(WRITE ${DEPFILE} "${depfile_content}\n")
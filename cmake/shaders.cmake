@@ -0,0 +1,65 @@
+# Offline shader build. Every hlsl_shader() call adds one DXC compile to an archive, add_shader_archive()
+# packs them with tools/shader_pack into a Shader_Archive plus a header with their reflection.
+# Each permutation is its own build step, so the build tool compiles them in parallel, and rebuilds
+# only those whose source or includes changed.
+
+set(SHADER_COMPILE_SCRIPT ${CMAKE_CURRENT_LIST_DIR}/compile_shader.cmake)
+
+# SHA256 of a shader source with line endings normalized, so a CRLF checkout hashes the same.
+function(shader_source_hash OUTPUT SOURCE)
+    file(READ ${SOURCE} content)
+    string(REPLACE "\r\n" "\n" content "${content}")
+    string(SHA256 hash "${content}")
+    set(${OUTPUT} ${hash} PARENT_SCOPE)
+endfunction()
+
+# hlsl_shader(<archive> NAME <name> SOURCE <file> PROFILE <profile> ENTRY <entry> [DEFINES ...] [FLAGS ...])
+function(hlsl_shader ARCHIVE)
+    cmake_parse_arguments(SHADER "" "NAME;SOURCE;PROFILE;ENTRY" "DEFINES;FLAGS" ${ARGN})
+    get_filename_component(source ${SHADER_SOURCE} ABSOLUTE)
+    set(output_dir ${CMAKE_CURRENT_BINARY_DIR}/shaders/${ARCHIVE})
+    set(output ${output_dir}/${SHADER_NAME}.bin)
+    set(listing ${output_dir}/${SHADER_NAME}.lst)
+    set(depfile ${output_dir}/${SHADER_NAME}.d)
+    string(REPLACE ";" "|" defines "${SHADER_DEFINES}")
+    string(REPLACE ";" "|" flags "${SHADER_FLAGS}")
+    set(dependency_args DEPENDS ${source} ${SHADER_COMPILE_SCRIPT})
+    if(CMAKE_VERSION VERSION_GREATER_EQUAL 3.21)
+        list(APPEND dependency_args DEPFILE ${depfile})
+    endif()
+    file(MAKE_DIRECTORY ${output_dir})
+    add_custom_command(
+        OUTPUT ${output} ${listing}
+        COMMAND ${CMAKE_COMMAND}
+            -DDXC=${DXC_EXECUTABLE}
+            -DSOURCE=${source}
+            -DOUTPUT=${output}
+            -DLISTING=${listing}
+            -DDEPFILE=${depfile}
+            -DPROFILE=${SHADER_PROFILE}
+            -DENTRY=${SHADER_ENTRY}
+            -DDEFINES=${defines}
+            -DFLAGS=${flags}
+            -P ${SHADER_COMPILE_SCRIPT}
+        ${dependency_args}
+        COMMENT "Compiling shader ${SHADER_NAME}"
+        VERBATIM)
+    set_property(GLOBAL APPEND PROPERTY SHADER_ARCHIVE_${ARCHIVE}_ARGS ${SHADER_NAME} ${SHADER_ENTRY} ${output} ${listing})
+    set_property(GLOBAL APPEND PROPERTY SHADER_ARCHIVE_${ARCHIVE}_OUTPUTS ${output} ${listing})
+endfunction()
+
+# add_shader_archive(<archive> ARCHIVE <file> HEADER <file>) adds the target <archive>.
+function(add_shader_archive ARCHIVE)
+    cmake_parse_arguments(SHADER_ARCHIVE "" "ARCHIVE;HEADER" "" ${ARGN})
+    get_property(pack_args GLOBAL PROPERTY SHADER_ARCHIVE_${ARCHIVE}_ARGS)
+    get_property(outputs GLOBAL PROPERTY SHADER_ARCHIVE_${ARCHIVE}_OUTPUTS)
+    get_filename_component(header_dir ${SHADER_ARCHIVE_HEADER} DIRECTORY)
+    file(MAKE_DIRECTORY ${header_dir})
+    add_custom_command(
+        OUTPUT ${SHADER_ARCHIVE_ARCHIVE} ${SHADER_ARCHIVE_HEADER}
+        COMMAND shader_pack ${SHADER_ARCHIVE_ARCHIVE} ${SHADER_ARCHIVE_HEADER} ${pack_args}
+        DEPENDS shader_pack ${outputs}
+        COMMENT "Packing shader archive ${ARCHIVE}"
+        VERBATIM)
+    add_custom_target(${ARCHIVE} DEPENDS ${SHADER_ARCHIVE_ARCHIVE} ${SHADER_ARCHIVE_HEADER})
+endfunction()
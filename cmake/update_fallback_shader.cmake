@@ -0,0 +1,14 @@
+# Copies a freshly compiled shader over the checked-in fallback and records which source it came from.
+# Run as cmake -P with SOURCE, BINARY, DESTINATION and STAMP set.
+
+include(${CMAKE_CURRENT_LIST_DIR}/shaders.cmake)
+
+execute_process(
+    COMMAND ${CMAKE_COMMAND} -E copy_if_different ${BINARY} ${DESTINATION}
+    RESULT_VARIABLE copy_result)
+if(NOT copy_result EQUAL 0)
+    message(FATAL_ERROR "Copying ${BINARY} to ${DESTINATION} failed.")
+endif()
+shader_source_hash(source_hash ${SOURCE})
+file(WRITE ${STAMP} "${source_hash}\n")
+message(STATUS "Updated ${DESTINATION} from ${SOURCE}.")
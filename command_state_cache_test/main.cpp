@@ -0,0 +1,251 @@
+#include "d3d12_command_state_cache.h"
+#include "test_check.h"
+#include <array>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// D3D12_Command_State_Cache in front of a mock list that applies every call it receives to a simulated
+// state. Hand-written sequences check which sets are emitted or filtered, a random run checks that the
+// list always ends up in the requested state with exactly one call per set that changed something.
+
+static constexpr uint32_t PARAMETER_COUNT = D3D12_Command_State_Cache<>::MAX_ROOT_CONSTANT_PARAMETERS;
+static constexpr uint32_t CONSTANT_COUNT = 4;
+
+// What a command list holds after the calls it received. Root constants are undefined (not valid) after
+// a root signature change, like on the GPU.
+struct List_State
+{
+    struct Bind_Point
+    {
+        ID3D12RootSignature* root_signature = nullptr;
+        std::array<std::array<uint32_t, CONSTANT_COUNT>, PARAMETER_COUNT> constants = {};
+        std::array<std::array<bool, CONSTANT_COUNT>, PARAMETER_COUNT> is_valid = {};
+    };
+
+    ID3D12DescriptorHeap* cbv_srv_uav_heap = nullptr;
+    ID3D12DescriptorHeap* sampler_heap = nullptr;
+    ID3D12PipelineState* pipeline_state = nullptr;
+    std::array<Bind_Point, 2> bind_points;
+};
+
+class Mock_Command_List
+{
+public:
+    void SetDescriptorHeaps(uint32_t heap_count, ID3D12DescriptorHeap* const* heaps)
+    {
+        call_count += 1;
+        heap_set_count += 1;
+        state.cbv_srv_uav_heap = heap_count > 0 ? heaps[0] : nullptr;
+        state.sampler_heap = heap_count > 1 ? heaps[1] : nullptr;
+    }
+
+    void SetComputeRootSignature(ID3D12RootSignature* root_signature) { set_root_signature(0, root_signature); }
+    void SetGraphicsRootSignature(ID3D12RootSignature* root_signature) { set_root_signature(1, root_signature); }
+
+    void SetPipelineState(ID3D12PipelineState* pipeline_state)
+    {
+        call_count += 1;
+        state.pipeline_state = pipeline_state;
+    }
+
+    void SetComputeRoot32BitConstants(uint32_t index, uint32_t count, const void* values, uint32_t first)
+    {
+        set_constants(0, index, count, values, first);
+    }
+
+    void SetGraphicsRoot32BitConstants(uint32_t index, uint32_t count, const void* values, uint32_t first)
+    {
+        set_constants(1, index, count, values, first);
+    }
+
+    List_State state;
+    uint64_t call_count = 0;
+    uint64_t heap_set_count = 0;
+    uint64_t constant_dword_count = 0;
+
+private:
+    void set_root_signature(uint32_t bind_point, ID3D12RootSignature* root_signature)
+    {
+        call_count += 1;
+        state.bind_points[bind_point] = { .root_signature = root_signature };
+    }
+
+    void set_constants(uint32_t bind_point, uint32_t index, uint32_t count, const void* values, uint32_t first)
+    {
+        call_count += 1;
+        constant_dword_count += count;
+        auto dwords = static_cast<const uint32_t*>(values);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            state.bind_points[bind_point].constants[index][first + i] = dwords[i];
+            state.bind_points[bind_point].is_valid[index][first + i] = true;
+        }
+    }
+};
+
+struct Constants
+{
+    uint32_t values[CONSTANT_COUNT];
+};
+
+// Distinct fake objects, the cache and the mock only compare the pointers.
+static uint8_t g_objects[64];
+
+template<typename T>
+static T* fake(uint32_t index)
+{
+    return reinterpret_cast<T*>(&g_objects[index]);
+}
+
+static void test_filtering()
+{
+    Mock_Command_List cmd;
+    D3D12_Command_State_Cache<Mock_Command_List> state(&cmd);
+    TEST_CHECK(state.get_command_list() == &cmd);
+
+    state.set_descriptor_heaps(fake<ID3D12DescriptorHeap>(0));
+    state.set_descriptor_heaps(fake<ID3D12DescriptorHeap>(0));
+    state.set_descriptor_heaps(fake<ID3D12DescriptorHeap>(0), fake<ID3D12DescriptorHeap>(1));
+    TEST_CHECK(cmd.heap_set_count == 2 && cmd.state.sampler_heap == fake<ID3D12DescriptorHeap>(1));
+
+    state.set_compute_root_signature(fake<ID3D12RootSignature>(2));
+    state.set_compute_root_signature(fake<ID3D12RootSignature>(2));
+    state.set_pipeline_state(fake<ID3D12PipelineState>(3));
+    state.set_pipeline_state(fake<ID3D12PipelineState>(3));
+    state.set_root_constants(0, Constants { { 1, 2, 3, 4 } });
+    state.set_root_constants(0, Constants { { 1, 2, 3, 4 } });
+    state.set_root_constants(0, Constants { { 1, 2, 3, 5 } });
+    TEST_CHECK(state.get_emitted_count() == 6 && state.get_filtered_count() == 4);
+    TEST_CHECK(cmd.call_count == state.get_emitted_count());
+    TEST_CHECK(cmd.constant_dword_count == 5);
+
+    // The graphics bind point has its own root signature and constants.
+    state.set_graphics_root_signature(fake<ID3D12RootSignature>(2));
+    state.set_root_constants(0, Constants { { 1, 2, 3, 5 } }, Root_Constants_Bind_Point::Graphics);
+    TEST_CHECK(state.get_emitted_count() == 8 && cmd.constant_dword_count == 9);
+
+    // A new compute root signature leaves the compute constants undefined, the graphics ones stay.
+    state.set_compute_root_signature(fake<ID3D12RootSignature>(4));
+    state.set_root_constants(0, Constants { { 1, 2, 3, 5 } });
+    state.set_root_constants(0, Constants { { 1, 2, 3, 5 } }, Root_Constants_Bind_Point::Graphics);
+    TEST_CHECK(state.get_emitted_count() == 10 && state.get_filtered_count() == 5);
+    TEST_CHECK(cmd.constant_dword_count == 13);
+
+    // A reset list has nothing bound, the same sets go out again.
+    Mock_Command_List next_cmd;
+    state.reset(&next_cmd);
+    state.set_descriptor_heaps(fake<ID3D12DescriptorHeap>(0), fake<ID3D12DescriptorHeap>(1));
+    state.set_compute_root_signature(fake<ID3D12RootSignature>(4));
+    state.set_pipeline_state(fake<ID3D12PipelineState>(3));
+    state.set_root_constants(0, Constants { { 1, 2, 3, 5 } });
+    TEST_CHECK(next_cmd.call_count == 4 && cmd.call_count == 10);
+    TEST_CHECK(state.get_emitted_count() == 14);
+
+    bool threw = false;
+    try
+    {
+        state.set_root_constants(PARAMETER_COUNT, Constants {});
+    }
+    catch (const std::exception&)
+    {
+        threw = true;
+    }
+    TEST_CHECK(threw);
+}
+
+// Random sets of a few objects and values, so repeats are common. After every set the mock's state has to
+// match what was requested, and a call may only go out when the set changed something.
+static void test_random_sets()
+{
+    static constexpr uint32_t SET_COUNT = 200000;
+    std::mt19937 random(18);
+    Mock_Command_List cmd;
+    D3D12_Command_State_Cache<Mock_Command_List> state(&cmd);
+    List_State expected;
+    for (uint32_t i = 0; i < SET_COUNT; ++i)
+    {
+        auto calls_before = cmd.call_count;
+        bool is_change = false;
+        switch (random() % 6)
+        {
+        case 0:
+        {
+            auto heap = random() % 3 == 0 ? nullptr : fake<ID3D12DescriptorHeap>(random() % 2);
+            auto sampler_heap = heap && random() % 2 == 0 ? fake<ID3D12DescriptorHeap>(2) : nullptr;
+            is_change = heap != expected.cbv_srv_uav_heap || sampler_heap != expected.sampler_heap;
+            expected.cbv_srv_uav_heap = heap;
+            expected.sampler_heap = sampler_heap;
+            state.set_descriptor_heaps(heap, sampler_heap);
+            break;
+        }
+        case 1:
+        {
+            auto bind_point = random() % 2;
+            auto root_signature = fake<ID3D12RootSignature>(8 + random() % 3);
+            is_change = root_signature != expected.bind_points[bind_point].root_signature;
+            if (is_change)
+            {
+                expected.bind_points[bind_point] = { .root_signature = root_signature };
+            }
+            bind_point == 0 ? state.set_compute_root_signature(root_signature) : state.set_graphics_root_signature(root_signature);
+            break;
+        }
+        case 2:
+        {
+            auto pipeline_state = fake<ID3D12PipelineState>(16 + random() % 3);
+            is_change = pipeline_state != expected.pipeline_state;
+            expected.pipeline_state = pipeline_state;
+            state.set_pipeline_state(pipeline_state);
+            break;
+        }
+        default:
+        {
+            auto bind_point = random() % 2;
+            auto index = random() % PARAMETER_COUNT;
+            Constants constants;
+            auto& expected_bind_point = expected.bind_points[bind_point];
+            for (uint32_t c = 0; c < CONSTANT_COUNT; ++c)
+            {
+                constants.values[c] = random() % 4 == 0 ? random() % 3 : expected_bind_point.constants[index][c];
+                is_change = is_change || !expected_bind_point.is_valid[index][c]
+                    || constants.values[c] != expected_bind_point.constants[index][c];
+                expected_bind_point.constants[index][c] = constants.values[c];
+                expected_bind_point.is_valid[index][c] = true;
+            }
+            state.set_root_constants(index, constants,
+                bind_point == 0 ? Root_Constants_Bind_Point::Compute : Root_Constants_Bind_Point::Graphics);
+            break;
+        }
+        }
+        TEST_CHECK(cmd.call_count - calls_before == (is_change ? 1u : 0u));
+
+        TEST_CHECK(cmd.state.cbv_srv_uav_heap == expected.cbv_srv_uav_heap && cmd.state.sampler_heap == expected.sampler_heap);
+        TEST_CHECK(cmd.state.pipeline_state == expected.pipeline_state);
+        for (uint32_t b = 0; b < 2; ++b)
+        {
+            const auto& actual = cmd.state.bind_points[b];
+            const auto& wanted = expected.bind_points[b];
+            TEST_CHECK(actual.root_signature == wanted.root_signature);
+            for (uint32_t p = 0; p < PARAMETER_COUNT; ++p)
+            {
+                for (uint32_t c = 0; c < CONSTANT_COUNT; ++c)
+                {
+                    // Values the caller relies on are defined and current on the list.
+                    TEST_CHECK(!wanted.is_valid[p][c] || (actual.is_valid[p][c] && actual.constants[p][c] == wanted.constants[p][c]));
+                }
+            }
+        }
+    }
+    TEST_CHECK(state.get_emitted_count() == cmd.call_count);
+    TEST_CHECK(state.get_emitted_count() + state.get_filtered_count() == SET_COUNT);
+    printf("%u sets: %llu emitted, %llu filtered\n", SET_COUNT, (unsigned long long)state.get_emitted_count(),
+        (unsigned long long)state.get_filtered_count());
+}
+
+int main()
+{
+    test_filtering();
+    test_random_sets();
+    return finish_test();
+}
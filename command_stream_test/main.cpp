@@ -0,0 +1,337 @@
+#include "command_stream.h"
+#include "test_check.h"
+#include <cstdint>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+// LEB128 varints at their edges, random command lists that have to come back byte for byte when a reader
+// feeds a writer, every truncation and random byte corruption of a stream (caught by ASan and the checks
+// below if the reader reads out of bounds or loops), and the saved file with its name table and hash.
+
+static void test_varints()
+{
+    const uint64_t values[] = {
+        0, 1, 127, 128, 255, 16383, 16384, 2097151, 2097152, UINT32_MAX, uint64_t(UINT32_MAX) + 1,
+        (1ull << 56) - 1, 1ull << 56, (1ull << 63) - 1, 1ull << 63, UINT64_MAX
+    };
+    for (auto value : values)
+    {
+        std::vector<uint8_t> data;
+        append_command_stream_varint(data, value);
+        // 7 bits per byte.
+        size_t bit_count = 1;
+        while (bit_count < 64 && (value >> bit_count) != 0)
+        {
+            bit_count += 1;
+        }
+        TEST_CHECK(data.size() == (bit_count + 6) / 7);
+        size_t offset = 0;
+        uint64_t decoded = 0;
+        TEST_CHECK(read_command_stream_varint(data, offset, decoded) && decoded == value && offset == data.size());
+        // Every shorter prefix is truncated.
+        for (size_t size = 0; size < data.size(); ++size)
+        {
+            offset = 0;
+            TEST_CHECK(!read_command_stream_varint(std::span(data).first(size), offset, decoded));
+        }
+    }
+
+    std::mt19937_64 random(19);
+    std::vector<uint8_t> data;
+    std::vector<uint64_t> expected;
+    for (uint32_t i = 0; i < 100000; ++i)
+    {
+        auto value = random() >> (random() % 64);
+        expected.push_back(value);
+        append_command_stream_varint(data, value);
+    }
+    size_t offset = 0;
+    for (auto value : expected)
+    {
+        uint64_t decoded = 0;
+        TEST_CHECK(read_command_stream_varint(data, offset, decoded) && decoded == value);
+    }
+    TEST_CHECK(offset == data.size());
+
+    // Longer than any 64 bit value, or with bits past the 64th.
+    const std::vector<uint8_t> overlong[] = {
+        { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x00 },
+        { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x02 },
+        { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x7f }
+    };
+    for (const auto& bytes : overlong)
+    {
+        offset = 0;
+        uint64_t decoded = 0;
+        TEST_CHECK(!read_command_stream_varint(bytes, offset, decoded));
+    }
+}
+
+static Command_Stream_Texture_Location make_location(std::mt19937& random)
+{
+    Command_Stream_Texture_Location location = {};
+    location.resource = random() % 16;
+    location.type = random() % 2;
+    if (location.type == 0)
+    {
+        location.subresource_index = random() % 12;
+        return location;
+    }
+    location.offset = (uint64_t(random()) << 16) & ~uint64_t(511);
+    location.format = random() % 120;
+    location.width = 1 + random() % 4096;
+    location.height = 1 + random() % 4096;
+    location.depth = 1;
+    location.row_pitch = 256 * (1 + random() % 64);
+    return location;
+}
+
+// A list with every kind of command and field values of all sizes.
+static void write_random_list(Command_Stream_Writer& writer, std::mt19937& random)
+{
+    auto field = [&random]() -> uint32_t { return random() % 3 == 0 ? random() : random() % 200; };
+    writer.begin_list(random() % 4);
+    auto command_count = random() % 24;
+    for (uint32_t c = 0; c < command_count; ++c)
+    {
+        switch (random() % 10)
+        {
+        case 0:
+        {
+            uint32_t heaps[2] = { field(), field() };
+            writer.set_descriptor_heaps(std::span<const uint32_t>(heaps, random() % 3));
+            break;
+        }
+        case 1:
+            writer.set_root_signature(Command_Stream_Bind_Point(random() % 2), field());
+            break;
+        case 2:
+            writer.set_pipeline_state(field());
+            break;
+        case 3:
+        {
+            std::vector<uint32_t> values(random() % 65);
+            for (auto& value : values)
+            {
+                value = field();
+            }
+            writer.set_root_constants(Command_Stream_Bind_Point(random() % 2), random() % 4, values, random() % 64);
+            break;
+        }
+        case 4:
+            writer.dispatch(field(), field(), field());
+            break;
+        case 5:
+            writer.copy_buffer_region(field(), uint64_t(random()) << (random() % 32), field(), random(), uint64_t(random()) << 8);
+            break;
+        case 6:
+            writer.copy_resource(field(), field());
+            break;
+        case 7:
+        {
+            Command_Stream_Box box = { field(), field(), field(), field(), field(), field() };
+            writer.copy_texture_region(make_location(random), field(), field(), field(), make_location(random),
+                random() % 2 ? &box : nullptr);
+            break;
+        }
+        default:
+        {
+            auto group_count = 1 + random() % 3;
+            writer.begin_barrier(group_count);
+            for (uint32_t g = 0; g < group_count; ++g)
+            {
+                auto type = Command_Stream_Barrier_Type(random() % 3);
+                auto barrier_count = random() % 4;
+                writer.barrier_group(type, barrier_count);
+                for (uint32_t b = 0; b < barrier_count; ++b)
+                {
+                    if (type == Command_Stream_Barrier_Type::Global)
+                    {
+                        writer.barrier(Command_Stream_Global_Barrier { field(), field(), field(), field() });
+                    }
+                    else if (type == Command_Stream_Barrier_Type::Texture)
+                    {
+                        writer.barrier(Command_Stream_Texture_Barrier {
+                            field(), field(), field(), field(), field(), field(), field(),
+                            field(), field(), field(), field(), field(), field(), field() });
+                    }
+                    else
+                    {
+                        writer.barrier(Command_Stream_Buffer_Barrier {
+                            field(), field(), field(), field(), field(), random(), uint64_t(random()) << 20 });
+                    }
+                }
+            }
+            break;
+        }
+        }
+    }
+    writer.end_list();
+}
+
+// Counts what a reader hands out, for streams that are not re-encoded.
+struct Counting_Visitor
+{
+    uint64_t command_count = 0;
+
+    void begin_list(uint32_t) { command_count += 1; }
+    void end_list() { command_count += 1; }
+    void set_descriptor_heaps(std::span<const uint32_t>) { command_count += 1; }
+    void set_root_signature(Command_Stream_Bind_Point, uint32_t) { command_count += 1; }
+    void set_pipeline_state(uint32_t) { command_count += 1; }
+    void set_root_constants(Command_Stream_Bind_Point, uint32_t, std::span<const uint32_t>, uint32_t) { command_count += 1; }
+    void dispatch(uint32_t, uint32_t, uint32_t) { command_count += 1; }
+    void copy_buffer_region(uint32_t, uint64_t, uint32_t, uint64_t, uint64_t) { command_count += 1; }
+    void copy_resource(uint32_t, uint32_t) { command_count += 1; }
+    void copy_texture_region(const Command_Stream_Texture_Location&, uint32_t, uint32_t, uint32_t,
+        const Command_Stream_Texture_Location&, const Command_Stream_Box*) { command_count += 1; }
+    void begin_barrier(uint32_t) { command_count += 1; }
+    void barrier_group(Command_Stream_Barrier_Type, uint32_t) {}
+    void barrier(const Command_Stream_Global_Barrier&) {}
+    void barrier(const Command_Stream_Texture_Barrier&) {}
+    void barrier(const Command_Stream_Buffer_Barrier&) {}
+};
+
+// Reads lists until the end or an error. A reader always makes progress, so this ends within `size` lists.
+static bool read_all(std::span<const uint8_t> data, uint64_t& list_count)
+{
+    Command_Stream_Reader reader(data);
+    Counting_Visitor visitor;
+    list_count = 0;
+    while (reader.read_list(visitor))
+    {
+        list_count += 1;
+        if (list_count > data.size())
+        {
+            return false;
+        }
+    }
+    return reader.is_valid();
+}
+
+static void test_round_trip()
+{
+    static constexpr uint32_t STREAM_COUNT = 200;
+    std::mt19937 random(1);
+    for (uint32_t s = 0; s < STREAM_COUNT; ++s)
+    {
+        Command_Stream_Writer writer;
+        auto list_count = 1 + random() % 4;
+        for (uint32_t l = 0; l < list_count; ++l)
+        {
+            write_random_list(writer, random);
+        }
+        std::vector<uint8_t> stream(writer.get_data().begin(), writer.get_data().end());
+
+        // Reading into a writer encodes the same bytes again.
+        Command_Stream_Reader reader(stream);
+        Command_Stream_Writer copy;
+        uint32_t read_count = 0;
+        while (reader.read_list(copy))
+        {
+            read_count += 1;
+        }
+        TEST_CHECK(reader.is_valid() && reader.is_at_end() && read_count == list_count);
+        TEST_CHECK(std::equal(stream.begin(), stream.end(), copy.get_data().begin(), copy.get_data().end()));
+
+        // Cut anywhere: the reader stops at the end of the data. A cut between commands still reads as a
+        // list, one inside a command marks the stream as corrupt.
+        for (size_t size = 0; size < stream.size(); ++size)
+        {
+            uint64_t lists = 0;
+            read_all(std::span(stream).first(size), lists);
+            TEST_CHECK(lists <= list_count);
+        }
+
+        // Random bytes overwritten: the reader may accept or reject, but stays in bounds and terminates.
+        for (uint32_t c = 0; c < 20; ++c)
+        {
+            auto corrupted = stream;
+            auto change_count = 1 + random() % 4;
+            for (uint32_t i = 0; i < change_count; ++i)
+            {
+                corrupted[random() % corrupted.size()] = uint8_t(random());
+            }
+            uint64_t lists = 0;
+            read_all(corrupted, lists);
+            TEST_CHECK(lists <= corrupted.size());
+        }
+        writer.clear();
+        TEST_CHECK(writer.get_data().empty());
+    }
+
+    // Unknown opcodes, oversized arrays and fields past 32 bits mark the stream as corrupt.
+    const std::vector<uint8_t> corrupt[] = {
+        { uint8_t(Command_Stream_Op::Count) },
+        { uint8_t(Command_Stream_Op::Set_Descriptor_Heaps), 65 },
+        { uint8_t(Command_Stream_Op::Set_Pipeline_State), 0x80, 0x80, 0x80, 0x80, 0x10 },
+        { uint8_t(Command_Stream_Op::Barrier), 1, 3, 0 },
+        { uint8_t(Command_Stream_Op::Barrier), 1, 0, 0x80, 0x80, 0x80, 0x80, 0x0f }
+    };
+    for (const auto& bytes : corrupt)
+    {
+        uint64_t lists = 0;
+        TEST_CHECK(!read_all(bytes, lists));
+    }
+}
+
+static void test_file()
+{
+    auto directory = std::filesystem::temp_directory_path() / "command_stream_test";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+    auto path = (directory / "frame.cmds").string();
+
+    int objects_storage[3];
+    Command_Stream_Objects objects;
+    TEST_CHECK(objects.get_id(nullptr) == 0);
+    TEST_CHECK(objects.get_id(&objects_storage[1]) == 1 && objects.get_id(&objects_storage[0]) == 2);
+    TEST_CHECK(objects.get_id(&objects_storage[1]) == 1);
+    objects.set_name(&objects_storage[1], "uav texture");
+    objects.set_name(&objects_storage[2], "");
+    TEST_CHECK(objects.get_id(&objects_storage[2]) == 3);
+    objects.forget(&objects_storage[0]);
+    TEST_CHECK(objects.get_id(&objects_storage[0]) == 4);
+
+    std::mt19937 random(3);
+    Command_Stream_Writer writer;
+    write_random_list(writer, random);
+    TEST_CHECK(save_command_stream(path.c_str(), objects, writer.get_data()));
+    {
+        Command_Stream_File file;
+        TEST_CHECK(file.open(path.c_str()));
+        TEST_CHECK(file.get_names().size() == 4 && file.get_names()[0] == "uav texture" && file.get_names()[2].empty());
+        TEST_CHECK(std::equal(file.get_stream().begin(), file.get_stream().end(), writer.get_data().begin(), writer.get_data().end()));
+    }
+
+    // A changed stream byte fails the hash, a cut file the size checks.
+    auto file_size = std::filesystem::file_size(path);
+    {
+        FILE* file = fopen(path.c_str(), "r+b");
+        fseek(file, long(file_size - 1), SEEK_SET);
+        auto last = uint8_t(fgetc(file));
+        fseek(file, long(file_size - 1), SEEK_SET);
+        fputc(last ^ 0x40, file);
+        fclose(file);
+        Command_Stream_File stream_file;
+        TEST_CHECK(!stream_file.open(path.c_str()) && stream_file.get_names().empty());
+    }
+    for (auto size : { file_size - 1, uint64_t(sizeof(Command_Stream_Header) + 3), uint64_t(sizeof(Command_Stream_Header) - 1) })
+    {
+        TEST_CHECK(save_command_stream(path.c_str(), objects, writer.get_data()));
+        std::filesystem::resize_file(path, size);
+        Command_Stream_File stream_file;
+        TEST_CHECK(!stream_file.open(path.c_str()));
+    }
+    std::filesystem::remove_all(directory);
+}
+
+int main()
+{
+    test_varints();
+    test_round_trip();
+    test_file();
+    return finish_test();
+}
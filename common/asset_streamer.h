@@ -0,0 +1,528 @@
+#pragma once
+
+#include "copy_scheduler.h"
+#include "job_system.h"
+#include "lz4_block.h"
+
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// File opened for positional reads. read() may be called from several threads at once.
+class Stream_File
+{
+public:
+    Stream_File() = default;
+    explicit Stream_File(const char* path) { open(path); }
+    ~Stream_File() { close(); }
+
+    Stream_File(const Stream_File&) = delete;
+    Stream_File& operator=(const Stream_File&) = delete;
+
+    bool open(const char* path)
+    {
+        close();
+#if defined(_WIN32)
+        m_file = CreateFileA(
+            path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, nullptr);
+        if (m_file == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+        LARGE_INTEGER file_size = {};
+        if (!GetFileSizeEx(m_file, &file_size))
+        {
+            close();
+            return false;
+        }
+        m_size = uint64_t(file_size.QuadPart);
+#else
+        m_file = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (m_file < 0)
+        {
+            return false;
+        }
+        struct stat file_stat = {};
+        if (fstat(m_file, &file_stat) != 0)
+        {
+            close();
+            return false;
+        }
+        m_size = uint64_t(file_stat.st_size);
+#endif
+        return true;
+    }
+
+    void close()
+    {
+#if defined(_WIN32)
+        if (m_file != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(m_file);
+        }
+        m_file = INVALID_HANDLE_VALUE;
+#else
+        if (m_file >= 0)
+        {
+            ::close(m_file);
+        }
+        m_file = -1;
+#endif
+        m_size = 0;
+    }
+
+    // Fails unless all of `data` was read.
+    bool read(uint64_t offset, std::span<uint8_t> data) const
+    {
+        if (!is_open() || offset > m_size || data.size() > m_size - offset)
+        {
+            return false;
+        }
+#if defined(_WIN32)
+        // Overlapped reads carry their offset, each needs its own event to wait on.
+        auto event = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+        if (event == nullptr)
+        {
+            return false;
+        }
+        bool success = true;
+        for (size_t done = 0; success && done < data.size();)
+        {
+            auto position = offset + done;
+            OVERLAPPED overlapped = {};
+            overlapped.Offset = DWORD(position);
+            overlapped.OffsetHigh = DWORD(position >> 32);
+            overlapped.hEvent = event;
+            auto size = DWORD(std::min<size_t>(data.size() - done, 1u << 30));
+            DWORD read = 0;
+            if (!ReadFile(m_file, data.data() + done, size, nullptr, &overlapped) && GetLastError() != ERROR_IO_PENDING)
+            {
+                success = false;
+            }
+            else if (!GetOverlappedResult(m_file, &overlapped, &read, TRUE) || read == 0)
+            {
+                success = false;
+            }
+            done += read;
+        }
+        CloseHandle(event);
+        return success;
+#else
+        for (size_t done = 0; done < data.size();)
+        {
+            auto read = pread(m_file, data.data() + done, data.size() - done, off_t(offset + done));
+            if (read < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (read <= 0)
+            {
+                return false;
+            }
+            done += size_t(read);
+        }
+        return true;
+#endif
+    }
+
+#if defined(_WIN32)
+    bool is_open() const { return m_file != INVALID_HANDLE_VALUE; }
+#else
+    bool is_open() const { return m_file >= 0; }
+#endif
+    uint64_t get_size() const { return m_size; }
+
+private:
+#if defined(_WIN32)
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+#else
+    int m_file = -1;
+#endif
+    uint64_t m_size = 0;
+};
+
+// Fills `decompressed` from `compressed`, false for corrupt data. Runs on worker threads.
+using Stream_Decompressor = bool (*)(std::span<const uint8_t> compressed, std::span<uint8_t> decompressed);
+
+// Compression ids index the streamer's decompressor table.
+static constexpr uint32_t STREAM_COMPRESSION_NONE = 0;
+static constexpr uint32_t STREAM_COMPRESSION_LZ4 = 1;
+static constexpr uint32_t MAX_STREAM_DECOMPRESSORS = 8;
+static constexpr uint32_t INVALID_STREAM_FILE = ~0u;
+
+struct Stream_Request
+{
+    uint32_t file;
+    uint64_t file_offset;
+    uint64_t compressed_size;
+    // Size after decompression, equals compressed_size for STREAM_COMPRESSION_NONE.
+    uint64_t size;
+    uint32_t compression = STREAM_COMPRESSION_NONE;
+    // Higher priorities are read first and handed to the sink first.
+    int32_t priority = 0;
+    // Where the data goes, passed through to the sink.
+    void* resource = nullptr;
+    uint64_t resource_offset = 0;
+};
+
+// Receives the streamed data on the thread that calls Asset_Streamer::update().
+class Stream_Sink
+{
+public:
+    virtual ~Stream_Sink() = default;
+    // `data` is only valid during the call. Returning false holds it back until the next update().
+    virtual bool consume(const Stream_Request& request, std::span<const uint8_t> data) = 0;
+    // The file could not be read or the data did not decompress.
+    virtual void fail(const Stream_Request& request) { (void)request; }
+};
+
+// Hands streamed buffers to a Copy_Scheduler, e.g. the one of a D3D12_Copy_Engine. Holds back while
+// more than max_pending_bytes wait for upload, so streaming can't run ahead of the copy queue.
+class Copy_Scheduler_Stream_Sink : public Stream_Sink
+{
+public:
+    Copy_Scheduler_Stream_Sink(Copy_Scheduler& scheduler, uint64_t max_pending_bytes)
+        : m_scheduler(scheduler)
+        , m_max_pending_bytes(max_pending_bytes)
+    {}
+
+    bool consume(const Stream_Request& request, std::span<const uint8_t> data) override
+    {
+        if (m_scheduler.get_pending_bytes() > 0 && m_scheduler.get_pending_bytes() + data.size() > m_max_pending_bytes)
+        {
+            return false;
+        }
+        m_scheduler.upload_buffer(request.resource, request.resource_offset, data);
+        return true;
+    }
+
+private:
+    Copy_Scheduler& m_scheduler;
+    uint64_t m_max_pending_bytes;
+};
+
+struct Asset_Streamer_Settings
+{
+    // Blocking reads in flight at once.
+    uint32_t io_thread_count = 2;
+    // Staging memory of requests between their read and their handoff to the sink.
+    uint64_t memory_budget = 64ull << 20;
+};
+
+// Streams file ranges to a sink in three stages: dedicated I/O threads read into staging buffers,
+// Job_System workers decompress, update() hands the results to the sink. Requests start in priority
+// order and only while their staging memory fits the budget; a request larger than the budget runs
+// alone. Staging buffers are recycled, so the steady state doesn't allocate.
+class Asset_Streamer
+{
+public:
+    Asset_Streamer(Job_System& job_system, Stream_Sink& sink, const Asset_Streamer_Settings& settings = {})
+        : m_job_system(job_system)
+        , m_sink(sink)
+        , m_settings(settings)
+    {
+        m_decompressors[STREAM_COMPRESSION_LZ4] = decompress_lz4_block;
+        for (uint32_t i = 0; i < std::max(settings.io_thread_count, 1u); ++i)
+        {
+            m_io_threads.emplace_back([this]() { io_main(); });
+        }
+    }
+
+    // Queued requests are dropped, requests in flight finish first.
+    ~Asset_Streamer()
+    {
+        {
+            std::scoped_lock lock(m_mutex);
+            m_running = false;
+        }
+        m_io_condition.notify_all();
+        for (auto& io_thread : m_io_threads)
+        {
+            io_thread.join();
+        }
+        m_job_system.wait(m_decompress_counter);
+    }
+
+    Asset_Streamer(const Asset_Streamer&) = delete;
+    Asset_Streamer& operator=(const Asset_Streamer&) = delete;
+
+    // Returns INVALID_STREAM_FILE if the file can't be opened. Files stay open for the streamer's lifetime.
+    uint32_t open_file(const char* path)
+    {
+        std::scoped_lock lock(m_mutex);
+        auto& file = m_files.emplace_back();
+        if (!file.open(path))
+        {
+            m_files.pop_back();
+            return INVALID_STREAM_FILE;
+        }
+        return uint32_t(m_files.size() - 1);
+    }
+
+    // Set before requesting data with the compression id.
+    void set_decompressor(uint32_t compression, Stream_Decompressor decompressor)
+    {
+        std::scoped_lock lock(m_mutex);
+        if (compression == STREAM_COMPRESSION_NONE || compression >= MAX_STREAM_DECOMPRESSORS)
+        {
+            throw std::exception();
+        }
+        m_decompressors[compression] = decompressor;
+    }
+
+    void request(const Stream_Request& request)
+    {
+        {
+            std::scoped_lock lock(m_mutex);
+            m_queue.push_back({ .request = request, .sequence = m_sequence++ });
+            std::push_heap(m_queue.begin(), m_queue.end(), Queued::is_after);
+        }
+        m_io_condition.notify_one();
+    }
+
+    // Hands finished requests to the sink, highest priority first, until about `max_bytes` were
+    // delivered or the sink holds back. Returns the number of delivered requests.
+    uint32_t update(uint64_t max_bytes = ~0ull)
+    {
+        {
+            std::scoped_lock lock(m_completed_mutex);
+            for (auto& job : m_completed)
+            {
+                m_ready.push_back(std::move(job));
+            }
+            m_completed.clear();
+        }
+        std::stable_sort(m_ready.begin(), m_ready.end(), [](const auto& a, const auto& b) {
+            return a->request.priority > b->request.priority;
+        });
+        uint32_t delivered = 0;
+        uint64_t delivered_bytes = 0;
+        uint64_t released_bytes = 0;
+        while (delivered < m_ready.size() && delivered_bytes < max_bytes)
+        {
+            auto& job = *m_ready[delivered];
+            if (job.success && !m_sink.consume(job.request, job.data))
+            {
+                break;
+            }
+            if (!job.success)
+            {
+                m_sink.fail(job.request);
+                m_failed_count += 1;
+            }
+            delivered_bytes += job.data.size();
+            released_bytes += job.staging_size;
+            release_buffer(std::move(job.compressed));
+            release_buffer(std::move(job.data));
+            delivered += 1;
+        }
+        m_ready.erase(m_ready.begin(), m_ready.begin() + delivered);
+        if (delivered > 0)
+        {
+            {
+                std::scoped_lock lock(m_mutex);
+                m_memory_in_use -= released_bytes;
+                m_in_flight -= delivered;
+                m_delivered_bytes += delivered_bytes;
+            }
+            m_io_condition.notify_all();
+        }
+        return delivered;
+    }
+
+    bool is_idle() const
+    {
+        std::scoped_lock lock(m_mutex);
+        return m_queue.empty() && m_in_flight == 0;
+    }
+
+    uint64_t get_memory_in_use() const
+    {
+        std::scoped_lock lock(m_mutex);
+        return m_memory_in_use;
+    }
+
+    uint64_t get_peak_memory() const
+    {
+        std::scoped_lock lock(m_mutex);
+        return m_peak_memory;
+    }
+
+    uint64_t get_delivered_bytes() const
+    {
+        std::scoped_lock lock(m_mutex);
+        return m_delivered_bytes;
+    }
+
+    uint64_t get_failed_count() const { return m_failed_count; }
+    const Asset_Streamer_Settings& get_settings() const { return m_settings; }
+
+private:
+    struct Queued
+    {
+        Stream_Request request;
+        uint64_t sequence;
+
+        // Heap order, the top is the highest priority and the oldest of equal priority.
+        static bool is_after(const Queued& a, const Queued& b)
+        {
+            return a.request.priority != b.request.priority
+                ? a.request.priority < b.request.priority
+                : a.sequence > b.sequence;
+        }
+    };
+
+    struct Job
+    {
+        Stream_Request request;
+        uint64_t staging_size;
+        std::vector<uint8_t> compressed;
+        std::vector<uint8_t> data;
+        bool success = false;
+    };
+
+    static uint64_t get_staging_size(const Stream_Request& request)
+    {
+        return request.compression == STREAM_COMPRESSION_NONE
+            ? request.size
+            : request.compressed_size + request.size;
+    }
+
+    bool can_start() const
+    {
+        return !m_queue.empty()
+            && (m_memory_in_use == 0 || m_memory_in_use + get_staging_size(m_queue.front().request) <= m_settings.memory_budget);
+    }
+
+    void io_main()
+    {
+        while (true)
+        {
+            auto job = std::make_unique<Job>();
+            const Stream_File* file = nullptr;
+            Stream_Decompressor decompressor = nullptr;
+            {
+                std::unique_lock lock(m_mutex);
+                m_io_condition.wait(lock, [this]() { return !m_running || can_start(); });
+                if (!m_running)
+                {
+                    return;
+                }
+                std::pop_heap(m_queue.begin(), m_queue.end(), Queued::is_after);
+                job->request = m_queue.back().request;
+                m_queue.pop_back();
+                job->staging_size = get_staging_size(job->request);
+                m_memory_in_use += job->staging_size;
+                m_peak_memory = std::max(m_peak_memory, m_memory_in_use);
+                m_in_flight += 1;
+                if (job->request.file < m_files.size())
+                {
+                    file = &m_files[job->request.file];
+                }
+                if (job->request.compression < MAX_STREAM_DECOMPRESSORS)
+                {
+                    decompressor = m_decompressors[job->request.compression];
+                }
+            }
+            const auto& request = job->request;
+            if (request.compression == STREAM_COMPRESSION_NONE)
+            {
+                job->data = acquire_buffer(request.size);
+                job->success = file && request.compressed_size == request.size
+                    && file->read(request.file_offset, job->data);
+                complete(std::move(job));
+                continue;
+            }
+            job->compressed = acquire_buffer(request.compressed_size);
+            job->success = file && decompressor && file->read(request.file_offset, job->compressed);
+            if (!job->success)
+            {
+                complete(std::move(job));
+                continue;
+            }
+            m_job_system.submit([this, job = job.release(), decompressor]() {
+                job->data = acquire_buffer(job->request.size);
+                job->success = decompressor(job->compressed, job->data);
+                complete(std::unique_ptr<Job>(job));
+            }, &m_decompress_counter);
+        }
+    }
+
+    void complete(std::unique_ptr<Job> job)
+    {
+        std::scoped_lock lock(m_completed_mutex);
+        m_completed.push_back(std::move(job));
+    }
+
+    std::vector<uint8_t> acquire_buffer(uint64_t size)
+    {
+        std::vector<uint8_t> buffer;
+        {
+            std::scoped_lock lock(m_buffer_mutex);
+            if (!m_free_buffers.empty())
+            {
+                buffer = std::move(m_free_buffers.back());
+                m_free_buffers.pop_back();
+            }
+        }
+        buffer.resize(size);
+        return buffer;
+    }
+
+    void release_buffer(std::vector<uint8_t>&& buffer)
+    {
+        if (buffer.capacity() == 0)
+        {
+            return;
+        }
+        std::scoped_lock lock(m_buffer_mutex);
+        m_free_buffers.push_back(std::move(buffer));
+    }
+
+    Job_System& m_job_system;
+    Stream_Sink& m_sink;
+    Asset_Streamer_Settings m_settings;
+
+    // Guards the queue, the files, the decompressors and the memory accounting.
+    mutable std::mutex m_mutex;
+    std::condition_variable m_io_condition;
+    bool m_running = true;
+    std::deque<Stream_File> m_files;
+    std::array<Stream_Decompressor, MAX_STREAM_DECOMPRESSORS> m_decompressors = {};
+    std::vector<Queued> m_queue;
+    uint64_t m_sequence = 0;
+    uint64_t m_memory_in_use = 0;
+    uint64_t m_peak_memory = 0;
+    uint64_t m_delivered_bytes = 0;
+    uint32_t m_in_flight = 0;
+
+    std::mutex m_completed_mutex;
+    std::vector<std::unique_ptr<Job>> m_completed;
+
+    std::mutex m_buffer_mutex;
+    std::vector<std::vector<uint8_t>> m_free_buffers;
+
+    // Only touched by update().
+    std::vector<std::unique_ptr<Job>> m_ready;
+    uint64_t m_failed_count = 0;
+
+    std::vector<std::thread> m_io_threads;
+    Job_Counter m_decompress_counter;
+};
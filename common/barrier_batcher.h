@@ -0,0 +1,228 @@
+#pragma once
+
+#include "barrier_types.h"
+
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+// IndexOrFirstMipLevel of a range covering every subresource, D3D12_BARRIER_SUBRESOURCE_RANGE's all form.
+static constexpr uint32_t ALL_SUBRESOURCES = 0xffffffff;
+
+static constexpr uint32_t READ_ONLY_BARRIER_ACCESS_MASK =
+    uint32_t(D3D12_BARRIER_ACCESS_VERTEX_BUFFER)
+    | uint32_t(D3D12_BARRIER_ACCESS_CONSTANT_BUFFER)
+    | uint32_t(D3D12_BARRIER_ACCESS_INDEX_BUFFER)
+    | uint32_t(D3D12_BARRIER_ACCESS_DEPTH_STENCIL_READ)
+    | uint32_t(D3D12_BARRIER_ACCESS_SHADER_RESOURCE)
+    | uint32_t(D3D12_BARRIER_ACCESS_INDIRECT_ARGUMENT)
+    | uint32_t(D3D12_BARRIER_ACCESS_COPY_SOURCE)
+    | uint32_t(D3D12_BARRIER_ACCESS_RESOLVE_SOURCE)
+    | uint32_t(D3D12_BARRIER_ACCESS_PREDICATION)
+    | uint32_t(D3D12_BARRIER_ACCESS_SHADING_RATE_SOURCE);
+
+// COMMON is deliberately not read-only, it may imply any access.
+inline bool is_read_only_access(D3D12_BARRIER_ACCESS access)
+{
+    return access == D3D12_BARRIER_ACCESS_NO_ACCESS
+        || (access != D3D12_BARRIER_ACCESS_COMMON && (uint32_t(access) & ~READ_ONLY_BARRIER_ACCESS_MASK) == 0);
+}
+
+inline bool is_same_subresource_range(
+    const D3D12_BARRIER_SUBRESOURCE_RANGE& a, const D3D12_BARRIER_SUBRESOURCE_RANGE& b)
+{
+    return a.IndexOrFirstMipLevel == b.IndexOrFirstMipLevel
+        && a.NumMipLevels == b.NumMipLevels
+        && a.FirstArraySlice == b.FirstArraySlice
+        && a.NumArraySlices == b.NumArraySlices
+        && a.FirstPlane == b.FirstPlane
+        && a.NumPlanes == b.NumPlanes;
+}
+
+// Ranges in the single subresource index form can only be compared with each other without the
+// resource's dimensions, against any other form they conservatively count as overlapping.
+inline bool do_subresource_ranges_overlap(
+    const D3D12_BARRIER_SUBRESOURCE_RANGE& a, const D3D12_BARRIER_SUBRESOURCE_RANGE& b)
+{
+    if (a.IndexOrFirstMipLevel == ALL_SUBRESOURCES || b.IndexOrFirstMipLevel == ALL_SUBRESOURCES)
+    {
+        return true;
+    }
+    if (a.NumMipLevels == 0 || b.NumMipLevels == 0)
+    {
+        return a.NumMipLevels != 0 || b.NumMipLevels != 0 || a.IndexOrFirstMipLevel == b.IndexOrFirstMipLevel;
+    }
+    auto overlaps = [](uint32_t first_a, uint32_t count_a, uint32_t first_b, uint32_t count_b) {
+        return first_a < first_b + count_b && first_b < first_a + count_a;
+    };
+    return overlaps(a.IndexOrFirstMipLevel, a.NumMipLevels, b.IndexOrFirstMipLevel, b.NumMipLevels)
+        && overlaps(a.FirstArraySlice, a.NumArraySlices, b.FirstArraySlice, b.NumArraySlices)
+        && overlaps(a.FirstPlane, a.NumPlanes, b.FirstPlane, b.NumPlanes);
+}
+
+// A barrier that keeps the layout and only orders reads after reads has nothing to do.
+inline bool is_noop_barrier(const D3D12_TEXTURE_BARRIER& barrier)
+{
+    return barrier.LayoutBefore == barrier.LayoutAfter
+        && (uint32_t(barrier.Flags) & uint32_t(D3D12_TEXTURE_BARRIER_FLAG_DISCARD)) == 0
+        && is_read_only_access(barrier.AccessBefore)
+        && is_read_only_access(barrier.AccessAfter);
+}
+
+inline bool is_noop_barrier(const D3D12_BUFFER_BARRIER& barrier)
+{
+    return is_read_only_access(barrier.AccessBefore) && is_read_only_access(barrier.AccessAfter);
+}
+
+// Collects barriers and emits them as a single Barrier call with up to one group per barrier type.
+// A second transition of the same subresource range is folded into the pending one,
+// transitions that end up as no-ops are dropped. Only a transition overlapping a pending one of a
+// different range forces an early flush, disjoint mips or slices of one texture share the call. Call flush() right before the next draw/dispatch/copy.
+// The command list is a template parameter so a recording mock can stand in for it.
+template<typename Command_List = ID3D12GraphicsCommandList7>
+class Barrier_Batcher
+{
+public:
+    explicit Barrier_Batcher(Command_List* cmd = nullptr)
+        : m_cmd(cmd)
+    {}
+
+    void set_command_list(Command_List* cmd)
+    {
+        flush();
+        m_cmd = cmd;
+    }
+
+    void texture(const D3D12_TEXTURE_BARRIER& barrier)
+    {
+        for (auto it = m_texture_barriers.rbegin(); it != m_texture_barriers.rend(); ++it)
+        {
+            if (it->pResource != barrier.pResource
+                || !do_subresource_ranges_overlap(it->Subresources, barrier.Subresources))
+            {
+                continue;
+            }
+            bool can_merge = is_same_subresource_range(it->Subresources, barrier.Subresources)
+                && (barrier.LayoutBefore == it->LayoutAfter || barrier.LayoutBefore == D3D12_BARRIER_LAYOUT_UNDEFINED)
+                && (uint32_t(barrier.Flags) & uint32_t(D3D12_TEXTURE_BARRIER_FLAG_DISCARD)) == 0;
+            if (!can_merge)
+            {
+                // Two transitions of overlapping subresources may not share one Barrier call.
+                flush();
+                break;
+            }
+            it->SyncAfter = barrier.SyncAfter;
+            it->AccessAfter = barrier.AccessAfter;
+            it->LayoutAfter = barrier.LayoutAfter;
+            if (is_noop_barrier(*it))
+            {
+                m_texture_barriers.erase(std::next(it).base());
+            }
+            return;
+        }
+        if (!is_noop_barrier(barrier))
+        {
+            m_texture_barriers.push_back(barrier);
+        }
+    }
+
+    void buffer(const D3D12_BUFFER_BARRIER& barrier)
+    {
+        for (auto it = m_buffer_barriers.rbegin(); it != m_buffer_barriers.rend(); ++it)
+        {
+            if (it->pResource != barrier.pResource)
+            {
+                continue;
+            }
+            it->SyncAfter = barrier.SyncAfter;
+            it->AccessAfter = barrier.AccessAfter;
+            if (is_noop_barrier(*it))
+            {
+                m_buffer_barriers.erase(std::next(it).base());
+            }
+            return;
+        }
+        if (!is_noop_barrier(barrier))
+        {
+            m_buffer_barriers.push_back(barrier);
+        }
+    }
+
+    // Global barriers are unioned into a single one.
+    void global(const D3D12_GLOBAL_BARRIER& barrier)
+    {
+        if (!m_has_global_barrier)
+        {
+            m_global_barrier = barrier;
+            m_has_global_barrier = true;
+            return;
+        }
+        m_global_barrier.SyncBefore = D3D12_BARRIER_SYNC(uint32_t(m_global_barrier.SyncBefore) | uint32_t(barrier.SyncBefore));
+        m_global_barrier.SyncAfter = D3D12_BARRIER_SYNC(uint32_t(m_global_barrier.SyncAfter) | uint32_t(barrier.SyncAfter));
+        m_global_barrier.AccessBefore = merge_access(m_global_barrier.AccessBefore, barrier.AccessBefore);
+        m_global_barrier.AccessAfter = merge_access(m_global_barrier.AccessAfter, barrier.AccessAfter);
+    }
+
+    void flush()
+    {
+        if (empty() || !m_cmd)
+        {
+            return;
+        }
+        D3D12_BARRIER_GROUP groups[3];
+        uint32_t group_count = 0;
+        if (m_has_global_barrier)
+        {
+            groups[group_count++] = {
+                .Type = D3D12_BARRIER_TYPE_GLOBAL,
+                .NumBarriers = 1,
+                .pGlobalBarriers = &m_global_barrier
+            };
+        }
+        if (!m_buffer_barriers.empty())
+        {
+            groups[group_count++] = {
+                .Type = D3D12_BARRIER_TYPE_BUFFER,
+                .NumBarriers = uint32_t(m_buffer_barriers.size()),
+                .pBufferBarriers = m_buffer_barriers.data()
+            };
+        }
+        if (!m_texture_barriers.empty())
+        {
+            groups[group_count++] = {
+                .Type = D3D12_BARRIER_TYPE_TEXTURE,
+                .NumBarriers = uint32_t(m_texture_barriers.size()),
+                .pTextureBarriers = m_texture_barriers.data()
+            };
+        }
+        m_cmd->Barrier(group_count, groups);
+        m_texture_barriers.clear();
+        m_buffer_barriers.clear();
+        m_has_global_barrier = false;
+    }
+
+    bool empty() const
+    {
+        return m_texture_barriers.empty() && m_buffer_barriers.empty() && !m_has_global_barrier;
+    }
+
+private:
+    static D3D12_BARRIER_ACCESS merge_access(D3D12_BARRIER_ACCESS a, D3D12_BARRIER_ACCESS b)
+    {
+        if (a == D3D12_BARRIER_ACCESS_NO_ACCESS)
+        {
+            return b;
+        }
+        if (b == D3D12_BARRIER_ACCESS_NO_ACCESS)
+        {
+            return a;
+        }
+        return D3D12_BARRIER_ACCESS(uint32_t(a) | uint32_t(b));
+    }
+
+    Command_List* m_cmd;
+    std::vector<D3D12_TEXTURE_BARRIER> m_texture_barriers;
+    std::vector<D3D12_BUFFER_BARRIER> m_buffer_barriers;
+    D3D12_GLOBAL_BARRIER m_global_barrier = {};
+    bool m_has_global_barrier = false;
+};
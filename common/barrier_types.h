@@ -0,0 +1,154 @@
+#pragma once
+
+// Enhanced barrier declarations used by the barrier batcher and the state tracker. Windows takes them
+// from the Agility SDK, elsewhere the subset is repeated with the same names, layouts and values, so the
+// batching and tracking logic builds and is tested without it. Nothing here talks to a device.
+#if defined(_WIN32)
+#include <../include/d3d12.h>
+#else
+#include <cstdint>
+
+struct ID3D12Resource;
+struct ID3D12GraphicsCommandList7;
+
+enum D3D12_BARRIER_LAYOUT : uint32_t
+{
+    D3D12_BARRIER_LAYOUT_UNDEFINED = 0xffffffff,
+    D3D12_BARRIER_LAYOUT_COMMON = 0,
+    D3D12_BARRIER_LAYOUT_PRESENT = 0,
+    D3D12_BARRIER_LAYOUT_GENERIC_READ = 1,
+    D3D12_BARRIER_LAYOUT_RENDER_TARGET = 2,
+    D3D12_BARRIER_LAYOUT_UNORDERED_ACCESS = 3,
+    D3D12_BARRIER_LAYOUT_DEPTH_STENCIL_WRITE = 4,
+    D3D12_BARRIER_LAYOUT_DEPTH_STENCIL_READ = 5,
+    D3D12_BARRIER_LAYOUT_SHADER_RESOURCE = 6,
+    D3D12_BARRIER_LAYOUT_COPY_SOURCE = 7,
+    D3D12_BARRIER_LAYOUT_COPY_DEST = 8,
+    D3D12_BARRIER_LAYOUT_RESOLVE_SOURCE = 9,
+    D3D12_BARRIER_LAYOUT_RESOLVE_DEST = 10,
+    D3D12_BARRIER_LAYOUT_SHADING_RATE_SOURCE = 11,
+    D3D12_BARRIER_LAYOUT_DIRECT_QUEUE_COMMON = 18,
+    D3D12_BARRIER_LAYOUT_DIRECT_QUEUE_GENERIC_READ = 19,
+    D3D12_BARRIER_LAYOUT_DIRECT_QUEUE_UNORDERED_ACCESS = 20,
+    D3D12_BARRIER_LAYOUT_DIRECT_QUEUE_SHADER_RESOURCE = 21,
+    D3D12_BARRIER_LAYOUT_DIRECT_QUEUE_COPY_SOURCE = 22,
+    D3D12_BARRIER_LAYOUT_DIRECT_QUEUE_COPY_DEST = 23,
+    D3D12_BARRIER_LAYOUT_COMPUTE_QUEUE_COMMON = 24,
+    D3D12_BARRIER_LAYOUT_COMPUTE_QUEUE_GENERIC_READ = 25,
+    D3D12_BARRIER_LAYOUT_COMPUTE_QUEUE_UNORDERED_ACCESS = 26,
+    D3D12_BARRIER_LAYOUT_COMPUTE_QUEUE_SHADER_RESOURCE = 27,
+    D3D12_BARRIER_LAYOUT_COMPUTE_QUEUE_COPY_SOURCE = 28,
+    D3D12_BARRIER_LAYOUT_COMPUTE_QUEUE_COPY_DEST = 29
+};
+
+enum D3D12_BARRIER_SYNC : uint32_t
+{
+    D3D12_BARRIER_SYNC_NONE = 0,
+    D3D12_BARRIER_SYNC_ALL = 0x1,
+    D3D12_BARRIER_SYNC_DRAW = 0x2,
+    D3D12_BARRIER_SYNC_INDEX_INPUT = 0x4,
+    D3D12_BARRIER_SYNC_VERTEX_SHADING = 0x8,
+    D3D12_BARRIER_SYNC_PIXEL_SHADING = 0x10,
+    D3D12_BARRIER_SYNC_DEPTH_STENCIL = 0x20,
+    D3D12_BARRIER_SYNC_RENDER_TARGET = 0x40,
+    D3D12_BARRIER_SYNC_COMPUTE_SHADING = 0x80,
+    D3D12_BARRIER_SYNC_RAYTRACING = 0x100,
+    D3D12_BARRIER_SYNC_COPY = 0x200,
+    D3D12_BARRIER_SYNC_RESOLVE = 0x400,
+    D3D12_BARRIER_SYNC_EXECUTE_INDIRECT = 0x800,
+    D3D12_BARRIER_SYNC_PREDICATION = 0x800,
+    D3D12_BARRIER_SYNC_ALL_SHADING = 0x1000,
+    D3D12_BARRIER_SYNC_NON_PIXEL_SHADING = 0x2000,
+    D3D12_BARRIER_SYNC_CLEAR_UNORDERED_ACCESS_VIEW = 0x8000,
+    D3D12_BARRIER_SYNC_SPLIT = 0x80000000
+};
+
+enum D3D12_BARRIER_ACCESS : uint32_t
+{
+    D3D12_BARRIER_ACCESS_COMMON = 0,
+    D3D12_BARRIER_ACCESS_VERTEX_BUFFER = 0x1,
+    D3D12_BARRIER_ACCESS_CONSTANT_BUFFER = 0x2,
+    D3D12_BARRIER_ACCESS_INDEX_BUFFER = 0x4,
+    D3D12_BARRIER_ACCESS_RENDER_TARGET = 0x8,
+    D3D12_BARRIER_ACCESS_UNORDERED_ACCESS = 0x10,
+    D3D12_BARRIER_ACCESS_DEPTH_STENCIL_WRITE = 0x20,
+    D3D12_BARRIER_ACCESS_DEPTH_STENCIL_READ = 0x40,
+    D3D12_BARRIER_ACCESS_SHADER_RESOURCE = 0x80,
+    D3D12_BARRIER_ACCESS_STREAM_OUTPUT = 0x100,
+    D3D12_BARRIER_ACCESS_INDIRECT_ARGUMENT = 0x200,
+    D3D12_BARRIER_ACCESS_PREDICATION = 0x200,
+    D3D12_BARRIER_ACCESS_COPY_DEST = 0x400,
+    D3D12_BARRIER_ACCESS_COPY_SOURCE = 0x800,
+    D3D12_BARRIER_ACCESS_RESOLVE_DEST = 0x1000,
+    D3D12_BARRIER_ACCESS_RESOLVE_SOURCE = 0x2000,
+    D3D12_BARRIER_ACCESS_SHADING_RATE_SOURCE = 0x10000,
+    D3D12_BARRIER_ACCESS_NO_ACCESS = 0x80000000
+};
+
+enum D3D12_BARRIER_TYPE : uint32_t
+{
+    D3D12_BARRIER_TYPE_GLOBAL = 0,
+    D3D12_BARRIER_TYPE_TEXTURE = 1,
+    D3D12_BARRIER_TYPE_BUFFER = 2
+};
+
+enum D3D12_TEXTURE_BARRIER_FLAGS : uint32_t
+{
+    D3D12_TEXTURE_BARRIER_FLAG_NONE = 0,
+    D3D12_TEXTURE_BARRIER_FLAG_DISCARD = 0x1
+};
+
+struct D3D12_BARRIER_SUBRESOURCE_RANGE
+{
+    uint32_t IndexOrFirstMipLevel;
+    uint32_t NumMipLevels;
+    uint32_t FirstArraySlice;
+    uint32_t NumArraySlices;
+    uint32_t FirstPlane;
+    uint32_t NumPlanes;
+};
+
+struct D3D12_GLOBAL_BARRIER
+{
+    D3D12_BARRIER_SYNC SyncBefore;
+    D3D12_BARRIER_SYNC SyncAfter;
+    D3D12_BARRIER_ACCESS AccessBefore;
+    D3D12_BARRIER_ACCESS AccessAfter;
+};
+
+struct D3D12_TEXTURE_BARRIER
+{
+    D3D12_BARRIER_SYNC SyncBefore;
+    D3D12_BARRIER_SYNC SyncAfter;
+    D3D12_BARRIER_ACCESS AccessBefore;
+    D3D12_BARRIER_ACCESS AccessAfter;
+    D3D12_BARRIER_LAYOUT LayoutBefore;
+    D3D12_BARRIER_LAYOUT LayoutAfter;
+    ID3D12Resource* pResource;
+    D3D12_BARRIER_SUBRESOURCE_RANGE Subresources;
+    D3D12_TEXTURE_BARRIER_FLAGS Flags;
+};
+
+struct D3D12_BUFFER_BARRIER
+{
+    D3D12_BARRIER_SYNC SyncBefore;
+    D3D12_BARRIER_SYNC SyncAfter;
+    D3D12_BARRIER_ACCESS AccessBefore;
+    D3D12_BARRIER_ACCESS AccessAfter;
+    ID3D12Resource* pResource;
+    uint64_t Offset;
+    uint64_t Size;
+};
+
+struct D3D12_BARRIER_GROUP
+{
+    D3D12_BARRIER_TYPE Type;
+    uint32_t NumBarriers;
+    union
+    {
+        const D3D12_GLOBAL_BARRIER* pGlobalBarriers;
+        const D3D12_TEXTURE_BARRIER* pTextureBarriers;
+        const D3D12_BUFFER_BARRIER* pBufferBarriers;
+    };
+};
+#endif
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Time base of all trace events, microseconds of the steady clock. On Windows this is the
+// QueryPerformanceCounter clock, which GPU timestamps can be calibrated against.
+inline double get_trace_time_us()
+{
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration<double, std::micro>(now).count();
+}
+
+// Collects events in the Chrome trace event format, viewable in chrome://tracing and Perfetto.
+// pid and tid only group events into tracks, GPU queues get their own "process".
+class Chrome_Trace
+{
+public:
+    void add_complete(
+        std::string_view name, std::string_view category, uint32_t pid, uint32_t tid, double begin_us, double duration_us)
+    {
+        m_events.push_back({
+            .phase = 'X',
+            .name = std::string(name),
+            .category = std::string(category),
+            .pid = pid,
+            .tid = tid,
+            .timestamp_us = begin_us,
+            .duration_us = duration_us
+        });
+    }
+
+    void set_process_name(uint32_t pid, std::string_view name)
+    {
+        m_events.push_back({ .phase = 'M', .name = std::string(name), .category = "process_name", .pid = pid, .tid = 0 });
+    }
+
+    void set_thread_name(uint32_t pid, uint32_t tid, std::string_view name)
+    {
+        m_events.push_back({ .phase = 'M', .name = std::string(name), .category = "thread_name", .pid = pid, .tid = tid });
+    }
+
+    size_t get_event_count() const { return m_events.size(); }
+    void clear() { m_events.clear(); }
+
+    std::string to_json() const
+    {
+        std::string json = "{\"traceEvents\":[";
+        char buffer[128];
+        for (size_t i = 0; i < m_events.size(); ++i)
+        {
+            const auto& event = m_events[i];
+            json += i > 0 ? ",\n{" : "\n{";
+            if (event.phase == 'M')
+            {
+                // Metadata events carry the name in args, the category field holds the metadata kind.
+                json += "\"ph\":\"M\",\"name\":";
+                append_string(json, event.category);
+                snprintf(buffer, sizeof(buffer), ",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":", event.pid, event.tid);
+                json += buffer;
+                append_string(json, event.name);
+                json += "}}";
+                continue;
+            }
+            json += "\"ph\":\"X\",\"name\":";
+            append_string(json, event.name);
+            json += ",\"cat\":";
+            append_string(json, event.category);
+            snprintf(buffer, sizeof(buffer), ",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                event.pid, event.tid, event.timestamp_us, event.duration_us);
+            json += buffer;
+        }
+        json += "\n],\"displayTimeUnit\":\"ms\"}\n";
+        return json;
+    }
+
+    bool write(const char* path) const
+    {
+        FILE* file = fopen(path, "wb");
+        if (!file)
+        {
+            return false;
+        }
+        auto json = to_json();
+        auto written = fwrite(json.data(), 1, json.size(), file);
+        return fclose(file) == 0 && written == json.size();
+    }
+
+private:
+    struct Event
+    {
+        char phase;
+        std::string name;
+        std::string category;
+        uint32_t pid;
+        uint32_t tid;
+        double timestamp_us = 0.0;
+        double duration_us = 0.0;
+    };
+
+    static void append_string(std::string& json, std::string_view value)
+    {
+        json += '"';
+        for (auto c : value)
+        {
+            switch (c)
+            {
+            case '"':
+                json += "\\\"";
+                break;
+            case '\\':
+                json += "\\\\";
+                break;
+            case '\n':
+                json += "\\n";
+                break;
+            case '\t':
+                json += "\\t";
+                break;
+            default:
+                if (uint8_t(c) < 0x20)
+                {
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", uint32_t(uint8_t(c)));
+                    json += escaped;
+                }
+                else
+                {
+                    json += c;
+                }
+                break;
+            }
+        }
+        json += '"';
+    }
+
+    std::vector<Event> m_events;
+};
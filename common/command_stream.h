@@ -0,0 +1,729 @@
+#pragma once
+
+#include "hash.h"
+#include "shader_blob.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Compact log of command list calls. Every command is an opcode byte followed by its fields as LEB128
+// varints, objects are referred to by ids out of a Command_Stream_Objects table instead of pointers.
+// The field values are the raw D3D12 enum and flag values, the format itself does not depend on D3D12.
+enum class Command_Stream_Op : uint8_t
+{
+    Begin_List,
+    End_List,
+    Set_Descriptor_Heaps,
+    Set_Root_Signature,
+    Set_Pipeline_State,
+    Set_Root_Constants,
+    Dispatch,
+    Copy_Buffer_Region,
+    Copy_Resource,
+    Copy_Texture_Region,
+    Barrier,
+    Count
+};
+
+enum class Command_Stream_Bind_Point : uint32_t
+{
+    Compute,
+    Graphics
+};
+
+// Same values as D3D12_BARRIER_TYPE.
+enum class Command_Stream_Barrier_Type : uint32_t
+{
+    Global,
+    Texture,
+    Buffer
+};
+
+struct Command_Stream_Global_Barrier
+{
+    uint32_t sync_before;
+    uint32_t sync_after;
+    uint32_t access_before;
+    uint32_t access_after;
+};
+
+struct Command_Stream_Texture_Barrier
+{
+    uint32_t sync_before;
+    uint32_t sync_after;
+    uint32_t access_before;
+    uint32_t access_after;
+    uint32_t layout_before;
+    uint32_t layout_after;
+    uint32_t resource;
+    uint32_t first_mip_level;
+    uint32_t mip_level_count;
+    uint32_t first_array_slice;
+    uint32_t array_slice_count;
+    uint32_t first_plane;
+    uint32_t plane_count;
+    uint32_t flags;
+};
+
+struct Command_Stream_Buffer_Barrier
+{
+    uint32_t sync_before;
+    uint32_t sync_after;
+    uint32_t access_before;
+    uint32_t access_after;
+    uint32_t resource;
+    uint64_t offset;
+    uint64_t size;
+};
+
+// Mirrors D3D12_TEXTURE_COPY_LOCATION, `type` 0 addresses a subresource, 1 a placed footprint.
+struct Command_Stream_Texture_Location
+{
+    uint32_t resource;
+    uint32_t type;
+    uint32_t subresource_index;
+    uint64_t offset;
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t depth;
+    uint32_t row_pitch;
+};
+
+struct Command_Stream_Box
+{
+    uint32_t left;
+    uint32_t top;
+    uint32_t front;
+    uint32_t right;
+    uint32_t bottom;
+    uint32_t back;
+};
+
+inline void append_command_stream_varint(std::vector<uint8_t>& data, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        data.push_back(uint8_t(value | 0x80));
+        value >>= 7;
+    }
+    data.push_back(uint8_t(value));
+}
+
+// Returns false on truncated or overlong values.
+inline bool read_command_stream_varint(std::span<const uint8_t> data, size_t& offset, uint64_t& value)
+{
+    value = 0;
+    for (uint32_t shift = 0; shift < 64 && offset < data.size(); shift += 7)
+    {
+        auto byte = data[offset++];
+        // The tenth byte only has room for the top bit.
+        if (shift == 63 && byte > 1)
+        {
+            return false;
+        }
+        value |= uint64_t(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Id 0 is null, ids are handed out in first use order. Names let a replay find the matching objects.
+class Command_Stream_Objects
+{
+public:
+    uint32_t get_id(const void* object)
+    {
+        if (!object)
+        {
+            return 0;
+        }
+        std::lock_guard lock(m_mutex);
+        auto [it, inserted] = m_ids.try_emplace(object, uint32_t(m_names.size() + 1));
+        if (inserted)
+        {
+            m_names.emplace_back();
+        }
+        return it->second;
+    }
+
+    void set_name(const void* object, std::string_view name)
+    {
+        auto id = get_id(object);
+        std::lock_guard lock(m_mutex);
+        m_names[id - 1] = name;
+    }
+
+    // Ids of released objects may be reused by new ones at the same address, drop them first.
+    void forget(const void* object)
+    {
+        std::lock_guard lock(m_mutex);
+        m_ids.erase(object);
+    }
+
+    std::vector<std::string> get_names() const
+    {
+        std::lock_guard lock(m_mutex);
+        return m_names;
+    }
+
+private:
+    mutable std::mutex m_mutex;
+    std::unordered_map<const void*, uint32_t> m_ids;
+    std::vector<std::string> m_names;
+};
+
+// Appends commands to a byte buffer. Keep one per recording thread and reuse it, clear() keeps the
+// allocation so steady state recording doesn't allocate.
+class Command_Stream_Writer
+{
+public:
+    void begin_list(uint32_t list_type)
+    {
+        op(Command_Stream_Op::Begin_List);
+        write(list_type);
+    }
+
+    void end_list() { op(Command_Stream_Op::End_List); }
+
+    void set_descriptor_heaps(std::span<const uint32_t> heaps)
+    {
+        op(Command_Stream_Op::Set_Descriptor_Heaps);
+        write(heaps.size());
+        for (auto heap : heaps)
+        {
+            write(heap);
+        }
+    }
+
+    void set_root_signature(Command_Stream_Bind_Point bind_point, uint32_t root_signature)
+    {
+        op(Command_Stream_Op::Set_Root_Signature);
+        write(uint32_t(bind_point));
+        write(root_signature);
+    }
+
+    void set_pipeline_state(uint32_t pipeline_state)
+    {
+        op(Command_Stream_Op::Set_Pipeline_State);
+        write(pipeline_state);
+    }
+
+    void set_root_constants(
+        Command_Stream_Bind_Point bind_point, uint32_t root_parameter_index,
+        std::span<const uint32_t> values, uint32_t offset)
+    {
+        op(Command_Stream_Op::Set_Root_Constants);
+        write(uint32_t(bind_point));
+        write(root_parameter_index);
+        write(offset);
+        write(values.size());
+        for (auto value : values)
+        {
+            write(value);
+        }
+    }
+
+    void dispatch(uint32_t x, uint32_t y, uint32_t z)
+    {
+        op(Command_Stream_Op::Dispatch);
+        write(x);
+        write(y);
+        write(z);
+    }
+
+    void copy_buffer_region(uint32_t dst, uint64_t dst_offset, uint32_t src, uint64_t src_offset, uint64_t size)
+    {
+        op(Command_Stream_Op::Copy_Buffer_Region);
+        write(dst);
+        write(dst_offset);
+        write(src);
+        write(src_offset);
+        write(size);
+    }
+
+    void copy_resource(uint32_t dst, uint32_t src)
+    {
+        op(Command_Stream_Op::Copy_Resource);
+        write(dst);
+        write(src);
+    }
+
+    void copy_texture_region(
+        const Command_Stream_Texture_Location& dst, uint32_t x, uint32_t y, uint32_t z,
+        const Command_Stream_Texture_Location& src, const Command_Stream_Box* box)
+    {
+        op(Command_Stream_Op::Copy_Texture_Region);
+        write(dst);
+        write(x);
+        write(y);
+        write(z);
+        write(src);
+        write(box != nullptr);
+        if (box)
+        {
+            for (auto value : { box->left, box->top, box->front, box->right, box->bottom, box->back })
+            {
+                write(value);
+            }
+        }
+    }
+
+    // Followed by `group_count` barrier_group() calls, each followed by its barriers.
+    void begin_barrier(uint32_t group_count)
+    {
+        op(Command_Stream_Op::Barrier);
+        write(group_count);
+    }
+
+    void barrier_group(Command_Stream_Barrier_Type type, uint32_t barrier_count)
+    {
+        write(uint32_t(type));
+        write(barrier_count);
+    }
+
+    void barrier(const Command_Stream_Global_Barrier& barrier)
+    {
+        write(barrier.sync_before);
+        write(barrier.sync_after);
+        write(barrier.access_before);
+        write(barrier.access_after);
+    }
+
+    void barrier(const Command_Stream_Texture_Barrier& barrier)
+    {
+        for (auto value : {
+            barrier.sync_before, barrier.sync_after, barrier.access_before, barrier.access_after,
+            barrier.layout_before, barrier.layout_after, barrier.resource,
+            barrier.first_mip_level, barrier.mip_level_count, barrier.first_array_slice, barrier.array_slice_count,
+            barrier.first_plane, barrier.plane_count, barrier.flags })
+        {
+            write(value);
+        }
+    }
+
+    void barrier(const Command_Stream_Buffer_Barrier& barrier)
+    {
+        write(barrier.sync_before);
+        write(barrier.sync_after);
+        write(barrier.access_before);
+        write(barrier.access_after);
+        write(barrier.resource);
+        write(barrier.offset);
+        write(barrier.size);
+    }
+
+    std::span<const uint8_t> get_data() const { return m_data; }
+    void clear() { m_data.clear(); }
+
+private:
+    void op(Command_Stream_Op value) { m_data.push_back(uint8_t(value)); }
+
+    void write(uint64_t value) { append_command_stream_varint(m_data, value); }
+
+    void write(const Command_Stream_Texture_Location& location)
+    {
+        write(location.resource);
+        write(location.type);
+        if (location.type == 0)
+        {
+            write(location.subresource_index);
+            return;
+        }
+        write(location.offset);
+        write(location.format);
+        write(location.width);
+        write(location.height);
+        write(location.depth);
+        write(location.row_pitch);
+    }
+
+    std::vector<uint8_t> m_data;
+};
+
+// Decodes a stream written by Command_Stream_Writer and hands every command to a visitor with the same
+// member functions as the writer, so a writer itself re-encodes a stream.
+class Command_Stream_Reader
+{
+public:
+    explicit Command_Stream_Reader(std::span<const uint8_t> data)
+        : m_data(data)
+    {}
+
+    bool is_at_end() const { return m_offset == m_data.size(); }
+    bool is_valid() const { return m_valid; }
+
+    // Reads commands up to and including the next End_List or the end of the stream.
+    // Returns false at the end of the stream or on malformed data, see is_valid().
+    template<typename Visitor>
+    bool read_list(Visitor& visitor)
+    {
+        if (is_at_end() || !m_valid)
+        {
+            return false;
+        }
+        while (m_valid && !is_at_end())
+        {
+            auto op = Command_Stream_Op(m_data[m_offset++]);
+            if (op == Command_Stream_Op::End_List)
+            {
+                visitor.end_list();
+                return true;
+            }
+            read_command(op, visitor);
+        }
+        return m_valid;
+    }
+
+private:
+    // Fields of a command are limited, values a valid stream never holds mark it as corrupt.
+    static constexpr uint32_t MAX_ARRAY_SIZE = 64;
+
+    template<typename Visitor>
+    void read_command(Command_Stream_Op op, Visitor& visitor)
+    {
+        switch (op)
+        {
+        case Command_Stream_Op::Begin_List:
+        {
+            auto list_type = read32();
+            if (m_valid)
+            {
+                visitor.begin_list(list_type);
+            }
+            break;
+        }
+        case Command_Stream_Op::Set_Descriptor_Heaps:
+        {
+            uint32_t heaps[MAX_ARRAY_SIZE];
+            auto count = read_array(heaps);
+            if (m_valid)
+            {
+                visitor.set_descriptor_heaps(std::span<const uint32_t>(heaps, count));
+            }
+            break;
+        }
+        case Command_Stream_Op::Set_Root_Signature:
+        {
+            auto bind_point = Command_Stream_Bind_Point(read32());
+            auto root_signature = read32();
+            if (m_valid)
+            {
+                visitor.set_root_signature(bind_point, root_signature);
+            }
+            break;
+        }
+        case Command_Stream_Op::Set_Pipeline_State:
+        {
+            auto pipeline_state = read32();
+            if (m_valid)
+            {
+                visitor.set_pipeline_state(pipeline_state);
+            }
+            break;
+        }
+        case Command_Stream_Op::Set_Root_Constants:
+        {
+            auto bind_point = Command_Stream_Bind_Point(read32());
+            auto root_parameter_index = read32();
+            auto offset = read32();
+            uint32_t values[MAX_ARRAY_SIZE];
+            auto count = read_array(values);
+            if (m_valid)
+            {
+                visitor.set_root_constants(
+                    bind_point, root_parameter_index, std::span<const uint32_t>(values, count), offset);
+            }
+            break;
+        }
+        case Command_Stream_Op::Dispatch:
+        {
+            auto x = read32();
+            auto y = read32();
+            auto z = read32();
+            if (m_valid)
+            {
+                visitor.dispatch(x, y, z);
+            }
+            break;
+        }
+        case Command_Stream_Op::Copy_Buffer_Region:
+        {
+            auto dst = read32();
+            auto dst_offset = read64();
+            auto src = read32();
+            auto src_offset = read64();
+            auto size = read64();
+            if (m_valid)
+            {
+                visitor.copy_buffer_region(dst, dst_offset, src, src_offset, size);
+            }
+            break;
+        }
+        case Command_Stream_Op::Copy_Resource:
+        {
+            auto dst = read32();
+            auto src = read32();
+            if (m_valid)
+            {
+                visitor.copy_resource(dst, src);
+            }
+            break;
+        }
+        case Command_Stream_Op::Copy_Texture_Region:
+        {
+            auto dst = read_location();
+            auto x = read32();
+            auto y = read32();
+            auto z = read32();
+            auto src = read_location();
+            auto has_box = read32();
+            Command_Stream_Box box = {};
+            if (has_box)
+            {
+                box = { read32(), read32(), read32(), read32(), read32(), read32() };
+            }
+            if (m_valid)
+            {
+                visitor.copy_texture_region(dst, x, y, z, src, has_box ? &box : nullptr);
+            }
+            break;
+        }
+        case Command_Stream_Op::Barrier:
+            read_barrier(visitor);
+            break;
+        default:
+            m_valid = false;
+            break;
+        }
+    }
+
+    template<typename Visitor>
+    void read_barrier(Visitor& visitor)
+    {
+        auto group_count = read32();
+        if (!m_valid)
+        {
+            return;
+        }
+        visitor.begin_barrier(group_count);
+        for (uint32_t g = 0; g < group_count && m_valid; ++g)
+        {
+            auto type = Command_Stream_Barrier_Type(read32());
+            auto barrier_count = read32();
+            if (!m_valid || uint32_t(type) > uint32_t(Command_Stream_Barrier_Type::Buffer)
+                || barrier_count > m_data.size() - m_offset)
+            {
+                m_valid = false;
+                return;
+            }
+            visitor.barrier_group(type, barrier_count);
+            for (uint32_t b = 0; b < barrier_count && m_valid; ++b)
+            {
+                switch (type)
+                {
+                case Command_Stream_Barrier_Type::Global:
+                {
+                    Command_Stream_Global_Barrier barrier = { read32(), read32(), read32(), read32() };
+                    if (m_valid)
+                    {
+                        visitor.barrier(barrier);
+                    }
+                    break;
+                }
+                case Command_Stream_Barrier_Type::Texture:
+                {
+                    Command_Stream_Texture_Barrier barrier = {
+                        read32(), read32(), read32(), read32(), read32(), read32(), read32(),
+                        read32(), read32(), read32(), read32(), read32(), read32(), read32()
+                    };
+                    if (m_valid)
+                    {
+                        visitor.barrier(barrier);
+                    }
+                    break;
+                }
+                case Command_Stream_Barrier_Type::Buffer:
+                {
+                    Command_Stream_Buffer_Barrier barrier = {
+                        read32(), read32(), read32(), read32(), read32(), read64(), read64()
+                    };
+                    if (m_valid)
+                    {
+                        visitor.barrier(barrier);
+                    }
+                    break;
+                }
+                default:
+                    m_valid = false;
+                    break;
+                }
+            }
+        }
+    }
+
+    uint64_t read64()
+    {
+        uint64_t value = 0;
+        if (!read_command_stream_varint(m_data, m_offset, value))
+        {
+            m_valid = false;
+            return 0;
+        }
+        return value;
+    }
+
+    uint32_t read32()
+    {
+        auto value = read64();
+        if (value > UINT32_MAX)
+        {
+            m_valid = false;
+            return 0;
+        }
+        return uint32_t(value);
+    }
+
+    uint32_t read_array(uint32_t (&values)[MAX_ARRAY_SIZE])
+    {
+        auto count = read32();
+        if (count > MAX_ARRAY_SIZE)
+        {
+            m_valid = false;
+            return 0;
+        }
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            values[i] = read32();
+        }
+        return count;
+    }
+
+    Command_Stream_Texture_Location read_location()
+    {
+        Command_Stream_Texture_Location location = {};
+        location.resource = read32();
+        location.type = read32();
+        if (location.type == 0)
+        {
+            location.subresource_index = read32();
+            return location;
+        }
+        location.offset = read64();
+        location.format = read32();
+        location.width = read32();
+        location.height = read32();
+        location.depth = read32();
+        location.row_pitch = read32();
+        return location;
+    }
+
+    std::span<const uint8_t> m_data;
+    size_t m_offset = 0;
+    bool m_valid = true;
+};
+
+static constexpr uint32_t COMMAND_STREAM_MAGIC = 0x53444d43; // 'CMDS'
+static constexpr uint32_t COMMAND_STREAM_VERSION = 1;
+
+struct Command_Stream_Header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t object_count;
+    uint64_t stream_size;
+    uint64_t stream_hash;
+};
+
+static_assert(sizeof(Command_Stream_Header) == 32);
+
+// On disk: header, the object names as varint length plus bytes, then the stream itself.
+inline bool save_command_stream(
+    const char* path, const Command_Stream_Objects& objects, std::span<const uint8_t> stream)
+{
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        return false;
+    }
+    auto names = objects.get_names();
+    std::vector<uint8_t> name_data;
+    for (const auto& name : names)
+    {
+        append_command_stream_varint(name_data, name.size());
+        name_data.insert(name_data.end(), name.begin(), name.end());
+    }
+    Command_Stream_Header header = {
+        .magic = COMMAND_STREAM_MAGIC,
+        .version = COMMAND_STREAM_VERSION,
+        .object_count = names.size(),
+        .stream_size = stream.size(),
+        .stream_hash = fnv1a_64(stream.data(), stream.size())
+    };
+    bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+    success = success && fwrite(name_data.data(), 1, name_data.size(), file) == name_data.size();
+    success = success && fwrite(stream.data(), 1, stream.size(), file) == stream.size();
+    return fclose(file) == 0 && success;
+}
+
+// Maps a saved stream, names and stream point into the mapping.
+class Command_Stream_File
+{
+public:
+    bool open(const char* path)
+    {
+        m_names.clear();
+        m_stream = {};
+        if (!m_file.open(path) || m_file.size() < sizeof(Command_Stream_Header))
+        {
+            return false;
+        }
+        auto bytes = static_cast<const uint8_t*>(m_file.data());
+        Command_Stream_Header header;
+        memcpy(&header, bytes, sizeof(header));
+        if (header.magic != COMMAND_STREAM_MAGIC || header.version != COMMAND_STREAM_VERSION)
+        {
+            return false;
+        }
+        std::span<const uint8_t> data(bytes, m_file.size());
+        size_t offset = sizeof(header);
+        for (uint64_t i = 0; i < header.object_count; ++i)
+        {
+            uint64_t length = 0;
+            if (!read_command_stream_varint(data, offset, length) || m_file.size() - offset < length)
+            {
+                m_names.clear();
+                return false;
+            }
+            m_names.emplace_back(reinterpret_cast<const char*>(bytes + offset), size_t(length));
+            offset += size_t(length);
+        }
+        if (m_file.size() - offset != header.stream_size
+            || fnv1a_64(bytes + offset, header.stream_size) != header.stream_hash)
+        {
+            m_names.clear();
+            return false;
+        }
+        m_stream = { bytes + offset, size_t(header.stream_size) };
+        return true;
+    }
+
+    // Indexed by id - 1.
+    std::span<const std::string_view> get_names() const { return m_names; }
+    std::span<const uint8_t> get_stream() const { return m_stream; }
+
+private:
+    Mapped_File m_file;
+    std::vector<std::string_view> m_names;
+    std::span<const uint8_t> m_stream;
+};
@@ -0,0 +1,346 @@
+#pragma once
+
+#include "hash.h"
+#include "shader_blob.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Limits from d3d12.h, repeated so the math builds without it.
+static constexpr uint32_t COMPUTE_MAX_THREADS_PER_GROUP = 1024;
+static constexpr uint32_t COMPUTE_MAX_GROUP_SIZE_XY = 1024;
+static constexpr uint32_t COMPUTE_MAX_GROUP_SIZE_Z = 64;
+static constexpr uint32_t COMPUTE_MAX_GROUP_COUNT = 65535;
+
+// numthreads of a compute shader.
+struct Thread_Group_Size
+{
+    uint32_t x = 1;
+    uint32_t y = 1;
+    uint32_t z = 1;
+
+    uint32_t get_thread_count() const { return x * y * z; }
+    bool operator==(const Thread_Group_Size&) const = default;
+};
+
+// Arguments of Dispatch.
+struct Dispatch_Size
+{
+    uint32_t x = 0;
+    uint32_t y = 0;
+    uint32_t z = 0;
+
+    bool operator==(const Dispatch_Size&) const = default;
+};
+
+inline bool is_valid_thread_group_size(Thread_Group_Size group_size)
+{
+    return group_size.x > 0 && group_size.y > 0 && group_size.z > 0
+        && group_size.x <= COMPUTE_MAX_GROUP_SIZE_XY
+        && group_size.y <= COMPUTE_MAX_GROUP_SIZE_XY
+        && group_size.z <= COMPUTE_MAX_GROUP_SIZE_Z
+        && uint64_t(group_size.x) * group_size.y * group_size.z <= COMPUTE_MAX_THREADS_PER_GROUP;
+}
+
+// Groups needed to cover `thread_count` threads, the last group may be partially out of bounds.
+inline uint32_t get_dispatch_group_count(uint32_t thread_count, uint32_t group_size)
+{
+    return uint32_t((uint64_t(thread_count) + group_size - 1) / group_size);
+}
+
+// Groups covering a grid of `thread_counts` threads, usually the dimensions of the written resource.
+// Returns false if the group size is invalid or a group count exceeds the dispatch limit.
+inline bool get_dispatch_size(
+    uint32_t thread_count_x, uint32_t thread_count_y, uint32_t thread_count_z, Thread_Group_Size group_size,
+    Dispatch_Size& dispatch_size)
+{
+    if (!is_valid_thread_group_size(group_size))
+    {
+        return false;
+    }
+    dispatch_size = {
+        .x = get_dispatch_group_count(thread_count_x, group_size.x),
+        .y = get_dispatch_group_count(thread_count_y, group_size.y),
+        .z = get_dispatch_group_count(thread_count_z, group_size.z)
+    };
+    return dispatch_size.x <= COMPUTE_MAX_GROUP_COUNT
+        && dispatch_size.y <= COMPUTE_MAX_GROUP_COUNT
+        && dispatch_size.z <= COMPUTE_MAX_GROUP_COUNT;
+}
+
+// Reads numthreads from the pipeline state validation part (PSV0) of a DXIL container.
+// Needs PSVRuntimeInfo2 or newer, i.e. a shader compiled for validator 1.6 and up.
+inline bool get_shader_thread_group_size(Shader_Blob shader, Thread_Group_Size& group_size)
+{
+    static constexpr uint32_t DXBC_MAGIC = 0x43425844; // 'DXBC'
+    static constexpr uint32_t PSV0_FOURCC = 0x30565350; // 'PSV0'
+    static constexpr uint32_t CONTAINER_HEADER_SIZE = 32;
+    static constexpr uint32_t PSV_STAGE_OFFSET = 24;
+    static constexpr uint32_t PSV_NUM_THREADS_OFFSET = 36;
+    static constexpr uint32_t PSV_COMPUTE_STAGE = 5;
+    auto bytes = static_cast<const uint8_t*>(shader.data);
+    auto read = [&](size_t offset) {
+        uint32_t value;
+        memcpy(&value, bytes + offset, sizeof(value));
+        return value;
+    };
+    if (shader.size < CONTAINER_HEADER_SIZE || read(0) != DXBC_MAGIC)
+    {
+        return false;
+    }
+    auto part_count = read(28);
+    if ((shader.size - CONTAINER_HEADER_SIZE) / sizeof(uint32_t) < part_count)
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < part_count; ++i)
+    {
+        size_t part_offset = read(CONTAINER_HEADER_SIZE + i * sizeof(uint32_t));
+        if (part_offset > shader.size || shader.size - part_offset < 12 || read(part_offset) != PSV0_FOURCC)
+        {
+            continue;
+        }
+        size_t part_size = read(part_offset + 4);
+        size_t info_size = read(part_offset + 8);
+        if (part_size > shader.size - part_offset - 8 || info_size + 4 > part_size
+            || info_size < PSV_NUM_THREADS_OFFSET + 3 * sizeof(uint32_t))
+        {
+            return false;
+        }
+        auto info = part_offset + 12;
+        if (bytes[info + PSV_STAGE_OFFSET] != PSV_COMPUTE_STAGE)
+        {
+            return false;
+        }
+        group_size = {
+            .x = read(info + PSV_NUM_THREADS_OFFSET),
+            .y = read(info + PSV_NUM_THREADS_OFFSET + 4),
+            .z = read(info + PSV_NUM_THREADS_OFFSET + 8)
+        };
+        return is_valid_thread_group_size(group_size);
+    }
+    return false;
+}
+
+inline uint64_t make_dispatch_kernel_key(std::string_view name)
+{
+    return Hasher().add(name.data(), name.size()).get();
+}
+
+static constexpr uint32_t DISPATCH_TUNING_CACHE_MAGIC = 0x4e555444; // 'DTUN'
+static constexpr uint32_t DISPATCH_TUNING_CACHE_VERSION = 1;
+
+struct Dispatch_Tuning_Cache_Header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t device_hash;
+    uint64_t entry_count;
+};
+
+struct Dispatch_Tuning_Cache_Entry
+{
+    uint64_t kernel_key;
+    uint32_t group_size_x;
+    uint32_t group_size_y;
+    uint32_t group_size_z;
+    uint32_t padding;
+};
+
+static_assert(sizeof(Dispatch_Tuning_Cache_Header) == 24);
+static_assert(sizeof(Dispatch_Tuning_Cache_Entry) == 24);
+
+// Picks the fastest of several compiled group size variants of a kernel. While a kernel is untuned,
+// select() cycles through its variants and report() collects their GPU times; once every variant has
+// `samples_per_variant` samples the one with the lowest median wins. Winners are kept per adapter and
+// driver, keyed like the Pipeline_Cache, and survive restarts through load() and save().
+class Dispatch_Autotuner
+{
+public:
+    explicit Dispatch_Autotuner(uint64_t device_hash, uint32_t samples_per_variant = 16)
+        : m_device_hash(device_hash)
+        , m_samples_per_variant(samples_per_variant > 0 ? samples_per_variant : 1)
+    {}
+
+    // Returns the variant to dispatch next. `kernel_key` identifies the kernel independent of its group size,
+    // e.g. a hash of the shader name.
+    uint32_t select(uint64_t kernel_key, std::span<const Thread_Group_Size> variants)
+    {
+        if (variants.size() <= 1)
+        {
+            return 0;
+        }
+        if (auto it = m_best.find(kernel_key); it != m_best.end())
+        {
+            auto best = std::find(variants.begin(), variants.end(), it->second);
+            if (best != variants.end())
+            {
+                return uint32_t(best - variants.begin());
+            }
+            // Variant set changed, tune again.
+            m_best.erase(it);
+            m_dirty = true;
+        }
+        auto& tuning = m_tuning[kernel_key];
+        if (tuning.variants.size() != variants.size()
+            || !std::equal(variants.begin(), variants.end(), tuning.variants.begin()))
+        {
+            tuning.variants.assign(variants.begin(), variants.end());
+            tuning.samples.assign(variants.size(), {});
+            tuning.next_variant = 0;
+        }
+        // Round robin, so clock ramps and other load drift hit all variants alike.
+        auto variant = tuning.next_variant;
+        tuning.next_variant = (tuning.next_variant + 1) % uint32_t(variants.size());
+        return variant;
+    }
+
+    // Adds a measured GPU time of `variant`, as selected for `kernel_key` earlier.
+    void report(uint64_t kernel_key, uint32_t variant, double duration_us)
+    {
+        auto it = m_tuning.find(kernel_key);
+        if (it == m_tuning.end() || variant >= it->second.samples.size())
+        {
+            return;
+        }
+        auto& tuning = it->second;
+        if (tuning.samples[variant].size() < m_samples_per_variant)
+        {
+            tuning.samples[variant].push_back(duration_us);
+        }
+        for (const auto& samples : tuning.samples)
+        {
+            if (samples.size() < m_samples_per_variant)
+            {
+                return;
+            }
+        }
+        uint32_t best = 0;
+        double best_median = 0.0;
+        for (uint32_t i = 0; i < tuning.samples.size(); ++i)
+        {
+            auto samples = tuning.samples[i];
+            std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+            auto median = samples[samples.size() / 2];
+            if (i == 0 || median < best_median)
+            {
+                best = i;
+                best_median = median;
+            }
+        }
+        m_best[kernel_key] = tuning.variants[best];
+        m_tuning.erase(it);
+        m_dirty = true;
+    }
+
+    bool is_tuned(uint64_t kernel_key) const { return m_best.contains(kernel_key); }
+
+    bool find(uint64_t kernel_key, Thread_Group_Size& group_size) const
+    {
+        auto it = m_best.find(kernel_key);
+        if (it == m_best.end())
+        {
+            return false;
+        }
+        group_size = it->second;
+        return true;
+    }
+
+    // Drops all results, e.g. to tune again after a shader change.
+    void clear()
+    {
+        m_best.clear();
+        m_tuning.clear();
+        m_dirty = true;
+    }
+
+    // Returns false if the file is missing, corrupt or belongs to a different adapter/driver.
+    bool load(const char* path)
+    {
+        m_best.clear();
+        m_tuning.clear();
+        Mapped_File file(path);
+        if (!file.is_open() || file.size() < sizeof(Dispatch_Tuning_Cache_Header))
+        {
+            return false;
+        }
+        auto bytes = static_cast<const uint8_t*>(file.data());
+        Dispatch_Tuning_Cache_Header header;
+        memcpy(&header, bytes, sizeof(header));
+        if (header.magic != DISPATCH_TUNING_CACHE_MAGIC
+            || header.version != DISPATCH_TUNING_CACHE_VERSION
+            || header.device_hash != m_device_hash
+            || (file.size() - sizeof(header)) / sizeof(Dispatch_Tuning_Cache_Entry) < header.entry_count)
+        {
+            m_dirty = true;
+            return false;
+        }
+        for (uint64_t i = 0; i < header.entry_count; ++i)
+        {
+            Dispatch_Tuning_Cache_Entry entry;
+            memcpy(&entry, bytes + sizeof(header) + i * sizeof(entry), sizeof(entry));
+            Thread_Group_Size group_size = { entry.group_size_x, entry.group_size_y, entry.group_size_z };
+            if (is_valid_thread_group_size(group_size))
+            {
+                m_best[entry.kernel_key] = group_size;
+            }
+        }
+        m_dirty = false;
+        return true;
+    }
+
+    bool save(const char* path)
+    {
+        FILE* file = fopen(path, "wb");
+        if (!file)
+        {
+            return false;
+        }
+        Dispatch_Tuning_Cache_Header header = {
+            .magic = DISPATCH_TUNING_CACHE_MAGIC,
+            .version = DISPATCH_TUNING_CACHE_VERSION,
+            .device_hash = m_device_hash,
+            .entry_count = m_best.size()
+        };
+        bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+        for (const auto& [kernel_key, group_size] : m_best)
+        {
+            Dispatch_Tuning_Cache_Entry entry = {
+                .kernel_key = kernel_key,
+                .group_size_x = group_size.x,
+                .group_size_y = group_size.y,
+                .group_size_z = group_size.z,
+                .padding = 0
+            };
+            success = success && fwrite(&entry, sizeof(entry), 1, file) == 1;
+        }
+        success = fclose(file) == 0 && success;
+        if (success)
+        {
+            m_dirty = false;
+        }
+        return success;
+    }
+
+    bool is_dirty() const { return m_dirty; }
+
+private:
+    struct Tuning
+    {
+        std::vector<Thread_Group_Size> variants;
+        std::vector<std::vector<double>> samples;
+        uint32_t next_variant = 0;
+    };
+
+    uint64_t m_device_hash;
+    uint32_t m_samples_per_variant;
+    std::unordered_map<uint64_t, Thread_Group_Size> m_best;
+    std::unordered_map<uint64_t, Tuning> m_tuning;
+    bool m_dirty = false;
+};
@@ -0,0 +1,584 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+static constexpr uint32_t INVALID_STAGING_PAGE = ~0u;
+static constexpr uint64_t COPY_BUFFER_PLACEMENT_ALIGNMENT = 16;
+// Same as D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT and D3D12_TEXTURE_DATA_PITCH_ALIGNMENT.
+static constexpr uint64_t COPY_TEXTURE_PLACEMENT_ALIGNMENT = 512;
+static constexpr uint32_t COPY_TEXTURE_PITCH_ALIGNMENT = 256;
+
+enum class Copy_Kind : uint8_t
+{
+    Buffer_Upload,
+    Buffer_Readback,
+    Texture_Upload
+};
+
+// One subresource of a 2D texture as rows of blocks, block_size is 4 for BC formats and 1 otherwise.
+struct Copy_Texture_Desc
+{
+    // Backend format, a DXGI_FORMAT for D3D12.
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t block_size;
+    // Bytes of one row of blocks.
+    uint32_t row_size;
+
+    uint32_t get_row_count() const { return (height + block_size - 1) / block_size; }
+    uint32_t get_row_pitch() const { return (row_size + COPY_TEXTURE_PITCH_ALIGNMENT - 1) & ~(COPY_TEXTURE_PITCH_ALIGNMENT - 1); }
+};
+
+// A copy between a staging page and a resource for the backend to record.
+struct Scheduled_Copy
+{
+    Copy_Kind kind;
+    void* resource;
+    uint32_t page;
+    uint64_t page_offset;
+    // Buffers: byte offset and size in the resource. Textures: first block row and row count.
+    uint64_t offset;
+    uint64_t size;
+    uint32_t subresource;
+    Copy_Texture_Desc texture;
+    // Earlier copies of the frame may touch the same bytes, the backend has to order this one after them.
+    bool needs_barrier;
+};
+
+struct Copy_Scheduler_Settings
+{
+    uint64_t page_size = 4ull << 20;
+    // Bytes moved per frame, larger requests continue in the next frames.
+    uint64_t max_bytes_per_frame = 32ull << 20;
+};
+
+// Receives `data` at `offset` into a readback request once its copy completed. Requests that were split
+// across pages or frames arrive in several calls.
+using Copy_Readback_Callback = std::function<void(uint64_t offset, std::span<const uint8_t> data)>;
+
+// API-agnostic scheduler for upload and readback copies through fixed size staging pages.
+// Requests made between two build_frame() calls are coalesced: buffer requests on the same resource
+// whose ranges touch or overlap become a single copy, later uploads win where they overlap. Small
+// copies share pages, copies larger than what is left of a page or of the frame's byte budget are
+// split and continue in later frames. Requests complete in the order they were made, a readback after
+// an upload of the same range sees the uploaded data.
+// Pages are owned by a frame until its fence value completed. Driven by a single thread.
+class Copy_Scheduler
+{
+public:
+    Copy_Scheduler(
+        const Copy_Scheduler_Settings& settings,
+        std::span<uint8_t* const> upload_pages, std::span<uint8_t* const> readback_pages)
+        : m_settings(settings)
+        , m_upload_pages(upload_pages.begin(), upload_pages.end())
+        , m_readback_pages(readback_pages.begin(), readback_pages.end())
+    {
+        for (uint32_t i = uint32_t(upload_pages.size()); i > 0; --i)
+        {
+            m_free_upload_pages.push_back(i - 1);
+        }
+        for (uint32_t i = uint32_t(readback_pages.size()); i > 0; --i)
+        {
+            m_free_readback_pages.push_back(i - 1);
+        }
+    }
+
+    Copy_Scheduler(const Copy_Scheduler&) = delete;
+    Copy_Scheduler& operator=(const Copy_Scheduler&) = delete;
+
+    // The data is copied, the caller's memory may be reused right away.
+    void upload_buffer(void* resource, uint64_t offset, std::span<const uint8_t> data)
+    {
+        if (data.empty())
+        {
+            return;
+        }
+        auto size = uint64_t(data.size());
+        m_requests.push_back({
+            .kind = Copy_Kind::Buffer_Upload,
+            .resource = resource,
+            .piece = { .offset = offset, .size = size, .sequence = m_request_count, .data_offset = append_data(data) }
+        });
+        m_request_count += 1;
+        m_pending_bytes += size;
+    }
+
+    // `data` holds the block rows of the subresource tightly packed, desc.row_size bytes each.
+    void upload_texture(void* resource, uint32_t subresource, const Copy_Texture_Desc& desc, std::span<const uint8_t> data)
+    {
+        if (desc.block_size == 0 || data.size() != uint64_t(desc.row_size) * desc.get_row_count()
+            || desc.get_row_pitch() > m_settings.page_size)
+        {
+            throw std::exception();
+        }
+        if (data.empty())
+        {
+            return;
+        }
+        auto size = uint64_t(data.size());
+        m_requests.push_back({
+            .kind = Copy_Kind::Texture_Upload,
+            .resource = resource,
+            .piece = { .offset = 0, .size = size, .sequence = m_request_count, .data_offset = append_data(data) },
+            .subresource = subresource,
+            .texture = desc
+        });
+        m_request_count += 1;
+        m_pending_bytes += size;
+    }
+
+    void readback_buffer(void* resource, uint64_t offset, uint64_t size, Copy_Readback_Callback callback)
+    {
+        if (size == 0)
+        {
+            return;
+        }
+        m_requests.push_back({
+            .kind = Copy_Kind::Buffer_Readback,
+            .resource = resource,
+            .piece = { .offset = offset, .size = size, .sequence = m_request_count, .data_offset = 0 },
+            .callback = std::move(callback)
+        });
+        m_request_count += 1;
+        m_pending_bytes += size;
+    }
+
+    // Coalesces the requests made since the last call and fills staging pages with as much of the queued
+    // work as the byte budget and the free pages allow. Upload data is in the pages when this returns.
+    std::span<const Scheduled_Copy> build_frame()
+    {
+        coalesce();
+        m_copies.clear();
+        m_frame_bytes = 0;
+        m_frame_segment = ~0ull;
+        while (!m_runs.empty() && schedule(m_runs.front()))
+        {
+            m_runs.pop_front();
+        }
+        m_copy_count += m_copies.size();
+        return m_copies;
+    }
+
+    // The copies of the last build_frame() are complete once `fence_value` completed.
+    void end_frame(uint64_t fence_value)
+    {
+        m_upload_cursor = {};
+        m_readback_cursor = {};
+        if (m_frame.upload_pages.empty() && m_frame.readback_pages.empty())
+        {
+            return;
+        }
+        m_frame.fence_value = fence_value;
+        m_frames.push_back(std::move(m_frame));
+        m_frame = {};
+    }
+
+    // Hands completed readbacks to their callbacks and frees the pages of completed frames.
+    void retire(uint64_t completed_fence_value)
+    {
+        while (!m_frames.empty() && m_frames.front().fence_value <= completed_fence_value)
+        {
+            auto& frame = m_frames.front();
+            for (const auto& chunk : frame.readbacks)
+            {
+                auto chunk_data = m_readback_pages[chunk.page] + chunk.page_offset;
+                const auto& pieces = chunk.run->pieces;
+                for (uint32_t i = 0; i < pieces.size(); ++i)
+                {
+                    auto begin = std::max(pieces[i].offset, chunk.begin);
+                    auto end = std::min(pieces[i].offset + pieces[i].size, chunk.end);
+                    if (begin < end && chunk.run->callbacks[i])
+                    {
+                        chunk.run->callbacks[i](begin - pieces[i].offset, { chunk_data + (begin - chunk.begin), size_t(end - begin) });
+                    }
+                }
+            }
+            m_free_upload_pages.insert(m_free_upload_pages.end(), frame.upload_pages.begin(), frame.upload_pages.end());
+            m_free_readback_pages.insert(m_free_readback_pages.end(), frame.readback_pages.begin(), frame.readback_pages.end());
+            m_frames.pop_front();
+        }
+    }
+
+    bool is_idle() const { return m_requests.empty() && m_runs.empty() && m_frames.empty(); }
+    // Bytes requested but not yet scheduled. Overlapping requests count once per request.
+    uint64_t get_pending_bytes() const { return m_pending_bytes; }
+    uint64_t get_frame_bytes() const { return m_frame_bytes; }
+    uint64_t get_request_count() const { return m_request_count; }
+    uint64_t get_copy_count() const { return m_copy_count; }
+    const Copy_Scheduler_Settings& get_settings() const { return m_settings; }
+
+private:
+    struct Piece
+    {
+        uint64_t offset;
+        uint64_t size;
+        uint64_t sequence;
+        // Upload data in the run's data.
+        uint64_t data_offset;
+    };
+
+    struct Request
+    {
+        Copy_Kind kind;
+        void* resource;
+        Piece piece;
+        uint32_t subresource = 0;
+        Copy_Texture_Desc texture = {};
+        Copy_Readback_Callback callback = {};
+    };
+
+    // Coalesced requests. Buffers count bytes in [begin, end), textures block rows.
+    struct Run
+    {
+        Copy_Kind kind;
+        void* resource;
+        uint64_t begin;
+        uint64_t end;
+        uint64_t next;
+        uint64_t requested_bytes;
+        // Runs of one segment never overlap each other.
+        uint64_t segment;
+        uint32_t subresource;
+        Copy_Texture_Desc texture;
+        // Upload data of all runs coalesced together.
+        std::shared_ptr<const std::vector<uint8_t>> data;
+        // Sorted by offset. Uploads that overlap are sorted by request order instead, so later ones win.
+        std::vector<Piece> pieces = {};
+        bool has_overlap = false;
+        // Readbacks only, one per piece.
+        std::vector<Copy_Readback_Callback> callbacks = {};
+    };
+
+    struct Sort_Key
+    {
+        void* resource;
+        uint64_t offset;
+        uint32_t index;
+    };
+
+    struct Page_Cursor
+    {
+        uint32_t page = INVALID_STAGING_PAGE;
+        uint64_t offset = 0;
+    };
+
+    struct Readback_Chunk
+    {
+        std::shared_ptr<const Run> run;
+        uint64_t begin;
+        uint64_t end;
+        uint32_t page;
+        uint64_t page_offset;
+    };
+
+    struct Frame
+    {
+        uint64_t fence_value = 0;
+        std::vector<uint32_t> upload_pages;
+        std::vector<uint32_t> readback_pages;
+        std::vector<Readback_Chunk> readbacks;
+    };
+
+    // Requests of the same kind in a row are coalesced per resource, a change of kind starts over so
+    // uploads and readbacks of the same range keep their order.
+    void coalesce()
+    {
+        auto data = std::make_shared<const std::vector<uint8_t>>(std::move(m_request_data));
+        m_request_data = {};
+        const auto& order = m_order;
+        for (uint32_t first = 0; first < m_requests.size();)
+        {
+            auto kind = m_requests[first].kind;
+            auto last = first + 1;
+            while (last < m_requests.size() && m_requests[last].kind == kind)
+            {
+                last += 1;
+            }
+            if (kind == Copy_Kind::Texture_Upload)
+            {
+                for (auto i = first; i < last; ++i)
+                {
+                    auto& request = m_requests[i];
+                    auto run = std::make_shared<Run>(Run {
+                        .kind = kind,
+                        .resource = request.resource,
+                        .begin = 0,
+                        .end = request.texture.get_row_count(),
+                        .next = 0,
+                        .requested_bytes = request.piece.size,
+                        // Texture uploads may target the same subresource, each is a segment of its own.
+                        .segment = m_segment_count++,
+                        .subresource = request.subresource,
+                        .texture = request.texture,
+                        .data = data
+                    });
+                    run->pieces.push_back(request.piece);
+                    m_runs.push_back(std::move(run));
+                }
+                first = last;
+                continue;
+            }
+            group_requests(first, last);
+            std::shared_ptr<Run> run;
+            for (const auto& key : order)
+            {
+                auto& request = m_requests[key.index];
+                auto end = request.piece.offset + request.piece.size;
+                if (run && run->resource == request.resource && request.piece.offset <= run->end)
+                {
+                    run->has_overlap = run->has_overlap || request.piece.offset < run->end;
+                    run->end = std::max(run->end, end);
+                }
+                else
+                {
+                    if (run)
+                    {
+                        finish_run(std::move(run));
+                    }
+                    run = std::make_shared<Run>(Run {
+                        .kind = kind,
+                        .resource = request.resource,
+                        .begin = request.piece.offset,
+                        .end = end,
+                        .next = request.piece.offset,
+                        .requested_bytes = 0,
+                        .segment = m_segment_count,
+                        .subresource = 0,
+                        .texture = {},
+                        .data = data
+                    });
+                }
+                run->requested_bytes += request.piece.size;
+                run->pieces.push_back(request.piece);
+                if (kind == Copy_Kind::Buffer_Readback)
+                {
+                    run->callbacks.push_back(std::move(request.callback));
+                }
+            }
+            finish_run(std::move(run));
+            m_segment_count += 1;
+            first = last;
+        }
+        m_requests.clear();
+    }
+
+    // Orders the requests [first, last) by resource and offset into m_order. Requests are bucketed per
+    // resource in request order, streamed requests to one resource usually arrive sorted already and
+    // skip the sort.
+    void group_requests(uint32_t first, uint32_t last)
+    {
+        m_group_indices.clear();
+        m_group_offsets.clear();
+        m_request_groups.resize(last - first);
+        void* last_resource = nullptr;
+        uint32_t group = 0;
+        for (auto i = first; i < last; ++i)
+        {
+            auto resource = m_requests[i].resource;
+            if (i == first || resource != last_resource)
+            {
+                group = m_group_indices.try_emplace(resource, uint32_t(m_group_offsets.size())).first->second;
+                if (group == m_group_offsets.size())
+                {
+                    m_group_offsets.push_back(0);
+                }
+                last_resource = resource;
+            }
+            m_request_groups[i - first] = group;
+            m_group_offsets[group] += 1;
+        }
+        uint32_t offset = 0;
+        for (auto& group_offset : m_group_offsets)
+        {
+            auto count = group_offset;
+            group_offset = offset;
+            offset += count;
+        }
+        m_order.resize(last - first);
+        for (auto i = first; i < last; ++i)
+        {
+            auto& group_offset = m_group_offsets[m_request_groups[i - first]];
+            m_order[group_offset++] = { .resource = m_requests[i].resource, .offset = m_requests[i].piece.offset, .index = i };
+        }
+        auto by_offset = [](const Sort_Key& a, const Sort_Key& b) {
+            return a.offset != b.offset ? a.offset < b.offset : a.index < b.index;
+        };
+        uint32_t group_begin = 0;
+        for (auto group_end : m_group_offsets)
+        {
+            auto begin = m_order.begin() + group_begin;
+            auto end = m_order.begin() + group_end;
+            if (!std::is_sorted(begin, end, by_offset))
+            {
+                std::sort(begin, end, by_offset);
+            }
+            group_begin = group_end;
+        }
+    }
+
+    uint64_t append_data(std::span<const uint8_t> data)
+    {
+        auto offset = uint64_t(m_request_data.size());
+        m_request_data.insert(m_request_data.end(), data.begin(), data.end());
+        return offset;
+    }
+
+    void finish_run(std::shared_ptr<Run> run)
+    {
+        if (run->has_overlap && run->kind == Copy_Kind::Buffer_Upload)
+        {
+            std::sort(run->pieces.begin(), run->pieces.end(), [](const Piece& a, const Piece& b) {
+                return a.sequence < b.sequence;
+            });
+        }
+        m_runs.push_back(std::move(run));
+    }
+
+    // Schedules as much of `run` as fits into this frame. Returns true once all of it is scheduled.
+    bool schedule(const std::shared_ptr<Run>& run_pointer)
+    {
+        auto& run = *run_pointer;
+        bool is_texture = run.kind == Copy_Kind::Texture_Upload;
+        bool is_upload = run.kind != Copy_Kind::Buffer_Readback;
+        auto& cursor = is_upload ? m_upload_cursor : m_readback_cursor;
+        auto alignment = is_texture ? COPY_TEXTURE_PLACEMENT_ALIGNMENT : COPY_BUFFER_PLACEMENT_ALIGNMENT;
+        // Bytes per unit of the run, block rows for textures.
+        uint64_t unit_size = is_texture ? run.texture.get_row_pitch() : 1;
+        while (run.next < run.end)
+        {
+            // The first copy of a frame always gets at least one unit so the queue keeps moving.
+            auto budget = m_settings.max_bytes_per_frame > m_frame_bytes ? m_settings.max_bytes_per_frame - m_frame_bytes : 0;
+            auto budget_units = m_frame_bytes == 0 ? std::max<uint64_t>(budget / unit_size, 1) : budget / unit_size;
+            if (budget_units == 0)
+            {
+                return false;
+            }
+            auto remaining_units = run.end - run.next;
+            auto page_offset = (cursor.offset + alignment - 1) & ~(alignment - 1);
+            auto page_units = cursor.page == INVALID_STAGING_PAGE || page_offset >= m_settings.page_size
+                ? 0
+                : (m_settings.page_size - page_offset) / unit_size;
+            // Start a new page when this one is full or when the copy would fit into a fresh one unsplit.
+            // Copies larger than a page fill up the rest of the current one first.
+            auto fresh_page_units = m_settings.page_size / unit_size;
+            auto needed_units = std::min(remaining_units, budget_units);
+            if (page_units == 0 || (page_units < needed_units && needed_units <= fresh_page_units))
+            {
+                auto& free_pages = is_upload ? m_free_upload_pages : m_free_readback_pages;
+                if (free_pages.empty())
+                {
+                    return false;
+                }
+                cursor = { .page = free_pages.back(), .offset = 0 };
+                free_pages.pop_back();
+                (is_upload ? m_frame.upload_pages : m_frame.readback_pages).push_back(cursor.page);
+                page_offset = 0;
+                page_units = fresh_page_units;
+            }
+            auto units = std::min({ remaining_units, budget_units, page_units });
+            auto bytes = units * unit_size;
+            if (is_upload)
+            {
+                write_upload(run, run.next, units, m_upload_pages[cursor.page] + page_offset);
+            }
+            else
+            {
+                m_frame.readbacks.push_back({
+                    .run = run_pointer,
+                    .begin = run.next,
+                    .end = run.next + units,
+                    .page = cursor.page,
+                    .page_offset = page_offset
+                });
+            }
+            m_copies.push_back({
+                .kind = run.kind,
+                .resource = run.resource,
+                .page = cursor.page,
+                .page_offset = page_offset,
+                .offset = run.next,
+                .size = units,
+                .subresource = run.subresource,
+                .texture = run.texture,
+                .needs_barrier = m_frame_segment != ~0ull && m_frame_segment != run.segment
+            });
+            m_frame_segment = run.segment;
+            cursor.offset = page_offset + bytes;
+            run.next += units;
+            m_frame_bytes += bytes;
+        }
+        m_pending_bytes -= run.requested_bytes;
+        return true;
+    }
+
+    void write_upload(const Run& run, uint64_t first, uint64_t count, uint8_t* destination)
+    {
+        const auto& pieces = run.pieces;
+        if (run.kind == Copy_Kind::Texture_Upload)
+        {
+            auto row_size = run.texture.row_size;
+            auto row_pitch = run.texture.get_row_pitch();
+            for (uint64_t row = 0; row < count; ++row)
+            {
+                memcpy(destination + row * row_pitch, run.data->data() + pieces[0].data_offset + (first + row) * row_size, row_size);
+            }
+            return;
+        }
+        auto end = first + count;
+        // Without overlaps the pieces are sorted by offset, skip the ones of earlier chunks.
+        auto piece_begin = pieces.begin();
+        if (!run.has_overlap)
+        {
+            piece_begin = std::lower_bound(pieces.begin(), pieces.end(), first, [](const Piece& piece, uint64_t offset) {
+                return piece.offset + piece.size <= offset;
+            });
+        }
+        for (auto piece = piece_begin; piece != pieces.end(); ++piece)
+        {
+            if (!run.has_overlap && piece->offset >= end)
+            {
+                break;
+            }
+            auto begin = std::max(piece->offset, first);
+            auto piece_end = std::min(piece->offset + piece->size, end);
+            if (begin < piece_end)
+            {
+                memcpy(destination + (begin - first), run.data->data() + piece->data_offset + (begin - piece->offset), size_t(piece_end - begin));
+            }
+        }
+    }
+
+    Copy_Scheduler_Settings m_settings;
+    std::vector<uint8_t*> m_upload_pages;
+    std::vector<uint8_t*> m_readback_pages;
+    std::vector<uint32_t> m_free_upload_pages;
+    std::vector<uint32_t> m_free_readback_pages;
+    std::vector<Request> m_requests;
+    std::vector<uint8_t> m_request_data;
+    std::vector<Sort_Key> m_order;
+    std::unordered_map<void*, uint32_t> m_group_indices;
+    std::vector<uint32_t> m_group_offsets;
+    std::vector<uint32_t> m_request_groups;
+    std::deque<std::shared_ptr<Run>> m_runs;
+    std::vector<Scheduled_Copy> m_copies;
+    Page_Cursor m_upload_cursor;
+    Page_Cursor m_readback_cursor;
+    Frame m_frame;
+    std::deque<Frame> m_frames;
+    uint64_t m_pending_bytes = 0;
+    uint64_t m_frame_bytes = 0;
+    uint64_t m_segment_count = 0;
+    uint64_t m_frame_segment = ~0ull;
+    uint64_t m_request_count = 0;
+    uint64_t m_copy_count = 0;
+};
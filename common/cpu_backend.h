@@ -0,0 +1,252 @@
+#pragma once
+
+#include "command_stream.h"
+#include "compute_dispatch.h"
+#include "job_system.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <span>
+#include <vector>
+
+// Linear CPU memory standing in for a buffer (height 1, texel size 1) or a single subresource 2D texture.
+struct Cpu_Resource
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t texel_size;
+    std::vector<uint8_t> data;
+
+    uint32_t get_row_pitch() const { return width * texel_size; }
+    uint8_t* get_row(uint32_t y) { return data.data() + size_t(y) * get_row_pitch(); }
+    const uint8_t* get_row(uint32_t y) const { return data.data() + size_t(y) * get_row_pitch(); }
+};
+
+inline Cpu_Resource make_cpu_buffer(uint32_t size)
+{
+    return { .width = size, .height = 1, .texel_size = 1, .data = std::vector<uint8_t>(size) };
+}
+
+inline Cpu_Resource make_cpu_texture_2d(uint32_t width, uint32_t height, uint32_t texel_size)
+{
+    return {
+        .width = width,
+        .height = height,
+        .texel_size = texel_size,
+        .data = std::vector<uint8_t>(size_t(width) * height * texel_size)
+    };
+}
+
+// Shader visible heap, kernels index it like ResourceDescriptorHeap[].
+struct Cpu_Descriptor_Heap
+{
+    std::vector<Cpu_Resource*> descriptors;
+};
+
+static constexpr uint32_t MAX_CPU_ROOT_PARAMETERS = 4;
+static constexpr uint32_t MAX_CPU_ROOT_CONSTANTS = 64;
+
+// What a kernel sees of the pipeline state at its dispatch.
+struct Cpu_Kernel_Context
+{
+    const std::array<std::array<uint32_t, MAX_CPU_ROOT_CONSTANTS>, MAX_CPU_ROOT_PARAMETERS>* root_constants;
+    const Cpu_Descriptor_Heap* descriptor_heap;
+    Thread_Group_Size group_size;
+    Dispatch_Size dispatch_size;
+
+    template<typename T>
+    T get_root_constants(uint32_t root_parameter_index) const
+    {
+        static_assert(sizeof(T) <= MAX_CPU_ROOT_CONSTANTS * sizeof(uint32_t));
+        T constants;
+        memcpy(&constants, (*root_constants)[root_parameter_index].data(), sizeof(T));
+        return constants;
+    }
+
+    // Null for out of range indices, where the GPU would be undefined.
+    Cpu_Resource* get_descriptor(uint32_t index) const
+    {
+        if (!descriptor_heap || index >= descriptor_heap->descriptors.size())
+        {
+            return nullptr;
+        }
+        return descriptor_heap->descriptors[index];
+    }
+};
+
+// CPU version of a compute shader, called once per thread group. Groups run concurrently.
+struct Cpu_Kernel
+{
+    Thread_Group_Size group_size;
+    void (*function)(const Cpu_Kernel_Context& context, uint32_t group_x, uint32_t group_y, uint32_t group_z);
+};
+
+// Executes a command stream on the CPU, a visitor for Command_Stream_Reader. `objects[id - 1]` is the
+// Cpu_Resource, Cpu_Descriptor_Heap or Cpu_Kernel (for pipeline states) of every id of the stream.
+// Dispatches spread their groups over the job system and finish before the next command, so barriers
+// have nothing left to do. Root signatures only reset the root constants.
+class Cpu_Backend
+{
+public:
+    Cpu_Backend(Job_System& job_system, std::span<void* const> objects)
+        : m_job_system(job_system)
+        , m_objects(objects)
+    {}
+
+    void begin_list(uint32_t) {}
+    void end_list() {}
+
+    void set_descriptor_heaps(std::span<const uint32_t> heaps)
+    {
+        m_descriptor_heap = heaps.empty() ? nullptr : get<Cpu_Descriptor_Heap>(heaps[0]);
+    }
+
+    void set_root_signature(Command_Stream_Bind_Point bind_point, uint32_t)
+    {
+        if (bind_point == Command_Stream_Bind_Point::Compute)
+        {
+            m_root_constants = {};
+        }
+    }
+
+    void set_pipeline_state(uint32_t pipeline_state) { m_kernel = get<Cpu_Kernel>(pipeline_state); }
+
+    // Graphics root constants have no consumer here.
+    void set_root_constants(
+        Command_Stream_Bind_Point bind_point, uint32_t root_parameter_index,
+        std::span<const uint32_t> values, uint32_t offset)
+    {
+        if (root_parameter_index >= MAX_CPU_ROOT_PARAMETERS
+            || offset > MAX_CPU_ROOT_CONSTANTS || values.size() > MAX_CPU_ROOT_CONSTANTS - offset)
+        {
+            throw std::exception();
+        }
+        if (bind_point == Command_Stream_Bind_Point::Compute)
+        {
+            std::copy(values.begin(), values.end(), m_root_constants[root_parameter_index].begin() + offset);
+        }
+    }
+
+    void dispatch(uint32_t x, uint32_t y, uint32_t z)
+    {
+        if (!m_kernel)
+        {
+            throw std::exception();
+        }
+        Cpu_Kernel_Context context = {
+            .root_constants = &m_root_constants,
+            .descriptor_heap = m_descriptor_heap,
+            .group_size = m_kernel->group_size,
+            .dispatch_size = { x, y, z }
+        };
+        auto group_count = uint64_t(x) * y * z;
+        if (group_count == 0)
+        {
+            return;
+        }
+        // A few batches per thread keeps stealing effective without paying a job per group.
+        auto batch_count = std::min<uint64_t>(group_count, uint64_t(m_job_system.get_thread_count()) * 4);
+        auto batch_size = (group_count + batch_count - 1) / batch_count;
+        auto function = m_kernel->function;
+        Job_Counter counter;
+        for (uint64_t first = 0; first < group_count; first += batch_size)
+        {
+            auto last = std::min(first + batch_size, group_count);
+            m_job_system.submit([&context, function, first, last, x, y]() {
+                for (auto group = first; group < last; ++group)
+                {
+                    function(context, uint32_t(group % x), uint32_t(group / x % y), uint32_t(group / x / y));
+                }
+            }, &counter);
+        }
+        m_job_system.wait(counter);
+    }
+
+    void copy_buffer_region(uint32_t dst, uint64_t dst_offset, uint32_t src, uint64_t src_offset, uint64_t size)
+    {
+        auto& dst_resource = *get<Cpu_Resource>(dst);
+        const auto& src_resource = *get<Cpu_Resource>(src);
+        if (dst_offset > dst_resource.data.size() || size > dst_resource.data.size() - dst_offset
+            || src_offset > src_resource.data.size() || size > src_resource.data.size() - src_offset)
+        {
+            throw std::exception();
+        }
+        memmove(dst_resource.data.data() + dst_offset, src_resource.data.data() + src_offset, size_t(size));
+    }
+
+    void copy_resource(uint32_t dst, uint32_t src)
+    {
+        auto& dst_resource = *get<Cpu_Resource>(dst);
+        const auto& src_resource = *get<Cpu_Resource>(src);
+        if (dst_resource.data.size() != src_resource.data.size())
+        {
+            throw std::exception();
+        }
+        dst_resource.data = src_resource.data;
+    }
+
+    // Subresource 0 of a 2D texture to or from a placed footprint, the footprint's format has to match the
+    // texture's texel size.
+    void copy_texture_region(
+        const Command_Stream_Texture_Location& dst, uint32_t x, uint32_t y, uint32_t z,
+        const Command_Stream_Texture_Location& src, const Command_Stream_Box* box)
+    {
+        auto& dst_resource = *get<Cpu_Resource>(dst.resource);
+        const auto& src_resource = *get<Cpu_Resource>(src.resource);
+        auto get_extent = [](const Command_Stream_Texture_Location& location, const Cpu_Resource& resource) {
+            return location.type == 0
+                ? std::array<uint32_t, 3> { resource.width, resource.height, resource.get_row_pitch() }
+                : std::array<uint32_t, 3> { location.width, location.height, location.row_pitch };
+        };
+        auto dst_extent = get_extent(dst, dst_resource);
+        auto src_extent = get_extent(src, src_resource);
+        auto texel_size = dst.type == 0 ? dst_resource.texel_size : src_resource.texel_size;
+        Command_Stream_Box src_box = box ? *box : Command_Stream_Box { 0, 0, 0, src_extent[0], src_extent[1], 1 };
+        if (z != 0 || src_box.front != 0 || src_box.back != 1
+            || (dst.type == 0 && dst.subresource_index != 0) || (src.type == 0 && src.subresource_index != 0)
+            || src_box.left > src_box.right || src_box.top > src_box.bottom
+            || src_box.right > src_extent[0] || src_box.bottom > src_extent[1]
+            || x > dst_extent[0] || src_box.right - src_box.left > dst_extent[0] - x
+            || y > dst_extent[1] || src_box.bottom - src_box.top > dst_extent[1] - y)
+        {
+            throw std::exception();
+        }
+        auto row_size = size_t(src_box.right - src_box.left) * texel_size;
+        for (uint32_t row = 0; row < src_box.bottom - src_box.top; ++row)
+        {
+            auto dst_offset = dst.offset + uint64_t(y + row) * dst_extent[2] + uint64_t(x) * texel_size;
+            auto src_offset = src.offset + uint64_t(src_box.top + row) * src_extent[2] + uint64_t(src_box.left) * texel_size;
+            if (dst_offset + row_size > dst_resource.data.size() || src_offset + row_size > src_resource.data.size())
+            {
+                throw std::exception();
+            }
+            memmove(dst_resource.data.data() + dst_offset, src_resource.data.data() + src_offset, row_size);
+        }
+    }
+
+    void begin_barrier(uint32_t) {}
+    void barrier_group(Command_Stream_Barrier_Type, uint32_t) {}
+    void barrier(const Command_Stream_Global_Barrier&) {}
+    void barrier(const Command_Stream_Texture_Barrier&) {}
+    void barrier(const Command_Stream_Buffer_Barrier&) {}
+
+private:
+    template<typename T>
+    T* get(uint32_t id) const
+    {
+        if (id == 0 || id > m_objects.size())
+        {
+            throw std::exception();
+        }
+        return static_cast<T*>(m_objects[id - 1]);
+    }
+
+    Job_System& m_job_system;
+    std::span<void* const> m_objects;
+    const Cpu_Descriptor_Heap* m_descriptor_heap = nullptr;
+    const Cpu_Kernel* m_kernel = nullptr;
+    std::array<std::array<uint32_t, MAX_CPU_ROOT_CONSTANTS>, MAX_CPU_ROOT_PARAMETERS> m_root_constants = {};
+};
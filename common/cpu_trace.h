@@ -0,0 +1,264 @@
+#pragma once
+
+#include "chrome_trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define CPU_TRACE_USE_RDTSC 1
+#else
+#define CPU_TRACE_USE_RDTSC 0
+#endif
+
+// Raw timestamp of trace events. The TSC on x86-64, assumed invariant, steady clock nanoseconds elsewhere.
+inline uint64_t get_cpu_trace_ticks()
+{
+#if CPU_TRACE_USE_RDTSC
+    return __rdtsc();
+#else
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+struct Cpu_Trace_Event
+{
+    // Has to outlive the trace, the scope macros pass string literals.
+    const char* name;
+    uint64_t begin;
+    uint64_t end;
+};
+
+// Single producer, single consumer ring of events. The owning thread pushes, the exporter drains.
+// A full ring drops new events instead of blocking or overwriting ones the exporter may be reading.
+class Cpu_Trace_Ring
+{
+public:
+    explicit Cpu_Trace_Ring(uint32_t capacity_log2)
+        : m_mask((1u << capacity_log2) - 1)
+        , m_events(std::make_unique<Cpu_Trace_Event[]>(size_t(1) << capacity_log2))
+    {}
+
+    void push(const Cpu_Trace_Event& event)
+    {
+        auto head = m_head.load(std::memory_order_relaxed);
+        // The exporter's tail is only read again when the ring looks full, not once per event.
+        if (head - m_cached_tail > m_mask)
+        {
+            m_cached_tail = m_tail.load(std::memory_order_acquire);
+            if (head - m_cached_tail > m_mask)
+            {
+                m_dropped_count.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+        m_events[head & m_mask] = event;
+        m_head.store(head + 1, std::memory_order_release);
+    }
+
+    template<typename Function>
+    void drain(Function&& function)
+    {
+        auto tail = m_tail.load(std::memory_order_relaxed);
+        auto head = m_head.load(std::memory_order_acquire);
+        for (; tail != head; ++tail)
+        {
+            function(m_events[tail & m_mask]);
+        }
+        m_tail.store(tail, std::memory_order_release);
+    }
+
+    uint64_t get_dropped_count() const { return m_dropped_count.load(std::memory_order_relaxed); }
+
+private:
+    uint64_t m_mask;
+    std::unique_ptr<Cpu_Trace_Event[]> m_events;
+    alignas(64) std::atomic<uint64_t> m_head = 0;
+    uint64_t m_cached_tail = 0;
+    alignas(64) std::atomic<uint64_t> m_tail = 0;
+    std::atomic<uint64_t> m_dropped_count = 0;
+};
+
+// Owns one Cpu_Trace_Ring per thread that ever traced. Rings register on first use, which is the only
+// locked path, and outlive their threads so late exports still see everything.
+class Cpu_Tracer
+{
+public:
+    static constexpr uint32_t RING_CAPACITY_LOG2 = 16;
+
+    static Cpu_Tracer& get()
+    {
+        static Cpu_Tracer tracer;
+        return tracer;
+    }
+
+    static void record(const char* name, uint64_t begin, uint64_t end) { get_thread_ring().push({ name, begin, end }); }
+
+    // Static so scopes skip get()'s initialization guard. Disabled tracing costs one relaxed load per scope.
+    static void set_enabled(bool enabled) { is_enabled_flag.store(enabled, std::memory_order_relaxed); }
+    static bool is_enabled() { return is_enabled_flag.load(std::memory_order_relaxed); }
+
+    // Ring of the calling thread, registered with the tracer on the thread's first call.
+    static Cpu_Trace_Ring& get_thread_ring() { return get_registered_thread_ring().ring; }
+
+    // Names the calling thread in exported traces.
+    void set_thread_name(std::string_view name)
+    {
+        auto& thread_ring = get_registered_thread_ring();
+        std::lock_guard lock(m_mutex);
+        thread_ring.name = name;
+    }
+
+    // Moves all buffered events into `trace`, one trace thread per ring.
+    void export_trace(Chrome_Trace& trace, uint32_t pid)
+    {
+        std::lock_guard lock(m_mutex);
+        auto calibration = get_calibration();
+        for (uint32_t i = 0; i < m_rings.size(); ++i)
+        {
+            auto& thread_ring = *m_rings[i];
+            if (!thread_ring.is_named_in_trace)
+            {
+                trace.set_thread_name(pid, i, thread_ring.name);
+                thread_ring.is_named_in_trace = true;
+            }
+            thread_ring.ring.drain([&](const Cpu_Trace_Event& event) {
+                auto begin_us = calibration.to_time_us(event.begin);
+                trace.add_complete(
+                    event.name, "cpu", pid, i, begin_us, calibration.to_time_us(event.end) - begin_us);
+            });
+        }
+    }
+
+    // Throws away all buffered events, keeps rings from filling up while nothing is exported.
+    void discard()
+    {
+        std::lock_guard lock(m_mutex);
+        for (auto& thread_ring : m_rings)
+        {
+            thread_ring->ring.drain([](const Cpu_Trace_Event&) {});
+        }
+    }
+
+    uint64_t get_dropped_count()
+    {
+        std::lock_guard lock(m_mutex);
+        uint64_t dropped_count = 0;
+        for (const auto& thread_ring : m_rings)
+        {
+            dropped_count += thread_ring->ring.get_dropped_count();
+        }
+        return dropped_count;
+    }
+
+private:
+    struct Thread_Ring
+    {
+        Cpu_Trace_Ring ring = Cpu_Trace_Ring(RING_CAPACITY_LOG2);
+        std::string name;
+        bool is_named_in_trace = false;
+    };
+
+    // Maps ticks linearly onto get_trace_time_us(), measured between construction and the export.
+    struct Calibration
+    {
+        uint64_t ticks;
+        double time_us;
+        double us_per_tick;
+
+        double to_time_us(uint64_t event_ticks) const
+        {
+            return time_us + double(int64_t(event_ticks - ticks)) * us_per_tick;
+        }
+    };
+
+    Cpu_Tracer()
+        : m_start_ticks(get_cpu_trace_ticks())
+        , m_start_time_us(get_trace_time_us())
+    {}
+
+    static Thread_Ring& get_registered_thread_ring()
+    {
+        if (!thread_ring)
+        {
+            auto& tracer = get();
+            std::lock_guard lock(tracer.m_mutex);
+            tracer.m_rings.push_back(std::make_unique<Thread_Ring>());
+            thread_ring = tracer.m_rings.back().get();
+            thread_ring->name = "Thread " + std::to_string(tracer.m_rings.size() - 1);
+        }
+        return *thread_ring;
+    }
+
+    Calibration get_calibration() const
+    {
+        auto ticks = get_cpu_trace_ticks();
+        auto time_us = get_trace_time_us();
+#if CPU_TRACE_USE_RDTSC
+        auto us_per_tick = ticks > m_start_ticks ? (time_us - m_start_time_us) / double(ticks - m_start_ticks) : 0.0;
+#else
+        auto us_per_tick = 1e-3;
+#endif
+        return { ticks, time_us, us_per_tick };
+    }
+
+    // Constant initialized, reading them needs no guard.
+    static inline std::atomic<bool> is_enabled_flag = true;
+    static inline thread_local Thread_Ring* thread_ring = nullptr;
+
+    uint64_t m_start_ticks;
+    double m_start_time_us;
+    std::mutex m_mutex;
+    std::vector<std::unique_ptr<Thread_Ring>> m_rings;
+};
+
+// Records the time between construction and destruction on the calling thread's ring. The ring is looked
+// up once, when the scope starts.
+class Cpu_Trace_Scope
+{
+public:
+    explicit Cpu_Trace_Scope(const char* name)
+        : m_ring(Cpu_Tracer::is_enabled() ? &Cpu_Tracer::get_thread_ring() : nullptr)
+        , m_name(name)
+        , m_begin(m_ring ? get_cpu_trace_ticks() : 0)
+    {}
+
+    ~Cpu_Trace_Scope()
+    {
+        if (m_ring)
+        {
+            m_ring->push({ m_name, m_begin, get_cpu_trace_ticks() });
+        }
+    }
+
+    Cpu_Trace_Scope(const Cpu_Trace_Scope&) = delete;
+    Cpu_Trace_Scope& operator=(const Cpu_Trace_Scope&) = delete;
+
+private:
+    Cpu_Trace_Ring* m_ring;
+    const char* m_name;
+    uint64_t m_begin;
+};
+
+// Define CPU_TRACE_DISABLE to compile all scopes out.
+#ifndef CPU_TRACE_DISABLE
+#define CPU_TRACE_CONCAT_IMPL(a, b) a##b
+#define CPU_TRACE_CONCAT(a, b) CPU_TRACE_CONCAT_IMPL(a, b)
+#define CPU_TRACE_SCOPE(name) Cpu_Trace_Scope CPU_TRACE_CONCAT(cpu_trace_scope_, __LINE__)(name)
+#define CPU_TRACE_FUNCTION() CPU_TRACE_SCOPE(__func__)
+#else
+#define CPU_TRACE_SCOPE(name)
+#define CPU_TRACE_FUNCTION()
+#endif
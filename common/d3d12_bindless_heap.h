@@ -0,0 +1,46 @@
+#pragma once
+
+#include "d3d12_common.h"
+#include "descriptor_index_allocator.h"
+
+// Shader-visible descriptor heap whose slots are handed out through a Descriptor_Index_Allocator.
+// The handle's index is what shaders use to index ResourceDescriptorHeap/SamplerDescriptorHeap.
+// Loader threads that create many views allocate through their own Descriptor_Index_Cache on get_allocator().
+class D3D12_Bindless_Heap
+{
+public:
+    D3D12_Bindless_Heap(ID3D12Device* device, D3D12_DESCRIPTOR_HEAP_TYPE type, uint32_t capacity)
+        : m_allocator(capacity)
+    {
+        D3D12_DESCRIPTOR_HEAP_DESC heap_desc = {
+            .Type = type,
+            .NumDescriptors = capacity,
+            .Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE,
+            .NodeMask = 0
+        };
+        throw_if_failed(device->CreateDescriptorHeap(&heap_desc, IID_PPV_ARGS(&m_heap)));
+        m_cpu_start = m_heap->GetCPUDescriptorHandleForHeapStart();
+        m_gpu_start = m_heap->GetGPUDescriptorHandleForHeapStart();
+        m_increment = device->GetDescriptorHandleIncrementSize(type);
+    }
+
+    D3D12_CPU_DESCRIPTOR_HANDLE get_cpu_handle(Descriptor_Handle handle) const
+    {
+        return { m_cpu_start.ptr + SIZE_T(handle.index) * m_increment };
+    }
+
+    D3D12_GPU_DESCRIPTOR_HANDLE get_gpu_handle(Descriptor_Handle handle) const
+    {
+        return { m_gpu_start.ptr + UINT64(handle.index) * m_increment };
+    }
+
+    Descriptor_Index_Allocator& get_allocator() { return m_allocator; }
+    ID3D12DescriptorHeap* get() const { return m_heap.Get(); }
+
+private:
+    ComPtr<ID3D12DescriptorHeap> m_heap;
+    Descriptor_Index_Allocator m_allocator;
+    D3D12_CPU_DESCRIPTOR_HANDLE m_cpu_start = {};
+    D3D12_GPU_DESCRIPTOR_HANDLE m_gpu_start = {};
+    uint32_t m_increment = 0;
+};
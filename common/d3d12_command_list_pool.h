@@ -0,0 +1,71 @@
+#pragma once
+
+#include "d3d12_common.h"
+
+#include <vector>
+
+// Command allocators and lists per frame in flight and per recording thread.
+// A thread only ever touches its own slot, so acquiring a list needs no locking. Slots are indexed by
+// Job_System::get_thread_index(), which is unique per thread.
+class D3D12_Command_List_Pool
+{
+public:
+    D3D12_Command_List_Pool(
+        ID3D12Device4* device, D3D12_COMMAND_LIST_TYPE type, uint32_t thread_count, uint32_t frames_in_flight)
+        : m_device(device)
+        , m_type(type)
+        , m_thread_count(thread_count)
+        , m_contexts(size_t(thread_count) * frames_in_flight)
+    {
+        for (auto& context : m_contexts)
+        {
+            throw_if_failed(device->CreateCommandAllocator(type, IID_PPV_ARGS(&context.allocator)));
+        }
+    }
+
+    // The frame slot has to be retired, see Frame_Ring::begin_frame.
+    void begin_frame(uint32_t frame_index)
+    {
+        m_frame_index = frame_index;
+        for (uint32_t i = 0; i < m_thread_count; ++i)
+        {
+            auto& context = get_context(i);
+            throw_if_failed(context.allocator->Reset());
+            context.used_count = 0;
+        }
+    }
+
+    // Returns a list in the recording state, backed by the calling thread's allocator.
+    ID3D12GraphicsCommandList7* acquire(uint32_t thread_index)
+    {
+        auto& context = get_context(thread_index);
+        if (context.used_count == context.cmds.size())
+        {
+            ComPtr<ID3D12GraphicsCommandList7> cmd;
+            throw_if_failed(m_device->CreateCommandList1(0, m_type, D3D12_COMMAND_LIST_FLAG_NONE, IID_PPV_ARGS(&cmd)));
+            context.cmds.push_back(cmd);
+        }
+        auto cmd = context.cmds[context.used_count++].Get();
+        throw_if_failed(cmd->Reset(context.allocator.Get(), nullptr));
+        return cmd;
+    }
+
+private:
+    struct Thread_Context
+    {
+        ComPtr<ID3D12CommandAllocator> allocator;
+        std::vector<ComPtr<ID3D12GraphicsCommandList7>> cmds;
+        size_t used_count = 0;
+    };
+
+    Thread_Context& get_context(uint32_t thread_index)
+    {
+        return m_contexts[size_t(m_frame_index) * m_thread_count + thread_index];
+    }
+
+    ID3D12Device4* m_device;
+    D3D12_COMMAND_LIST_TYPE m_type;
+    uint32_t m_thread_count;
+    uint32_t m_frame_index = 0;
+    std::vector<Thread_Context> m_contexts;
+};
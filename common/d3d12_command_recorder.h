@@ -0,0 +1,488 @@
+#pragma once
+
+#include "command_stream.h"
+#include "d3d12_common.h"
+
+#include <algorithm>
+#include <array>
+#include <span>
+#include <vector>
+
+// Forwards calls to a command list and logs them into a Command_Stream_Writer. The member functions are
+// named after the command list's, so a recorder stands in for the list in Barrier_Batcher,
+// D3D12_Command_State_Cache and set_root_constants(). Calls that aren't covered here go to
+// get_command_list() directly and are not logged.
+template<typename Command_List = ID3D12GraphicsCommandList7>
+class D3D12_Command_Recorder
+{
+public:
+    explicit D3D12_Command_Recorder(Command_Stream_Objects& objects)
+        : m_objects(objects)
+    {}
+
+    // Without a writer the recorder only forwards. Ids are cached per list, forget() objects between lists.
+    void begin(Command_List* cmd, Command_Stream_Writer* writer)
+    {
+        m_cmd = cmd;
+        m_writer = writer;
+        m_id_cache = {};
+        if (m_writer)
+        {
+            m_writer->begin_list(uint32_t(cmd->GetType()));
+        }
+    }
+
+    void end()
+    {
+        if (m_writer)
+        {
+            m_writer->end_list();
+        }
+        m_writer = nullptr;
+    }
+
+    Command_List* get_command_list() const { return m_cmd; }
+    D3D12_COMMAND_LIST_TYPE GetType() const { return m_cmd->GetType(); }
+
+    void SetDescriptorHeaps(UINT heap_count, ID3D12DescriptorHeap* const* heaps)
+    {
+        m_cmd->SetDescriptorHeaps(heap_count, heaps);
+        if (m_writer)
+        {
+            std::array<uint32_t, 2> ids = {};
+            for (uint32_t i = 0; i < heap_count && i < ids.size(); ++i)
+            {
+                ids[i] = get_id(heaps[i]);
+            }
+            m_writer->set_descriptor_heaps({ ids.data(), std::min<size_t>(heap_count, ids.size()) });
+        }
+    }
+
+    void SetComputeRootSignature(ID3D12RootSignature* root_signature)
+    {
+        m_cmd->SetComputeRootSignature(root_signature);
+        if (m_writer)
+        {
+            m_writer->set_root_signature(Command_Stream_Bind_Point::Compute, get_id(root_signature));
+        }
+    }
+
+    void SetGraphicsRootSignature(ID3D12RootSignature* root_signature)
+    {
+        m_cmd->SetGraphicsRootSignature(root_signature);
+        if (m_writer)
+        {
+            m_writer->set_root_signature(Command_Stream_Bind_Point::Graphics, get_id(root_signature));
+        }
+    }
+
+    void SetPipelineState(ID3D12PipelineState* pipeline_state)
+    {
+        m_cmd->SetPipelineState(pipeline_state);
+        if (m_writer)
+        {
+            m_writer->set_pipeline_state(get_id(pipeline_state));
+        }
+    }
+
+    void SetComputeRoot32BitConstants(UINT root_parameter_index, UINT count, const void* data, UINT offset)
+    {
+        m_cmd->SetComputeRoot32BitConstants(root_parameter_index, count, data, offset);
+        if (m_writer)
+        {
+            m_writer->set_root_constants(Command_Stream_Bind_Point::Compute, root_parameter_index,
+                { static_cast<const uint32_t*>(data), count }, offset);
+        }
+    }
+
+    void SetGraphicsRoot32BitConstants(UINT root_parameter_index, UINT count, const void* data, UINT offset)
+    {
+        m_cmd->SetGraphicsRoot32BitConstants(root_parameter_index, count, data, offset);
+        if (m_writer)
+        {
+            m_writer->set_root_constants(Command_Stream_Bind_Point::Graphics, root_parameter_index,
+                { static_cast<const uint32_t*>(data), count }, offset);
+        }
+    }
+
+    void Dispatch(UINT x, UINT y, UINT z)
+    {
+        m_cmd->Dispatch(x, y, z);
+        if (m_writer)
+        {
+            m_writer->dispatch(x, y, z);
+        }
+    }
+
+    void CopyBufferRegion(ID3D12Resource* dst, UINT64 dst_offset, ID3D12Resource* src, UINT64 src_offset, UINT64 size)
+    {
+        m_cmd->CopyBufferRegion(dst, dst_offset, src, src_offset, size);
+        if (m_writer)
+        {
+            m_writer->copy_buffer_region(get_id(dst), dst_offset, get_id(src), src_offset, size);
+        }
+    }
+
+    void CopyResource(ID3D12Resource* dst, ID3D12Resource* src)
+    {
+        m_cmd->CopyResource(dst, src);
+        if (m_writer)
+        {
+            m_writer->copy_resource(get_id(dst), get_id(src));
+        }
+    }
+
+    void CopyTextureRegion(
+        const D3D12_TEXTURE_COPY_LOCATION* dst, UINT x, UINT y, UINT z,
+        const D3D12_TEXTURE_COPY_LOCATION* src, const D3D12_BOX* box)
+    {
+        m_cmd->CopyTextureRegion(dst, x, y, z, src, box);
+        if (m_writer)
+        {
+            Command_Stream_Box stream_box = {};
+            if (box)
+            {
+                stream_box = { box->left, box->top, box->front, box->right, box->bottom, box->back };
+            }
+            m_writer->copy_texture_region(
+                get_location(*dst), x, y, z, get_location(*src), box ? &stream_box : nullptr);
+        }
+    }
+
+    void Barrier(UINT32 group_count, const D3D12_BARRIER_GROUP* groups)
+    {
+        m_cmd->Barrier(group_count, groups);
+        if (!m_writer)
+        {
+            return;
+        }
+        m_writer->begin_barrier(group_count);
+        for (uint32_t g = 0; g < group_count; ++g)
+        {
+            const auto& group = groups[g];
+            m_writer->barrier_group(Command_Stream_Barrier_Type(group.Type), group.NumBarriers);
+            for (uint32_t b = 0; b < group.NumBarriers; ++b)
+            {
+                switch (group.Type)
+                {
+                case D3D12_BARRIER_TYPE_GLOBAL:
+                {
+                    const auto& barrier = group.pGlobalBarriers[b];
+                    m_writer->barrier(Command_Stream_Global_Barrier {
+                        uint32_t(barrier.SyncBefore), uint32_t(barrier.SyncAfter),
+                        uint32_t(barrier.AccessBefore), uint32_t(barrier.AccessAfter)
+                    });
+                    break;
+                }
+                case D3D12_BARRIER_TYPE_TEXTURE:
+                {
+                    const auto& barrier = group.pTextureBarriers[b];
+                    m_writer->barrier(Command_Stream_Texture_Barrier {
+                        uint32_t(barrier.SyncBefore), uint32_t(barrier.SyncAfter),
+                        uint32_t(barrier.AccessBefore), uint32_t(barrier.AccessAfter),
+                        uint32_t(barrier.LayoutBefore), uint32_t(barrier.LayoutAfter),
+                        get_id(barrier.pResource),
+                        barrier.Subresources.IndexOrFirstMipLevel, barrier.Subresources.NumMipLevels,
+                        barrier.Subresources.FirstArraySlice, barrier.Subresources.NumArraySlices,
+                        barrier.Subresources.FirstPlane, barrier.Subresources.NumPlanes,
+                        uint32_t(barrier.Flags)
+                    });
+                    break;
+                }
+                case D3D12_BARRIER_TYPE_BUFFER:
+                {
+                    const auto& barrier = group.pBufferBarriers[b];
+                    m_writer->barrier(Command_Stream_Buffer_Barrier {
+                        uint32_t(barrier.SyncBefore), uint32_t(barrier.SyncAfter),
+                        uint32_t(barrier.AccessBefore), uint32_t(barrier.AccessAfter),
+                        get_id(barrier.pResource), barrier.Offset, barrier.Size
+                    });
+                    break;
+                }
+                }
+            }
+        }
+    }
+
+private:
+    static constexpr uint32_t ID_CACHE_SIZE = 64;
+
+    // Direct mapped in front of the shared, locked table, a frame touches few objects.
+    uint32_t get_id(const void* object)
+    {
+        auto& entry = m_id_cache[(reinterpret_cast<uintptr_t>(object) >> 4) % ID_CACHE_SIZE];
+        if (entry.object != object)
+        {
+            entry = { object, m_objects.get_id(object) };
+        }
+        return entry.id;
+    }
+
+    Command_Stream_Texture_Location get_location(const D3D12_TEXTURE_COPY_LOCATION& location)
+    {
+        Command_Stream_Texture_Location result = {};
+        result.resource = get_id(location.pResource);
+        result.type = uint32_t(location.Type);
+        if (location.Type == D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX)
+        {
+            result.subresource_index = location.SubresourceIndex;
+            return result;
+        }
+        result.offset = location.PlacedFootprint.Offset;
+        result.format = uint32_t(location.PlacedFootprint.Footprint.Format);
+        result.width = location.PlacedFootprint.Footprint.Width;
+        result.height = location.PlacedFootprint.Footprint.Height;
+        result.depth = location.PlacedFootprint.Footprint.Depth;
+        result.row_pitch = location.PlacedFootprint.Footprint.RowPitch;
+        return result;
+    }
+
+    struct Id_Cache_Entry
+    {
+        const void* object;
+        uint32_t id;
+    };
+
+    Command_Stream_Objects& m_objects;
+    Command_List* m_cmd = nullptr;
+    Command_Stream_Writer* m_writer = nullptr;
+    std::array<Id_Cache_Entry, ID_CACHE_SIZE> m_id_cache = {};
+};
+
+// Re-issues a recorded stream on a command list, a visitor for Command_Stream_Reader.
+// `objects[id - 1]` is the live object for every id of the stream, e.g. looked up by its recorded name.
+template<typename Command_List = ID3D12GraphicsCommandList7>
+class D3D12_Command_Replayer
+{
+public:
+    D3D12_Command_Replayer(Command_List* cmd, std::span<void* const> objects)
+        : m_cmd(cmd)
+        , m_objects(objects)
+    {}
+
+    void begin_list(uint32_t) {}
+    void end_list() {}
+
+    void set_descriptor_heaps(std::span<const uint32_t> heaps)
+    {
+        std::array<ID3D12DescriptorHeap*, 2> descriptor_heaps = {};
+        if (heaps.size() > descriptor_heaps.size())
+        {
+            throw std::exception();
+        }
+        for (uint32_t i = 0; i < heaps.size(); ++i)
+        {
+            descriptor_heaps[i] = get<ID3D12DescriptorHeap>(heaps[i]);
+        }
+        m_cmd->SetDescriptorHeaps(uint32_t(heaps.size()), descriptor_heaps.data());
+    }
+
+    void set_root_signature(Command_Stream_Bind_Point bind_point, uint32_t root_signature)
+    {
+        if (bind_point == Command_Stream_Bind_Point::Compute)
+        {
+            m_cmd->SetComputeRootSignature(get<ID3D12RootSignature>(root_signature));
+        }
+        else
+        {
+            m_cmd->SetGraphicsRootSignature(get<ID3D12RootSignature>(root_signature));
+        }
+    }
+
+    void set_pipeline_state(uint32_t pipeline_state)
+    {
+        m_cmd->SetPipelineState(get<ID3D12PipelineState>(pipeline_state));
+    }
+
+    void set_root_constants(
+        Command_Stream_Bind_Point bind_point, uint32_t root_parameter_index,
+        std::span<const uint32_t> values, uint32_t offset)
+    {
+        if (bind_point == Command_Stream_Bind_Point::Compute)
+        {
+            m_cmd->SetComputeRoot32BitConstants(root_parameter_index, uint32_t(values.size()), values.data(), offset);
+        }
+        else
+        {
+            m_cmd->SetGraphicsRoot32BitConstants(root_parameter_index, uint32_t(values.size()), values.data(), offset);
+        }
+    }
+
+    void dispatch(uint32_t x, uint32_t y, uint32_t z) { m_cmd->Dispatch(x, y, z); }
+
+    void copy_buffer_region(uint32_t dst, uint64_t dst_offset, uint32_t src, uint64_t src_offset, uint64_t size)
+    {
+        m_cmd->CopyBufferRegion(get<ID3D12Resource>(dst), dst_offset, get<ID3D12Resource>(src), src_offset, size);
+    }
+
+    void copy_resource(uint32_t dst, uint32_t src)
+    {
+        m_cmd->CopyResource(get<ID3D12Resource>(dst), get<ID3D12Resource>(src));
+    }
+
+    void copy_texture_region(
+        const Command_Stream_Texture_Location& dst, uint32_t x, uint32_t y, uint32_t z,
+        const Command_Stream_Texture_Location& src, const Command_Stream_Box* box)
+    {
+        auto dst_location = get_location(dst);
+        auto src_location = get_location(src);
+        D3D12_BOX d3d12_box = {};
+        if (box)
+        {
+            d3d12_box = { box->left, box->top, box->front, box->right, box->bottom, box->back };
+        }
+        m_cmd->CopyTextureRegion(&dst_location, x, y, z, &src_location, box ? &d3d12_box : nullptr);
+    }
+
+    // Barriers arrive one by one, the Barrier call goes out once the last group is complete.
+    void begin_barrier(uint32_t group_count)
+    {
+        m_groups.clear();
+        m_global_barriers.clear();
+        m_texture_barriers.clear();
+        m_buffer_barriers.clear();
+        m_remaining_group_count = group_count;
+        m_remaining_barrier_count = 0;
+        m_is_barrier_pending = true;
+        flush_barriers_if_complete();
+    }
+
+    void barrier_group(Command_Stream_Barrier_Type type, uint32_t barrier_count)
+    {
+        m_groups.push_back({ .Type = D3D12_BARRIER_TYPE(type), .NumBarriers = barrier_count, .pGlobalBarriers = nullptr });
+        --m_remaining_group_count;
+        m_remaining_barrier_count = barrier_count;
+        flush_barriers_if_complete();
+    }
+
+    void barrier(const Command_Stream_Global_Barrier& barrier)
+    {
+        m_global_barriers.push_back({
+            .SyncBefore = D3D12_BARRIER_SYNC(barrier.sync_before),
+            .SyncAfter = D3D12_BARRIER_SYNC(barrier.sync_after),
+            .AccessBefore = D3D12_BARRIER_ACCESS(barrier.access_before),
+            .AccessAfter = D3D12_BARRIER_ACCESS(barrier.access_after)
+        });
+        --m_remaining_barrier_count;
+        flush_barriers_if_complete();
+    }
+
+    void barrier(const Command_Stream_Texture_Barrier& barrier)
+    {
+        m_texture_barriers.push_back({
+            .SyncBefore = D3D12_BARRIER_SYNC(barrier.sync_before),
+            .SyncAfter = D3D12_BARRIER_SYNC(barrier.sync_after),
+            .AccessBefore = D3D12_BARRIER_ACCESS(barrier.access_before),
+            .AccessAfter = D3D12_BARRIER_ACCESS(barrier.access_after),
+            .LayoutBefore = D3D12_BARRIER_LAYOUT(barrier.layout_before),
+            .LayoutAfter = D3D12_BARRIER_LAYOUT(barrier.layout_after),
+            .pResource = get<ID3D12Resource>(barrier.resource),
+            .Subresources = {
+                .IndexOrFirstMipLevel = barrier.first_mip_level,
+                .NumMipLevels = barrier.mip_level_count,
+                .FirstArraySlice = barrier.first_array_slice,
+                .NumArraySlices = barrier.array_slice_count,
+                .FirstPlane = barrier.first_plane,
+                .NumPlanes = barrier.plane_count
+            },
+            .Flags = D3D12_TEXTURE_BARRIER_FLAGS(barrier.flags)
+        });
+        --m_remaining_barrier_count;
+        flush_barriers_if_complete();
+    }
+
+    void barrier(const Command_Stream_Buffer_Barrier& barrier)
+    {
+        m_buffer_barriers.push_back({
+            .SyncBefore = D3D12_BARRIER_SYNC(barrier.sync_before),
+            .SyncAfter = D3D12_BARRIER_SYNC(barrier.sync_after),
+            .AccessBefore = D3D12_BARRIER_ACCESS(barrier.access_before),
+            .AccessAfter = D3D12_BARRIER_ACCESS(barrier.access_after),
+            .pResource = get<ID3D12Resource>(barrier.resource),
+            .Offset = barrier.offset,
+            .Size = barrier.size
+        });
+        --m_remaining_barrier_count;
+        flush_barriers_if_complete();
+    }
+
+private:
+    template<typename T>
+    T* get(uint32_t id) const
+    {
+        if (id == 0)
+        {
+            return nullptr;
+        }
+        if (id > m_objects.size())
+        {
+            throw std::exception();
+        }
+        return static_cast<T*>(m_objects[id - 1]);
+    }
+
+    D3D12_TEXTURE_COPY_LOCATION get_location(const Command_Stream_Texture_Location& location) const
+    {
+        D3D12_TEXTURE_COPY_LOCATION result = {};
+        result.pResource = get<ID3D12Resource>(location.resource);
+        result.Type = D3D12_TEXTURE_COPY_TYPE(location.type);
+        if (result.Type == D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX)
+        {
+            result.SubresourceIndex = location.subresource_index;
+            return result;
+        }
+        result.PlacedFootprint = {
+            .Offset = location.offset,
+            .Footprint = {
+                .Format = DXGI_FORMAT(location.format),
+                .Width = location.width,
+                .Height = location.height,
+                .Depth = location.depth,
+                .RowPitch = location.row_pitch
+            }
+        };
+        return result;
+    }
+
+    void flush_barriers_if_complete()
+    {
+        if (!m_is_barrier_pending || m_remaining_group_count > 0 || m_remaining_barrier_count > 0)
+        {
+            return;
+        }
+        // The barrier arrays are complete now and won't move anymore.
+        size_t global_offset = 0;
+        size_t texture_offset = 0;
+        size_t buffer_offset = 0;
+        for (auto& group : m_groups)
+        {
+            switch (group.Type)
+            {
+            case D3D12_BARRIER_TYPE_GLOBAL:
+                group.pGlobalBarriers = m_global_barriers.data() + global_offset;
+                global_offset += group.NumBarriers;
+                break;
+            case D3D12_BARRIER_TYPE_TEXTURE:
+                group.pTextureBarriers = m_texture_barriers.data() + texture_offset;
+                texture_offset += group.NumBarriers;
+                break;
+            case D3D12_BARRIER_TYPE_BUFFER:
+                group.pBufferBarriers = m_buffer_barriers.data() + buffer_offset;
+                buffer_offset += group.NumBarriers;
+                break;
+            }
+        }
+        m_cmd->Barrier(uint32_t(m_groups.size()), m_groups.data());
+        m_is_barrier_pending = false;
+    }
+
+    Command_List* m_cmd;
+    std::span<void* const> m_objects;
+    std::vector<D3D12_BARRIER_GROUP> m_groups;
+    std::vector<D3D12_GLOBAL_BARRIER> m_global_barriers;
+    std::vector<D3D12_TEXTURE_BARRIER> m_texture_barriers;
+    std::vector<D3D12_BUFFER_BARRIER> m_buffer_barriers;
+    uint32_t m_remaining_group_count = 0;
+    uint32_t m_remaining_barrier_count = 0;
+    bool m_is_barrier_pending = false;
+};
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "root_constants.h"
+
+#include <array>
+#include <cstdint>
+#include <exception>
+
+// Only pointers to these are compared and passed on, so the filtering builds and is tested without d3d12.h.
+#if defined(_WIN32)
+#include <../include/d3d12.h>
+#else
+struct ID3D12DescriptorHeap;
+struct ID3D12GraphicsCommandList;
+struct ID3D12PipelineState;
+struct ID3D12RootSignature;
+#endif
+
+// Sits in front of a command list and drops state sets that would not change anything. A fresh or reset
+// list has no state bound, so call reset() with it. Root constants are diffed per DWORD, see
+// set_root_constants(). Templated on the list so the emitted calls can be recorded by a mock.
+template<typename Command_List = ID3D12GraphicsCommandList>
+class D3D12_Command_State_Cache
+{
+public:
+    static constexpr uint32_t MAX_ROOT_CONSTANT_PARAMETERS = 4;
+
+    explicit D3D12_Command_State_Cache(Command_List* cmd = nullptr) { reset(cmd); }
+
+    void reset(Command_List* cmd)
+    {
+        m_cmd = cmd;
+        m_cbv_srv_uav_heap = nullptr;
+        m_sampler_heap = nullptr;
+        m_pipeline_state = nullptr;
+        for (auto& bind_point : m_bind_points)
+        {
+            invalidate(bind_point, nullptr);
+        }
+    }
+
+    void set_descriptor_heaps(ID3D12DescriptorHeap* cbv_srv_uav_heap, ID3D12DescriptorHeap* sampler_heap = nullptr)
+    {
+        if (cbv_srv_uav_heap == m_cbv_srv_uav_heap && sampler_heap == m_sampler_heap)
+        {
+            ++m_filtered_count;
+            return;
+        }
+        m_cbv_srv_uav_heap = cbv_srv_uav_heap;
+        m_sampler_heap = sampler_heap;
+        std::array<ID3D12DescriptorHeap*, 2> heaps;
+        uint32_t heap_count = 0;
+        for (auto heap : { cbv_srv_uav_heap, sampler_heap })
+        {
+            if (heap)
+            {
+                heaps[heap_count++] = heap;
+            }
+        }
+        m_cmd->SetDescriptorHeaps(heap_count, heaps.data());
+        ++m_emitted_count;
+    }
+
+    void set_compute_root_signature(ID3D12RootSignature* root_signature)
+    {
+        auto& bind_point = m_bind_points[uint32_t(Root_Constants_Bind_Point::Compute)];
+        if (root_signature == bind_point.root_signature)
+        {
+            ++m_filtered_count;
+            return;
+        }
+        invalidate(bind_point, root_signature);
+        m_cmd->SetComputeRootSignature(root_signature);
+        ++m_emitted_count;
+    }
+
+    void set_graphics_root_signature(ID3D12RootSignature* root_signature)
+    {
+        auto& bind_point = m_bind_points[uint32_t(Root_Constants_Bind_Point::Graphics)];
+        if (root_signature == bind_point.root_signature)
+        {
+            ++m_filtered_count;
+            return;
+        }
+        invalidate(bind_point, root_signature);
+        m_cmd->SetGraphicsRootSignature(root_signature);
+        ++m_emitted_count;
+    }
+
+    void set_pipeline_state(ID3D12PipelineState* pipeline_state)
+    {
+        if (pipeline_state == m_pipeline_state)
+        {
+            ++m_filtered_count;
+            return;
+        }
+        m_pipeline_state = pipeline_state;
+        m_cmd->SetPipelineState(pipeline_state);
+        ++m_emitted_count;
+    }
+
+    template<Root_Constants T>
+    void set_root_constants(
+        uint32_t root_parameter_index, const T& constants,
+        Root_Constants_Bind_Point bind_point = Root_Constants_Bind_Point::Compute)
+    {
+        if (root_parameter_index >= MAX_ROOT_CONSTANT_PARAMETERS)
+        {
+            throw std::exception();
+        }
+        auto& cache = m_bind_points[uint32_t(bind_point)].root_constants[root_parameter_index];
+        auto range = cache.update(constants);
+        if (range.count == 0)
+        {
+            ++m_filtered_count;
+            return;
+        }
+        set_root_constant_range(m_cmd, cache, root_parameter_index, range, bind_point);
+        ++m_emitted_count;
+    }
+
+    Command_List* get_command_list() const { return m_cmd; }
+    uint64_t get_emitted_count() const { return m_emitted_count; }
+    uint64_t get_filtered_count() const { return m_filtered_count; }
+
+private:
+    struct Bind_Point
+    {
+        ID3D12RootSignature* root_signature;
+        std::array<Root_Constant_Cache, MAX_ROOT_CONSTANT_PARAMETERS> root_constants;
+    };
+
+    // Setting a root signature leaves all root arguments of its bind point undefined.
+    static void invalidate(Bind_Point& bind_point, ID3D12RootSignature* root_signature)
+    {
+        bind_point.root_signature = root_signature;
+        for (auto& cache : bind_point.root_constants)
+        {
+            cache.invalidate();
+        }
+    }
+
+    Command_List* m_cmd = nullptr;
+    ID3D12DescriptorHeap* m_cbv_srv_uav_heap = nullptr;
+    ID3D12DescriptorHeap* m_sampler_heap = nullptr;
+    ID3D12PipelineState* m_pipeline_state = nullptr;
+    std::array<Bind_Point, 2> m_bind_points = {};
+    uint64_t m_emitted_count = 0;
+    uint64_t m_filtered_count = 0;
+};
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <../include/d3d12.h>
+#include <cstdio>
+#include <exception>
+#include <wrl.h>
+
+using Microsoft::WRL::ComPtr;
+
+inline ID3D12Device* device_ref = nullptr;
+
+inline void throw_if_failed(HRESULT hr)
+{
+    if (device_ref)
+    {
+        auto device_removal_hr = device_ref->GetDeviceRemovedReason();
+        if (FAILED(device_removal_hr))
+        {
+            printf("Device Removal HRESULT: %u\n", device_removal_hr);
+        }
+    }
+    if (FAILED(hr))
+    {
+        throw std::exception();
+    }
+}
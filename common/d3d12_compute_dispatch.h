@@ -0,0 +1,112 @@
+#pragma once
+
+#include "compute_dispatch.h"
+#include "d3d12_command_state_cache.h"
+#include "d3d12_common.h"
+#include "d3d12_pipeline_cache.h"
+
+#include <span>
+#include <string_view>
+#include <vector>
+
+// Dispatches enough groups of `group_size` to cover `thread_count_x` x `thread_count_y` x `thread_count_z` threads.
+inline void dispatch_threads(
+    ID3D12GraphicsCommandList* cmd, Thread_Group_Size group_size,
+    uint32_t thread_count_x, uint32_t thread_count_y = 1, uint32_t thread_count_z = 1)
+{
+    Dispatch_Size dispatch_size;
+    if (!get_dispatch_size(thread_count_x, thread_count_y, thread_count_z, group_size, dispatch_size))
+    {
+        throw std::exception();
+    }
+    cmd->Dispatch(dispatch_size.x, dispatch_size.y, dispatch_size.z);
+}
+
+// A compute kernel compiled with one or more numthreads variants. The group size of every variant comes
+// from build time reflection or is read from its bytecode, the variant in use is picked by a Dispatch_Autotuner.
+class D3D12_Compute_Kernel
+{
+public:
+    struct Variant
+    {
+        ComPtr<ID3D12PipelineState> pso;
+        Thread_Group_Size group_size;
+    };
+
+    D3D12_Compute_Kernel(
+        ID3D12Device* device,
+        Pipeline_Cache& cache,
+        std::string_view name,
+        ID3D12RootSignature* root_signature,
+        Shader_Blob root_signature_blob,
+        std::span<const Shader_Blob> shaders,
+        std::span<const Thread_Group_Size> group_sizes = {})
+        : m_key(make_dispatch_kernel_key(name))
+    {
+        for (uint32_t i = 0; i < shaders.size(); ++i)
+        {
+            const auto& shader = shaders[i];
+            Variant variant;
+            if (i < group_sizes.size())
+            {
+                variant.group_size = group_sizes[i];
+            }
+            else if (!get_shader_thread_group_size(shader, variant.group_size))
+            {
+                throw std::exception();
+            }
+            D3D12_COMPUTE_PIPELINE_STATE_DESC pso_desc = {
+                .pRootSignature = root_signature,
+                .CS = {
+                    .pShaderBytecode = shader.data,
+                    .BytecodeLength = shader.size
+                },
+                .NodeMask = 0,
+                .CachedPSO = {
+                    .pCachedBlob = nullptr,
+                    .CachedBlobSizeInBytes = 0
+                },
+                .Flags = D3D12_PIPELINE_STATE_FLAG_NONE
+            };
+            variant.pso = create_compute_pipeline_cached(device, cache, pso_desc, root_signature_blob);
+            m_group_sizes.push_back(variant.group_size);
+            m_variants.push_back(std::move(variant));
+        }
+    }
+
+    // Index of the variant to use this frame, hand it back to the tuner with the measured time.
+    uint32_t select(Dispatch_Autotuner& autotuner) const { return autotuner.select(m_key, m_group_sizes); }
+
+    void report(Dispatch_Autotuner& autotuner, uint32_t variant, double duration_us) const
+    {
+        autotuner.report(m_key, variant, duration_us);
+    }
+
+    // Binds the variant's pipeline and dispatches it over the thread grid.
+    void dispatch(
+        ID3D12GraphicsCommandList* cmd, uint32_t variant,
+        uint32_t thread_count_x, uint32_t thread_count_y = 1, uint32_t thread_count_z = 1) const
+    {
+        cmd->SetPipelineState(m_variants[variant].pso.Get());
+        dispatch_threads(cmd, m_variants[variant].group_size, thread_count_x, thread_count_y, thread_count_z);
+    }
+
+    // Same as above, skips binding the pipeline if it is bound already.
+    void dispatch(
+        D3D12_Command_State_Cache<>& state, uint32_t variant,
+        uint32_t thread_count_x, uint32_t thread_count_y = 1, uint32_t thread_count_z = 1) const
+    {
+        state.set_pipeline_state(m_variants[variant].pso.Get());
+        dispatch_threads(
+            state.get_command_list(), m_variants[variant].group_size, thread_count_x, thread_count_y, thread_count_z);
+    }
+
+    const Variant& get_variant(uint32_t variant) const { return m_variants[variant]; }
+    uint32_t get_variant_count() const { return uint32_t(m_variants.size()); }
+    uint64_t get_key() const { return m_key; }
+
+private:
+    uint64_t m_key;
+    std::vector<Variant> m_variants;
+    std::vector<Thread_Group_Size> m_group_sizes;
+};
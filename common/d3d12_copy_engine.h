@@ -0,0 +1,211 @@
+#pragma once
+
+#include "copy_scheduler.h"
+#include "d3d12_common.h"
+#include "d3d12_fence.h"
+
+#include <cstdint>
+#include <vector>
+
+// Copy_Scheduler on a dedicated copy queue with persistently mapped upload and readback pages.
+// Buffers need no barriers on the copy queue, textures have to be in D3D12_BARRIER_LAYOUT_COMMON.
+// Other queues order their use of the copied data with wait() on the value submit() returned.
+class D3D12_Copy_Engine
+{
+public:
+    D3D12_Copy_Engine(
+        ID3D12Device4* device, const Copy_Scheduler_Settings& settings,
+        uint32_t upload_page_count, uint32_t readback_page_count, uint32_t frames_in_flight)
+        : m_queue(create_queue(device))
+        , m_fence(device, m_queue.Get())
+        , m_frame_ring(m_fence, frames_in_flight)
+        , m_upload_pages(create_pages(device, D3D12_HEAP_TYPE_UPLOAD, settings.page_size, upload_page_count))
+        , m_readback_pages(create_pages(device, D3D12_HEAP_TYPE_READBACK, settings.page_size, readback_page_count))
+        , m_scheduler(settings, get_page_pointers(m_upload_pages), get_page_pointers(m_readback_pages))
+    {
+        m_cmd_allocators.resize(m_frame_ring.get_frames_in_flight());
+        for (auto& cmd_allocator : m_cmd_allocators)
+        {
+            throw_if_failed(device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY, IID_PPV_ARGS(&cmd_allocator)));
+        }
+        throw_if_failed(device->CreateCommandList1(
+            0, D3D12_COMMAND_LIST_TYPE_COPY, D3D12_COMMAND_LIST_FLAG_NONE, IID_PPV_ARGS(&m_cmd)));
+    }
+
+    D3D12_Copy_Engine(const D3D12_Copy_Engine&) = delete;
+    D3D12_Copy_Engine& operator=(const D3D12_Copy_Engine&) = delete;
+
+    // Records and submits this frame's share of the queued copies. Returns the fence value that
+    // completes them, or 0 if there was nothing to copy.
+    uint64_t submit()
+    {
+        m_frame_ring.is_retired(m_frame_ring.get_last_signaled_value());
+        m_scheduler.retire(m_frame_ring.get_completed_value());
+        auto copies = m_scheduler.build_frame();
+        if (copies.empty())
+        {
+            return 0;
+        }
+        auto frame_index = m_frame_ring.begin_frame();
+        auto cmd_allocator = m_cmd_allocators[frame_index].Get();
+        throw_if_failed(cmd_allocator->Reset());
+        throw_if_failed(m_cmd->Reset(cmd_allocator, nullptr));
+        for (const auto& copy : copies)
+        {
+            if (copy.needs_barrier)
+            {
+                D3D12_GLOBAL_BARRIER barrier = {
+                    .SyncBefore = D3D12_BARRIER_SYNC_COPY,
+                    .SyncAfter = D3D12_BARRIER_SYNC_COPY,
+                    .AccessBefore = D3D12_BARRIER_ACCESS_COPY_DEST,
+                    .AccessAfter = D3D12_BARRIER_ACCESS_COPY_SOURCE | D3D12_BARRIER_ACCESS_COPY_DEST
+                };
+                D3D12_BARRIER_GROUP barrier_group = {
+                    .Type = D3D12_BARRIER_TYPE_GLOBAL,
+                    .NumBarriers = 1,
+                    .pGlobalBarriers = &barrier
+                };
+                m_cmd->Barrier(1, &barrier_group);
+            }
+            record(copy);
+        }
+        throw_if_failed(m_cmd->Close());
+        ID3D12CommandList* cmd = m_cmd.Get();
+        m_queue->ExecuteCommandLists(1, &cmd);
+        m_scheduler.end_frame(m_frame_ring.get_pending_value());
+        return m_frame_ring.end_frame();
+    }
+
+    // GPU side wait of `queue` for the copies submitted up to `value`.
+    void wait(ID3D12CommandQueue* queue, uint64_t value) const
+    {
+        if (value > 0)
+        {
+            throw_if_failed(queue->Wait(m_fence.get(), value));
+        }
+    }
+
+    // Blocks until every submitted copy completed and hands out the remaining readbacks.
+    void wait_idle()
+    {
+        m_frame_ring.wait_idle();
+        m_scheduler.retire(m_frame_ring.get_completed_value());
+    }
+
+    Copy_Scheduler& get_scheduler() { return m_scheduler; }
+    ID3D12CommandQueue* get_queue() const { return m_queue.Get(); }
+    ID3D12Fence* get_fence() const { return m_fence.get(); }
+
+private:
+    struct Page
+    {
+        ComPtr<ID3D12Resource> resource;
+        uint8_t* data;
+    };
+
+    static ComPtr<ID3D12CommandQueue> create_queue(ID3D12Device* device)
+    {
+        ComPtr<ID3D12CommandQueue> queue;
+        D3D12_COMMAND_QUEUE_DESC queue_desc = {
+            .Type = D3D12_COMMAND_LIST_TYPE_COPY,
+            .Priority = D3D12_COMMAND_QUEUE_PRIORITY_NORMAL,
+            .Flags = D3D12_COMMAND_QUEUE_FLAG_NONE,
+            .NodeMask = 0
+        };
+        throw_if_failed(device->CreateCommandQueue(&queue_desc, IID_PPV_ARGS(&queue)));
+        return queue;
+    }
+
+    static std::vector<Page> create_pages(ID3D12Device* device, D3D12_HEAP_TYPE heap_type, uint64_t page_size, uint32_t page_count)
+    {
+        D3D12_HEAP_PROPERTIES heap_props = {
+            .Type = heap_type,
+            .CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+            .MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN,
+            .CreationNodeMask = 0,
+            .VisibleNodeMask = 0
+        };
+        D3D12_RESOURCE_DESC resource_desc = {
+            .Dimension = D3D12_RESOURCE_DIMENSION_BUFFER,
+            .Alignment = 0,
+            .Width = page_size,
+            .Height = 1,
+            .DepthOrArraySize = 1,
+            .MipLevels = 1,
+            .Format = DXGI_FORMAT_UNKNOWN,
+            .SampleDesc = { .Count = 1, .Quality = 0 },
+            .Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
+            .Flags = D3D12_RESOURCE_FLAG_NONE
+        };
+        auto initial_state = heap_type == D3D12_HEAP_TYPE_UPLOAD ? D3D12_RESOURCE_STATE_GENERIC_READ : D3D12_RESOURCE_STATE_COPY_DEST;
+        std::vector<Page> pages(page_count);
+        for (auto& page : pages)
+        {
+            throw_if_failed(device->CreateCommittedResource(
+                &heap_props, D3D12_HEAP_FLAG_NONE, &resource_desc, initial_state, nullptr, IID_PPV_ARGS(&page.resource)));
+            // Readback pages are read on the CPU whole, upload pages never.
+            D3D12_RANGE read_range = { .Begin = 0, .End = heap_type == D3D12_HEAP_TYPE_READBACK ? SIZE_T(page_size) : 0 };
+            throw_if_failed(page.resource->Map(0, &read_range, reinterpret_cast<void**>(&page.data)));
+        }
+        return pages;
+    }
+
+    static std::vector<uint8_t*> get_page_pointers(const std::vector<Page>& pages)
+    {
+        std::vector<uint8_t*> pointers;
+        for (const auto& page : pages)
+        {
+            pointers.push_back(page.data);
+        }
+        return pointers;
+    }
+
+    void record(const Scheduled_Copy& copy)
+    {
+        auto resource = static_cast<ID3D12Resource*>(copy.resource);
+        switch (copy.kind)
+        {
+        case Copy_Kind::Buffer_Upload:
+            m_cmd->CopyBufferRegion(resource, copy.offset, m_upload_pages[copy.page].resource.Get(), copy.page_offset, copy.size);
+            break;
+        case Copy_Kind::Buffer_Readback:
+            m_cmd->CopyBufferRegion(m_readback_pages[copy.page].resource.Get(), copy.page_offset, resource, copy.offset, copy.size);
+            break;
+        case Copy_Kind::Texture_Upload:
+        {
+            // Whole blocks, the footprint of a BC texture is padded to multiples of 4 texels.
+            auto block_size = copy.texture.block_size;
+            D3D12_TEXTURE_COPY_LOCATION dst = {
+                .pResource = resource,
+                .Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX,
+                .SubresourceIndex = copy.subresource
+            };
+            D3D12_TEXTURE_COPY_LOCATION src = {
+                .pResource = m_upload_pages[copy.page].resource.Get(),
+                .Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT,
+                .PlacedFootprint = {
+                    .Offset = copy.page_offset,
+                    .Footprint = {
+                        .Format = DXGI_FORMAT(copy.texture.format),
+                        .Width = (copy.texture.width + block_size - 1) / block_size * block_size,
+                        .Height = uint32_t(copy.size) * block_size,
+                        .Depth = 1,
+                        .RowPitch = copy.texture.get_row_pitch()
+                    }
+                }
+            };
+            m_cmd->CopyTextureRegion(&dst, 0, uint32_t(copy.offset) * block_size, 0, &src, nullptr);
+            break;
+        }
+        }
+    }
+
+    ComPtr<ID3D12CommandQueue> m_queue;
+    D3D12_Fence m_fence;
+    Frame_Ring m_frame_ring;
+    std::vector<Page> m_upload_pages;
+    std::vector<Page> m_readback_pages;
+    Copy_Scheduler m_scheduler;
+    std::vector<ComPtr<ID3D12CommandAllocator>> m_cmd_allocators;
+    ComPtr<ID3D12GraphicsCommandList7> m_cmd;
+};
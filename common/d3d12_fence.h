@@ -0,0 +1,61 @@
+#pragma once
+
+#include "d3d12_common.h"
+#include "frame_ring.h"
+
+// Long-lived fence bound to one queue. Replaces creating a fence and event per wait.
+class D3D12_Fence : public Fence
+{
+public:
+    D3D12_Fence(ID3D12Device* device, ID3D12CommandQueue* queue)
+        : m_queue(queue)
+    {
+        throw_if_failed(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_fence)));
+        m_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+        if (m_event == NULL)
+        {
+            throw_if_failed(HRESULT_FROM_WIN32(GetLastError()));
+        }
+    }
+
+    ~D3D12_Fence() override
+    {
+        CloseHandle(m_event);
+    }
+
+    D3D12_Fence(const D3D12_Fence&) = delete;
+    D3D12_Fence& operator=(const D3D12_Fence&) = delete;
+
+    void signal(uint64_t value) override
+    {
+        throw_if_failed(m_queue->Signal(m_fence.Get(), value));
+    }
+
+    uint64_t get_completed_value() override
+    {
+        return m_fence->GetCompletedValue();
+    }
+
+    void wait(uint64_t value) override
+    {
+        if (m_fence->GetCompletedValue() >= value)
+        {
+            return;
+        }
+        throw_if_failed(m_fence->SetEventOnCompletion(value, m_event));
+        // A failed wait must not look like completion, the caller would reuse allocators still in flight.
+        if (WaitForSingleObject(m_event, INFINITE) != WAIT_OBJECT_0)
+        {
+            throw_if_failed(HRESULT_FROM_WIN32(GetLastError()));
+            throw std::exception();
+        }
+    }
+
+    ID3D12Fence* get() const { return m_fence.Get(); }
+    ID3D12CommandQueue* get_queue() const { return m_queue; }
+
+private:
+    ComPtr<ID3D12Fence> m_fence;
+    ID3D12CommandQueue* m_queue;
+    HANDLE m_event = NULL;
+};
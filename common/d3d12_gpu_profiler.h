@@ -0,0 +1,217 @@
+#pragma once
+
+#include "d3d12_common.h"
+#include "gpu_profiler.h"
+
+#include <cstddef>
+#include <string_view>
+
+static_assert(sizeof(Gpu_Pipeline_Statistics) == sizeof(D3D12_QUERY_DATA_PIPELINE_STATISTICS));
+
+struct D3D12_Gpu_Scope
+{
+    uint32_t index = INVALID_GPU_SCOPE;
+    bool has_statistics = false;
+};
+
+// Timestamp and pipeline statistics queries per frame in flight, resolved into a persistently mapped
+// readback buffer. Results of a frame are read in begin_frame() once its slot retired, so nothing stalls.
+// Scopes work on direct and compute lists, copy lists are skipped as they need a copy queue timestamp heap.
+// All timestamps are converted with the frequency and clock calibration of `queue`.
+class D3D12_Gpu_Profiler
+{
+public:
+    D3D12_Gpu_Profiler(ID3D12Device* device, ID3D12CommandQueue* queue, uint32_t frames_in_flight, uint32_t max_scopes_per_frame = 256)
+        : m_queue(queue)
+        , m_profiler(frames_in_flight, max_scopes_per_frame)
+    {
+        auto scope_count = frames_in_flight * max_scopes_per_frame;
+        D3D12_QUERY_HEAP_DESC timestamp_heap_desc = {
+            .Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP,
+            .Count = 2 * scope_count,
+            .NodeMask = 0
+        };
+        throw_if_failed(device->CreateQueryHeap(&timestamp_heap_desc, IID_PPV_ARGS(&m_timestamp_heap)));
+        D3D12_QUERY_HEAP_DESC statistics_heap_desc = {
+            .Type = D3D12_QUERY_HEAP_TYPE_PIPELINE_STATISTICS,
+            .Count = scope_count,
+            .NodeMask = 0
+        };
+        throw_if_failed(device->CreateQueryHeap(&statistics_heap_desc, IID_PPV_ARGS(&m_statistics_heap)));
+
+        m_statistics_offset = uint64_t(2) * scope_count * sizeof(uint64_t);
+        D3D12_HEAP_PROPERTIES heap_props = {
+            .Type = D3D12_HEAP_TYPE_READBACK,
+            .CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+            .MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN,
+            .CreationNodeMask = 0,
+            .VisibleNodeMask = 0
+        };
+        D3D12_RESOURCE_DESC resource_desc = {
+            .Dimension = D3D12_RESOURCE_DIMENSION_BUFFER,
+            .Alignment = 0,
+            .Width = m_statistics_offset + uint64_t(scope_count) * sizeof(Gpu_Pipeline_Statistics),
+            .Height = 1,
+            .DepthOrArraySize = 1,
+            .MipLevels = 1,
+            .Format = DXGI_FORMAT_UNKNOWN,
+            .SampleDesc = { .Count = 1, .Quality = 0 },
+            .Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
+            .Flags = D3D12_RESOURCE_FLAG_NONE
+        };
+        throw_if_failed(device->CreateCommittedResource(
+            &heap_props, D3D12_HEAP_FLAG_NONE, &resource_desc, D3D12_RESOURCE_STATE_COPY_DEST,
+            nullptr, IID_PPV_ARGS(&m_buffer)));
+        void* cpu_base = nullptr;
+        throw_if_failed(m_buffer->Map(0, nullptr, &cpu_base));
+        m_cpu_base = static_cast<const std::byte*>(cpu_base);
+
+        throw_if_failed(queue->GetTimestampFrequency(&m_frequency));
+        LARGE_INTEGER cpu_frequency;
+        QueryPerformanceFrequency(&cpu_frequency);
+        m_cpu_frequency = uint64_t(cpu_frequency.QuadPart);
+    }
+
+    ~D3D12_Gpu_Profiler()
+    {
+        D3D12_RANGE written_range = { .Begin = 0, .End = 0 };
+        m_buffer->Unmap(0, &written_range);
+    }
+
+    D3D12_Gpu_Profiler(const D3D12_Gpu_Profiler&) = delete;
+    D3D12_Gpu_Profiler& operator=(const D3D12_Gpu_Profiler&) = delete;
+
+    // Collects the results the frame slot held last. The slot has to be retired, see Frame_Ring::begin_frame.
+    void begin_frame(uint32_t frame_index)
+    {
+        auto timestamps = reinterpret_cast<const uint64_t*>(m_cpu_base)
+            + m_profiler.get_first_timestamp_query(frame_index);
+        auto statistics = reinterpret_cast<const Gpu_Pipeline_Statistics*>(m_cpu_base + m_statistics_offset)
+            + m_profiler.get_first_statistics_query(frame_index);
+        m_profiler.collect(
+            frame_index,
+            { timestamps, size_t(2) * m_profiler.get_max_scopes() },
+            { statistics, m_profiler.get_max_scopes() });
+        m_profiler.begin_frame(frame_index);
+    }
+
+    // Pipeline statistics are only gathered on direct lists.
+    D3D12_Gpu_Scope begin_scope(ID3D12GraphicsCommandList* cmd, std::string_view name, bool with_statistics = false)
+    {
+        auto type = cmd->GetType();
+        if (type != D3D12_COMMAND_LIST_TYPE_DIRECT && type != D3D12_COMMAND_LIST_TYPE_COMPUTE)
+        {
+            return {};
+        }
+        bool has_statistics = with_statistics && type == D3D12_COMMAND_LIST_TYPE_DIRECT;
+        auto index = m_profiler.begin_scope(name, type == D3D12_COMMAND_LIST_TYPE_DIRECT ? 0 : 1, has_statistics);
+        if (index == INVALID_GPU_SCOPE)
+        {
+            return {};
+        }
+        auto frame_index = m_profiler.get_frame_index();
+        cmd->EndQuery(m_timestamp_heap.Get(), D3D12_QUERY_TYPE_TIMESTAMP,
+            m_profiler.get_first_timestamp_query(frame_index) + 2 * index);
+        if (has_statistics)
+        {
+            cmd->BeginQuery(m_statistics_heap.Get(), D3D12_QUERY_TYPE_PIPELINE_STATISTICS,
+                m_profiler.get_first_statistics_query(frame_index) + index);
+        }
+        return { index, has_statistics };
+    }
+
+    void end_scope(ID3D12GraphicsCommandList* cmd, D3D12_Gpu_Scope scope)
+    {
+        if (scope.index == INVALID_GPU_SCOPE)
+        {
+            return;
+        }
+        auto frame_index = m_profiler.get_frame_index();
+        if (scope.has_statistics)
+        {
+            cmd->EndQuery(m_statistics_heap.Get(), D3D12_QUERY_TYPE_PIPELINE_STATISTICS,
+                m_profiler.get_first_statistics_query(frame_index) + scope.index);
+        }
+        cmd->EndQuery(m_timestamp_heap.Get(), D3D12_QUERY_TYPE_TIMESTAMP,
+            m_profiler.get_first_timestamp_query(frame_index) + 2 * scope.index + 1);
+    }
+
+    // Copies this frame's queries to the readback buffer. Record it on a direct list that executes after
+    // every scope of the frame, e.g. once all queues were joined.
+    void resolve(ID3D12GraphicsCommandList* cmd)
+    {
+        auto frame_index = m_profiler.get_frame_index();
+        auto scope_count = m_profiler.get_scope_count();
+        if (scope_count > 0)
+        {
+            auto first_timestamp = m_profiler.get_first_timestamp_query(frame_index);
+            cmd->ResolveQueryData(m_timestamp_heap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, first_timestamp, 2 * scope_count,
+                m_buffer.Get(), uint64_t(first_timestamp) * sizeof(uint64_t));
+            // Unused statistics queries were never begun and must not be resolved.
+            for (uint32_t s = 0; s < scope_count; ++s)
+            {
+                if (!m_profiler.has_statistics(s))
+                {
+                    continue;
+                }
+                auto query = m_profiler.get_first_statistics_query(frame_index) + s;
+                cmd->ResolveQueryData(m_statistics_heap.Get(), D3D12_QUERY_TYPE_PIPELINE_STATISTICS, query, 1,
+                    m_buffer.Get(), m_statistics_offset + uint64_t(query) * sizeof(Gpu_Pipeline_Statistics));
+            }
+        }
+        uint64_t gpu_timestamp = 0;
+        uint64_t cpu_timestamp = 0;
+        throw_if_failed(m_queue->GetClockCalibration(&gpu_timestamp, &cpu_timestamp));
+        m_profiler.end_frame({
+            .gpu_timestamp = gpu_timestamp,
+            .gpu_frequency = m_frequency,
+            .cpu_time_us = double(cpu_timestamp) * 1e6 / double(m_cpu_frequency)
+        });
+    }
+
+    const std::vector<Gpu_Scope_Result>& get_results() const { return m_profiler.get_results(); }
+    const Profiler_Statistics& get_statistics() const { return m_profiler.get_statistics(); }
+
+    // Adds the most recently collected frame to `trace`, the direct queue as thread 0, compute as 1.
+    void write_trace(Chrome_Trace& trace, uint32_t pid) const { m_profiler.write_trace(trace, pid); }
+
+    static void set_trace_names(Chrome_Trace& trace, uint32_t pid)
+    {
+        trace.set_process_name(pid, "GPU");
+        trace.set_thread_name(pid, 0, "Direct queue");
+        trace.set_thread_name(pid, 1, "Compute queue");
+    }
+
+private:
+    ID3D12CommandQueue* m_queue;
+    Gpu_Profiler m_profiler;
+    ComPtr<ID3D12QueryHeap> m_timestamp_heap;
+    ComPtr<ID3D12QueryHeap> m_statistics_heap;
+    ComPtr<ID3D12Resource> m_buffer;
+    const std::byte* m_cpu_base = nullptr;
+    uint64_t m_statistics_offset = 0;
+    uint64_t m_frequency = 1;
+    uint64_t m_cpu_frequency = 1;
+};
+
+// Times the commands recorded during its lifetime.
+class D3D12_Gpu_Profile_Scope
+{
+public:
+    D3D12_Gpu_Profile_Scope(
+        D3D12_Gpu_Profiler& profiler, ID3D12GraphicsCommandList* cmd, std::string_view name, bool with_statistics = false)
+        : m_profiler(profiler)
+        , m_cmd(cmd)
+        , m_scope(profiler.begin_scope(cmd, name, with_statistics))
+    {}
+
+    ~D3D12_Gpu_Profile_Scope() { m_profiler.end_scope(m_cmd, m_scope); }
+
+    D3D12_Gpu_Profile_Scope(const D3D12_Gpu_Profile_Scope&) = delete;
+    D3D12_Gpu_Profile_Scope& operator=(const D3D12_Gpu_Profile_Scope&) = delete;
+
+private:
+    D3D12_Gpu_Profiler& m_profiler;
+    ID3D12GraphicsCommandList* m_cmd;
+    D3D12_Gpu_Scope m_scope;
+};
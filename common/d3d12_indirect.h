@@ -0,0 +1,126 @@
+#pragma once
+
+#include "d3d12_common.h"
+#include "indirect_arguments.h"
+
+#include <vector>
+
+// `root_signature` is the one the constants of the layout belong to, and null for a layout without constants.
+inline ComPtr<ID3D12CommandSignature> create_command_signature(
+    ID3D12Device* device, const Indirect_Command_Layout& layout, ID3D12RootSignature* root_signature)
+{
+    std::vector<D3D12_INDIRECT_ARGUMENT_DESC> argument_descs;
+    for (const auto& argument : layout.arguments)
+    {
+        D3D12_INDIRECT_ARGUMENT_DESC argument_desc = { .Type = D3D12_INDIRECT_ARGUMENT_TYPE(argument.type) };
+        if (argument.type == Indirect_Argument_Type::Constant)
+        {
+            argument_desc.Constant = {
+                .RootParameterIndex = argument.root_parameter_index,
+                .DestOffsetIn32BitValues = argument.dest_offset,
+                .Num32BitValuesToSet = argument.value_count
+            };
+        }
+        argument_descs.push_back(argument_desc);
+    }
+    D3D12_COMMAND_SIGNATURE_DESC signature_desc = {
+        .ByteStride = layout.byte_stride,
+        .NumArgumentDescs = uint32_t(argument_descs.size()),
+        .pArgumentDescs = argument_descs.data(),
+        .NodeMask = 0
+    };
+    ComPtr<ID3D12CommandSignature> signature;
+    throw_if_failed(device->CreateCommandSignature(
+        &signature_desc, layout.needs_root_signature() ? root_signature : nullptr, IID_PPV_ARGS(&signature)));
+    return signature;
+}
+
+// Default heap buffer for GPU generated commands and their counts, suballocated per frame through an
+// Indirect_Argument_Allocator. Culling or emitter shaders append commands through a UAV and bump the
+// count, ExecuteIndirect runs as many as the count says. Barriers are up to the caller: UAV writes,
+// then INDIRECT_ARGUMENT for execute(), and COPY_DEST for reset_counts().
+class D3D12_Indirect_Argument_Buffer
+{
+public:
+    D3D12_Indirect_Argument_Buffer(ID3D12Device* device, uint64_t capacity)
+        : m_allocator(capacity)
+    {
+        D3D12_HEAP_PROPERTIES heap_props = {
+            .Type = D3D12_HEAP_TYPE_DEFAULT,
+            .CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+            .MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN,
+            .CreationNodeMask = 0,
+            .VisibleNodeMask = 0
+        };
+        D3D12_RESOURCE_DESC resource_desc = {
+            .Dimension = D3D12_RESOURCE_DIMENSION_BUFFER,
+            .Alignment = 0,
+            .Width = capacity,
+            .Height = 1,
+            .DepthOrArraySize = 1,
+            .MipLevels = 1,
+            .Format = DXGI_FORMAT_UNKNOWN,
+            .SampleDesc = { .Count = 1, .Quality = 0 },
+            .Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
+            .Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS
+        };
+        throw_if_failed(device->CreateCommittedResource(
+            &heap_props, D3D12_HEAP_FLAG_NONE, &resource_desc, D3D12_RESOURCE_STATE_COMMON,
+            nullptr, IID_PPV_ARGS(&m_buffer)));
+        m_gpu_base = m_buffer->GetGPUVirtualAddress();
+    }
+
+    D3D12_Indirect_Argument_Buffer(const D3D12_Indirect_Argument_Buffer&) = delete;
+    D3D12_Indirect_Argument_Buffer& operator=(const D3D12_Indirect_Argument_Buffer&) = delete;
+
+    // Thread-safe. Returns an invalid allocation if the ring is full.
+    Indirect_Argument_Allocation allocate(const Indirect_Command_Layout& layout, uint32_t max_command_count)
+    {
+        return m_allocator.allocate(layout, max_command_count);
+    }
+
+    // Zeroes the counts allocated since the last call, record it before the pass that appends commands.
+    void reset_counts(ID3D12GraphicsCommandList2* cmd)
+    {
+        std::vector<D3D12_WRITEBUFFERIMMEDIATE_PARAMETER> params;
+        for (auto count_offset : m_allocator.take_count_offsets())
+        {
+            params.push_back({ .Dest = m_gpu_base + count_offset, .Value = 0 });
+        }
+        if (!params.empty())
+        {
+            cmd->WriteBufferImmediate(uint32_t(params.size()), params.data(), nullptr);
+        }
+    }
+
+    void execute(
+        ID3D12GraphicsCommandList* cmd, ID3D12CommandSignature* signature, const Indirect_Argument_Allocation& allocation) const
+    {
+        cmd->ExecuteIndirect(
+            signature, allocation.max_command_count,
+            m_buffer.Get(), allocation.argument_offset,
+            m_buffer.Get(), allocation.count_offset);
+    }
+
+    // For binding the commands and the count as root UAVs of the shader that writes them.
+    D3D12_GPU_VIRTUAL_ADDRESS get_argument_address(const Indirect_Argument_Allocation& allocation) const
+    {
+        return m_gpu_base + allocation.argument_offset;
+    }
+
+    D3D12_GPU_VIRTUAL_ADDRESS get_count_address(const Indirect_Argument_Allocation& allocation) const
+    {
+        return m_gpu_base + allocation.count_offset;
+    }
+
+    void end_frame(uint64_t fence_value) { m_allocator.end_frame(fence_value); }
+    void retire(uint64_t completed_fence_value) { m_allocator.retire(completed_fence_value); }
+
+    Indirect_Argument_Allocator& get_allocator() { return m_allocator; }
+    ID3D12Resource* get_resource() const { return m_buffer.Get(); }
+
+private:
+    Indirect_Argument_Allocator m_allocator;
+    ComPtr<ID3D12Resource> m_buffer;
+    D3D12_GPU_VIRTUAL_ADDRESS m_gpu_base = 0;
+};
@@ -0,0 +1,512 @@
+#pragma once
+
+#include "d3d12_common.h"
+#include "hash.h"
+#include "tlsf_allocator.h"
+
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// Resource heap tier 1 hardware can't mix buffers, textures and render targets in one heap.
+enum class D3D12_Heap_Class : uint32_t
+{
+    Any,
+    Buffer,
+    Texture,
+    Render_Target,
+    Count
+};
+
+inline D3D12_HEAP_FLAGS get_heap_flags(D3D12_Heap_Class heap_class)
+{
+    switch (heap_class)
+    {
+    case D3D12_Heap_Class::Buffer:
+        return D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS;
+    case D3D12_Heap_Class::Texture:
+        return D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES;
+    case D3D12_Heap_Class::Render_Target:
+        return D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES;
+    default:
+        return D3D12_HEAP_FLAG_ALLOW_ALL_BUFFERS_AND_TEXTURES;
+    }
+}
+
+struct D3D12_Allocation
+{
+    ID3D12Heap* heap = nullptr;
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    uint32_t pool = ~0u;
+    uint32_t heap_index = ~0u;
+    Tlsf_Allocation block = {};
+
+    bool is_valid() const { return heap != nullptr; }
+};
+
+// Relocates allocations for D3D12_Memory_Allocator::defragment. `move` recreates the placed resource
+// at `to`, records the copy and returns true, or returns false to leave the allocation where it is.
+class D3D12_Defragmentation_Handler
+{
+public:
+    virtual ~D3D12_Defragmentation_Handler() = default;
+    virtual bool move(const D3D12_Allocation& from, const D3D12_Allocation& to, void* user_data) = 0;
+};
+
+// Suballocates placed resources from large heaps, one pool of heaps per heap type and heap class.
+// Placement within a heap is done by a Tlsf_Allocator. Resources larger than the default heap size get
+// a dedicated heap. Not thread-safe.
+class D3D12_Memory_Allocator
+{
+public:
+    static constexpr uint64_t DEFAULT_HEAP_SIZE = 64ull << 20;
+
+    explicit D3D12_Memory_Allocator(ID3D12Device10* device, uint64_t heap_size = DEFAULT_HEAP_SIZE)
+        : m_device(device)
+        , m_heap_size(heap_size)
+    {
+        D3D12_FEATURE_DATA_D3D12_OPTIONS options = {};
+        throw_if_failed(device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &options, sizeof(options)));
+        m_resource_heap_tier = options.ResourceHeapTier;
+    }
+
+    D3D12_Memory_Allocator(const D3D12_Memory_Allocator&) = delete;
+    D3D12_Memory_Allocator& operator=(const D3D12_Memory_Allocator&) = delete;
+
+    D3D12_Heap_Class get_heap_class(const D3D12_RESOURCE_DESC1& desc) const
+    {
+        if (m_resource_heap_tier >= D3D12_RESOURCE_HEAP_TIER_2)
+        {
+            return D3D12_Heap_Class::Any;
+        }
+        if (desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
+        {
+            return D3D12_Heap_Class::Buffer;
+        }
+        if (desc.Flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL))
+        {
+            return D3D12_Heap_Class::Render_Target;
+        }
+        return D3D12_Heap_Class::Texture;
+    }
+
+    // Size and alignment as the driver reports them. With D3D12_RESOURCE_FLAG_USE_TIGHT_ALIGNMENT the
+    // alignment drops below the 64KiB default, so small buffers pack densely.
+    D3D12_RESOURCE_ALLOCATION_INFO get_allocation_info(const D3D12_RESOURCE_DESC1& desc) const
+    {
+        return m_device->GetResourceAllocationInfo2(0, 1, &desc, nullptr);
+    }
+
+    D3D12_Allocation allocate(
+        D3D12_HEAP_TYPE heap_type,
+        D3D12_Heap_Class heap_class,
+        const D3D12_RESOURCE_ALLOCATION_INFO& info,
+        void* user_data = nullptr)
+    {
+        auto pool_index = get_pool_index(heap_type, heap_class);
+        auto& pool = m_pools[pool_index];
+        for (uint32_t i = 0; i < pool.size(); ++i)
+        {
+            auto allocation = allocate_from_heap(pool_index, i, info, user_data);
+            if (allocation.is_valid())
+            {
+                return allocation;
+            }
+        }
+        auto heap_size = info.SizeInBytes > m_heap_size
+            ? (info.SizeInBytes + D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT - 1)
+                & ~uint64_t(D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT - 1)
+            : m_heap_size;
+        auto heap_index = create_heap(pool_index, heap_type, heap_class, heap_size, info.Alignment);
+        return allocate_from_heap(pool_index, heap_index, info, user_data);
+    }
+
+    // Allocates memory for `desc` and creates a placed resource in it. `allocation` receives the memory,
+    // the resource has to be released before the allocation is freed.
+    ComPtr<ID3D12Resource> create_resource(
+        D3D12_HEAP_TYPE heap_type,
+        const D3D12_RESOURCE_DESC1& desc,
+        D3D12_BARRIER_LAYOUT initial_layout,
+        const D3D12_CLEAR_VALUE* clear_value,
+        D3D12_Allocation& allocation,
+        void* user_data = nullptr)
+    {
+        allocation = allocate(heap_type, get_heap_class(desc), get_allocation_info(desc), user_data);
+        if (!allocation.is_valid())
+        {
+            throw std::exception();
+        }
+        ComPtr<ID3D12Resource> resource;
+        throw_if_failed(m_device->CreatePlacedResource2(
+            allocation.heap, allocation.offset, &desc, initial_layout, clear_value, 0, nullptr, IID_PPV_ARGS(&resource)));
+        return resource;
+    }
+
+    void free(const D3D12_Allocation& allocation)
+    {
+        if (!allocation.is_valid())
+        {
+            return;
+        }
+        auto& heap = *m_pools[allocation.pool][allocation.heap_index];
+        heap.user_data[allocation.block.block] = nullptr;
+        heap.allocator.free(allocation.block);
+    }
+
+    // The memory may still be in use by the GPU until `fence_value` completes.
+    void free_deferred(const D3D12_Allocation& allocation, uint64_t fence_value)
+    {
+        m_deferred_frees.push_back({ allocation, fence_value });
+    }
+
+    void retire(uint64_t completed_fence_value)
+    {
+        while (!m_deferred_frees.empty() && m_deferred_frees.front().fence_value <= completed_fence_value)
+        {
+            free(m_deferred_frees.front().allocation);
+            m_deferred_frees.pop_front();
+        }
+    }
+
+    // Tries to empty the least occupied heap of a pool by moving up to `max_moves` of its allocations
+    // into the other heaps. Moved-from memory is freed once `fence_value` completes.
+    // Returns the number of allocations moved.
+    uint32_t defragment(
+        D3D12_HEAP_TYPE heap_type,
+        D3D12_Heap_Class heap_class,
+        D3D12_Defragmentation_Handler& handler,
+        uint32_t max_moves,
+        uint64_t fence_value)
+    {
+        auto pool_index = get_pool_index(heap_type, heap_class);
+        auto& pool = m_pools[pool_index];
+        uint32_t source = ~0u;
+        for (uint32_t i = 0; i < pool.size(); ++i)
+        {
+            const auto& allocator = pool[i]->allocator;
+            if (allocator.is_empty() || allocator.get_size() != m_heap_size)
+            {
+                continue;
+            }
+            if (source == ~0u || allocator.get_allocated_bytes() < pool[source]->allocator.get_allocated_bytes())
+            {
+                source = i;
+            }
+        }
+        if (source == ~0u)
+        {
+            return 0;
+        }
+        std::vector<Tlsf_Allocation> candidates;
+        pool[source]->allocator.for_each_allocation([&](const Tlsf_Allocation& block) {
+            candidates.push_back(block);
+        });
+        uint32_t moves = 0;
+        for (const auto& block : candidates)
+        {
+            if (moves == max_moves)
+            {
+                break;
+            }
+            D3D12_Allocation from = {
+                .heap = pool[source]->heap.Get(),
+                .offset = block.offset,
+                .size = block.size,
+                .pool = pool_index,
+                .heap_index = source,
+                .block = block
+            };
+            auto user_data = pool[source]->user_data[block.block];
+            D3D12_RESOURCE_ALLOCATION_INFO info = { .SizeInBytes = block.size, .Alignment = pool[source]->alignment };
+            D3D12_Allocation to = {};
+            for (uint32_t i = 0; i < pool.size() && !to.is_valid(); ++i)
+            {
+                if (i != source)
+                {
+                    to = allocate_from_heap(pool_index, i, info, user_data);
+                }
+            }
+            if (!to.is_valid())
+            {
+                break;
+            }
+            if (!handler.move(from, to, user_data))
+            {
+                free(to);
+                continue;
+            }
+            free_deferred(from, fence_value);
+            moves += 1;
+        }
+        return moves;
+    }
+
+    // Releases heaps without allocations. Call once nothing is pending in free_deferred.
+    void release_empty_heaps()
+    {
+        for (auto& pool : m_pools)
+        {
+            // Heap indices are stored in live allocations, so only the tail can be popped.
+            while (!pool.empty() && pool.back()->allocator.is_empty())
+            {
+                pool.pop_back();
+            }
+        }
+    }
+
+    uint64_t get_allocated_bytes() const
+    {
+        uint64_t bytes = 0;
+        for (const auto& pool : m_pools)
+        {
+            for (const auto& heap : pool)
+            {
+                bytes += heap->allocator.get_allocated_bytes();
+            }
+        }
+        return bytes;
+    }
+
+    uint64_t get_reserved_bytes() const
+    {
+        uint64_t bytes = 0;
+        for (const auto& pool : m_pools)
+        {
+            for (const auto& heap : pool)
+            {
+                bytes += heap->allocator.get_size();
+            }
+        }
+        return bytes;
+    }
+
+private:
+    static constexpr uint32_t HEAP_TYPE_COUNT = 3;
+
+    struct Heap
+    {
+        ComPtr<ID3D12Heap> heap;
+        Tlsf_Allocator allocator;
+        uint64_t alignment;
+        std::vector<void*> user_data;
+    };
+
+    struct Deferred_Free
+    {
+        D3D12_Allocation allocation;
+        uint64_t fence_value;
+    };
+
+    static uint32_t get_pool_index(D3D12_HEAP_TYPE heap_type, D3D12_Heap_Class heap_class)
+    {
+        uint32_t type_index = 0;
+        switch (heap_type)
+        {
+        case D3D12_HEAP_TYPE_DEFAULT:
+            type_index = 0;
+            break;
+        case D3D12_HEAP_TYPE_UPLOAD:
+            type_index = 1;
+            break;
+        case D3D12_HEAP_TYPE_READBACK:
+            type_index = 2;
+            break;
+        default:
+            // GPU_UPLOAD and CUSTOM heaps have their own page properties, they must not share the DEFAULT pool.
+            throw std::exception();
+        }
+        return type_index * uint32_t(D3D12_Heap_Class::Count) + uint32_t(heap_class);
+    }
+
+    uint32_t create_heap(
+        uint32_t pool_index, D3D12_HEAP_TYPE heap_type, D3D12_Heap_Class heap_class, uint64_t size, uint64_t alignment)
+    {
+        // MSAA resources need 4MiB aligned heaps, everything else is fine with the 64KiB default.
+        auto heap_alignment = alignment > D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT
+            ? uint64_t(D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT)
+            : uint64_t(D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+        D3D12_HEAP_DESC heap_desc = {
+            .SizeInBytes = size,
+            .Properties = {
+                .Type = heap_type,
+                .CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+                .MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN,
+                .CreationNodeMask = 0,
+                .VisibleNodeMask = 0
+            },
+            .Alignment = heap_alignment,
+            .Flags = get_heap_flags(heap_class)
+        };
+        auto heap = std::make_unique<Heap>(Heap {
+            .heap = nullptr,
+            .allocator = Tlsf_Allocator(size),
+            .alignment = heap_alignment,
+            .user_data = {}
+        });
+        throw_if_failed(m_device->CreateHeap(&heap_desc, IID_PPV_ARGS(&heap->heap)));
+        auto& pool = m_pools[pool_index];
+        pool.push_back(std::move(heap));
+        return uint32_t(pool.size() - 1);
+    }
+
+    D3D12_Allocation allocate_from_heap(
+        uint32_t pool_index, uint32_t heap_index, const D3D12_RESOURCE_ALLOCATION_INFO& info, void* user_data)
+    {
+        auto& heap = *m_pools[pool_index][heap_index];
+        if (info.Alignment > heap.alignment)
+        {
+            return {};
+        }
+        auto block = heap.allocator.allocate(info.SizeInBytes, info.Alignment);
+        if (!block.is_valid())
+        {
+            return {};
+        }
+        if (heap.user_data.size() <= block.block)
+        {
+            heap.user_data.resize(block.block + 1);
+        }
+        heap.user_data[block.block] = user_data;
+        return {
+            .heap = heap.heap.Get(),
+            .offset = block.offset,
+            .size = block.size,
+            .pool = pool_index,
+            .heap_index = heap_index,
+            .block = block
+        };
+    }
+
+    ID3D12Device10* m_device;
+    uint64_t m_heap_size;
+    D3D12_RESOURCE_HEAP_TIER m_resource_heap_tier;
+    std::vector<std::unique_ptr<Heap>> m_pools[HEAP_TYPE_COUNT * uint32_t(D3D12_Heap_Class::Count)];
+    std::deque<Deferred_Free> m_deferred_frees;
+};
+
+// Memory for resources that only live within one frame. Resources are placed when they are first used
+// and their range is returned after the last use, so later resources alias the memory of earlier ones.
+// The first access to an acquired resource has to be a barrier from D3D12_BARRIER_LAYOUT_UNDEFINED with
+// D3D12_TEXTURE_BARRIER_FLAG_DISCARD (or a full overwrite for buffers).
+// Keep one pool per frame in flight and reset it once that frame retired. Callers that plan the aliasing
+// themselves, like D3D12_Render_Graph, place resources at their own offsets with acquire_at() instead.
+class D3D12_Transient_Pool
+{
+public:
+    D3D12_Transient_Pool(
+        ID3D12Device10* device, D3D12_Heap_Class heap_class, uint64_t size,
+        uint64_t alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT)
+        : m_device(device)
+        , m_allocator((size + alignment - 1) / alignment * alignment)
+        , m_alignment(alignment)
+    {
+        D3D12_HEAP_DESC heap_desc = {
+            .SizeInBytes = m_allocator.get_size(),
+            .Properties = {
+                .Type = D3D12_HEAP_TYPE_DEFAULT,
+                .CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+                .MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN,
+                .CreationNodeMask = 0,
+                .VisibleNodeMask = 0
+            },
+            .Alignment = alignment,
+            .Flags = get_heap_flags(heap_class)
+        };
+        throw_if_failed(device->CreateHeap(&heap_desc, IID_PPV_ARGS(&m_heap)));
+    }
+
+    D3D12_Transient_Pool(const D3D12_Transient_Pool&) = delete;
+    D3D12_Transient_Pool& operator=(const D3D12_Transient_Pool&) = delete;
+
+    // Returns nullptr if the pool is out of memory. Placed resources are cached by description and offset,
+    // so a frame graph that allocates the same way every frame creates no new resources after warm up.
+    ID3D12Resource* acquire(const D3D12_RESOURCE_DESC1& desc, const D3D12_CLEAR_VALUE* clear_value = nullptr)
+    {
+        auto info = m_device->GetResourceAllocationInfo2(0, 1, &desc, nullptr);
+        if (info.Alignment > m_alignment)
+        {
+            return nullptr;
+        }
+        auto block = m_allocator.allocate(info.SizeInBytes, info.Alignment);
+        if (!block.is_valid())
+        {
+            return nullptr;
+        }
+        auto& cached = get_placed_resource(desc, block.offset, clear_value);
+        cached.block = block;
+        return cached.resource.Get();
+    }
+
+    // Places the resource at `offset` without going through the pool's allocator, the caller makes sure
+    // resources in use at the same time don't overlap. Don't mix with acquire() in the same frame.
+    ID3D12Resource* acquire_at(
+        const D3D12_RESOURCE_DESC1& desc, uint64_t offset, const D3D12_CLEAR_VALUE* clear_value = nullptr)
+    {
+        return get_placed_resource(desc, offset, clear_value).resource.Get();
+    }
+
+    // The memory may be handed to a later acquire within the same frame.
+    void release(ID3D12Resource* resource)
+    {
+        for (auto& [key, cached] : m_resources)
+        {
+            if (cached.resource.Get() == resource && cached.block.is_valid())
+            {
+                m_allocator.free(cached.block);
+                cached.block = {};
+                return;
+            }
+        }
+    }
+
+    void reset()
+    {
+        for (auto& [key, cached] : m_resources)
+        {
+            if (cached.block.is_valid())
+            {
+                m_allocator.free(cached.block);
+                cached.block = {};
+            }
+        }
+    }
+
+    ID3D12Heap* get_heap() const { return m_heap.Get(); }
+    uint64_t get_size() const { return m_allocator.get_size(); }
+    uint64_t get_alignment() const { return m_alignment; }
+    const Tlsf_Allocator& get_allocator() const { return m_allocator; }
+
+private:
+    struct Cached_Resource
+    {
+        ComPtr<ID3D12Resource> resource;
+        Tlsf_Allocation block;
+    };
+
+    Cached_Resource& get_placed_resource(
+        const D3D12_RESOURCE_DESC1& desc, uint64_t offset, const D3D12_CLEAR_VALUE* clear_value)
+    {
+        // Field by field, the description has padding.
+        auto key = Hasher()
+            .add(desc.Dimension).add(desc.Width).add(desc.Height).add(desc.DepthOrArraySize).add(desc.MipLevels)
+            .add(desc.Format).add(desc.SampleDesc.Count).add(desc.SampleDesc.Quality).add(desc.Layout).add(desc.Flags)
+            .add(offset)
+            .get();
+        auto& cached = m_resources[key];
+        if (!cached.resource)
+        {
+            throw_if_failed(m_device->CreatePlacedResource2(
+                m_heap.Get(), offset, &desc, D3D12_BARRIER_LAYOUT_UNDEFINED, clear_value,
+                0, nullptr, IID_PPV_ARGS(&cached.resource)));
+        }
+        return cached;
+    }
+
+    ID3D12Device10* m_device;
+    ComPtr<ID3D12Heap> m_heap;
+    Tlsf_Allocator m_allocator;
+    uint64_t m_alignment;
+    std::unordered_map<uint64_t, Cached_Resource> m_resources;
+};
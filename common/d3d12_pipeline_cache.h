@@ -0,0 +1,64 @@
+#pragma once
+
+#include "d3d12_common.h"
+#include "pipeline_cache.h"
+
+#include <dxgi1_6.h>
+
+inline Pipeline_Cache_Device_Id get_pipeline_cache_device_id(IDXGIAdapter4* adapter)
+{
+    DXGI_ADAPTER_DESC3 adapter_desc = {};
+    throw_if_failed(adapter->GetDesc3(&adapter_desc));
+    LARGE_INTEGER umd_version = {};
+    if (FAILED(adapter->CheckInterfaceSupport(__uuidof(IDXGIDevice), &umd_version)))
+    {
+        umd_version.QuadPart = 0;
+    }
+    return {
+        .vendor_id = adapter_desc.VendorId,
+        .device_id = adapter_desc.DeviceId,
+        .subsys_id = adapter_desc.SubSysId,
+        .revision = adapter_desc.Revision,
+        .driver_version = uint64_t(umd_version.QuadPart)
+    };
+}
+
+// Creates the PSO from the cached blob if there is one. A blob the driver rejects is dropped and the
+// PSO gets compiled from scratch, freshly compiled PSOs have their blob stored back into the cache.
+inline ComPtr<ID3D12PipelineState> create_compute_pipeline_cached(
+    ID3D12Device* device,
+    Pipeline_Cache& cache,
+    D3D12_COMPUTE_PIPELINE_STATE_DESC pso_desc,
+    Shader_Blob root_signature_blob)
+{
+    ComPtr<ID3D12PipelineState> result;
+    auto key = make_compute_pipeline_key(
+        root_signature_blob,
+        { pso_desc.CS.pShaderBytecode, pso_desc.CS.BytecodeLength },
+        pso_desc.NodeMask,
+        uint32_t(pso_desc.Flags));
+    auto cached_blob = cache.find(key);
+    if (!cached_blob.empty())
+    {
+        pso_desc.CachedPSO = {
+            .pCachedBlob = cached_blob.data,
+            .CachedBlobSizeInBytes = cached_blob.size
+        };
+        if (SUCCEEDED(device->CreateComputePipelineState(&pso_desc, IID_PPV_ARGS(&result))))
+        {
+            return result;
+        }
+        cache.erase(key);
+    }
+    pso_desc.CachedPSO = {
+        .pCachedBlob = nullptr,
+        .CachedBlobSizeInBytes = 0
+    };
+    throw_if_failed(device->CreateComputePipelineState(&pso_desc, IID_PPV_ARGS(&result)));
+    ComPtr<ID3DBlob> blob;
+    if (SUCCEEDED(result->GetCachedBlob(&blob)))
+    {
+        cache.store(key, blob->GetBufferPointer(), blob->GetBufferSize());
+    }
+    return result;
+}
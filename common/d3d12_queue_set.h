@@ -0,0 +1,141 @@
+#pragma once
+
+#include "d3d12_common.h"
+#include "queue_planner.h"
+
+#include <span>
+#include <vector>
+
+inline D3D12_COMMAND_LIST_TYPE get_command_list_type(Queue_Type queue)
+{
+    switch (queue)
+    {
+    case Queue_Type::Compute:
+        return D3D12_COMMAND_LIST_TYPE_COMPUTE;
+    case Queue_Type::Copy:
+        return D3D12_COMMAND_LIST_TYPE_COPY;
+    default:
+        return D3D12_COMMAND_LIST_TYPE_DIRECT;
+    }
+}
+
+// The direct queue plus a compute and a copy queue, each with its own timeline fence.
+// submit() turns a Queue_Plan into ExecuteCommandLists, Signal and Wait calls and joins every queue back
+// into the direct queue at the end, so a fence signaled on the direct queue afterwards covers the whole frame.
+class D3D12_Queue_Set
+{
+public:
+    D3D12_Queue_Set(ID3D12Device* device, ID3D12CommandQueue* direct_queue)
+    {
+        m_queues[uint32_t(Queue_Type::Direct)] = direct_queue;
+        for (auto queue : { Queue_Type::Compute, Queue_Type::Copy })
+        {
+            D3D12_COMMAND_QUEUE_DESC queue_desc = {
+                .Type = get_command_list_type(queue),
+                .Priority = D3D12_COMMAND_QUEUE_PRIORITY_NORMAL,
+                .Flags = D3D12_COMMAND_QUEUE_FLAG_NONE,
+                .NodeMask = 0
+            };
+            throw_if_failed(device->CreateCommandQueue(&queue_desc, IID_PPV_ARGS(&m_owned_queues[uint32_t(queue)])));
+            m_queues[uint32_t(queue)] = m_owned_queues[uint32_t(queue)].Get();
+        }
+        for (auto& fence : m_fences)
+        {
+            throw_if_failed(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&fence)));
+        }
+    }
+
+    D3D12_Queue_Set(const D3D12_Queue_Set&) = delete;
+    D3D12_Queue_Set& operator=(const D3D12_Queue_Set&) = delete;
+
+    // `cmds[i]` holds the commands of plan.passes[i] and has the type of its queue.
+    // Consecutive passes on a queue without a wait or signal in between share one ExecuteCommandLists.
+    // `join_cmd`, if any, runs on the direct queue after all queues were joined.
+    void submit(const Queue_Plan& plan, std::span<ID3D12CommandList* const> cmds, ID3D12CommandList* join_cmd = nullptr)
+    {
+        bool uses_other_queues = plan.pass_counts[uint32_t(Queue_Type::Compute)] > 0
+            || plan.pass_counts[uint32_t(Queue_Type::Copy)] > 0;
+        if (uses_other_queues)
+        {
+            // Order this frame's async work after everything submitted to the direct queue so far,
+            // otherwise it could overlap the previous frame's accesses to the same resources.
+            signal(Queue_Type::Direct, ++m_values[uint32_t(Queue_Type::Direct)]);
+            for (auto queue : { Queue_Type::Compute, Queue_Type::Copy })
+            {
+                if (plan.pass_counts[uint32_t(queue)] > 0)
+                {
+                    wait(queue, Queue_Type::Direct, m_values[uint32_t(Queue_Type::Direct)]);
+                }
+            }
+        }
+        uint64_t base_values[QUEUE_TYPE_COUNT];
+        for (uint32_t q = 0; q < QUEUE_TYPE_COUNT; ++q)
+        {
+            base_values[q] = m_values[q];
+        }
+        for (uint32_t i = 0; i < plan.passes.size(); ++i)
+        {
+            const auto& pass = plan.passes[i];
+            if (!pass.waits.empty())
+            {
+                flush(pass.queue);
+                for (const auto& queue_wait : pass.waits)
+                {
+                    wait(pass.queue, queue_wait.queue, base_values[uint32_t(queue_wait.queue)] + queue_wait.value);
+                }
+            }
+            m_batches[uint32_t(pass.queue)].push_back(cmds[i]);
+            if (pass.signal)
+            {
+                flush(pass.queue);
+                signal(pass.queue, base_values[uint32_t(pass.queue)] + pass.value);
+            }
+        }
+        for (uint32_t q = 0; q < QUEUE_TYPE_COUNT; ++q)
+        {
+            flush(Queue_Type(q));
+            m_values[q] = base_values[q] + plan.pass_counts[q];
+        }
+        for (auto queue : { Queue_Type::Compute, Queue_Type::Copy })
+        {
+            if (plan.pass_counts[uint32_t(queue)] > 0)
+            {
+                wait(Queue_Type::Direct, queue, m_values[uint32_t(queue)]);
+            }
+        }
+        if (join_cmd)
+        {
+            m_queues[uint32_t(Queue_Type::Direct)]->ExecuteCommandLists(1, &join_cmd);
+        }
+    }
+
+    ID3D12CommandQueue* get_queue(Queue_Type queue) const { return m_queues[uint32_t(queue)]; }
+    ID3D12Fence* get_fence(Queue_Type queue) const { return m_fences[uint32_t(queue)].Get(); }
+
+private:
+    void flush(Queue_Type queue)
+    {
+        auto& batch = m_batches[uint32_t(queue)];
+        if (!batch.empty())
+        {
+            m_queues[uint32_t(queue)]->ExecuteCommandLists(uint32_t(batch.size()), batch.data());
+            batch.clear();
+        }
+    }
+
+    void signal(Queue_Type queue, uint64_t value)
+    {
+        throw_if_failed(m_queues[uint32_t(queue)]->Signal(m_fences[uint32_t(queue)].Get(), value));
+    }
+
+    void wait(Queue_Type queue, Queue_Type on_queue, uint64_t value)
+    {
+        throw_if_failed(m_queues[uint32_t(queue)]->Wait(m_fences[uint32_t(on_queue)].Get(), value));
+    }
+
+    ID3D12CommandQueue* m_queues[QUEUE_TYPE_COUNT] = {};
+    ComPtr<ID3D12CommandQueue> m_owned_queues[QUEUE_TYPE_COUNT];
+    ComPtr<ID3D12Fence> m_fences[QUEUE_TYPE_COUNT];
+    uint64_t m_values[QUEUE_TYPE_COUNT] = {};
+    std::vector<ID3D12CommandList*> m_batches[QUEUE_TYPE_COUNT];
+};
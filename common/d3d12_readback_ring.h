@@ -0,0 +1,181 @@
+#pragma once
+
+#include "d3d12_common.h"
+#include "readback_queue.h"
+
+#include <cstddef>
+#include <span>
+
+// Readback heap buffer split into `slot_count` slots of `slot_size` bytes, persistently mapped.
+// Copies are recorded into a free slot and can be read in place once their fence value completed,
+// either by polling try_get() or from a callback run by update().
+// Like its Readback_Queue, the ring is driven by a single thread. Command lists recorded on other threads
+// take their slot from request_texture() on that thread and only call record_texture_copy() themselves.
+class D3D12_Readback_Ring
+{
+public:
+    using Callback = std::function<void(std::span<const std::byte> data)>;
+
+    D3D12_Readback_Ring(ID3D12Device* device, uint32_t slot_count, uint64_t slot_size)
+        : m_queue(slot_count)
+        , m_slot_size(
+            (slot_size + D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT - 1) & ~uint64_t(D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT - 1))
+        , m_sizes(slot_count, 0)
+    {
+        D3D12_HEAP_PROPERTIES heap_props = {
+            .Type = D3D12_HEAP_TYPE_READBACK,
+            .CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+            .MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN,
+            .CreationNodeMask = 0,
+            .VisibleNodeMask = 0
+        };
+        D3D12_RESOURCE_DESC resource_desc = {
+            .Dimension = D3D12_RESOURCE_DIMENSION_BUFFER,
+            .Alignment = 0,
+            .Width = m_slot_size * slot_count,
+            .Height = 1,
+            .DepthOrArraySize = 1,
+            .MipLevels = 1,
+            .Format = DXGI_FORMAT_UNKNOWN,
+            .SampleDesc = { .Count = 1, .Quality = 0 },
+            .Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
+            .Flags = D3D12_RESOURCE_FLAG_NONE
+        };
+        throw_if_failed(device->CreateCommittedResource(
+            &heap_props, D3D12_HEAP_FLAG_NONE, &resource_desc, D3D12_RESOURCE_STATE_COPY_DEST,
+            nullptr, IID_PPV_ARGS(&m_buffer)));
+        void* cpu_base = nullptr;
+        throw_if_failed(m_buffer->Map(0, nullptr, &cpu_base));
+        m_cpu_base = static_cast<const std::byte*>(cpu_base);
+    }
+
+    ~D3D12_Readback_Ring()
+    {
+        D3D12_RANGE written_range = { .Begin = 0, .End = 0 };
+        m_buffer->Unmap(0, &written_range);
+    }
+
+    D3D12_Readback_Ring(const D3D12_Readback_Ring&) = delete;
+    D3D12_Readback_Ring& operator=(const D3D12_Readback_Ring&) = delete;
+
+    // Records a copy of `size` bytes of `source` at `source_offset`. The source has to be in a state that
+    // allows copy reads. Returns an invalid ticket if no slot is free or the copy doesn't fit in a slot.
+    Readback_Ticket read_buffer(
+        ID3D12GraphicsCommandList* cmd, ID3D12Resource* source, uint64_t source_offset, uint64_t size, Callback callback = {})
+    {
+        if (size > m_slot_size)
+        {
+            return {};
+        }
+        auto ticket = m_queue.request(wrap(std::move(callback)));
+        if (!ticket.is_valid())
+        {
+            return {};
+        }
+        m_sizes[ticket.slot] = size;
+        cmd->CopyBufferRegion(m_buffer.Get(), get_slot_offset(ticket.slot), source, source_offset, size);
+        return ticket;
+    }
+
+    // Records a copy of one texture subresource. The data is laid out as in `footprint` (see
+    // GetCopyableFootprints), its Offset is ignored.
+    Readback_Ticket read_texture(
+        ID3D12GraphicsCommandList* cmd,
+        ID3D12Resource* source,
+        uint32_t subresource,
+        D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint,
+        Callback callback = {})
+    {
+        auto ticket = request_texture(footprint, std::move(callback));
+        if (ticket.is_valid())
+        {
+            record_texture_copy(cmd, ticket, source, subresource, footprint);
+        }
+        return ticket;
+    }
+
+    // The first half of read_texture(): takes a slot for a copy laid out as in `footprint`. Returns an
+    // invalid ticket if no slot is free or the copy doesn't fit in a slot.
+    Readback_Ticket request_texture(const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& footprint, Callback callback = {})
+    {
+        uint64_t size = uint64_t(footprint.Footprint.RowPitch) * footprint.Footprint.Height * footprint.Footprint.Depth;
+        if (size > m_slot_size)
+        {
+            return {};
+        }
+        auto ticket = m_queue.request(wrap(std::move(callback)));
+        if (!ticket.is_valid())
+        {
+            return {};
+        }
+        m_sizes[ticket.slot] = size;
+        return ticket;
+    }
+
+    // The second half: records the copy into the slot of a request_texture() ticket. Doesn't touch the
+    // queue, so passes recorded on job system workers can call it. Submit after the list was recorded.
+    void record_texture_copy(
+        ID3D12GraphicsCommandList* cmd,
+        Readback_Ticket ticket,
+        ID3D12Resource* source,
+        uint32_t subresource,
+        D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint) const
+    {
+        footprint.Offset = get_slot_offset(ticket.slot);
+        D3D12_TEXTURE_COPY_LOCATION dst = {
+            .pResource = m_buffer.Get(),
+            .Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT,
+            .PlacedFootprint = footprint
+        };
+        D3D12_TEXTURE_COPY_LOCATION src = {
+            .pResource = source,
+            .Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX,
+            .SubresourceIndex = subresource
+        };
+        cmd->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+    }
+
+    // All copies recorded since the last call complete with `fence_value`.
+    void submit(uint64_t fence_value) { m_queue.submit(fence_value); }
+    void update(uint64_t completed_fence_value) { m_queue.update(completed_fence_value); }
+
+    // Empty until the copy completed. Points straight into the mapped buffer, valid until release().
+    std::span<const std::byte> try_get(Readback_Ticket ticket) const
+    {
+        auto slot = m_queue.try_get(ticket);
+        if (slot == INVALID_READBACK_SLOT)
+        {
+            return {};
+        }
+        return get_slot_data(slot);
+    }
+
+    void release(Readback_Ticket ticket) { m_queue.release(ticket); }
+
+    Readback_Queue& get_queue() { return m_queue; }
+    ID3D12Resource* get_resource() const { return m_buffer.Get(); }
+    uint64_t get_slot_size() const { return m_slot_size; }
+
+private:
+    uint64_t get_slot_offset(uint32_t slot) const { return uint64_t(slot) * m_slot_size; }
+
+    std::span<const std::byte> get_slot_data(uint32_t slot) const
+    {
+        return { m_cpu_base + get_slot_offset(slot), size_t(m_sizes[slot]) };
+    }
+
+    Readback_Queue::Callback wrap(Callback callback)
+    {
+        if (!callback)
+        {
+            return {};
+        }
+        return [this, callback = std::move(callback)](uint32_t slot) { callback(get_slot_data(slot)); };
+    }
+
+    Readback_Queue m_queue;
+    uint64_t m_slot_size;
+    std::vector<uint64_t> m_sizes;
+    ComPtr<ID3D12Resource> m_buffer;
+    const std::byte* m_cpu_base = nullptr;
+};
@@ -0,0 +1,480 @@
+#pragma once
+
+#include "d3d12_memory_allocator.h"
+#include "queue_planner.h"
+#include "render_graph.h"
+#include "resource_state_tracker.h"
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+inline D3D12_BARRIER_SYNC get_stage_sync(uint32_t stages)
+{
+    uint32_t sync = D3D12_BARRIER_SYNC_NONE;
+    if (stages & RENDER_GRAPH_STAGE_GRAPHICS)
+    {
+        sync |= D3D12_BARRIER_SYNC_DRAW;
+    }
+    if (stages & RENDER_GRAPH_STAGE_COMPUTE)
+    {
+        sync |= D3D12_BARRIER_SYNC_COMPUTE_SHADING;
+    }
+    if (stages & RENDER_GRAPH_STAGE_COPY)
+    {
+        sync |= D3D12_BARRIER_SYNC_COPY;
+    }
+    return D3D12_BARRIER_SYNC(sync);
+}
+
+inline D3D12_BARRIER_SYNC get_shading_sync(uint32_t stages)
+{
+    uint32_t sync = D3D12_BARRIER_SYNC_NONE;
+    if (stages & RENDER_GRAPH_STAGE_GRAPHICS)
+    {
+        sync |= D3D12_BARRIER_SYNC_ALL_SHADING;
+    }
+    if (stages & RENDER_GRAPH_STAGE_COMPUTE)
+    {
+        sync |= D3D12_BARRIER_SYNC_COMPUTE_SHADING;
+    }
+    return D3D12_BARRIER_SYNC(sync);
+}
+
+inline Resource_State get_resource_state(Resource_Access access)
+{
+    switch (access.usage)
+    {
+    case Resource_Usage::Shader_Read:
+        return { D3D12_BARRIER_LAYOUT_SHADER_RESOURCE, get_shading_sync(access.stages), D3D12_BARRIER_ACCESS_SHADER_RESOURCE };
+    case Resource_Usage::Unordered_Access:
+        return { D3D12_BARRIER_LAYOUT_UNORDERED_ACCESS, get_shading_sync(access.stages), D3D12_BARRIER_ACCESS_UNORDERED_ACCESS };
+    case Resource_Usage::Render_Target:
+        return { D3D12_BARRIER_LAYOUT_RENDER_TARGET, D3D12_BARRIER_SYNC_RENDER_TARGET, D3D12_BARRIER_ACCESS_RENDER_TARGET };
+    case Resource_Usage::Depth_Read:
+        return { D3D12_BARRIER_LAYOUT_DEPTH_STENCIL_READ, D3D12_BARRIER_SYNC_DEPTH_STENCIL, D3D12_BARRIER_ACCESS_DEPTH_STENCIL_READ };
+    case Resource_Usage::Depth_Write:
+        return { D3D12_BARRIER_LAYOUT_DEPTH_STENCIL_WRITE, D3D12_BARRIER_SYNC_DEPTH_STENCIL, D3D12_BARRIER_ACCESS_DEPTH_STENCIL_WRITE };
+    case Resource_Usage::Copy_Source:
+        return { D3D12_BARRIER_LAYOUT_COPY_SOURCE, D3D12_BARRIER_SYNC_COPY, D3D12_BARRIER_ACCESS_COPY_SOURCE };
+    case Resource_Usage::Copy_Dest:
+        return { D3D12_BARRIER_LAYOUT_COPY_DEST, D3D12_BARRIER_SYNC_COPY, D3D12_BARRIER_ACCESS_COPY_DEST };
+    case Resource_Usage::Indirect_Argument:
+        return { D3D12_BARRIER_LAYOUT_UNDEFINED, D3D12_BARRIER_SYNC_EXECUTE_INDIRECT, D3D12_BARRIER_ACCESS_INDIRECT_ARGUMENT };
+    case Resource_Usage::Present:
+        return { D3D12_BARRIER_LAYOUT_PRESENT, D3D12_BARRIER_SYNC_NONE, D3D12_BARRIER_ACCESS_NO_ACCESS };
+    default:
+        return { D3D12_BARRIER_LAYOUT_UNDEFINED, get_stage_sync(access.stages), D3D12_BARRIER_ACCESS_NO_ACCESS };
+    }
+}
+
+// Stages whose work a queue can execute, see Render_Graph_Stage.
+inline uint32_t get_queue_stages(Queue_Type queue)
+{
+    switch (queue)
+    {
+    case Queue_Type::Compute:
+        return RENDER_GRAPH_STAGE_COMPUTE | RENDER_GRAPH_STAGE_COPY;
+    case Queue_Type::Copy:
+        return RENDER_GRAPH_STAGE_COPY;
+    default:
+        return RENDER_GRAPH_STAGE_GRAPHICS | RENDER_GRAPH_STAGE_COMPUTE | RENDER_GRAPH_STAGE_COPY;
+    }
+}
+
+// Whether a barrier from or to `usage` can be issued on `queue`.
+inline bool is_queue_compatible(Resource_Usage usage, Queue_Type queue)
+{
+    switch (usage)
+    {
+    case Resource_Usage::Undefined:
+    case Resource_Usage::Copy_Source:
+    case Resource_Usage::Copy_Dest:
+        return true;
+    case Resource_Usage::Shader_Read:
+    case Resource_Usage::Unordered_Access:
+    case Resource_Usage::Indirect_Argument:
+        return queue != Queue_Type::Copy;
+    default:
+        return queue == Queue_Type::Direct;
+    }
+}
+
+inline bool is_queue_compatible(D3D12_BARRIER_LAYOUT layout, Queue_Type queue)
+{
+    switch (layout)
+    {
+    case D3D12_BARRIER_LAYOUT_UNDEFINED:
+    case D3D12_BARRIER_LAYOUT_COMMON:
+    case D3D12_BARRIER_LAYOUT_COPY_SOURCE:
+    case D3D12_BARRIER_LAYOUT_COPY_DEST:
+        return true;
+    case D3D12_BARRIER_LAYOUT_GENERIC_READ:
+    case D3D12_BARRIER_LAYOUT_SHADER_RESOURCE:
+    case D3D12_BARRIER_LAYOUT_UNORDERED_ACCESS:
+        return queue != Queue_Type::Copy;
+    default:
+        return queue == Queue_Type::Direct;
+    }
+}
+
+// D3D12 backend of Render_Graph. Rebuild the graph every frame between begin() and end():
+// - transient resources are placed at their compiled offsets in one D3D12_Transient_Pool per heap class,
+//   which caches them by description and offset so a stable graph creates none after the first frame;
+// - imported resources start in their state from the Resource_State_Registry, end() writes their final
+//   state back;
+// - every barrier is known after compile(), so passes can be recorded on any thread in any order;
+// - compute and copy passes whose barriers the other queues can issue are offered to the Queue_Planner,
+//   submit the lists with D3D12_Queue_Set. Barriers on those queues drop the sync of stages that ran on
+//   another queue, the planner's fence waits already order them.
+// Transient memory is reused by the next frame right away, which relies on submissions to a queue not
+// overlapping across ExecuteCommandLists calls.
+class D3D12_Render_Graph
+{
+public:
+    using Execute_Function = std::function<void(ID3D12GraphicsCommandList7* cmd)>;
+
+    D3D12_Render_Graph(ID3D12Device10* device, D3D12_Memory_Allocator& allocator, Resource_State_Registry& registry)
+        : m_device(device)
+        , m_allocator(allocator)
+        , m_registry(registry)
+    {}
+
+    D3D12_Render_Graph(const D3D12_Render_Graph&) = delete;
+    D3D12_Render_Graph& operator=(const D3D12_Render_Graph&) = delete;
+
+    void begin()
+    {
+        m_graph.clear();
+        m_resources.clear();
+        m_executes.clear();
+    }
+
+    Render_Graph_Resource_Handle create_resource(
+        std::string name, const D3D12_RESOURCE_DESC1& desc, const D3D12_CLEAR_VALUE* clear_value = nullptr)
+    {
+        auto heap_class = m_allocator.get_heap_class(desc);
+        auto info = m_allocator.get_allocation_info(desc);
+        auto handle = m_graph.create_resource(std::move(name), info.SizeInBytes, info.Alignment, uint32_t(heap_class));
+        m_resources.push_back({
+            .resource = nullptr,
+            .desc = desc,
+            .clear_value = clear_value ? *clear_value : D3D12_CLEAR_VALUE {},
+            .has_clear_value = clear_value != nullptr,
+            .alignment = info.Alignment
+        });
+        return handle;
+    }
+
+    Render_Graph_Resource_Handle import_resource(std::string name, ID3D12Resource* resource, Resource_Access final_access = {})
+    {
+        auto handle = m_graph.import_resource(std::move(name), final_access);
+        m_resources.push_back({ .resource = resource, .desc = {}, .clear_value = {}, .has_clear_value = false, .alignment = 0 });
+        return handle;
+    }
+
+    Render_Graph_Pass_Handle add_pass(std::string name, Render_Graph_Pass_Type type, Execute_Function execute)
+    {
+        m_executes.push_back(std::move(execute));
+        return m_graph.add_pass(std::move(name), type);
+    }
+
+    void read(Render_Graph_Pass_Handle pass, Render_Graph_Resource_Handle resource, Resource_Usage usage)
+    {
+        m_graph.read(pass, resource, usage);
+    }
+
+    void write(Render_Graph_Pass_Handle pass, Render_Graph_Resource_Handle resource, Resource_Usage usage)
+    {
+        m_graph.write(pass, resource, usage);
+    }
+
+    void set_side_effects(Render_Graph_Pass_Handle pass) { m_graph.set_side_effects(pass); }
+
+    // Schedules the graph, plans the queues, (re)creates the transient pools and binds every transient to a
+    // placed resource. Without `allow_async_queues` everything runs on the direct queue.
+    void compile(bool allow_async_queues = false)
+    {
+        m_graph.compile(m_compiled);
+        plan_queues(allow_async_queues);
+        auto group_count = uint32_t(m_compiled.memory_group_sizes.size());
+        if (m_pools.size() < group_count)
+        {
+            m_pools.resize(group_count);
+        }
+        for (uint32_t group = 0; group < group_count; ++group)
+        {
+            uint64_t alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+            for (uint32_t r = 0; r < m_resources.size(); ++r)
+            {
+                if (is_placed(r, group) && m_resources[r].alignment > alignment)
+                {
+                    alignment = m_resources[r].alignment;
+                }
+            }
+            grow_memory(group, m_compiled.memory_group_sizes[group], alignment);
+        }
+        for (uint32_t r = 0; r < m_resources.size(); ++r)
+        {
+            auto offset = m_compiled.transient_offsets[r];
+            if (m_graph.is_imported(r) || offset == INVALID_TRANSIENT_OFFSET)
+            {
+                continue;
+            }
+            auto& resource = m_resources[r];
+            auto group = uint32_t(m_allocator.get_heap_class(resource.desc));
+            resource.resource = m_pools[group]->acquire_at(
+                resource.desc, offset, resource.has_clear_value ? &resource.clear_value : nullptr);
+        }
+    }
+
+    // Valid after compile(). nullptr for transients of culled passes.
+    ID3D12Resource* get_resource(Render_Graph_Resource_Handle handle) const { return m_resources[handle.index].resource; }
+
+    uint32_t get_scheduled_pass_count() const { return uint32_t(m_compiled.passes.size()); }
+    const std::string& get_scheduled_pass_name(uint32_t index) const
+    {
+        return m_graph.get_pass_name(m_compiled.passes[index].pass);
+    }
+    Render_Graph_Pass_Type get_scheduled_pass_type(uint32_t index) const
+    {
+        return m_graph.get_pass_type(m_compiled.passes[index].pass);
+    }
+    Queue_Type get_scheduled_pass_queue(uint32_t index) const { return m_plan.passes[index].queue; }
+    const Queue_Plan& get_queue_plan() const { return m_plan; }
+
+    // Records the barriers and the commands of the `index`th pass in execution order into a list of the
+    // pass' queue type. Different passes may record concurrently. If everything runs on the direct queue
+    // the last pass also transitions imported resources into their final access.
+    void record_pass(uint32_t index, ID3D12GraphicsCommandList7* cmd) const
+    {
+        const auto& pass = m_compiled.passes[index];
+        auto queue = m_plan.passes[index].queue;
+        Barrier_Batcher<> barriers(cmd);
+        for (const auto& barrier : pass.barriers)
+        {
+            append_barrier(barriers, barrier, queue);
+        }
+        barriers.flush();
+        if (m_executes[pass.pass])
+        {
+            m_executes[pass.pass](cmd);
+        }
+        if (index + 1 == m_compiled.passes.size() && !needs_final_command_list())
+        {
+            record_final_barriers(cmd);
+        }
+    }
+
+    // With async queues in use the final transitions go into an extra direct list submitted after the
+    // queues were joined.
+    bool needs_final_command_list() const
+    {
+        return !m_compiled.final_barriers.empty()
+            && (m_plan.pass_counts[uint32_t(Queue_Type::Compute)] > 0 || m_plan.pass_counts[uint32_t(Queue_Type::Copy)] > 0);
+    }
+
+    void record_final_barriers(ID3D12GraphicsCommandList7* cmd) const
+    {
+        Barrier_Batcher<> barriers(cmd);
+        for (const auto& barrier : m_compiled.final_barriers)
+        {
+            append_barrier(barriers, barrier, Queue_Type::Direct);
+        }
+        barriers.flush();
+    }
+
+    // Commits the imported resources' final states. Replaced transient pools are released once
+    // `fence_value`, the value signaled after this frame's work, completed.
+    void end(uint64_t fence_value)
+    {
+        for (uint32_t r = 0; r < m_resources.size(); ++r)
+        {
+            if (!m_graph.is_imported(r) || m_compiled.final_accesses[r].usage == Resource_Usage::Undefined)
+            {
+                continue;
+            }
+            if (auto entry = m_registry.find(m_resources[r].resource))
+            {
+                auto state = get_resource_state(m_compiled.final_accesses[r]);
+                for (auto& subresource_state : entry->states)
+                {
+                    subresource_state = state;
+                }
+            }
+        }
+        for (auto& pool : m_pending_retirements)
+        {
+            m_retired.push_back({ std::move(pool), fence_value });
+        }
+        m_pending_retirements.clear();
+    }
+
+    void retire(uint64_t completed_fence_value)
+    {
+        while (!m_retired.empty() && m_retired.front().fence_value <= completed_fence_value)
+        {
+            m_retired.pop_front();
+        }
+    }
+
+    const Render_Graph& get_graph() const { return m_graph; }
+    const Compiled_Render_Graph& get_compiled() const { return m_compiled; }
+
+private:
+    struct Graph_Resource
+    {
+        ID3D12Resource* resource;
+        D3D12_RESOURCE_DESC1 desc;
+        D3D12_CLEAR_VALUE clear_value;
+        bool has_clear_value;
+        uint64_t alignment;
+    };
+
+    struct Retired_Pool
+    {
+        std::unique_ptr<D3D12_Transient_Pool> pool;
+        uint64_t fence_value;
+    };
+
+    bool is_placed(uint32_t resource, uint32_t group) const
+    {
+        return !m_graph.is_imported(resource)
+            && m_compiled.transient_offsets[resource] != INVALID_TRANSIENT_OFFSET
+            && uint32_t(m_allocator.get_heap_class(m_resources[resource].desc)) == group;
+    }
+
+    void plan_queues(bool allow_async_queues)
+    {
+        std::vector<Queue_Plan_Input> inputs(m_compiled.passes.size());
+        for (uint32_t i = 0; i < inputs.size(); ++i)
+        {
+            const auto& pass = m_compiled.passes[i];
+            auto queue = Queue_Type::Direct;
+            if (allow_async_queues)
+            {
+                switch (m_graph.get_pass_type(pass.pass))
+                {
+                case Render_Graph_Pass_Type::Compute:
+                    queue = Queue_Type::Compute;
+                    break;
+                case Render_Graph_Pass_Type::Copy:
+                    queue = Queue_Type::Copy;
+                    break;
+                default:
+                    break;
+                }
+            }
+            for (const auto& barrier : pass.barriers)
+            {
+                if (queue != Queue_Type::Direct && !can_issue_barrier(barrier, queue))
+                {
+                    queue = Queue_Type::Direct;
+                }
+            }
+            inputs[i] = { .preferred_queue = queue, .dependencies = pass.dependencies };
+        }
+        m_plan = Queue_Planner::plan(inputs);
+    }
+
+    bool can_issue_barrier(const Render_Graph_Barrier& barrier, Queue_Type queue) const
+    {
+        if (!is_queue_compatible(barrier.after.usage, queue))
+        {
+            return false;
+        }
+        if (!barrier.is_external)
+        {
+            return is_queue_compatible(barrier.before.usage, queue);
+        }
+        auto entry = m_registry.find(m_resources[barrier.resource].resource);
+        return !entry || entry->dimensions.is_buffer || is_queue_compatible(entry->states[0].layout, queue);
+    }
+
+    void grow_memory(uint32_t group, uint64_t size, uint64_t alignment)
+    {
+        auto& pool = m_pools[group];
+        if (size == 0 || (pool && pool->get_size() >= size && pool->get_alignment() >= alignment))
+        {
+            return;
+        }
+        if (pool)
+        {
+            m_pending_retirements.push_back(std::move(pool));
+        }
+        pool = std::make_unique<D3D12_Transient_Pool>(m_device, D3D12_Heap_Class(group), size, alignment);
+    }
+
+    void append_barrier(Barrier_Batcher<>& barriers, const Render_Graph_Barrier& barrier, Queue_Type queue) const
+    {
+        auto resource = m_resources[barrier.resource].resource;
+        auto before_access = barrier.before;
+        before_access.stages &= get_queue_stages(queue);
+        auto before = get_resource_state(before_access);
+        if (before_access.stages == RENDER_GRAPH_STAGE_NONE)
+        {
+            // Nothing on this queue to wait for.
+            before.sync = D3D12_BARRIER_SYNC_NONE;
+            before.access = D3D12_BARRIER_ACCESS_NO_ACCESS;
+        }
+        auto after = get_resource_state(barrier.after);
+        bool is_buffer = false;
+        if (m_graph.is_imported(barrier.resource))
+        {
+            auto entry = m_registry.find(resource);
+            if (entry && barrier.is_external)
+            {
+                before = entry->states[0];
+                if (queue != Queue_Type::Direct)
+                {
+                    // D3D12_Queue_Set orders async work after all earlier direct queue work.
+                    before.sync = D3D12_BARRIER_SYNC_NONE;
+                    before.access = D3D12_BARRIER_ACCESS_NO_ACCESS;
+                }
+            }
+            is_buffer = entry && entry->dimensions.is_buffer;
+        }
+        else
+        {
+            is_buffer = m_resources[barrier.resource].desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER;
+        }
+        if (is_buffer)
+        {
+            barriers.buffer({
+                .SyncBefore = before.sync,
+                .SyncAfter = after.sync,
+                .AccessBefore = before.access,
+                .AccessAfter = after.access,
+                .pResource = resource,
+                .Offset = 0,
+                .Size = UINT64_MAX
+            });
+            return;
+        }
+        barriers.texture({
+            .SyncBefore = before.sync,
+            .SyncAfter = after.sync,
+            .AccessBefore = before.access,
+            .AccessAfter = after.access,
+            .LayoutBefore = before.layout,
+            .LayoutAfter = after.layout,
+            .pResource = resource,
+            .Subresources = ALL_SUBRESOURCE_RANGE,
+            .Flags = barrier.is_discard ? D3D12_TEXTURE_BARRIER_FLAG_DISCARD : D3D12_TEXTURE_BARRIER_FLAG_NONE
+        });
+    }
+
+    ID3D12Device10* m_device;
+    D3D12_Memory_Allocator& m_allocator;
+    Resource_State_Registry& m_registry;
+    Render_Graph m_graph;
+    Compiled_Render_Graph m_compiled;
+    Queue_Plan m_plan;
+    std::vector<Graph_Resource> m_resources;
+    std::vector<Execute_Function> m_executes;
+    std::vector<std::unique_ptr<D3D12_Transient_Pool>> m_pools;
+    std::vector<std::unique_ptr<D3D12_Transient_Pool>> m_pending_retirements;
+    std::deque<Retired_Pool> m_retired;
+};
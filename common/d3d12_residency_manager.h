@@ -0,0 +1,158 @@
+#pragma once
+
+#include "d3d12_common.h"
+#include "residency_policy.h"
+
+#include <array>
+#include <cstdint>
+#include <dxgi1_6.h>
+#include <span>
+#include <vector>
+
+struct D3D12_Residency_Handle
+{
+    DXGI_MEMORY_SEGMENT_GROUP segment = DXGI_MEMORY_SEGMENT_GROUP_LOCAL;
+    uint32_t id = INVALID_RESIDENCY_ID;
+
+    bool is_valid() const { return id != INVALID_RESIDENCY_ID; }
+};
+
+// Keeps tracked heaps within the adapter's video memory budget, one Residency_Policy per memory
+// segment. The budget of the tracked heaps is what QueryVideoMemoryInfo reports minus the usage of
+// everything untracked, it is queried again after budget change notifications and after heaps were
+// tracked or untracked. Evicted heaps come back through EnqueueMakeResident, the queues wait on its
+// fence, so the CPU never blocks on paging. Heaps and committed resources work alike, both are pageable.
+class D3D12_Residency_Manager
+{
+public:
+    D3D12_Residency_Manager(ID3D12Device3* device, IDXGIAdapter3* adapter)
+        : m_device(device)
+        , m_adapter(adapter)
+    {
+        throw_if_failed(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_fence)));
+        m_budget_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+        if (m_budget_event == NULL)
+        {
+            throw_if_failed(HRESULT_FROM_WIN32(GetLastError()));
+        }
+        throw_if_failed(adapter->RegisterVideoMemoryBudgetChangeNotificationEvent(m_budget_event, &m_budget_cookie));
+    }
+
+    ~D3D12_Residency_Manager()
+    {
+        m_adapter->UnregisterVideoMemoryBudgetChangeNotification(m_budget_cookie);
+        CloseHandle(m_budget_event);
+    }
+
+    D3D12_Residency_Manager(const D3D12_Residency_Manager&) = delete;
+    D3D12_Residency_Manager& operator=(const D3D12_Residency_Manager&) = delete;
+
+    // `object` is resident, as it is after creation. Upload and readback heaps live in NON_LOCAL memory
+    // on discrete adapters, everything else in LOCAL.
+    D3D12_Residency_Handle track(ID3D12Pageable* object, uint64_t size, DXGI_MEMORY_SEGMENT_GROUP segment)
+    {
+        auto& segment_state = m_segments[segment];
+        auto id = segment_state.policy.add(size);
+        if (segment_state.objects.size() <= id)
+        {
+            segment_state.objects.resize(id + 1);
+        }
+        segment_state.objects[id] = object;
+        m_is_budget_stale = true;
+        return { .segment = segment, .id = id };
+    }
+
+    // The GPU has to be done with the object.
+    void untrack(const D3D12_Residency_Handle& handle)
+    {
+        auto& segment_state = m_segments[handle.segment];
+        segment_state.policy.remove(handle.id);
+        segment_state.objects[handle.id] = nullptr;
+        m_is_budget_stale = true;
+    }
+
+    // The object is accessed by work that completes with `fence_value`.
+    void use(const D3D12_Residency_Handle& handle, uint64_t fence_value)
+    {
+        m_segments[handle.segment].policy.use(handle.id, fence_value);
+    }
+
+    // Call right before submitting the work that used the objects. Evicts idle objects while over budget
+    // and makes the used objects that were evicted resident, with every queue in `queues` waiting for them.
+    void prepare_submit(std::span<ID3D12CommandQueue* const> queues, uint64_t completed_fence_value)
+    {
+        if (WaitForSingleObject(m_budget_event, 0) == WAIT_OBJECT_0 || m_is_budget_stale)
+        {
+            update_budgets();
+        }
+        m_evict.clear();
+        m_make_resident.clear();
+        for (auto& segment_state : m_segments)
+        {
+            const auto& plan = segment_state.policy.plan(completed_fence_value);
+            for (auto id : plan.evict)
+            {
+                m_evict.push_back(segment_state.objects[id]);
+            }
+            for (auto id : plan.make_resident)
+            {
+                m_make_resident.push_back(segment_state.objects[id]);
+            }
+        }
+        if (!m_evict.empty())
+        {
+            throw_if_failed(m_device->Evict(uint32_t(m_evict.size()), m_evict.data()));
+        }
+        if (m_make_resident.empty())
+        {
+            return;
+        }
+        m_fence_value += 1;
+        throw_if_failed(m_device->EnqueueMakeResident(
+            D3D12_RESIDENCY_FLAG_NONE, uint32_t(m_make_resident.size()), m_make_resident.data(), m_fence.Get(), m_fence_value));
+        for (auto queue : queues)
+        {
+            throw_if_failed(queue->Wait(m_fence.Get(), m_fence_value));
+        }
+    }
+
+    const Residency_Policy& get_policy(DXGI_MEMORY_SEGMENT_GROUP segment) const { return m_segments[segment].policy; }
+    const DXGI_QUERY_VIDEO_MEMORY_INFO& get_memory_info(DXGI_MEMORY_SEGMENT_GROUP segment) const
+    {
+        return m_segments[segment].memory_info;
+    }
+
+private:
+    struct Segment
+    {
+        Residency_Policy policy;
+        std::vector<ID3D12Pageable*> objects;
+        DXGI_QUERY_VIDEO_MEMORY_INFO memory_info = {};
+    };
+
+    void update_budgets()
+    {
+        for (uint32_t i = 0; i < m_segments.size(); ++i)
+        {
+            auto& segment_state = m_segments[i];
+            throw_if_failed(m_adapter->QueryVideoMemoryInfo(0, DXGI_MEMORY_SEGMENT_GROUP(i), &segment_state.memory_info));
+            const auto& info = segment_state.memory_info;
+            auto resident_bytes = segment_state.policy.get_resident_bytes();
+            auto untracked_bytes = info.CurrentUsage > resident_bytes ? info.CurrentUsage - resident_bytes : 0;
+            segment_state.policy.set_budget(info.Budget > untracked_bytes ? info.Budget - untracked_bytes : 0);
+        }
+        m_is_budget_stale = false;
+    }
+
+    ID3D12Device3* m_device;
+    IDXGIAdapter3* m_adapter;
+    ComPtr<ID3D12Fence> m_fence;
+    uint64_t m_fence_value = 0;
+    HANDLE m_budget_event = NULL;
+    DWORD m_budget_cookie = 0;
+    bool m_is_budget_stale = true;
+    // Indexed by DXGI_MEMORY_SEGMENT_GROUP.
+    std::array<Segment, 2> m_segments;
+    std::vector<ID3D12Pageable*> m_evict;
+    std::vector<ID3D12Pageable*> m_make_resident;
+};
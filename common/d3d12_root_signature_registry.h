@@ -0,0 +1,71 @@
+#pragma once
+
+#include "d3d12_common.h"
+#include "hash.h"
+#include "shader_blob.h"
+
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+struct D3D12_Root_Signature
+{
+    ID3D12RootSignature* root_signature = nullptr;
+    // Serialized form, part of pipeline cache keys.
+    Shader_Blob blob;
+};
+
+// Interns root signatures by the hash of their serialized blob, so identical signatures are created once
+// and compare equal by pointer, which is what lets D3D12_Command_State_Cache filter resets. Not thread safe.
+class D3D12_Root_Signature_Registry
+{
+public:
+    explicit D3D12_Root_Signature_Registry(ID3D12Device* device)
+        : m_device(device)
+    {}
+
+    D3D12_Root_Signature_Registry(const D3D12_Root_Signature_Registry&) = delete;
+    D3D12_Root_Signature_Registry& operator=(const D3D12_Root_Signature_Registry&) = delete;
+
+    D3D12_Root_Signature get_or_create(const D3D12_VERSIONED_ROOT_SIGNATURE_DESC& desc)
+    {
+        ComPtr<ID3DBlob> blob;
+        ComPtr<ID3DBlob> error_blob;
+        throw_if_failed(D3D12SerializeVersionedRootSignature(&desc, &blob, &error_blob));
+        return get_or_create({ blob->GetBufferPointer(), blob->GetBufferSize() });
+    }
+
+    // `blob` is a serialized root signature, e.g. one embedded in a shader.
+    D3D12_Root_Signature get_or_create(Shader_Blob blob)
+    {
+        auto hash = fnv1a_64(blob.data, blob.size);
+        auto [first, last] = m_entries.equal_range(hash);
+        for (auto it = first; it != last; ++it)
+        {
+            const auto& entry = it->second;
+            if (entry.blob.size() == blob.size && memcmp(entry.blob.data(), blob.data, blob.size) == 0)
+            {
+                return { entry.root_signature.Get(), { entry.blob.data(), entry.blob.size() } };
+            }
+        }
+        Entry entry;
+        auto bytes = static_cast<const uint8_t*>(blob.data);
+        entry.blob.assign(bytes, bytes + blob.size);
+        throw_if_failed(m_device->CreateRootSignature(
+            0, entry.blob.data(), entry.blob.size(), IID_PPV_ARGS(&entry.root_signature)));
+        auto& inserted = m_entries.emplace(hash, std::move(entry))->second;
+        return { inserted.root_signature.Get(), { inserted.blob.data(), inserted.blob.size() } };
+    }
+
+    uint32_t get_count() const { return uint32_t(m_entries.size()); }
+
+private:
+    struct Entry
+    {
+        ComPtr<ID3D12RootSignature> root_signature;
+        std::vector<uint8_t> blob;
+    };
+
+    ID3D12Device* m_device;
+    std::unordered_multimap<uint64_t, Entry> m_entries;
+};
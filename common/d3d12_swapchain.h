@@ -0,0 +1,159 @@
+#pragma once
+
+#include "d3d12_common.h"
+#include "present_pacer.h"
+#include "resource_state_tracker.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <dxgi1_6.h>
+
+static constexpr uint32_t MAX_SWAPCHAIN_BUFFERS = 4;
+
+// Flip model swapchain with a frame latency waitable object and tearing support where the system has
+// it. Owns the RTVs of its buffers and rewrites them in place on resize. With a registry, the buffers
+// are registered in the PRESENT layout and unregistered again when they are released.
+class D3D12_Swapchain : public Present_Target
+{
+public:
+    D3D12_Swapchain(
+        IDXGIFactory5* factory, ID3D12Device* device, ID3D12CommandQueue* queue, HWND window,
+        uint32_t width, uint32_t height, const Present_Settings& settings, DXGI_FORMAT format,
+        Resource_State_Registry* registry = nullptr)
+        : m_device(device)
+        , m_registry(registry)
+        , m_buffer_count(std::clamp(settings.buffer_count, 2u, MAX_SWAPCHAIN_BUFFERS))
+        , m_format(format)
+    {
+        BOOL allow_tearing = FALSE;
+        m_is_tearing_supported = SUCCEEDED(factory->CheckFeatureSupport(
+            DXGI_FEATURE_PRESENT_ALLOW_TEARING, &allow_tearing, sizeof(allow_tearing))) && allow_tearing;
+        m_flags = DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+        if (m_is_tearing_supported)
+        {
+            m_flags |= DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING;
+        }
+        ComPtr<IDXGISwapChain1> swapchain1;
+        DXGI_SWAP_CHAIN_DESC1 swapchain_desc = {
+            .Width = width,
+            .Height = height,
+            .Format = format,
+            .SampleDesc = { .Count = 1, .Quality = 0 },
+            .BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT,
+            .BufferCount = m_buffer_count,
+            .Scaling = DXGI_SCALING_STRETCH,
+            .SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD,
+            .AlphaMode = DXGI_ALPHA_MODE_UNSPECIFIED,
+            .Flags = m_flags
+        };
+        throw_if_failed(factory->CreateSwapChainForHwnd(queue, window, &swapchain_desc, nullptr, nullptr, &swapchain1));
+        throw_if_failed(swapchain1->QueryInterface(IID_PPV_ARGS(&m_swapchain)));
+        // Exclusive fullscreen can't tear and would fight the waitable, stay in the flip model window.
+        throw_if_failed(factory->MakeWindowAssociation(window, DXGI_MWA_NO_ALT_ENTER));
+        throw_if_failed(m_swapchain->SetMaximumFrameLatency(std::max(settings.max_frame_latency, 1u)));
+        m_waitable = m_swapchain->GetFrameLatencyWaitableObject();
+
+        D3D12_DESCRIPTOR_HEAP_DESC rtv_descriptor_heap_desc = {
+            .Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV,
+            .NumDescriptors = MAX_SWAPCHAIN_BUFFERS,
+            .Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE,
+            .NodeMask = 0
+        };
+        throw_if_failed(device->CreateDescriptorHeap(&rtv_descriptor_heap_desc, IID_PPV_ARGS(&m_rtv_descriptor_heap)));
+        auto increment = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
+        for (uint32_t i = 0; i < MAX_SWAPCHAIN_BUFFERS; ++i)
+        {
+            m_descriptors[i] = m_rtv_descriptor_heap->GetCPUDescriptorHandleForHeapStart();
+            m_descriptors[i].ptr += i * increment;
+        }
+        acquire_buffers();
+    }
+
+    ~D3D12_Swapchain() override
+    {
+        release_buffers();
+        CloseHandle(m_waitable);
+    }
+
+    D3D12_Swapchain(const D3D12_Swapchain&) = delete;
+    D3D12_Swapchain& operator=(const D3D12_Swapchain&) = delete;
+
+    bool wait_for_frame_latency(uint32_t timeout_ms) override
+    {
+        return WaitForSingleObjectEx(m_waitable, timeout_ms, TRUE) == WAIT_OBJECT_0;
+    }
+
+    // An occluded window returns DXGI_STATUS_OCCLUDED, which is no failure.
+    void present(uint32_t sync_interval, bool allow_tearing) override
+    {
+        throw_if_failed(m_swapchain->Present(sync_interval, allow_tearing ? DXGI_PRESENT_ALLOW_TEARING : 0));
+    }
+
+    // ResizeBuffers needs every reference to the old buffers released. The RTVs are rewritten in place,
+    // so descriptor handles stay valid.
+    void resize(uint32_t width, uint32_t height) override
+    {
+        release_buffers();
+        throw_if_failed(m_swapchain->ResizeBuffers(m_buffer_count, width, height, DXGI_FORMAT_UNKNOWN, m_flags));
+        acquire_buffers();
+    }
+
+    bool is_tearing_supported() const override { return m_is_tearing_supported; }
+
+    IDXGISwapChain4* get() const { return m_swapchain.Get(); }
+    uint32_t get_buffer_count() const { return m_buffer_count; }
+    uint32_t get_current_buffer_index() const { return m_swapchain->GetCurrentBackBufferIndex(); }
+    ID3D12Resource* get_buffer(uint32_t index) const { return m_buffers[index].Get(); }
+    D3D12_CPU_DESCRIPTOR_HANDLE get_descriptor(uint32_t index) const { return m_descriptors[index]; }
+
+private:
+    void acquire_buffers()
+    {
+        for (uint32_t i = 0; i < m_buffer_count; ++i)
+        {
+            throw_if_failed(m_swapchain->GetBuffer(i, IID_PPV_ARGS(&m_buffers[i])));
+            D3D12_RENDER_TARGET_VIEW_DESC rtv_desc = {
+                .Format = m_format,
+                .ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2D,
+                .Texture2D = {
+                    .MipSlice = 0,
+                    .PlaneSlice = 0
+                }
+            };
+            m_device->CreateRenderTargetView(m_buffers[i].Get(), &rtv_desc, m_descriptors[i]);
+            if (m_registry)
+            {
+                m_registry->register_resource(m_buffers[i].Get(), { .mip_levels = 1, .array_size = 1, .plane_count = 1 }, {
+                    .layout = D3D12_BARRIER_LAYOUT_PRESENT,
+                    .sync = D3D12_BARRIER_SYNC_NONE,
+                    .access = D3D12_BARRIER_ACCESS_NO_ACCESS
+                });
+            }
+        }
+    }
+
+    void release_buffers()
+    {
+        for (auto& buffer : m_buffers)
+        {
+            if (buffer && m_registry)
+            {
+                m_registry->unregister_resource(buffer.Get());
+            }
+            buffer.Reset();
+        }
+    }
+
+    ID3D12Device* m_device;
+    Resource_State_Registry* m_registry;
+    uint32_t m_buffer_count;
+    DXGI_FORMAT m_format;
+    UINT m_flags = 0;
+    bool m_is_tearing_supported = false;
+    ComPtr<IDXGISwapChain4> m_swapchain;
+    HANDLE m_waitable = NULL;
+    ComPtr<ID3D12DescriptorHeap> m_rtv_descriptor_heap;
+    std::array<ComPtr<ID3D12Resource>, MAX_SWAPCHAIN_BUFFERS> m_buffers = {};
+    std::array<D3D12_CPU_DESCRIPTOR_HANDLE, MAX_SWAPCHAIN_BUFFERS> m_descriptors = {};
+};
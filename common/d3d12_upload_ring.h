@@ -0,0 +1,109 @@
+#pragma once
+
+#include "d3d12_common.h"
+#include "linear_ring_allocator.h"
+
+#include <cstring>
+
+struct D3D12_Upload_Allocation
+{
+    void* cpu_address = nullptr;
+    D3D12_GPU_VIRTUAL_ADDRESS gpu_address = 0;
+    ID3D12Resource* resource = nullptr;
+    uint64_t offset = 0;
+
+    bool is_valid() const { return cpu_address != nullptr; }
+};
+
+// Persistently mapped upload heap buffer suballocated through a Linear_Ring_Allocator.
+// Used for per-frame constants, instance data and copy staging.
+class D3D12_Upload_Ring
+{
+public:
+    D3D12_Upload_Ring(ID3D12Device* device, uint64_t capacity)
+        : m_allocator(capacity)
+    {
+        D3D12_HEAP_PROPERTIES heap_props = {
+            .Type = D3D12_HEAP_TYPE_UPLOAD,
+            .CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+            .MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN,
+            .CreationNodeMask = 0,
+            .VisibleNodeMask = 0
+        };
+        D3D12_RESOURCE_DESC resource_desc = {
+            .Dimension = D3D12_RESOURCE_DIMENSION_BUFFER,
+            .Alignment = 0,
+            .Width = capacity,
+            .Height = 1,
+            .DepthOrArraySize = 1,
+            .MipLevels = 1,
+            .Format = DXGI_FORMAT_UNKNOWN,
+            .SampleDesc = { .Count = 1, .Quality = 0 },
+            .Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
+            .Flags = D3D12_RESOURCE_FLAG_NONE
+        };
+        throw_if_failed(device->CreateCommittedResource(
+            &heap_props, D3D12_HEAP_FLAG_NONE, &resource_desc, D3D12_RESOURCE_STATE_GENERIC_READ,
+            nullptr, IID_PPV_ARGS(&m_buffer)));
+        D3D12_RANGE read_range = { .Begin = 0, .End = 0 };
+        throw_if_failed(m_buffer->Map(0, &read_range, reinterpret_cast<void**>(&m_cpu_base)));
+        m_gpu_base = m_buffer->GetGPUVirtualAddress();
+    }
+
+    ~D3D12_Upload_Ring()
+    {
+        m_buffer->Unmap(0, nullptr);
+    }
+
+    D3D12_Upload_Ring(const D3D12_Upload_Ring&) = delete;
+    D3D12_Upload_Ring& operator=(const D3D12_Upload_Ring&) = delete;
+
+    // Thread-safe. Returns an invalid allocation if the ring is full.
+    D3D12_Upload_Allocation allocate(uint64_t size, uint64_t alignment)
+    {
+        auto offset = m_allocator.allocate(size, alignment);
+        if (offset == INVALID_RING_OFFSET)
+        {
+            return {};
+        }
+        return {
+            .cpu_address = m_cpu_base + offset,
+            .gpu_address = m_gpu_base + offset,
+            .resource = m_buffer.Get(),
+            .offset = offset
+        };
+    }
+
+    // CBV placement: 256 byte aligned and a multiple of 256 bytes in size.
+    template<typename T>
+    D3D12_Upload_Allocation allocate_constants(const T& data)
+    {
+        static constexpr uint64_t size =
+            (sizeof(T) + D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT - 1)
+            & ~uint64_t(D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT - 1);
+        auto allocation = allocate(size, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+        if (allocation.is_valid())
+        {
+            memcpy(allocation.cpu_address, &data, sizeof(T));
+        }
+        return allocation;
+    }
+
+    // Staging for texture copies, see D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT.
+    D3D12_Upload_Allocation allocate_texture_staging(uint64_t size)
+    {
+        return allocate(size, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+    }
+
+    void end_frame(uint64_t fence_value) { m_allocator.end_frame(fence_value); }
+    void retire(uint64_t completed_fence_value) { m_allocator.retire(completed_fence_value); }
+
+    Linear_Ring_Allocator& get_allocator() { return m_allocator; }
+    ID3D12Resource* get_resource() const { return m_buffer.Get(); }
+
+private:
+    Linear_Ring_Allocator m_allocator;
+    ComPtr<ID3D12Resource> m_buffer;
+    uint8_t* m_cpu_base = nullptr;
+    D3D12_GPU_VIRTUAL_ADDRESS m_gpu_base = 0;
+};
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+static constexpr uint32_t INVALID_DESCRIPTOR_INDEX = ~0u;
+
+// Index into a bindless heap plus the generation it was handed out with.
+// A handle whose generation no longer matches the slot's generation has been freed.
+struct Descriptor_Handle
+{
+    uint32_t index = INVALID_DESCRIPTOR_INDEX;
+    uint32_t generation = 0;
+
+    bool is_valid() const { return index != INVALID_DESCRIPTOR_INDEX; }
+};
+
+// API-agnostic index management for a bindless descriptor heap.
+// Free indices form an intrusive list, indices above the high water mark have never been used.
+class Descriptor_Index_Allocator
+{
+public:
+    explicit Descriptor_Index_Allocator(uint32_t capacity)
+        : m_capacity(capacity)
+        , m_generations(std::make_unique<std::atomic<uint32_t>[]>(capacity))
+        , m_next_free(capacity, INVALID_DESCRIPTOR_INDEX)
+    {
+        for (uint32_t i = 0; i < capacity; ++i)
+        {
+            m_generations[i].store(1, std::memory_order_relaxed);
+        }
+    }
+
+    Descriptor_Index_Allocator(const Descriptor_Index_Allocator&) = delete;
+    Descriptor_Index_Allocator& operator=(const Descriptor_Index_Allocator&) = delete;
+
+    Descriptor_Handle allocate()
+    {
+        uint32_t index;
+        if (allocate_indices(&index, 1) == 0)
+        {
+            return {};
+        }
+        return make_handle(index);
+    }
+
+    // Frees immediately. Only valid if the GPU can no longer access the descriptor.
+    // Returns false for stale handles, i.e. double frees.
+    bool free(Descriptor_Handle handle)
+    {
+        if (!invalidate(handle))
+        {
+            return false;
+        }
+        free_indices(&handle.index, 1);
+        return true;
+    }
+
+    // The handle is invalidated right away, but the index is only reused once `fence_value` retired.
+    // Fence values may come in any order, e.g. from passes retiring on different queues.
+    bool free_deferred(Descriptor_Handle handle, uint64_t fence_value)
+    {
+        std::scoped_lock lock(m_mutex);
+        if (!invalidate(handle))
+        {
+            return false;
+        }
+        // Kept sorted by fence value. Frees mostly arrive in order, so this is usually an append.
+        auto it = m_deferred_frees.end();
+        while (it != m_deferred_frees.begin() && std::prev(it)->fence_value > fence_value)
+        {
+            --it;
+        }
+        m_deferred_frees.insert(it, { handle.index, fence_value });
+        return true;
+    }
+
+    // Returns every deferred free whose fence value is at most `completed_value` to the free list.
+    // Stops at the first one still pending, the list is sorted so the rest is pending too.
+    void retire(uint64_t completed_value)
+    {
+        std::scoped_lock lock(m_mutex);
+        while (!m_deferred_frees.empty() && m_deferred_frees.front().fence_value <= completed_value)
+        {
+            push_free(m_deferred_frees.front().index);
+            m_deferred_frees.pop_front();
+        }
+    }
+
+    bool is_alive(Descriptor_Handle handle) const
+    {
+        return handle.index < m_capacity
+            && m_generations[handle.index].load(std::memory_order_acquire) == handle.generation;
+    }
+
+    Descriptor_Handle make_handle(uint32_t index) const
+    {
+        return { index, m_generations[index].load(std::memory_order_acquire) };
+    }
+
+    // Bumps the generation so the handle can no longer be used. Does not return the index to the free list.
+    bool invalidate(Descriptor_Handle handle)
+    {
+        if (handle.index >= m_capacity)
+        {
+            return false;
+        }
+        auto expected = handle.generation;
+        return m_generations[handle.index].compare_exchange_strong(
+            expected, handle.generation + 1, std::memory_order_acq_rel);
+    }
+
+    // Bulk paths used by Descriptor_Index_Cache, one lock per batch.
+    uint32_t allocate_indices(uint32_t* indices, uint32_t count)
+    {
+        std::scoped_lock lock(m_mutex);
+        uint32_t allocated = 0;
+        while (allocated < count && m_free_head != INVALID_DESCRIPTOR_INDEX)
+        {
+            indices[allocated++] = m_free_head;
+            m_free_head = m_next_free[m_free_head];
+            m_free_count -= 1;
+        }
+        while (allocated < count && m_high_water < m_capacity)
+        {
+            indices[allocated++] = m_high_water++;
+        }
+        return allocated;
+    }
+
+    void free_indices(const uint32_t* indices, uint32_t count)
+    {
+        std::scoped_lock lock(m_mutex);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            push_free(indices[i]);
+        }
+    }
+
+    uint32_t get_capacity() const { return m_capacity; }
+
+    uint32_t get_allocated_count()
+    {
+        std::scoped_lock lock(m_mutex);
+        return m_high_water - m_free_count - uint32_t(m_deferred_frees.size());
+    }
+
+private:
+    struct Deferred_Free
+    {
+        uint32_t index;
+        uint64_t fence_value;
+    };
+
+    void push_free(uint32_t index)
+    {
+        m_next_free[index] = m_free_head;
+        m_free_head = index;
+        m_free_count += 1;
+    }
+
+    uint32_t m_capacity;
+    std::unique_ptr<std::atomic<uint32_t>[]> m_generations;
+    std::mutex m_mutex;
+    std::vector<uint32_t> m_next_free;
+    uint32_t m_free_head = INVALID_DESCRIPTOR_INDEX;
+    uint32_t m_free_count = 0;
+    uint32_t m_high_water = 0;
+    std::deque<Deferred_Free> m_deferred_frees;
+};
+
+// Per-thread front end for Descriptor_Index_Allocator. Owned by exactly one thread,
+// refills and drains in batches so loader threads rarely touch the allocator's lock.
+class Descriptor_Index_Cache
+{
+public:
+    static constexpr uint32_t BATCH_SIZE = 64;
+
+    explicit Descriptor_Index_Cache(Descriptor_Index_Allocator& allocator)
+        : m_allocator(allocator)
+    {}
+
+    ~Descriptor_Index_Cache()
+    {
+        m_allocator.free_indices(m_indices, m_count);
+    }
+
+    Descriptor_Index_Cache(const Descriptor_Index_Cache&) = delete;
+    Descriptor_Index_Cache& operator=(const Descriptor_Index_Cache&) = delete;
+
+    Descriptor_Handle allocate()
+    {
+        if (m_count == 0)
+        {
+            m_count = m_allocator.allocate_indices(m_indices, BATCH_SIZE);
+            if (m_count == 0)
+            {
+                return {};
+            }
+        }
+        return m_allocator.make_handle(m_indices[--m_count]);
+    }
+
+    bool free(Descriptor_Handle handle)
+    {
+        if (!m_allocator.invalidate(handle))
+        {
+            return false;
+        }
+        if (m_count == 2 * BATCH_SIZE)
+        {
+            m_count -= BATCH_SIZE;
+            m_allocator.free_indices(m_indices + m_count, BATCH_SIZE);
+        }
+        m_indices[m_count++] = handle.index;
+        return true;
+    }
+
+private:
+    Descriptor_Index_Allocator& m_allocator;
+    uint32_t m_indices[2 * BATCH_SIZE];
+    uint32_t m_count = 0;
+};
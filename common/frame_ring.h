@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Monotonic timeline fence as seen by the frame pacing logic.
+// Kept free of any graphics API so it can be backed by a fake fence.
+class Fence
+{
+public:
+    virtual ~Fence() = default;
+
+    // Enqueue a signal of `value` behind all previously submitted work.
+    virtual void signal(uint64_t value) = 0;
+    virtual uint64_t get_completed_value() = 0;
+    // Block the calling thread until the completed value reaches `value`.
+    virtual void wait(uint64_t value) = 0;
+};
+
+// Tracks N frames in flight on a single fence. Every frame gets the next fence value,
+// a frame slot may only be reused once the value it was last signaled with has retired.
+class Frame_Ring
+{
+public:
+    Frame_Ring(Fence& fence, uint32_t frames_in_flight)
+        : m_fence(fence)
+        , m_slot_values(frames_in_flight > 0 ? frames_in_flight : 1, 0)
+    {}
+
+    Frame_Ring(const Frame_Ring&) = delete;
+    Frame_Ring& operator=(const Frame_Ring&) = delete;
+
+    // Blocks until the slot of the upcoming frame is free again and returns its index.
+    uint32_t begin_frame()
+    {
+        m_frame_index = uint32_t(m_frame_count % m_slot_values.size());
+        auto slot_value = m_slot_values[m_frame_index];
+        if (!is_retired(slot_value))
+        {
+            m_fence.wait(slot_value);
+            m_completed_value = slot_value > m_completed_value ? slot_value : m_completed_value;
+        }
+        return m_frame_index;
+    }
+
+    // Signals the fence after the frame's work has been submitted and returns the value used.
+    uint64_t end_frame()
+    {
+        auto value = m_next_value++;
+        m_fence.signal(value);
+        m_slot_values[m_frame_index] = value;
+        m_frame_count += 1;
+        return value;
+    }
+
+    void wait_idle()
+    {
+        auto last_value = get_last_signaled_value();
+        if (!is_retired(last_value))
+        {
+            m_fence.wait(last_value);
+            m_completed_value = last_value;
+        }
+    }
+
+    bool is_retired(uint64_t value)
+    {
+        if (value <= m_completed_value)
+        {
+            return true;
+        }
+        m_completed_value = m_fence.get_completed_value();
+        return value <= m_completed_value;
+    }
+
+    uint32_t get_frames_in_flight() const { return uint32_t(m_slot_values.size()); }
+    uint32_t get_frame_index() const { return m_frame_index; }
+    uint64_t get_frame_count() const { return m_frame_count; }
+    // Value the frame currently being recorded will be signaled with.
+    uint64_t get_pending_value() const { return m_next_value; }
+    uint64_t get_last_signaled_value() const { return m_next_value - 1; }
+    uint64_t get_completed_value() const { return m_completed_value; }
+
+private:
+    Fence& m_fence;
+    std::vector<uint64_t> m_slot_values;
+    uint64_t m_next_value = 1;
+    uint64_t m_completed_value = 0;
+    uint64_t m_frame_count = 0;
+    uint32_t m_frame_index = 0;
+};
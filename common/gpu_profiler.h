@@ -0,0 +1,283 @@
+#pragma once
+
+#include "chrome_trace.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+static constexpr uint32_t INVALID_GPU_SCOPE = ~0u;
+
+// Same layout as D3D12_QUERY_DATA_PIPELINE_STATISTICS.
+struct Gpu_Pipeline_Statistics
+{
+    uint64_t ia_vertices;
+    uint64_t ia_primitives;
+    uint64_t vs_invocations;
+    uint64_t gs_invocations;
+    uint64_t gs_primitives;
+    uint64_t c_invocations;
+    uint64_t c_primitives;
+    uint64_t ps_invocations;
+    uint64_t hs_invocations;
+    uint64_t ds_invocations;
+    uint64_t cs_invocations;
+};
+
+// One simultaneous sample of a GPU timestamp and the trace clock, see get_trace_time_us.
+struct Gpu_Clock_Calibration
+{
+    uint64_t gpu_timestamp = 0;
+    uint64_t gpu_frequency = 1;
+    double cpu_time_us = 0.0;
+
+    double to_cpu_time_us(uint64_t timestamp) const
+    {
+        return cpu_time_us + double(int64_t(timestamp - gpu_timestamp)) * 1e6 / double(gpu_frequency);
+    }
+};
+
+struct Gpu_Scope_Result
+{
+    std::string name;
+    uint32_t track;
+    double begin_us;
+    double duration_us;
+    bool has_statistics;
+    Gpu_Pipeline_Statistics statistics;
+};
+
+// Last, average, minimum and maximum of a value per name over a sliding window of samples.
+class Profiler_Statistics
+{
+public:
+    struct Summary
+    {
+        double last;
+        double average;
+        double minimum;
+        double maximum;
+        uint32_t sample_count;
+    };
+
+    explicit Profiler_Statistics(uint32_t window_size)
+        : m_window_size(window_size > 0 ? window_size : 1)
+    {}
+
+    void add(std::string_view name, double value)
+    {
+        auto it = m_series.find(name);
+        if (it == m_series.end())
+        {
+            it = m_series.emplace(std::string(name), Series { .samples = std::vector<double>(m_window_size, 0.0) }).first;
+        }
+        auto& series = it->second;
+        series.samples[series.next] = value;
+        series.next = (series.next + 1) % m_window_size;
+        series.count = series.count < m_window_size ? series.count + 1 : m_window_size;
+        series.last = value;
+    }
+
+    bool get(std::string_view name, Summary& summary) const
+    {
+        auto it = m_series.find(name);
+        if (it == m_series.end())
+        {
+            return false;
+        }
+        summary = summarize(it->second);
+        return true;
+    }
+
+    template<typename Function>
+    void for_each(Function&& function) const
+    {
+        for (const auto& [name, series] : m_series)
+        {
+            function(std::string_view(name), summarize(series));
+        }
+    }
+
+    void clear() { m_series.clear(); }
+
+private:
+    struct Series
+    {
+        std::vector<double> samples;
+        uint32_t next = 0;
+        uint32_t count = 0;
+        double last = 0.0;
+    };
+
+    struct String_Hash
+    {
+        using is_transparent = void;
+        size_t operator()(std::string_view value) const { return std::hash<std::string_view>()(value); }
+    };
+
+    static Summary summarize(const Series& series)
+    {
+        Summary summary = {
+            .last = series.last,
+            .average = 0.0,
+            .minimum = series.samples[0],
+            .maximum = series.samples[0],
+            .sample_count = series.count
+        };
+        for (uint32_t i = 0; i < series.count; ++i)
+        {
+            auto sample = series.samples[i];
+            summary.average += sample;
+            summary.minimum = sample < summary.minimum ? sample : summary.minimum;
+            summary.maximum = sample > summary.maximum ? sample : summary.maximum;
+        }
+        summary.average /= series.count > 0 ? series.count : 1;
+        return summary;
+    }
+
+    uint32_t m_window_size;
+    std::unordered_map<std::string, Series, String_Hash, std::equal_to<>> m_series;
+};
+
+// API independent part of a GPU profiler: hands out query slots per frame in flight and turns resolved
+// query data back into named results once the frame slot retired.
+// Scope s of frame slot f owns timestamp queries 2 * (f * max_scopes + s) and +1 and pipeline statistics
+// query f * max_scopes + s. begin_scope() may be called from any thread, everything else from one.
+class Gpu_Profiler
+{
+public:
+    Gpu_Profiler(uint32_t frames_in_flight, uint32_t max_scopes_per_frame, uint32_t statistics_window = 64)
+        : m_max_scopes(max_scopes_per_frame)
+        , m_frames(frames_in_flight)
+        , m_statistics(statistics_window)
+    {
+        for (auto& frame : m_frames)
+        {
+            frame.scopes = std::make_unique<Scope[]>(max_scopes_per_frame);
+        }
+    }
+
+    // The frame slot has to be retired and collected, see collect().
+    void begin_frame(uint32_t frame_index)
+    {
+        m_frame_index = frame_index;
+        auto& frame = m_frames[frame_index];
+        frame.scope_count.store(0, std::memory_order_relaxed);
+        frame.is_resolved = false;
+    }
+
+    // Returns the scope index within the current frame or INVALID_GPU_SCOPE if the frame is full.
+    uint32_t begin_scope(std::string_view name, uint32_t track, bool has_statistics)
+    {
+        auto& frame = m_frames[m_frame_index];
+        auto scope = frame.scope_count.fetch_add(1, std::memory_order_relaxed);
+        if (scope >= m_max_scopes)
+        {
+            return INVALID_GPU_SCOPE;
+        }
+        frame.scopes[scope].name = name;
+        frame.scopes[scope].track = track;
+        frame.scopes[scope].has_statistics = has_statistics;
+        return scope;
+    }
+
+    // Scopes of the current frame. Only stable once recording finished.
+    uint32_t get_scope_count() const
+    {
+        auto count = m_frames[m_frame_index].scope_count.load(std::memory_order_relaxed);
+        return count < m_max_scopes ? count : m_max_scopes;
+    }
+
+    bool has_statistics(uint32_t scope) const { return m_frames[m_frame_index].scopes[scope].has_statistics; }
+
+    // Marks the current frame's queries as resolved, `calibration` maps its timestamps to the trace clock.
+    void end_frame(Gpu_Clock_Calibration calibration)
+    {
+        auto& frame = m_frames[m_frame_index];
+        frame.calibration = calibration;
+        frame.is_resolved = true;
+    }
+
+    // Turns the resolved data of a retired frame slot into results. `timestamps` and `statistics` hold the
+    // slot's queries starting at its first one.
+    void collect(
+        uint32_t frame_index, std::span<const uint64_t> timestamps, std::span<const Gpu_Pipeline_Statistics> statistics)
+    {
+        auto& frame = m_frames[frame_index];
+        if (!frame.is_resolved)
+        {
+            return;
+        }
+        frame.is_resolved = false;
+        m_results.clear();
+        auto count = frame.scope_count.load(std::memory_order_relaxed);
+        count = count < m_max_scopes ? count : m_max_scopes;
+        for (uint32_t s = 0; s < count && 2 * s + 1 < timestamps.size(); ++s)
+        {
+            const auto& scope = frame.scopes[s];
+            auto begin = timestamps[2 * s];
+            auto end = timestamps[2 * s + 1];
+            Gpu_Scope_Result result = {
+                .name = scope.name,
+                .track = scope.track,
+                .begin_us = frame.calibration.to_cpu_time_us(begin),
+                .duration_us = end > begin ? double(end - begin) * 1e6 / double(frame.calibration.gpu_frequency) : 0.0,
+                .has_statistics = scope.has_statistics && s < statistics.size(),
+                .statistics = {}
+            };
+            if (result.has_statistics)
+            {
+                result.statistics = statistics[s];
+            }
+            m_statistics.add(result.name, result.duration_us);
+            m_results.push_back(std::move(result));
+        }
+    }
+
+    // Results of the most recently collected frame.
+    const std::vector<Gpu_Scope_Result>& get_results() const { return m_results; }
+    const Profiler_Statistics& get_statistics() const { return m_statistics; }
+
+    // Adds the most recently collected frame as complete events, one thread per track.
+    void write_trace(Chrome_Trace& trace, uint32_t pid) const
+    {
+        for (const auto& result : m_results)
+        {
+            trace.add_complete(result.name, "gpu", pid, result.track, result.begin_us, result.duration_us);
+        }
+    }
+
+    uint32_t get_frame_index() const { return m_frame_index; }
+    uint32_t get_frames_in_flight() const { return uint32_t(m_frames.size()); }
+    uint32_t get_max_scopes() const { return m_max_scopes; }
+
+    uint32_t get_first_timestamp_query(uint32_t frame_index) const { return 2 * frame_index * m_max_scopes; }
+    uint32_t get_first_statistics_query(uint32_t frame_index) const { return frame_index * m_max_scopes; }
+
+private:
+    struct Scope
+    {
+        std::string name;
+        uint32_t track = 0;
+        bool has_statistics = false;
+    };
+
+    struct Frame
+    {
+        std::unique_ptr<Scope[]> scopes;
+        std::atomic<uint32_t> scope_count = 0;
+        Gpu_Clock_Calibration calibration;
+        bool is_resolved = false;
+    };
+
+    uint32_t m_max_scopes;
+    uint32_t m_frame_index = 0;
+    std::vector<Frame> m_frames;
+    std::vector<Gpu_Scope_Result> m_results;
+    Profiler_Statistics m_statistics;
+};
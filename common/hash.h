@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// 64 bit FNV-1a. Not cryptographic, only used for cache and lookup keys.
+static constexpr uint64_t FNV1A_64_OFFSET_BASIS = 0xcbf29ce484222325ull;
+static constexpr uint64_t FNV1A_64_PRIME = 0x00000100000001b3ull;
+
+inline uint64_t fnv1a_64(const void* data, size_t size, uint64_t hash = FNV1A_64_OFFSET_BASIS)
+{
+    auto bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= FNV1A_64_PRIME;
+    }
+    return hash;
+}
+
+constexpr uint64_t fnv1a_64(std::string_view str, uint64_t hash = FNV1A_64_OFFSET_BASIS)
+{
+    for (auto c : str)
+    {
+        hash ^= uint8_t(c);
+        hash *= FNV1A_64_PRIME;
+    }
+    return hash;
+}
+
+// Incremental hasher for keys built out of several independent pieces.
+class Hasher
+{
+public:
+    Hasher& add(const void* data, size_t size)
+    {
+        m_hash = fnv1a_64(data, size, m_hash);
+        return *this;
+    }
+
+    template<typename T>
+    Hasher& add(const T& value)
+    {
+        return add(&value, sizeof(T));
+    }
+
+    uint64_t get() const { return m_hash; }
+
+private:
+    uint64_t m_hash = FNV1A_64_OFFSET_BASIS;
+};
@@ -0,0 +1,419 @@
+#pragma once
+
+#include "command_stream.h"
+#include "compute_dispatch.h"
+#include "linear_ring_allocator.h"
+#include "root_constants.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <span>
+#include <utility>
+#include <vector>
+
+// Same values as D3D12_INDIRECT_ARGUMENT_TYPE, the subset a command layout can hold.
+enum class Indirect_Argument_Type : uint32_t
+{
+    Draw = 0,
+    Draw_Indexed = 1,
+    Dispatch = 2,
+    Constant = 5
+};
+
+// Mirrors D3D12_DRAW_ARGUMENTS.
+struct Indirect_Draw_Arguments
+{
+    uint32_t vertex_count_per_instance;
+    uint32_t instance_count;
+    uint32_t start_vertex_location;
+    uint32_t start_instance_location;
+};
+
+// Mirrors D3D12_DRAW_INDEXED_ARGUMENTS.
+struct Indirect_Draw_Indexed_Arguments
+{
+    uint32_t index_count_per_instance;
+    uint32_t instance_count;
+    uint32_t start_index_location;
+    int32_t base_vertex_location;
+    uint32_t start_instance_location;
+};
+
+// Dispatch_Size mirrors D3D12_DISPATCH_ARGUMENTS.
+static_assert(sizeof(Dispatch_Size) == 12);
+static_assert(sizeof(Indirect_Draw_Arguments) == 16);
+static_assert(sizeof(Indirect_Draw_Indexed_Arguments) == 20);
+
+struct Indirect_Argument
+{
+    Indirect_Argument_Type type;
+    // Constants only: the 32 bit constants root parameter and the DWORD range in it.
+    uint32_t root_parameter_index = 0;
+    uint32_t dest_offset = 0;
+    uint32_t value_count = 0;
+    // Position in a command.
+    uint32_t byte_offset = 0;
+
+    uint32_t get_size() const
+    {
+        switch (type)
+        {
+        case Indirect_Argument_Type::Draw: return sizeof(Indirect_Draw_Arguments);
+        case Indirect_Argument_Type::Draw_Indexed: return sizeof(Indirect_Draw_Indexed_Arguments);
+        case Indirect_Argument_Type::Dispatch: return sizeof(Dispatch_Size);
+        case Indirect_Argument_Type::Constant: return value_count * uint32_t(sizeof(uint32_t));
+        }
+        return 0;
+    }
+};
+
+// Layout of one indirect command: root constants followed by exactly one draw or dispatch, the
+// arguments of a D3D12 command signature.
+struct Indirect_Command_Layout
+{
+    std::vector<Indirect_Argument> arguments;
+    uint32_t byte_stride = 0;
+
+    const Indirect_Argument& get_action() const { return arguments.back(); }
+    bool is_compute() const { return get_action().type == Indirect_Argument_Type::Dispatch; }
+    // A command signature that changes root arguments needs the root signature they belong to.
+    bool needs_root_signature() const { return arguments.size() > 1; }
+};
+
+// Collects the arguments of a layout in command order, build() checks them against the command
+// signature rules and throws on a violation.
+class Indirect_Command_Layout_Builder
+{
+public:
+    Indirect_Command_Layout_Builder& add_constants(uint32_t root_parameter_index, uint32_t dest_offset, uint32_t value_count)
+    {
+        m_arguments.push_back({
+            .type = Indirect_Argument_Type::Constant,
+            .root_parameter_index = root_parameter_index,
+            .dest_offset = dest_offset,
+            .value_count = value_count
+        });
+        return *this;
+    }
+
+    template<Root_Constants T>
+    Indirect_Command_Layout_Builder& add_constants(uint32_t root_parameter_index, uint32_t dest_offset = 0)
+    {
+        return add_constants(root_parameter_index, dest_offset, ROOT_CONSTANT_COUNT<T>);
+    }
+
+    Indirect_Command_Layout_Builder& add_dispatch() { return add_action(Indirect_Argument_Type::Dispatch); }
+    Indirect_Command_Layout_Builder& add_draw() { return add_action(Indirect_Argument_Type::Draw); }
+    Indirect_Command_Layout_Builder& add_draw_indexed() { return add_action(Indirect_Argument_Type::Draw_Indexed); }
+
+    // Pads commands to `byte_stride`, e.g. to match a structured buffer element the culling shader writes.
+    Indirect_Command_Layout_Builder& set_byte_stride(uint32_t byte_stride)
+    {
+        m_byte_stride = byte_stride;
+        return *this;
+    }
+
+    Indirect_Command_Layout build() const
+    {
+        Indirect_Command_Layout layout = { .arguments = m_arguments, .byte_stride = 0 };
+        if (layout.arguments.empty())
+        {
+            throw std::exception();
+        }
+        uint32_t byte_offset = 0;
+        for (uint32_t i = 0; i < layout.arguments.size(); ++i)
+        {
+            auto& argument = layout.arguments[i];
+            bool is_last = i + 1 == layout.arguments.size();
+            if ((argument.type == Indirect_Argument_Type::Constant) == is_last)
+            {
+                throw std::exception();
+            }
+            if (argument.type == Indirect_Argument_Type::Constant
+                && (argument.value_count == 0 || argument.dest_offset > MAX_ROOT_CONSTANTS
+                    || argument.value_count > MAX_ROOT_CONSTANTS - argument.dest_offset))
+            {
+                throw std::exception();
+            }
+            argument.byte_offset = byte_offset;
+            byte_offset += argument.get_size();
+        }
+        layout.byte_stride = m_byte_stride > 0 ? m_byte_stride : byte_offset;
+        if (layout.byte_stride < byte_offset || layout.byte_stride % sizeof(uint32_t) != 0)
+        {
+            throw std::exception();
+        }
+        return layout;
+    }
+
+private:
+    Indirect_Command_Layout_Builder& add_action(Indirect_Argument_Type type)
+    {
+        m_arguments.push_back({ .type = type });
+        return *this;
+    }
+
+    std::vector<Indirect_Argument> m_arguments;
+    uint32_t m_byte_stride = 0;
+};
+
+// Writes commands of a layout into CPU memory, for argument buffers filled on the CPU and for tests.
+// `argument` indexes layout.arguments, the type has to match.
+class Indirect_Command_Writer
+{
+public:
+    Indirect_Command_Writer(const Indirect_Command_Layout& layout, std::span<uint8_t> commands)
+        : m_layout(layout)
+        , m_commands(commands)
+    {}
+
+    void write_constant_values(uint32_t command, uint32_t argument, std::span<const uint32_t> values)
+    {
+        const auto& desc = m_layout.arguments[argument];
+        if (desc.type != Indirect_Argument_Type::Constant || values.size() != desc.value_count)
+        {
+            throw std::exception();
+        }
+        write(command, desc, values.data());
+    }
+
+    template<Root_Constants T>
+    void write_constants(uint32_t command, uint32_t argument, const T& constants)
+    {
+        std::array<uint32_t, ROOT_CONSTANT_COUNT<T>> values;
+        memcpy(values.data(), &constants, sizeof(T));
+        write_constant_values(command, argument, values);
+    }
+
+    void write_dispatch(uint32_t command, const Dispatch_Size& dispatch_size)
+    {
+        write_action(command, Indirect_Argument_Type::Dispatch, &dispatch_size);
+    }
+
+    void write_draw(uint32_t command, const Indirect_Draw_Arguments& draw)
+    {
+        write_action(command, Indirect_Argument_Type::Draw, &draw);
+    }
+
+    void write_draw_indexed(uint32_t command, const Indirect_Draw_Indexed_Arguments& draw)
+    {
+        write_action(command, Indirect_Argument_Type::Draw_Indexed, &draw);
+    }
+
+    uint32_t get_command_capacity() const { return uint32_t(m_commands.size() / m_layout.byte_stride); }
+
+private:
+    void write_action(uint32_t command, Indirect_Argument_Type type, const void* data)
+    {
+        const auto& desc = m_layout.get_action();
+        if (desc.type != type)
+        {
+            throw std::exception();
+        }
+        write(command, desc, data);
+    }
+
+    void write(uint32_t command, const Indirect_Argument& desc, const void* data)
+    {
+        auto offset = uint64_t(command) * m_layout.byte_stride + desc.byte_offset;
+        if (command >= get_command_capacity())
+        {
+            throw std::exception();
+        }
+        memcpy(m_commands.data() + offset, data, desc.get_size());
+    }
+
+    const Indirect_Command_Layout& m_layout;
+    std::span<uint8_t> m_commands;
+};
+
+enum class Indirect_Error
+{
+    None,
+    // Offsets into the argument and count buffer have to be 4 byte aligned.
+    Misaligned_Offset,
+    // The executed commands or the count reach past the end of their buffer.
+    Out_Of_Bounds,
+    // A dispatch exceeds COMPUTE_MAX_GROUP_COUNT in some dimension.
+    Dispatch_Too_Large
+};
+
+struct Indirect_Result
+{
+    Indirect_Error error = Indirect_Error::None;
+    // The failing command, or the number of commands executed on success.
+    uint32_t command = 0;
+
+    bool is_valid() const { return error == Indirect_Error::None; }
+};
+
+// CPU model of ExecuteIndirect: decodes up to `max_command_count` commands from `arguments` at
+// `argument_offset`, fewer if the uint32 at `count_offset` in `count` is smaller, and replays them on
+// `visitor`. The visitor sees the calls a Command_Stream_Reader would make, set_root_constants() and
+// dispatch(), and draw() / draw_indexed() with the argument structs if it has them; calls it lacks
+// are skipped. All commands are validated before the first one runs, an invalid stream runs nothing.
+template<typename Visitor>
+Indirect_Result execute_indirect_commands(
+    Visitor& visitor, const Indirect_Command_Layout& layout,
+    std::span<const uint8_t> arguments, uint64_t argument_offset, uint32_t max_command_count,
+    std::span<const uint8_t> count = {}, uint64_t count_offset = 0)
+{
+    auto command_count = max_command_count;
+    if (argument_offset % sizeof(uint32_t) != 0 || (!count.empty() && count_offset % sizeof(uint32_t) != 0))
+    {
+        return { Indirect_Error::Misaligned_Offset, 0 };
+    }
+    if (!count.empty())
+    {
+        if (count_offset > count.size() || count.size() - count_offset < sizeof(uint32_t))
+        {
+            return { Indirect_Error::Out_Of_Bounds, 0 };
+        }
+        uint32_t count_value;
+        memcpy(&count_value, count.data() + count_offset, sizeof(count_value));
+        command_count = std::min(command_count, count_value);
+    }
+    auto read = [&](uint32_t command, const Indirect_Argument& argument, void* data) {
+        memcpy(data, arguments.data() + argument_offset + uint64_t(command) * layout.byte_stride + argument.byte_offset,
+            argument.get_size());
+    };
+    const auto& action = layout.get_action();
+    for (uint32_t command = 0; command < command_count; ++command)
+    {
+        // The last command only needs its arguments, not the padding up to the stride.
+        auto end = argument_offset + uint64_t(command) * layout.byte_stride + action.byte_offset + action.get_size();
+        if (argument_offset > arguments.size() || end > arguments.size())
+        {
+            return { Indirect_Error::Out_Of_Bounds, command };
+        }
+        if (action.type == Indirect_Argument_Type::Dispatch)
+        {
+            Dispatch_Size dispatch_size;
+            read(command, action, &dispatch_size);
+            if (dispatch_size.x > COMPUTE_MAX_GROUP_COUNT || dispatch_size.y > COMPUTE_MAX_GROUP_COUNT
+                || dispatch_size.z > COMPUTE_MAX_GROUP_COUNT)
+            {
+                return { Indirect_Error::Dispatch_Too_Large, command };
+            }
+        }
+    }
+    auto bind_point = layout.is_compute() ? Command_Stream_Bind_Point::Compute : Command_Stream_Bind_Point::Graphics;
+    for (uint32_t command = 0; command < command_count; ++command)
+    {
+        for (const auto& argument : layout.arguments)
+        {
+            switch (argument.type)
+            {
+            case Indirect_Argument_Type::Constant:
+                if constexpr (requires { visitor.set_root_constants(bind_point, 0u, std::span<const uint32_t>(), 0u); })
+                {
+                    std::array<uint32_t, MAX_ROOT_CONSTANTS> values;
+                    read(command, argument, values.data());
+                    visitor.set_root_constants(bind_point, argument.root_parameter_index,
+                        std::span<const uint32_t>(values.data(), argument.value_count), argument.dest_offset);
+                }
+                break;
+            case Indirect_Argument_Type::Dispatch:
+                if constexpr (requires { visitor.dispatch(0u, 0u, 0u); })
+                {
+                    Dispatch_Size dispatch_size;
+                    read(command, argument, &dispatch_size);
+                    visitor.dispatch(dispatch_size.x, dispatch_size.y, dispatch_size.z);
+                }
+                break;
+            case Indirect_Argument_Type::Draw:
+                if constexpr (requires { visitor.draw(Indirect_Draw_Arguments()); })
+                {
+                    Indirect_Draw_Arguments draw;
+                    read(command, argument, &draw);
+                    visitor.draw(draw);
+                }
+                break;
+            case Indirect_Argument_Type::Draw_Indexed:
+                if constexpr (requires { visitor.draw_indexed(Indirect_Draw_Indexed_Arguments()); })
+                {
+                    Indirect_Draw_Indexed_Arguments draw;
+                    read(command, argument, &draw);
+                    visitor.draw_indexed(draw);
+                }
+                break;
+            }
+        }
+    }
+    return { Indirect_Error::None, command_count };
+}
+
+// Validates an argument stream without running it.
+inline Indirect_Result validate_indirect_commands(
+    const Indirect_Command_Layout& layout,
+    std::span<const uint8_t> arguments, uint64_t argument_offset, uint32_t max_command_count,
+    std::span<const uint8_t> count = {}, uint64_t count_offset = 0)
+{
+    struct Null_Visitor {} visitor;
+    return execute_indirect_commands(visitor, layout, arguments, argument_offset, max_command_count, count, count_offset);
+}
+
+static constexpr uint64_t INDIRECT_ARGUMENT_ALIGNMENT = 16;
+
+// Commands and their count in one allocation: the count at `count_offset` followed by room for
+// `max_command_count` commands at `argument_offset`.
+struct Indirect_Argument_Allocation
+{
+    uint64_t argument_offset = INVALID_RING_OFFSET;
+    uint64_t count_offset = INVALID_RING_OFFSET;
+    uint32_t max_command_count = 0;
+
+    bool is_valid() const { return argument_offset != INVALID_RING_OFFSET; }
+};
+
+// Per frame argument space for GPU generated commands, a Linear_Ring_Allocator over the argument
+// buffer. Counts start at zero every frame: the backend resets the counts of take_count_offsets()
+// before the pass that appends commands. allocate() is thread-safe like the ring.
+class Indirect_Argument_Allocator
+{
+public:
+    explicit Indirect_Argument_Allocator(uint64_t capacity)
+        : m_allocator(capacity)
+    {}
+
+    // Returns an invalid allocation if the ring is full.
+    Indirect_Argument_Allocation allocate(const Indirect_Command_Layout& layout, uint32_t max_command_count)
+    {
+        auto size = INDIRECT_ARGUMENT_ALIGNMENT + uint64_t(layout.byte_stride) * max_command_count;
+        auto offset = m_allocator.allocate(size, INDIRECT_ARGUMENT_ALIGNMENT);
+        if (offset == INVALID_RING_OFFSET)
+        {
+            return {};
+        }
+        {
+            std::scoped_lock lock(m_mutex);
+            m_count_offsets.push_back(offset);
+        }
+        return {
+            .argument_offset = offset + INDIRECT_ARGUMENT_ALIGNMENT,
+            .count_offset = offset,
+            .max_command_count = max_command_count
+        };
+    }
+
+    // Counts allocated since the last call, to be reset to zero.
+    std::vector<uint64_t> take_count_offsets()
+    {
+        std::scoped_lock lock(m_mutex);
+        return std::exchange(m_count_offsets, {});
+    }
+
+    void end_frame(uint64_t fence_value) { m_allocator.end_frame(fence_value); }
+    void retire(uint64_t completed_fence_value) { m_allocator.retire(completed_fence_value); }
+
+    Linear_Ring_Allocator& get_allocator() { return m_allocator; }
+
+private:
+    Linear_Ring_Allocator m_allocator;
+    std::mutex m_mutex;
+    std::vector<uint64_t> m_count_offsets;
+};
@@ -0,0 +1,246 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Counts outstanding jobs. Job_System::wait on it blocks until all jobs attached to it finished, and
+// rethrows the first exception one of them threw.
+class Job_Counter
+{
+public:
+    bool is_done() const { return m_pending.load(std::memory_order_acquire) == 0; }
+
+private:
+    friend class Job_System;
+    std::atomic<uint32_t> m_pending = 0;
+    // Written by the first job that throws, before its decrement, and read once m_pending is zero.
+    std::atomic<bool> m_has_exception = false;
+    std::exception_ptr m_exception;
+};
+
+// Work-stealing job scheduler. Every worker owns a queue it pushes to and pops from at the back,
+// idle workers steal from the front of the other queues. Threads that are not workers push into a
+// shared queue and help executing jobs while they wait.
+// Thread indices select per-thread resources, so every thread using them needs its own: 0 is the thread
+// that created the Job_System, workers are 1..get_worker_count(), and up to `extra_thread_count` other
+// threads take the remaining ones through register_thread(). get_thread_index() throws on any other thread.
+class Job_System
+{
+public:
+    explicit Job_System(uint32_t worker_count = get_default_worker_count(), uint32_t extra_thread_count = 0)
+        : m_next_extra_index(worker_count + 1)
+        , m_thread_count(worker_count + 1 + extra_thread_count)
+    {
+        thread_index = 0;
+        m_queues.reserve(worker_count + 1);
+        for (uint32_t i = 0; i < worker_count + 1; ++i)
+        {
+            m_queues.push_back(std::make_unique<Job_Queue>());
+        }
+        m_workers.reserve(worker_count);
+        for (uint32_t i = 1; i <= worker_count; ++i)
+        {
+            m_workers.emplace_back([this, i]() { worker_main(i); });
+        }
+    }
+
+    ~Job_System()
+    {
+        {
+            std::scoped_lock lock(m_sleep_mutex);
+            m_running = false;
+        }
+        m_sleep_condition.notify_all();
+        for (auto& worker : m_workers)
+        {
+            worker.join();
+        }
+    }
+
+    Job_System(const Job_System&) = delete;
+    Job_System& operator=(const Job_System&) = delete;
+
+    void submit(std::function<void()> function, Job_Counter* counter = nullptr)
+    {
+        if (counter)
+        {
+            counter->m_pending.fetch_add(1, std::memory_order_relaxed);
+        }
+        auto& queue = *m_queues[thread_index < m_queues.size() ? thread_index : 0];
+        {
+            std::scoped_lock lock(queue.mutex);
+            queue.jobs.push_back({ std::move(function), counter });
+        }
+        m_queued_jobs.fetch_add(1, std::memory_order_release);
+        {
+            // Pairs with the predicate check in worker_main so the wake up can't get lost.
+            std::scoped_lock lock(m_sleep_mutex);
+        }
+        m_sleep_condition.notify_one();
+    }
+
+    // Executes queued jobs on the calling thread until the counter reaches zero. Rethrows the first
+    // exception of the counter's jobs, the counter can be used again afterwards.
+    void wait(Job_Counter& counter)
+    {
+        while (!counter.is_done())
+        {
+            if (!try_execute_one())
+            {
+                std::this_thread::yield();
+            }
+        }
+        if (counter.m_has_exception.load(std::memory_order_relaxed))
+        {
+            auto exception = std::exchange(counter.m_exception, nullptr);
+            counter.m_has_exception.store(false, std::memory_order_relaxed);
+            std::rethrow_exception(exception);
+        }
+    }
+
+    // Gives the calling non-worker thread its own thread index, throws once all extra indices are taken.
+    uint32_t register_thread()
+    {
+        auto index = m_next_extra_index.fetch_add(1, std::memory_order_relaxed);
+        if (index >= m_thread_count)
+        {
+            throw std::exception();
+        }
+        thread_index = index;
+        return index;
+    }
+
+    uint32_t get_worker_count() const { return uint32_t(m_workers.size()); }
+    // Number of distinct thread indices, i.e. the size of per-thread resource arrays.
+    uint32_t get_thread_count() const { return m_thread_count; }
+
+    static uint32_t get_thread_index()
+    {
+        if (thread_index == INVALID_THREAD_INDEX)
+        {
+            throw std::exception();
+        }
+        return thread_index;
+    }
+
+    static uint32_t get_default_worker_count()
+    {
+        auto hardware_threads = std::thread::hardware_concurrency();
+        return hardware_threads > 1 ? hardware_threads - 1 : 1;
+    }
+
+private:
+    struct Job
+    {
+        std::function<void()> function;
+        Job_Counter* counter;
+    };
+
+    struct Job_Queue
+    {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    bool try_pop(uint32_t queue_index, Job& job, bool from_back)
+    {
+        auto& queue = *m_queues[queue_index];
+        std::scoped_lock lock(queue.mutex);
+        if (queue.jobs.empty())
+        {
+            return false;
+        }
+        if (from_back)
+        {
+            job = std::move(queue.jobs.back());
+            queue.jobs.pop_back();
+        }
+        else
+        {
+            job = std::move(queue.jobs.front());
+            queue.jobs.pop_front();
+        }
+        return true;
+    }
+
+    bool try_execute_one()
+    {
+        if (m_queued_jobs.load(std::memory_order_acquire) == 0)
+        {
+            return false;
+        }
+        Job job;
+        auto own_index = thread_index < m_queues.size() ? thread_index : 0;
+        bool found = try_pop(own_index, job, true);
+        auto queue_count = uint32_t(m_queues.size());
+        for (uint32_t i = 1; !found && i < queue_count; ++i)
+        {
+            found = try_pop((own_index + i) % queue_count, job, false);
+        }
+        if (!found)
+        {
+            return false;
+        }
+        m_queued_jobs.fetch_sub(1, std::memory_order_relaxed);
+        if (!job.counter)
+        {
+            // Nobody waits for it, an exception has nowhere to go but out of the thread.
+            job.function();
+            return true;
+        }
+        try
+        {
+            job.function();
+        }
+        catch (...)
+        {
+            if (!job.counter->m_has_exception.exchange(true, std::memory_order_relaxed))
+            {
+                job.counter->m_exception = std::current_exception();
+            }
+        }
+        job.counter->m_pending.fetch_sub(1, std::memory_order_release);
+        return true;
+    }
+
+    void worker_main(uint32_t index)
+    {
+        thread_index = index;
+        while (true)
+        {
+            if (try_execute_one())
+            {
+                continue;
+            }
+            std::unique_lock lock(m_sleep_mutex);
+            m_sleep_condition.wait(lock, [this]() {
+                return !m_running || m_queued_jobs.load(std::memory_order_acquire) > 0;
+            });
+            if (!m_running)
+            {
+                return;
+            }
+        }
+    }
+
+    static constexpr uint32_t INVALID_THREAD_INDEX = ~0u;
+    static inline thread_local uint32_t thread_index = INVALID_THREAD_INDEX;
+
+    std::atomic<uint32_t> m_next_extra_index;
+    uint32_t m_thread_count;
+    std::vector<std::unique_ptr<Job_Queue>> m_queues;
+    std::vector<std::thread> m_workers;
+    std::atomic<uint32_t> m_queued_jobs = 0;
+    std::mutex m_sleep_mutex;
+    std::condition_variable m_sleep_condition;
+    bool m_running = true;
+};
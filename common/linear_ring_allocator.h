@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+
+static constexpr uint64_t INVALID_RING_OFFSET = ~0ull;
+
+// Backend-neutral bump allocator over a ring of `capacity` bytes.
+// Positions are virtual and only ever grow, the physical offset is position % capacity.
+// allocate() is lock-free and may be called from any recording thread, end_frame() and retire()
+// belong to the thread driving the frame loop.
+class Linear_Ring_Allocator
+{
+public:
+    explicit Linear_Ring_Allocator(uint64_t capacity)
+        : m_capacity(capacity)
+    {}
+
+    Linear_Ring_Allocator(const Linear_Ring_Allocator&) = delete;
+    Linear_Ring_Allocator& operator=(const Linear_Ring_Allocator&) = delete;
+
+    // Returns the physical offset or INVALID_RING_OFFSET if the ring is full.
+    // `alignment` has to be a power of two that divides the capacity.
+    // An allocation never straddles the end of the ring, the remainder is skipped instead.
+    uint64_t allocate(uint64_t size, uint64_t alignment)
+    {
+        if (size == 0 || size > m_capacity)
+        {
+            return INVALID_RING_OFFSET;
+        }
+        auto head = m_head.load(std::memory_order_relaxed);
+        while (true)
+        {
+            auto start = (head + alignment - 1) & ~(alignment - 1);
+            if (start % m_capacity + size > m_capacity)
+            {
+                start = (start / m_capacity + 1) * m_capacity;
+            }
+            auto end = start + size;
+            if (end - m_tail.load(std::memory_order_acquire) > m_capacity)
+            {
+                return INVALID_RING_OFFSET;
+            }
+            if (m_head.compare_exchange_weak(head, end, std::memory_order_acq_rel, std::memory_order_relaxed))
+            {
+                m_wasted_bytes.fetch_add(start - head, std::memory_order_relaxed);
+                return start % m_capacity;
+            }
+        }
+    }
+
+    // Everything allocated so far belongs to the frame that will be signaled with `fence_value`.
+    void end_frame(uint64_t fence_value)
+    {
+        m_frames.push_back({ m_head.load(std::memory_order_acquire), fence_value });
+    }
+
+    // Releases the regions of all frames whose fence value has completed.
+    void retire(uint64_t completed_fence_value)
+    {
+        while (!m_frames.empty() && m_frames.front().fence_value <= completed_fence_value)
+        {
+            m_tail.store(m_frames.front().head, std::memory_order_release);
+            m_frames.pop_front();
+        }
+    }
+
+    uint64_t get_capacity() const { return m_capacity; }
+
+    uint64_t get_used_bytes() const
+    {
+        return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+    }
+
+    // Bytes lost to alignment padding and to skipping the end of the ring, for fragmentation statistics.
+    uint64_t get_wasted_bytes() const { return m_wasted_bytes.load(std::memory_order_relaxed); }
+
+private:
+    struct Frame
+    {
+        uint64_t head;
+        uint64_t fence_value;
+    };
+
+    uint64_t m_capacity;
+    std::atomic<uint64_t> m_head = 0;
+    std::atomic<uint64_t> m_tail = 0;
+    std::atomic<uint64_t> m_wasted_bytes = 0;
+    std::deque<Frame> m_frames;
+};
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <vector>
+
+// LZ4 block format (no frame header), compatible with LZ4_compress_default / LZ4_decompress_safe.
+// The compressor is a plain greedy matcher for packing tools and tests, not tuned for ratio.
+
+// Returns false for corrupt input or if the output doesn't fill `decompressed` exactly.
+inline bool decompress_lz4_block(std::span<const uint8_t> compressed, std::span<uint8_t> decompressed)
+{
+    auto read_length = [&](size_t& position, size_t& length) {
+        uint8_t byte;
+        do
+        {
+            if (position >= compressed.size())
+            {
+                return false;
+            }
+            byte = compressed[position++];
+            length += byte;
+        } while (byte == 255);
+        return true;
+    };
+    size_t in = 0;
+    size_t out = 0;
+    while (in < compressed.size())
+    {
+        auto token = compressed[in++];
+        size_t literal_length = token >> 4;
+        if (literal_length == 15 && !read_length(in, literal_length))
+        {
+            return false;
+        }
+        if (literal_length > compressed.size() - in || literal_length > decompressed.size() - out)
+        {
+            return false;
+        }
+        memcpy(decompressed.data() + out, compressed.data() + in, literal_length);
+        in += literal_length;
+        out += literal_length;
+        // The last sequence has literals only.
+        if (in == compressed.size())
+        {
+            break;
+        }
+        if (compressed.size() - in < 2)
+        {
+            return false;
+        }
+        size_t offset = compressed[in] | (size_t(compressed[in + 1]) << 8);
+        in += 2;
+        size_t match_length = token & 15;
+        if (match_length == 15 && !read_length(in, match_length))
+        {
+            return false;
+        }
+        match_length += 4;
+        if (offset == 0 || offset > out || match_length > decompressed.size() - out)
+        {
+            return false;
+        }
+        auto destination = decompressed.data() + out;
+        const auto* source = destination - offset;
+        if (offset >= match_length)
+        {
+            memcpy(destination, source, match_length);
+        }
+        else
+        {
+            // Overlapping matches repeat the last `offset` bytes.
+            for (size_t i = 0; i < match_length; ++i)
+            {
+                destination[i] = source[i];
+            }
+        }
+        out += match_length;
+    }
+    return out == decompressed.size();
+}
+
+inline std::vector<uint8_t> compress_lz4_block(std::span<const uint8_t> data)
+{
+    // Format limits: the last 5 bytes are always literals and the last match starts 12 bytes before the end.
+    static constexpr size_t LAST_LITERALS = 5;
+    static constexpr size_t MATCH_FIND_LIMIT = 12;
+    static constexpr uint32_t HASH_BITS = 14;
+    static constexpr size_t MAX_OFFSET = 65535;
+
+    std::vector<uint8_t> result;
+    result.reserve(data.size() + data.size() / 255 + 16);
+    auto append_length = [&](size_t length) {
+        for (; length >= 255; length -= 255)
+        {
+            result.push_back(255);
+        }
+        result.push_back(uint8_t(length));
+    };
+    auto append_sequence = [&](size_t literal_begin, size_t literal_end, size_t offset, size_t match_length) {
+        auto literal_length = literal_end - literal_begin;
+        auto match_code = match_length >= 4 ? match_length - 4 : 0;
+        result.push_back(uint8_t((std::min<size_t>(literal_length, 15) << 4) | std::min<size_t>(match_code, 15)));
+        if (literal_length >= 15)
+        {
+            append_length(literal_length - 15);
+        }
+        result.insert(result.end(), data.begin() + literal_begin, data.begin() + literal_end);
+        if (match_length == 0)
+        {
+            return;
+        }
+        result.push_back(uint8_t(offset));
+        result.push_back(uint8_t(offset >> 8));
+        if (match_code >= 15)
+        {
+            append_length(match_code - 15);
+        }
+    };
+    auto read_u32 = [&](size_t position) {
+        uint32_t value;
+        memcpy(&value, data.data() + position, sizeof(value));
+        return value;
+    };
+
+    size_t anchor = 0;
+    if (data.size() > MATCH_FIND_LIMIT)
+    {
+        // Positions + 1, 0 is empty.
+        std::vector<uint32_t> table(size_t(1) << HASH_BITS);
+        auto limit = data.size() - MATCH_FIND_LIMIT;
+        size_t position = 0;
+        while (position < limit)
+        {
+            auto sequence = read_u32(position);
+            auto& entry = table[(sequence * 2654435761u) >> (32 - HASH_BITS)];
+            size_t candidate = entry;
+            entry = uint32_t(position + 1);
+            if (candidate == 0 || position - (candidate - 1) > MAX_OFFSET || read_u32(candidate - 1) != sequence)
+            {
+                position += 1;
+                continue;
+            }
+            candidate -= 1;
+            size_t match_length = 4;
+            auto max_length = data.size() - LAST_LITERALS - position;
+            while (match_length < max_length && data[candidate + match_length] == data[position + match_length])
+            {
+                match_length += 1;
+            }
+            append_sequence(anchor, position, position - candidate, match_length);
+            position += match_length;
+            anchor = position;
+        }
+    }
+    append_sequence(anchor, data.size(), 0, 0);
+    return result;
+}
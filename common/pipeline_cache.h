@@ -0,0 +1,184 @@
+#pragma once
+
+#include "hash.h"
+#include "shader_blob.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// Identifies the adapter and driver a cache was produced with. Any change invalidates the whole cache.
+// The adapter LUID is deliberately not part of it since it changes on every boot.
+struct Pipeline_Cache_Device_Id
+{
+    uint32_t vendor_id;
+    uint32_t device_id;
+    uint32_t subsys_id;
+    uint32_t revision;
+    uint64_t driver_version;
+};
+
+inline uint64_t get_pipeline_cache_device_hash(const Pipeline_Cache_Device_Id& id)
+{
+    return Hasher()
+        .add(id.vendor_id)
+        .add(id.device_id)
+        .add(id.subsys_id)
+        .add(id.revision)
+        .add(id.driver_version)
+        .get();
+}
+
+// Key of a compute pipeline: serialized root signature, shader bytecode and the remaining desc fields.
+inline uint64_t make_compute_pipeline_key(
+    Shader_Blob root_signature, Shader_Blob cs, uint32_t node_mask, uint32_t flags)
+{
+    return Hasher()
+        .add(root_signature.size)
+        .add(root_signature.data, root_signature.size)
+        .add(cs.size)
+        .add(cs.data, cs.size)
+        .add(node_mask)
+        .add(flags)
+        .get();
+}
+
+static constexpr uint32_t PIPELINE_CACHE_MAGIC = 0x434f5350; // 'PSOC'
+static constexpr uint32_t PIPELINE_CACHE_VERSION = 1;
+
+struct Pipeline_Cache_Header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t device_hash;
+    uint64_t entry_count;
+};
+
+struct Pipeline_Cache_Entry
+{
+    uint64_t key;
+    uint64_t size;
+    uint64_t data_hash;
+};
+
+static_assert(sizeof(Pipeline_Cache_Header) == 24);
+static_assert(sizeof(Pipeline_Cache_Entry) == 24);
+
+// Driver PSO blobs keyed by pipeline key. On disk: header, then per entry the
+// Pipeline_Cache_Entry immediately followed by its blob bytes.
+class Pipeline_Cache
+{
+public:
+    explicit Pipeline_Cache(uint64_t device_hash)
+        : m_device_hash(device_hash)
+    {}
+
+    // Returns false if the file is missing, corrupt or belongs to a different adapter/driver.
+    // In that case the cache starts out empty and gets rewritten on the next save.
+    bool load(const char* path)
+    {
+        m_entries.clear();
+        Mapped_File file(path);
+        if (!file.is_open() || file.size() < sizeof(Pipeline_Cache_Header))
+        {
+            return false;
+        }
+        auto bytes = static_cast<const uint8_t*>(file.data());
+        Pipeline_Cache_Header header;
+        memcpy(&header, bytes, sizeof(header));
+        if (header.magic != PIPELINE_CACHE_MAGIC
+            || header.version != PIPELINE_CACHE_VERSION
+            || header.device_hash != m_device_hash)
+        {
+            m_dirty = true;
+            return false;
+        }
+        size_t offset = sizeof(header);
+        for (uint64_t i = 0; i < header.entry_count; ++i)
+        {
+            Pipeline_Cache_Entry entry;
+            if (file.size() - offset < sizeof(entry))
+            {
+                m_entries.clear();
+                m_dirty = true;
+                return false;
+            }
+            memcpy(&entry, bytes + offset, sizeof(entry));
+            offset += sizeof(entry);
+            if (file.size() - offset < entry.size || fnv1a_64(bytes + offset, entry.size) != entry.data_hash)
+            {
+                m_entries.clear();
+                m_dirty = true;
+                return false;
+            }
+            m_entries[entry.key].assign(bytes + offset, bytes + offset + entry.size);
+            offset += entry.size;
+        }
+        m_dirty = false;
+        return true;
+    }
+
+    bool save(const char* path)
+    {
+        FILE* file = fopen(path, "wb");
+        if (!file)
+        {
+            return false;
+        }
+        Pipeline_Cache_Header header = {
+            .magic = PIPELINE_CACHE_MAGIC,
+            .version = PIPELINE_CACHE_VERSION,
+            .device_hash = m_device_hash,
+            .entry_count = m_entries.size()
+        };
+        bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+        for (const auto& [key, data] : m_entries)
+        {
+            Pipeline_Cache_Entry entry = {
+                .key = key,
+                .size = data.size(),
+                .data_hash = fnv1a_64(data.data(), data.size())
+            };
+            success = success && fwrite(&entry, sizeof(entry), 1, file) == 1;
+            success = success && fwrite(data.data(), 1, data.size(), file) == data.size();
+        }
+        success = fclose(file) == 0 && success;
+        if (success)
+        {
+            m_dirty = false;
+        }
+        return success;
+    }
+
+    Shader_Blob find(uint64_t key) const
+    {
+        auto it = m_entries.find(key);
+        if (it == m_entries.end())
+        {
+            return {};
+        }
+        return { it->second.data(), it->second.size() };
+    }
+
+    void store(uint64_t key, const void* data, size_t size)
+    {
+        auto bytes = static_cast<const uint8_t*>(data);
+        m_entries[key].assign(bytes, bytes + size);
+        m_dirty = true;
+    }
+
+    void erase(uint64_t key)
+    {
+        m_dirty |= m_entries.erase(key) > 0;
+    }
+
+    bool is_dirty() const { return m_dirty; }
+    size_t get_entry_count() const { return m_entries.size(); }
+
+private:
+    uint64_t m_device_hash;
+    std::unordered_map<uint64_t, std::vector<uint8_t>> m_entries;
+    bool m_dirty = false;
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <span>
+#include <vector>
+
+inline uint32_t get_png_crc32(std::span<const uint8_t> data, uint32_t crc = 0)
+{
+    static const auto table = []() {
+        std::array<uint32_t, 256> result;
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t value = i;
+            for (uint32_t bit = 0; bit < 8; ++bit)
+            {
+                value = value & 1 ? 0xedb88320u ^ (value >> 1) : value >> 1;
+            }
+            result[i] = value;
+        }
+        return result;
+    }();
+    crc = ~crc;
+    for (auto byte : data)
+    {
+        crc = table[(crc ^ byte) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// Writes 8 bit RGBA pixels, rows tightly packed. The image data is stored uncompressed, the files are
+// meant for comparing and viewing test output, not for size.
+inline bool write_png_rgba8(const char* path, uint32_t width, uint32_t height, std::span<const uint8_t> pixels)
+{
+    if (pixels.size() != size_t(width) * height * 4)
+    {
+        return false;
+    }
+    auto append_u32 = [](std::vector<uint8_t>& data, uint32_t value) {
+        for (int shift = 24; shift >= 0; shift -= 8)
+        {
+            data.push_back(uint8_t(value >> shift));
+        }
+    };
+    std::vector<uint8_t> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    auto append_chunk = [&](const char* type, std::span<const uint8_t> chunk) {
+        append_u32(png, uint32_t(chunk.size()));
+        auto type_offset = png.size();
+        png.insert(png.end(), type, type + 4);
+        png.insert(png.end(), chunk.begin(), chunk.end());
+        append_u32(png, get_png_crc32({ png.data() + type_offset, png.size() - type_offset }));
+    };
+
+    std::vector<uint8_t> header;
+    append_u32(header, width);
+    append_u32(header, height);
+    header.insert(header.end(), { 8, 6, 0, 0, 0 }); // 8 bit RGBA, no interlacing
+    append_chunk("IHDR", header);
+
+    // zlib stream of stored deflate blocks over the filtered rows, every row starts with filter type 0.
+    std::vector<uint8_t> rows;
+    rows.reserve(pixels.size() + height);
+    auto row_size = size_t(width) * 4;
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        rows.push_back(0);
+        rows.insert(rows.end(), pixels.begin() + y * row_size, pixels.begin() + (y + 1) * row_size);
+    }
+    std::vector<uint8_t> zlib = { 0x78, 0x01 };
+    static constexpr size_t MAX_STORED_BLOCK_SIZE = 65535;
+    size_t offset = 0;
+    do
+    {
+        auto block_size = std::min(rows.size() - offset, MAX_STORED_BLOCK_SIZE);
+        bool is_last = offset + block_size == rows.size();
+        zlib.push_back(is_last ? 1 : 0);
+        zlib.push_back(uint8_t(block_size));
+        zlib.push_back(uint8_t(block_size >> 8));
+        zlib.push_back(uint8_t(~block_size));
+        zlib.push_back(uint8_t(~block_size >> 8));
+        zlib.insert(zlib.end(), rows.begin() + offset, rows.begin() + offset + block_size);
+        offset += block_size;
+    } while (offset < rows.size());
+    uint32_t adler_a = 1;
+    uint32_t adler_b = 0;
+    for (auto byte : rows)
+    {
+        adler_a = (adler_a + byte) % 65521;
+        adler_b = (adler_b + adler_a) % 65521;
+    }
+    append_u32(zlib, (adler_b << 16) | adler_a);
+    append_chunk("IDAT", zlib);
+    append_chunk("IEND", {});
+
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        return false;
+    }
+    bool success = fwrite(png.data(), 1, png.size(), file) == png.size();
+    return fclose(file) == 0 && success;
+}
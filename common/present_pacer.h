@@ -0,0 +1,160 @@
+#pragma once
+
+#include "frame_ring.h"
+
+#include <chrono>
+#include <cstdint>
+
+// Swapchain as seen by the presentation logic.
+// Kept free of any graphics API so it can be backed by a simulated display.
+class Present_Target
+{
+public:
+    virtual ~Present_Target() = default;
+
+    // Blocks until the swapchain accepts another frame without exceeding its frame latency, or until
+    // `timeout_ms` passed. Returns false on timeout.
+    virtual bool wait_for_frame_latency(uint32_t timeout_ms) = 0;
+    virtual void present(uint32_t sync_interval, bool allow_tearing) = 0;
+    // Only called once no submitted work references the back buffers anymore.
+    virtual void resize(uint32_t width, uint32_t height) = 0;
+    virtual bool is_tearing_supported() const = 0;
+};
+
+class Present_Clock
+{
+public:
+    virtual ~Present_Clock() = default;
+
+    virtual uint64_t get_time_us() = 0;
+};
+
+class Steady_Present_Clock : public Present_Clock
+{
+public:
+    uint64_t get_time_us() override
+    {
+        auto now = std::chrono::steady_clock::now().time_since_epoch();
+        return uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(now).count());
+    }
+};
+
+struct Present_Settings
+{
+    uint32_t buffer_count = 3;
+    // Frames the swapchain may queue ahead of the display. 1 keeps input-to-photon latency lowest.
+    uint32_t max_frame_latency = 1;
+    bool vsync = true;
+    // Only used without vsync, lets variable refresh displays show frames as soon as they are done.
+    bool allow_tearing = true;
+};
+
+enum class Present_Frame
+{
+    Render,
+    // The back buffers were recreated at a new size, views and states of the old ones are gone.
+    Render_Resized,
+    // The window is minimized, nothing would be shown. Don't render and block on window messages instead.
+    Skip
+};
+
+// Paces frames on the frame latency waitable of a swapchain and applies window resizes between frames.
+// Resize requests only record the latest size. begin_frame() applies it once, after waiting for the
+// frames already in flight on the frame ring, so dragging a window border neither resizes per message
+// nor flushes any queue with a new signal. Restoring a minimized window at its old size is no resize.
+class Present_Pacer
+{
+public:
+    static constexpr uint32_t FRAME_LATENCY_TIMEOUT_MS = 1000;
+
+    Present_Pacer(
+        Present_Target& target, Present_Clock& clock, Frame_Ring& frame_ring,
+        const Present_Settings& settings, uint32_t width, uint32_t height)
+        : m_target(target)
+        , m_clock(clock)
+        , m_frame_ring(frame_ring)
+        , m_settings(settings)
+        , m_width(width)
+        , m_height(height)
+        , m_requested_width(width)
+        , m_requested_height(height)
+    {}
+
+    Present_Pacer(const Present_Pacer&) = delete;
+    Present_Pacer& operator=(const Present_Pacer&) = delete;
+
+    // Size of the client area, zero while minimized.
+    void request_resize(uint32_t width, uint32_t height)
+    {
+        m_requested_width = width;
+        m_requested_height = height;
+    }
+
+    // Call before sampling input, the wait is what keeps the frame's input fresh.
+    Present_Frame begin_frame()
+    {
+        if (m_requested_width == 0 || m_requested_height == 0)
+        {
+            return Present_Frame::Skip;
+        }
+        auto result = Present_Frame::Render;
+        if (m_requested_width != m_width || m_requested_height != m_height)
+        {
+            m_frame_ring.wait_idle();
+            m_target.resize(m_requested_width, m_requested_height);
+            m_width = m_requested_width;
+            m_height = m_requested_height;
+            m_resize_count += 1;
+            result = Present_Frame::Render_Resized;
+        }
+        auto wait_begin = m_clock.get_time_us();
+        if (!m_target.wait_for_frame_latency(FRAME_LATENCY_TIMEOUT_MS))
+        {
+            m_latency_timeout_count += 1;
+        }
+        m_latency_wait_us = m_clock.get_time_us() - wait_begin;
+        return result;
+    }
+
+    // Call after the frame's work was submitted and before the frame ring signals it.
+    void present()
+    {
+        bool allow_tearing = !m_settings.vsync && m_settings.allow_tearing && m_target.is_tearing_supported();
+        m_target.present(m_settings.vsync ? 1 : 0, allow_tearing);
+        auto now = m_clock.get_time_us();
+        if (m_present_count > 0)
+        {
+            m_frame_interval_us = now - m_last_present_us;
+        }
+        m_last_present_us = now;
+        m_present_count += 1;
+    }
+
+    void set_vsync(bool vsync) { m_settings.vsync = vsync; }
+
+    const Present_Settings& get_settings() const { return m_settings; }
+    uint32_t get_width() const { return m_width; }
+    uint32_t get_height() const { return m_height; }
+    // Time begin_frame() spent waiting for the swapchain, roughly how far the CPU ran ahead.
+    uint64_t get_latency_wait_us() const { return m_latency_wait_us; }
+    uint64_t get_frame_interval_us() const { return m_frame_interval_us; }
+    uint64_t get_present_count() const { return m_present_count; }
+    uint64_t get_resize_count() const { return m_resize_count; }
+    uint64_t get_latency_timeout_count() const { return m_latency_timeout_count; }
+
+private:
+    Present_Target& m_target;
+    Present_Clock& m_clock;
+    Frame_Ring& m_frame_ring;
+    Present_Settings m_settings;
+    uint32_t m_width;
+    uint32_t m_height;
+    uint32_t m_requested_width;
+    uint32_t m_requested_height;
+    uint64_t m_latency_wait_us = 0;
+    uint64_t m_frame_interval_us = 0;
+    uint64_t m_last_present_us = 0;
+    uint64_t m_present_count = 0;
+    uint64_t m_resize_count = 0;
+    uint64_t m_latency_timeout_count = 0;
+};
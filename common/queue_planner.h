@@ -0,0 +1,273 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum class Queue_Type : uint8_t
+{
+    Direct,
+    Compute,
+    Copy
+};
+
+static constexpr uint32_t QUEUE_TYPE_COUNT = 3;
+
+struct Queue_Plan_Input
+{
+    // Queue the pass may run on. Direct always works, Compute and Copy are only taken when profitable.
+    Queue_Type preferred_queue;
+    // Indices of earlier passes this pass has to run after.
+    std::vector<uint32_t> dependencies;
+};
+
+struct Queue_Wait
+{
+    Queue_Type queue;
+    uint64_t value;
+};
+
+// Per-frame submission plan. Fence values are local to the plan: the nth pass on a queue completes value n.
+// A backend offsets them by the value its fence was at when the frame started.
+struct Queue_Plan
+{
+    struct Pass
+    {
+        Queue_Type queue;
+        uint64_t value;
+        // The queue signals `value` after the pass. Only set where a wait or the frame end needs it.
+        bool signal;
+        // GPU side waits the queue has to issue before the pass.
+        std::vector<Queue_Wait> waits;
+    };
+
+    std::vector<Pass> passes;
+    // Number of passes per queue, i.e. the last value of each queue.
+    uint64_t pass_counts[QUEUE_TYPE_COUNT] = {};
+};
+
+// Portable planner for multi-queue submission. Passes come in a valid serial order (e.g. from
+// Render_Graph::compile), the planner assigns queues and derives the minimal set of cross-queue waits.
+class Queue_Planner
+{
+public:
+    static Queue_Plan plan(const std::vector<Queue_Plan_Input>& inputs)
+    {
+        Queue_Plan plan;
+        auto pass_count = uint32_t(inputs.size());
+        plan.passes.resize(pass_count);
+        auto ancestors = get_ancestors(inputs);
+        for (uint32_t p = 0; p < pass_count; ++p)
+        {
+            auto queue = inputs[p].preferred_queue;
+            if (queue != Queue_Type::Direct && !has_overlap_partner(inputs, ancestors, p))
+            {
+                queue = Queue_Type::Direct;
+            }
+            auto& pass = plan.passes[p];
+            pass.queue = queue;
+            pass.value = ++plan.pass_counts[uint32_t(queue)];
+            pass.signal = false;
+        }
+        // Vector clocks: known[q][o] is the highest value of queue o that queue q has synchronized with,
+        // pass_clocks[p] is the state of known[queue of p] right after p.
+        uint64_t known[QUEUE_TYPE_COUNT][QUEUE_TYPE_COUNT] = {};
+        std::vector<Clock> pass_clocks(pass_count);
+        for (uint32_t p = 0; p < pass_count; ++p)
+        {
+            auto& pass = plan.passes[p];
+            auto q = uint32_t(pass.queue);
+            // The latest pass per other queue this pass depends on. Waiting on it covers the earlier ones.
+            uint32_t required[QUEUE_TYPE_COUNT] = { INVALID_PASS, INVALID_PASS, INVALID_PASS };
+            for (auto dependency : inputs[p].dependencies)
+            {
+                auto o = uint32_t(plan.passes[dependency].queue);
+                if (o != q && (required[o] == INVALID_PASS || plan.passes[dependency].value > plan.passes[required[o]].value))
+                {
+                    required[o] = dependency;
+                }
+            }
+            for (uint32_t o = 0; o < QUEUE_TYPE_COUNT; ++o)
+            {
+                if (required[o] == INVALID_PASS || known[q][o] >= plan.passes[required[o]].value)
+                {
+                    continue;
+                }
+                auto dependency = required[o];
+                plan.passes[dependency].signal = true;
+                pass.waits.push_back({ Queue_Type(o), plan.passes[dependency].value });
+                for (uint32_t i = 0; i < QUEUE_TYPE_COUNT; ++i)
+                {
+                    known[q][i] = known[q][i] > pass_clocks[dependency].values[i] ? known[q][i] : pass_clocks[dependency].values[i];
+                }
+            }
+            known[q][q] = pass.value;
+            for (uint32_t i = 0; i < QUEUE_TYPE_COUNT; ++i)
+            {
+                pass_clocks[p].values[i] = known[q][i];
+            }
+        }
+        // The last pass of every queue signals so the frame end can join all queues.
+        for (uint32_t p = pass_count; p > 0; --p)
+        {
+            auto& pass = plan.passes[p - 1];
+            if (pass.value == plan.pass_counts[uint32_t(pass.queue)])
+            {
+                pass.signal = true;
+            }
+        }
+        return plan;
+    }
+
+    // Replays the plan on a simulated timeline of concurrently running queues. Returns false if the plan
+    // can deadlock or lets a pass start before one of its dependencies is guaranteed to have finished.
+    static bool validate(const std::vector<Queue_Plan_Input>& inputs, const Queue_Plan& plan)
+    {
+        auto pass_count = uint32_t(plan.passes.size());
+        if (inputs.size() != pass_count)
+        {
+            return false;
+        }
+        std::vector<uint32_t> queue_passes[QUEUE_TYPE_COUNT];
+        for (uint32_t p = 0; p < pass_count; ++p)
+        {
+            const auto& pass = plan.passes[p];
+            auto& passes = queue_passes[uint32_t(pass.queue)];
+            if (pass.value != passes.size() + 1)
+            {
+                return false;
+            }
+            passes.push_back(p);
+        }
+        // Happens-before through queue order and waits, as vector clocks of pass values.
+        std::vector<Clock> clocks(pass_count);
+        uint64_t signaled[QUEUE_TYPE_COUNT] = {};
+        size_t next[QUEUE_TYPE_COUNT] = {};
+        uint32_t executed = 0;
+        while (executed < pass_count)
+        {
+            bool progress = false;
+            for (uint32_t q = 0; q < QUEUE_TYPE_COUNT; ++q)
+            {
+                if (next[q] == queue_passes[q].size())
+                {
+                    continue;
+                }
+                auto p = queue_passes[q][next[q]];
+                const auto& pass = plan.passes[p];
+                Clock clock = {};
+                if (next[q] > 0)
+                {
+                    clock = clocks[queue_passes[q][next[q] - 1]];
+                }
+                bool blocked = false;
+                for (const auto& wait : pass.waits)
+                {
+                    auto o = uint32_t(wait.queue);
+                    if (signaled[o] < wait.value)
+                    {
+                        blocked = true;
+                        break;
+                    }
+                    // The fence reaches the value with the first signal at or after it, the wait
+                    // synchronizes with that pass.
+                    auto signaler = find_signaler(plan, queue_passes[o], wait.value);
+                    for (uint32_t i = 0; i < QUEUE_TYPE_COUNT; ++i)
+                    {
+                        clock.values[i] = clock.values[i] > clocks[signaler].values[i] ? clock.values[i] : clocks[signaler].values[i];
+                    }
+                }
+                if (blocked)
+                {
+                    continue;
+                }
+                clock.values[q] = pass.value;
+                clocks[p] = clock;
+                if (pass.signal)
+                {
+                    signaled[q] = pass.value;
+                }
+                next[q] += 1;
+                executed += 1;
+                progress = true;
+            }
+            if (!progress)
+            {
+                return false;
+            }
+        }
+        for (uint32_t p = 0; p < pass_count; ++p)
+        {
+            for (auto dependency : inputs[p].dependencies)
+            {
+                const auto& dependency_pass = plan.passes[dependency];
+                if (clocks[p].values[uint32_t(dependency_pass.queue)] < dependency_pass.value)
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+private:
+    static constexpr uint32_t INVALID_PASS = ~0u;
+
+    struct Clock
+    {
+        uint64_t values[QUEUE_TYPE_COUNT] = {};
+    };
+
+    // Transitive dependencies as one bit set per pass.
+    static std::vector<std::vector<uint64_t>> get_ancestors(const std::vector<Queue_Plan_Input>& inputs)
+    {
+        auto pass_count = inputs.size();
+        auto words = (pass_count + 63) / 64;
+        std::vector<std::vector<uint64_t>> ancestors(pass_count, std::vector<uint64_t>(words, 0));
+        for (size_t p = 0; p < pass_count; ++p)
+        {
+            for (auto dependency : inputs[p].dependencies)
+            {
+                ancestors[p][dependency / 64] |= 1ull << (dependency % 64);
+                for (size_t w = 0; w < words; ++w)
+                {
+                    ancestors[p][w] |= ancestors[dependency][w];
+                }
+            }
+        }
+        return ancestors;
+    }
+
+    // Moving a pass to another queue only pays off if some direct queue pass can run concurrently with it,
+    // i.e. is neither an ancestor nor a descendant.
+    static bool has_overlap_partner(
+        const std::vector<Queue_Plan_Input>& inputs, const std::vector<std::vector<uint64_t>>& ancestors, uint32_t pass)
+    {
+        for (uint32_t other = 0; other < inputs.size(); ++other)
+        {
+            if (other == pass || inputs[other].preferred_queue != Queue_Type::Direct)
+            {
+                continue;
+            }
+            bool is_ancestor = (ancestors[pass][other / 64] >> (other % 64)) & 1;
+            bool is_descendant = (ancestors[other][pass / 64] >> (pass % 64)) & 1;
+            if (!is_ancestor && !is_descendant)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static uint32_t find_signaler(const Queue_Plan& plan, const std::vector<uint32_t>& queue_passes, uint64_t value)
+    {
+        for (auto i = size_t(value - 1); i < queue_passes.size(); ++i)
+        {
+            if (plan.passes[queue_passes[i]].signal)
+            {
+                return queue_passes[i];
+            }
+        }
+        return queue_passes.back();
+    }
+};
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+
+static constexpr uint32_t INVALID_READBACK_SLOT = ~0u;
+
+struct Readback_Ticket
+{
+    uint32_t slot = INVALID_READBACK_SLOT;
+    uint32_t generation = 0;
+
+    bool is_valid() const { return slot != INVALID_READBACK_SLOT; }
+};
+
+// API-agnostic state machine for a fixed set of readback slots.
+// A slot goes Free -> Recorded (copy recorded, not yet submitted) -> In_Flight (tagged with a fence value)
+// -> Ready (fence completed) -> Free again once the consumer releases it.
+// Requests with a callback are handed to the callback from update() and released right after it returns,
+// requests without one wait in Ready until try_get() picked them up and release() was called.
+// Driven by a single thread.
+class Readback_Queue
+{
+public:
+    enum class Slot_State : uint8_t
+    {
+        Free,
+        Recorded,
+        In_Flight,
+        Ready
+    };
+
+    using Callback = std::function<void(uint32_t slot)>;
+
+    explicit Readback_Queue(uint32_t slot_count)
+        : m_slots(slot_count)
+    {
+        for (uint32_t i = slot_count; i > 0; --i)
+        {
+            m_free_slots.push_back(i - 1);
+        }
+    }
+
+    Readback_Queue(const Readback_Queue&) = delete;
+    Readback_Queue& operator=(const Readback_Queue&) = delete;
+
+    // Returns an invalid ticket if every slot is in use. The caller records the copy into the returned slot.
+    Readback_Ticket request(Callback callback = {})
+    {
+        if (m_free_slots.empty())
+        {
+            return {};
+        }
+        auto slot_index = m_free_slots.back();
+        m_free_slots.pop_back();
+        auto& slot = m_slots[slot_index];
+        slot.state = Slot_State::Recorded;
+        slot.callback = std::move(callback);
+        m_recorded.push_back(slot_index);
+        return { slot_index, slot.generation };
+    }
+
+    // Every request recorded since the last submit completes with `fence_value`.
+    void submit(uint64_t fence_value)
+    {
+        for (auto slot_index : m_recorded)
+        {
+            m_slots[slot_index].state = Slot_State::In_Flight;
+            m_slots[slot_index].fence_value = fence_value;
+            m_in_flight.push_back(slot_index);
+        }
+        m_recorded.clear();
+    }
+
+    // Moves completed slots to Ready and runs their callbacks. Never blocks.
+    void update(uint64_t completed_fence_value)
+    {
+        while (!m_in_flight.empty() && m_slots[m_in_flight.front()].fence_value <= completed_fence_value)
+        {
+            auto slot_index = m_in_flight.front();
+            m_in_flight.pop_front();
+            auto& slot = m_slots[slot_index];
+            slot.state = Slot_State::Ready;
+            if (slot.callback)
+            {
+                auto callback = std::move(slot.callback);
+                slot.callback = {};
+                auto generation = slot.generation;
+                callback(slot_index);
+                // The callback may have released the request itself.
+                if (slot.generation == generation)
+                {
+                    release_slot(slot_index);
+                }
+            }
+        }
+    }
+
+    // Returns the slot holding the data if the request completed, INVALID_READBACK_SLOT otherwise.
+    // The slot's memory stays valid until release().
+    uint32_t try_get(Readback_Ticket ticket) const
+    {
+        return is_ready(ticket) ? ticket.slot : INVALID_READBACK_SLOT;
+    }
+
+    bool is_ready(Readback_Ticket ticket) const
+    {
+        return is_current(ticket) && m_slots[ticket.slot].state == Slot_State::Ready;
+    }
+
+    // Gives up a request. Requests that are still in flight are released as soon as they complete.
+    void release(Readback_Ticket ticket)
+    {
+        if (!is_current(ticket))
+        {
+            return;
+        }
+        auto& slot = m_slots[ticket.slot];
+        if (slot.state == Slot_State::Ready)
+        {
+            release_slot(ticket.slot);
+        }
+        else if (slot.state != Slot_State::Free)
+        {
+            slot.callback = [](uint32_t) {};
+        }
+    }
+
+    Slot_State get_state(uint32_t slot) const { return m_slots[slot].state; }
+    uint32_t get_slot_count() const { return uint32_t(m_slots.size()); }
+    uint32_t get_free_slot_count() const { return uint32_t(m_free_slots.size()); }
+
+private:
+    struct Slot
+    {
+        Slot_State state = Slot_State::Free;
+        uint32_t generation = 0;
+        uint64_t fence_value = 0;
+        Callback callback;
+    };
+
+    bool is_current(Readback_Ticket ticket) const
+    {
+        return ticket.slot < m_slots.size() && m_slots[ticket.slot].generation == ticket.generation;
+    }
+
+    void release_slot(uint32_t slot_index)
+    {
+        auto& slot = m_slots[slot_index];
+        slot.state = Slot_State::Free;
+        slot.generation += 1;
+        m_free_slots.push_back(slot_index);
+    }
+
+    std::vector<Slot> m_slots;
+    std::vector<uint32_t> m_free_slots;
+    std::vector<uint32_t> m_recorded;
+    std::deque<uint32_t> m_in_flight;
+};
@@ -0,0 +1,626 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+static constexpr uint32_t INVALID_RENDER_GRAPH_INDEX = ~0u;
+static constexpr uint64_t INVALID_TRANSIENT_OFFSET = ~0ull;
+
+enum class Render_Graph_Pass_Type : uint8_t
+{
+    Graphics,
+    Compute,
+    Copy
+};
+
+// Stages a resource is accessed from, one bit per pass type.
+enum Render_Graph_Stage : uint32_t
+{
+    RENDER_GRAPH_STAGE_NONE = 0,
+    RENDER_GRAPH_STAGE_GRAPHICS = 1u << uint32_t(Render_Graph_Pass_Type::Graphics),
+    RENDER_GRAPH_STAGE_COMPUTE = 1u << uint32_t(Render_Graph_Pass_Type::Compute),
+    RENDER_GRAPH_STAGE_COPY = 1u << uint32_t(Render_Graph_Pass_Type::Copy)
+};
+
+enum class Resource_Usage : uint8_t
+{
+    Undefined,
+    Shader_Read,
+    Unordered_Access,
+    Render_Target,
+    Depth_Read,
+    Depth_Write,
+    Copy_Source,
+    Copy_Dest,
+    Indirect_Argument,
+    Present
+};
+
+inline bool is_write_usage(Resource_Usage usage)
+{
+    return usage == Resource_Usage::Unordered_Access
+        || usage == Resource_Usage::Render_Target
+        || usage == Resource_Usage::Depth_Write
+        || usage == Resource_Usage::Copy_Dest;
+}
+
+struct Resource_Access
+{
+    Resource_Usage usage = Resource_Usage::Undefined;
+    uint32_t stages = RENDER_GRAPH_STAGE_NONE;
+
+    bool operator==(const Resource_Access&) const = default;
+};
+
+struct Render_Graph_Resource_Handle
+{
+    uint32_t index = INVALID_RENDER_GRAPH_INDEX;
+
+    bool is_valid() const { return index != INVALID_RENDER_GRAPH_INDEX; }
+};
+
+struct Render_Graph_Pass_Handle
+{
+    uint32_t index = INVALID_RENDER_GRAPH_INDEX;
+
+    bool is_valid() const { return index != INVALID_RENDER_GRAPH_INDEX; }
+};
+
+// Whole-resource transition from `before` to `after`, issued right before a pass.
+// - is_external: first use of an imported resource, `before` is whatever state it is in outside the graph
+//   and has to be supplied by the backend.
+// - is_discard: first use of a transient resource. Its contents are undefined and `before.stages` are the
+//   stages that last accessed resources previously occupying the same memory.
+struct Render_Graph_Barrier
+{
+    uint32_t resource;
+    Resource_Access before;
+    Resource_Access after;
+    bool is_external;
+    bool is_discard;
+};
+
+struct Compiled_Render_Graph
+{
+    struct Pass
+    {
+        uint32_t pass;
+        std::vector<Render_Graph_Barrier> barriers;
+        // Execution order indices of the passes this one has to run after: data dependencies, the pass
+        // holding a shared read barrier and the previous users of aliased memory. Sorted, for queue planning.
+        std::vector<uint32_t> dependencies;
+    };
+
+    // Execution order, culled passes are absent.
+    std::vector<Pass> passes;
+    // Transitions of imported resources into their requested final access, after the last pass.
+    std::vector<Render_Graph_Barrier> final_barriers;
+    // Offset of every transient resource within its memory group, INVALID_TRANSIENT_OFFSET if unused.
+    std::vector<uint64_t> transient_offsets;
+    // Memory needed per memory group.
+    std::vector<uint64_t> memory_group_sizes;
+    // Last access of every resource within the graph.
+    std::vector<Resource_Access> final_accesses;
+};
+
+// Backend-independent frame graph. Passes declare which resources they read and write, compile() culls
+// passes that contribute to no output, orders the rest, derives the barriers between them and packs
+// transient resources with disjoint lifetimes into the same memory.
+// Declaration order is the reference order: a pass sees the writes of passes declared before it.
+// Imported resources and passes marked with side effects are the outputs of the graph.
+class Render_Graph
+{
+public:
+    void clear()
+    {
+        m_resources.clear();
+        m_passes.clear();
+    }
+
+    // `memory_group` separates resources that can't share memory, e.g. heap tiers on D3D12.
+    Render_Graph_Resource_Handle create_resource(
+        std::string name, uint64_t size, uint64_t alignment, uint32_t memory_group = 0)
+    {
+        m_resources.push_back({
+            .name = std::move(name),
+            .size = size,
+            .alignment = alignment > 0 ? alignment : 1,
+            .memory_group = memory_group,
+            .is_imported = false,
+            .final_access = {}
+        });
+        return { uint32_t(m_resources.size() - 1) };
+    }
+
+    // An Undefined `final_access` leaves the resource in the state of its last use.
+    Render_Graph_Resource_Handle import_resource(std::string name, Resource_Access final_access = {})
+    {
+        m_resources.push_back({
+            .name = std::move(name),
+            .size = 0,
+            .alignment = 1,
+            .memory_group = 0,
+            .is_imported = true,
+            .final_access = final_access
+        });
+        return { uint32_t(m_resources.size() - 1) };
+    }
+
+    Render_Graph_Pass_Handle add_pass(std::string name, Render_Graph_Pass_Type type)
+    {
+        m_passes.push_back({ .name = std::move(name), .type = type, .has_side_effects = false, .accesses = {} });
+        return { uint32_t(m_passes.size() - 1) };
+    }
+
+    void read(Render_Graph_Pass_Handle pass, Render_Graph_Resource_Handle resource, Resource_Usage usage)
+    {
+        add_access(pass, resource, usage, false);
+    }
+
+    // Writes are assumed to depend on the previous contents, so earlier writers are never culled.
+    void write(Render_Graph_Pass_Handle pass, Render_Graph_Resource_Handle resource, Resource_Usage usage)
+    {
+        add_access(pass, resource, usage, true);
+    }
+
+    void set_side_effects(Render_Graph_Pass_Handle pass) { m_passes[pass.index].has_side_effects = true; }
+
+    uint32_t get_pass_count() const { return uint32_t(m_passes.size()); }
+    uint32_t get_resource_count() const { return uint32_t(m_resources.size()); }
+    const std::string& get_pass_name(uint32_t pass) const { return m_passes[pass].name; }
+    Render_Graph_Pass_Type get_pass_type(uint32_t pass) const { return m_passes[pass].type; }
+    const std::string& get_resource_name(uint32_t resource) const { return m_resources[resource].name; }
+    bool is_imported(uint32_t resource) const { return m_resources[resource].is_imported; }
+
+    void compile(Compiled_Render_Graph& compiled) const
+    {
+        compiled = {};
+        auto live = cull();
+        std::vector<std::vector<uint32_t>> predecessors;
+        auto order = schedule(live, predecessors);
+        std::vector<uint32_t> positions(m_passes.size(), INVALID_RENDER_GRAPH_INDEX);
+        for (uint32_t i = 0; i < order.size(); ++i)
+        {
+            positions[order[i]] = i;
+        }
+        compiled.passes.resize(order.size());
+        for (uint32_t i = 0; i < order.size(); ++i)
+        {
+            compiled.passes[i].pass = order[i];
+            for (auto predecessor : predecessors[order[i]])
+            {
+                compiled.passes[i].dependencies.push_back(positions[predecessor]);
+            }
+        }
+        // Accesses of every resource in execution order.
+        std::vector<std::vector<std::pair<uint32_t, Resource_Access>>> timelines(m_resources.size());
+        for (uint32_t i = 0; i < order.size(); ++i)
+        {
+            const auto& pass = m_passes[order[i]];
+            for (const auto& access : pass.accesses)
+            {
+                timelines[access.resource].push_back({ i, { access.usage, get_stage(pass.type) } });
+            }
+        }
+        std::vector<std::vector<uint32_t>> aliased;
+        place_transients(timelines, aliased, compiled);
+        compiled.final_accesses.resize(m_resources.size());
+        for (uint32_t r = 0; r < m_resources.size(); ++r)
+        {
+            emit_barriers(r, timelines, aliased, compiled);
+        }
+        for (auto& pass : compiled.passes)
+        {
+            std::sort(pass.dependencies.begin(), pass.dependencies.end());
+            pass.dependencies.erase(std::unique(pass.dependencies.begin(), pass.dependencies.end()), pass.dependencies.end());
+        }
+    }
+
+private:
+    struct Access
+    {
+        uint32_t resource;
+        Resource_Usage usage;
+        bool is_write;
+    };
+
+    struct Pass
+    {
+        std::string name;
+        Render_Graph_Pass_Type type;
+        bool has_side_effects;
+        std::vector<Access> accesses;
+    };
+
+    struct Resource
+    {
+        std::string name;
+        uint64_t size;
+        uint64_t alignment;
+        uint32_t memory_group;
+        bool is_imported;
+        Resource_Access final_access;
+    };
+
+    static uint32_t get_stage(Render_Graph_Pass_Type type) { return 1u << uint32_t(type); }
+
+    void add_access(Render_Graph_Pass_Handle pass, Render_Graph_Resource_Handle resource, Resource_Usage usage, bool is_write)
+    {
+        // One access per resource and pass, a write supersedes a read.
+        for (auto& access : m_passes[pass.index].accesses)
+        {
+            if (access.resource == resource.index)
+            {
+                if (is_write || !access.is_write)
+                {
+                    access.usage = usage;
+                    access.is_write = is_write;
+                }
+                return;
+            }
+        }
+        m_passes[pass.index].accesses.push_back({ resource.index, usage, is_write });
+    }
+
+    std::vector<bool> cull() const
+    {
+        // last_writers[p][a]: last pass declared before p that writes the resource of p's access a.
+        std::vector<std::vector<uint32_t>> last_writers(m_passes.size());
+        std::vector<uint32_t> last_writer(m_resources.size(), INVALID_RENDER_GRAPH_INDEX);
+        std::vector<uint32_t> worklist;
+        std::vector<bool> live(m_passes.size(), false);
+        for (uint32_t p = 0; p < m_passes.size(); ++p)
+        {
+            const auto& pass = m_passes[p];
+            last_writers[p].reserve(pass.accesses.size());
+            bool is_output = pass.has_side_effects;
+            for (const auto& access : pass.accesses)
+            {
+                last_writers[p].push_back(last_writer[access.resource]);
+                is_output = is_output || (access.is_write && m_resources[access.resource].is_imported);
+            }
+            for (const auto& access : pass.accesses)
+            {
+                if (access.is_write)
+                {
+                    last_writer[access.resource] = p;
+                }
+            }
+            if (is_output)
+            {
+                live[p] = true;
+                worklist.push_back(p);
+            }
+        }
+        while (!worklist.empty())
+        {
+            auto p = worklist.back();
+            worklist.pop_back();
+            for (auto writer : last_writers[p])
+            {
+                if (writer != INVALID_RENDER_GRAPH_INDEX && !live[writer])
+                {
+                    live[writer] = true;
+                    worklist.push_back(writer);
+                }
+            }
+        }
+        return live;
+    }
+
+    // Kahn's algorithm over read-after-write, write-after-read and write-after-write edges. Among the
+    // ready passes the earliest declared one that does not depend on the pass scheduled last is picked,
+    // which moves dependent passes apart so their barriers have work to overlap with.
+    std::vector<uint32_t> schedule(const std::vector<bool>& live, std::vector<std::vector<uint32_t>>& predecessors) const
+    {
+        auto pass_count = uint32_t(m_passes.size());
+        std::vector<std::vector<uint32_t>> successors(pass_count);
+        predecessors.assign(pass_count, {});
+        std::vector<uint32_t> last_writer(m_resources.size(), INVALID_RENDER_GRAPH_INDEX);
+        std::vector<std::vector<uint32_t>> readers(m_resources.size());
+        auto add_edge = [&](uint32_t from, uint32_t to) {
+            if (from != INVALID_RENDER_GRAPH_INDEX && from != to)
+            {
+                successors[from].push_back(to);
+                predecessors[to].push_back(from);
+            }
+        };
+        for (uint32_t p = 0; p < pass_count; ++p)
+        {
+            if (!live[p])
+            {
+                continue;
+            }
+            for (const auto& access : m_passes[p].accesses)
+            {
+                add_edge(last_writer[access.resource], p);
+                if (access.is_write)
+                {
+                    for (auto reader : readers[access.resource])
+                    {
+                        add_edge(reader, p);
+                    }
+                    readers[access.resource].clear();
+                    last_writer[access.resource] = p;
+                }
+                else
+                {
+                    readers[access.resource].push_back(p);
+                }
+            }
+        }
+        std::vector<uint32_t> in_degree(pass_count, 0);
+        for (uint32_t p = 0; p < pass_count; ++p)
+        {
+            auto& preds = predecessors[p];
+            std::sort(preds.begin(), preds.end());
+            preds.erase(std::unique(preds.begin(), preds.end()), preds.end());
+            in_degree[p] = uint32_t(preds.size());
+            auto& succs = successors[p];
+            std::sort(succs.begin(), succs.end());
+            succs.erase(std::unique(succs.begin(), succs.end()), succs.end());
+        }
+        std::vector<uint32_t> ready;
+        for (uint32_t p = 0; p < pass_count; ++p)
+        {
+            if (live[p] && in_degree[p] == 0)
+            {
+                ready.push_back(p);
+            }
+        }
+        std::vector<uint32_t> order;
+        uint32_t previous = INVALID_RENDER_GRAPH_INDEX;
+        while (!ready.empty())
+        {
+            // `ready` is kept sorted by declaration order.
+            size_t pick = 0;
+            if (previous != INVALID_RENDER_GRAPH_INDEX)
+            {
+                for (size_t i = 0; i < ready.size(); ++i)
+                {
+                    const auto& preds = predecessors[ready[i]];
+                    if (!std::binary_search(preds.begin(), preds.end(), previous))
+                    {
+                        pick = i;
+                        break;
+                    }
+                }
+            }
+            auto p = ready[pick];
+            ready.erase(ready.begin() + pick);
+            order.push_back(p);
+            previous = p;
+            for (auto s : successors[p])
+            {
+                if (--in_degree[s] == 0)
+                {
+                    ready.insert(std::lower_bound(ready.begin(), ready.end(), s), s);
+                }
+            }
+        }
+        return order;
+    }
+
+    // Memory last used by `resource`, for finding what a later transient in the same range has to wait for.
+    struct Memory_Range
+    {
+        uint64_t begin;
+        uint64_t end;
+        uint32_t resource;
+    };
+
+    static uint64_t align_up(uint64_t offset, uint64_t alignment)
+    {
+        return (offset + alignment - 1) / alignment * alignment;
+    }
+
+    // Linear scan over the execution order: a transient takes memory at its first use and hands it back
+    // after its last use, so a placement only looks at the free ranges of its memory group rather than at
+    // every other transient. Resources first used by the same pass go largest first, each into the free
+    // range it fits best. `aliased[r]` receives the transients that last used the memory `r` takes over.
+    void place_transients(
+        const std::vector<std::vector<std::pair<uint32_t, Resource_Access>>>& timelines,
+        std::vector<std::vector<uint32_t>>& aliased,
+        Compiled_Render_Graph& compiled) const
+    {
+        compiled.transient_offsets.assign(m_resources.size(), INVALID_TRANSIENT_OFFSET);
+        aliased.assign(m_resources.size(), {});
+        std::vector<uint32_t> transients;
+        for (uint32_t r = 0; r < m_resources.size(); ++r)
+        {
+            if (!m_resources[r].is_imported && !timelines[r].empty())
+            {
+                transients.push_back(r);
+                if (m_resources[r].memory_group >= compiled.memory_group_sizes.size())
+                {
+                    compiled.memory_group_sizes.resize(m_resources[r].memory_group + 1, 0);
+                }
+            }
+        }
+        std::sort(transients.begin(), transients.end(), [&](uint32_t a, uint32_t b) {
+            auto first_a = timelines[a].front().first;
+            auto first_b = timelines[b].front().first;
+            return first_a != first_b ? first_a < first_b
+                : m_resources[a].size != m_resources[b].size ? m_resources[a].size > m_resources[b].size
+                : a < b;
+        });
+        auto by_last_use = transients;
+        std::sort(by_last_use.begin(), by_last_use.end(), [&](uint32_t a, uint32_t b) {
+            return timelines[a].back().first < timelines[b].back().first;
+        });
+
+        // Free memory per group, sorted and coalesced. The last range is open-ended, the group grows into it
+        // when nothing below its current size fits.
+        auto group_count = compiled.memory_group_sizes.size();
+        std::vector<std::vector<std::pair<uint64_t, uint64_t>>> free_ranges(group_count, { { 0, ~0ull } });
+        // Last user of every byte that has been used, per group, sorted.
+        std::vector<std::vector<Memory_Range>> last_users(group_count);
+        size_t retired = 0;
+        for (auto r : transients)
+        {
+            auto first_use = timelines[r].front().first;
+            for (; retired < by_last_use.size() && timelines[by_last_use[retired]].back().first < first_use; ++retired)
+            {
+                auto other = by_last_use[retired];
+                auto group = m_resources[other].memory_group;
+                auto begin = compiled.transient_offsets[other];
+                release_range(free_ranges[group], begin, begin + m_resources[other].size);
+                set_last_user(last_users[group], { begin, begin + m_resources[other].size, other });
+            }
+
+            const auto& resource = m_resources[r];
+            auto& ranges = free_ranges[resource.memory_group];
+            size_t pick = ranges.size() - 1;
+            uint64_t pick_slack = ~0ull;
+            for (size_t i = 0; i + 1 < ranges.size(); ++i)
+            {
+                auto offset = align_up(ranges[i].first, resource.alignment);
+                if (offset + resource.size <= ranges[i].second && ranges[i].second - offset - resource.size < pick_slack)
+                {
+                    pick = i;
+                    pick_slack = ranges[i].second - offset - resource.size;
+                }
+            }
+            auto offset = align_up(ranges[pick].first, resource.alignment);
+            auto end = offset + resource.size;
+            auto [range_begin, range_end] = ranges[pick];
+            ranges.erase(ranges.begin() + pick);
+            if (end < range_end)
+            {
+                ranges.insert(ranges.begin() + pick, { end, range_end });
+            }
+            if (range_begin < offset)
+            {
+                ranges.insert(ranges.begin() + pick, { range_begin, offset });
+            }
+            compiled.transient_offsets[r] = offset;
+            auto& group_size = compiled.memory_group_sizes[resource.memory_group];
+            group_size = std::max(group_size, end);
+
+            const auto& users = last_users[resource.memory_group];
+            auto it = std::partition_point(users.begin(), users.end(), [&](const Memory_Range& range) { return range.end <= offset; });
+            for (; it != users.end() && it->begin < end; ++it)
+            {
+                aliased[r].push_back(it->resource);
+            }
+        }
+    }
+
+    // Returns [begin, end) to the sorted free ranges, merged with its neighbours.
+    static void release_range(std::vector<std::pair<uint64_t, uint64_t>>& ranges, uint64_t begin, uint64_t end)
+    {
+        auto next = std::upper_bound(ranges.begin(), ranges.end(), std::pair<uint64_t, uint64_t>(begin, end));
+        if (next != ranges.end() && next->first == end)
+        {
+            end = next->second;
+            next = ranges.erase(next);
+        }
+        if (next != ranges.begin() && std::prev(next)->second == begin)
+        {
+            std::prev(next)->second = end;
+            return;
+        }
+        ranges.insert(next, { begin, end });
+    }
+
+    // Overwrites the last user of `range`'s bytes, trimming the ranges it partially covers.
+    static void set_last_user(std::vector<Memory_Range>& users, const Memory_Range& range)
+    {
+        auto first = std::partition_point(users.begin(), users.end(), [&](const Memory_Range& user) { return user.end <= range.begin; });
+        auto last = std::partition_point(first, users.end(), [&](const Memory_Range& user) { return user.begin < range.end; });
+        Memory_Range pieces[3];
+        uint32_t piece_count = 0;
+        if (first != last && first->begin < range.begin)
+        {
+            pieces[piece_count++] = { first->begin, range.begin, first->resource };
+        }
+        pieces[piece_count++] = range;
+        if (first != last && std::prev(last)->end > range.end)
+        {
+            pieces[piece_count++] = { range.end, std::prev(last)->end, std::prev(last)->resource };
+        }
+        first = users.erase(first, last);
+        users.insert(first, pieces, pieces + piece_count);
+    }
+
+    // Stages of the last accesses of the transients that last used `resource`'s memory before it. The first
+    // use of `resource` depends on those last accesses, older users are ordered before them already.
+    uint32_t get_aliased_stages(
+        uint32_t resource,
+        const std::vector<std::vector<std::pair<uint32_t, Resource_Access>>>& timelines,
+        const std::vector<std::vector<uint32_t>>& aliased,
+        Compiled_Render_Graph& compiled) const
+    {
+        auto first_use = timelines[resource].front().first;
+        uint32_t stages = RENDER_GRAPH_STAGE_NONE;
+        for (auto r : aliased[resource])
+        {
+            stages |= timelines[r].back().second.stages;
+            compiled.passes[first_use].dependencies.push_back(timelines[r].back().first);
+        }
+        return stages;
+    }
+
+    // Consecutive reads with the same usage share one barrier whose stages cover all of the readers,
+    // every write gets its own so write-after-write hazards (e.g. back to back UAV passes) are ordered.
+    void emit_barriers(
+        uint32_t resource,
+        const std::vector<std::vector<std::pair<uint32_t, Resource_Access>>>& timelines,
+        const std::vector<std::vector<uint32_t>>& aliased,
+        Compiled_Render_Graph& compiled) const
+    {
+        const auto& self = m_resources[resource];
+        const auto& timeline = timelines[resource];
+        Resource_Access current = {};
+        bool is_first = true;
+        size_t i = 0;
+        while (i < timeline.size())
+        {
+            auto [position, access] = timeline[i];
+            size_t next = i + 1;
+            if (!is_write_usage(access.usage))
+            {
+                while (next < timeline.size() && timeline[next].second.usage == access.usage)
+                {
+                    access.stages |= timeline[next].second.stages;
+                    compiled.passes[timeline[next].first].dependencies.push_back(position);
+                    next += 1;
+                }
+            }
+            Render_Graph_Barrier barrier = {
+                .resource = resource,
+                .before = current,
+                .after = access,
+                .is_external = is_first && self.is_imported,
+                .is_discard = is_first && !self.is_imported
+            };
+            if (barrier.is_discard)
+            {
+                barrier.before = { Resource_Usage::Undefined, get_aliased_stages(resource, timelines, aliased, compiled) };
+            }
+            compiled.passes[position].barriers.push_back(barrier);
+            current = access;
+            is_first = false;
+            i = next;
+        }
+        compiled.final_accesses[resource] = current;
+        if (self.is_imported && self.final_access.usage != Resource_Usage::Undefined && !(self.final_access == current))
+        {
+            compiled.final_barriers.push_back({
+                .resource = resource,
+                .before = current,
+                .after = self.final_access,
+                .is_external = timeline.empty(),
+                .is_discard = false
+            });
+            compiled.final_accesses[resource] = self.final_access;
+        }
+    }
+
+    std::vector<Resource> m_resources;
+    std::vector<Pass> m_passes;
+};
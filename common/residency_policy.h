@@ -0,0 +1,220 @@
+#pragma once
+
+#include <cstdint>
+#include <exception>
+#include <vector>
+
+static constexpr uint32_t INVALID_RESIDENCY_ID = ~0u;
+
+// What the backend has to do before submitting the work that used the heaps since the last plan.
+struct Residency_Plan
+{
+    // Evict these first, so the heaps made resident fit.
+    std::vector<uint32_t> evict;
+    // Used by the upcoming work while evicted.
+    std::vector<uint32_t> make_resident;
+};
+
+// API-agnostic residency bookkeeping for one memory segment. Heaps are ordered by their last use; when
+// the resident bytes exceed the budget, the least recently used heaps whose work completed are evicted.
+// Heaps the GPU may still access are never evicted, so the budget can be overshot if everything
+// resident is busy. Evicted heaps become resident again in the plan of the work that uses them next.
+// Fence values passed to use() have to be non-decreasing. Driven by a single thread.
+class Residency_Policy
+{
+public:
+    explicit Residency_Policy(uint64_t budget = ~0ull)
+        : m_budget(budget)
+    {}
+
+    // New heaps are resident and count as the most recently used.
+    uint32_t add(uint64_t size)
+    {
+        uint32_t id;
+        if (!m_free_ids.empty())
+        {
+            id = m_free_ids.back();
+            m_free_ids.pop_back();
+        }
+        else
+        {
+            id = uint32_t(m_heaps.size());
+            m_heaps.emplace_back();
+        }
+        m_heaps[id] = { .size = size, .is_alive = true, .is_resident = true };
+        link_back(id);
+        m_resident_bytes += size;
+        return id;
+    }
+
+    // The GPU has to be done with the heap.
+    void remove(uint32_t id)
+    {
+        auto& heap = get(id);
+        if (heap.is_resident)
+        {
+            m_resident_bytes -= heap.size;
+        }
+        if (heap.is_resident || heap.is_queued)
+        {
+            unlink(id);
+        }
+        heap = {};
+        m_free_ids.push_back(id);
+    }
+
+    // The heap is accessed by work that completes with `fence_value`.
+    void use(uint32_t id, uint64_t fence_value)
+    {
+        auto& heap = get(id);
+        heap.last_use = fence_value;
+        if (heap.is_resident || heap.is_queued)
+        {
+            if (m_tail != id)
+            {
+                unlink(id);
+                link_back(id);
+            }
+            return;
+        }
+        heap.is_queued = true;
+        m_queued.push_back(id);
+        link_back(id);
+    }
+
+    // Applies from the next plan on, e.g. after a budget change notification.
+    void set_budget(uint64_t budget) { m_budget = budget; }
+
+    // Makes the heaps used since the last call resident, then evicts idle heaps in LRU order while the
+    // resident bytes exceed the budget.
+    const Residency_Plan& plan(uint64_t completed_fence_value)
+    {
+        m_plan.evict.clear();
+        m_plan.make_resident.clear();
+        for (auto id : m_queued)
+        {
+            auto& heap = m_heaps[id];
+            heap.is_queued = false;
+            if (heap.is_alive && !heap.is_resident)
+            {
+                heap.is_resident = true;
+                m_resident_bytes += heap.size;
+                m_plan.make_resident.push_back(id);
+            }
+        }
+        m_queued.clear();
+        // Busy heaps are skipped rather than ending the search, new heaps are idle behind busy ones.
+        for (auto id = m_head; id != INVALID_RESIDENCY_ID && m_resident_bytes > m_budget;)
+        {
+            auto& heap = m_heaps[id];
+            auto next = heap.next;
+            if (heap.last_use <= completed_fence_value)
+            {
+                unlink(id);
+                heap.is_resident = false;
+                m_resident_bytes -= heap.size;
+                m_evicted_bytes += heap.size;
+                m_plan.evict.push_back(id);
+            }
+            id = next;
+        }
+        for (auto id : m_plan.make_resident)
+        {
+            m_made_resident_bytes += m_heaps[id].size;
+        }
+        return m_plan;
+    }
+
+    bool is_resident(uint32_t id) const { return get(id).is_resident; }
+    uint64_t get_size(uint32_t id) const { return get(id).size; }
+    uint64_t get_budget() const { return m_budget; }
+    uint64_t get_resident_bytes() const { return m_resident_bytes; }
+    uint64_t get_over_budget_bytes() const { return m_resident_bytes > m_budget ? m_resident_bytes - m_budget : 0; }
+    // Totals over all plans, to spot thrashing.
+    uint64_t get_evicted_bytes() const { return m_evicted_bytes; }
+    uint64_t get_made_resident_bytes() const { return m_made_resident_bytes; }
+
+private:
+    struct Heap
+    {
+        uint64_t size = 0;
+        uint64_t last_use = 0;
+        uint32_t prev = INVALID_RESIDENCY_ID;
+        uint32_t next = INVALID_RESIDENCY_ID;
+        bool is_alive = false;
+        bool is_resident = false;
+        // Used while evicted, resident with the next plan.
+        bool is_queued = false;
+    };
+
+    Heap& get(uint32_t id)
+    {
+        check(id);
+        return m_heaps[id];
+    }
+
+    const Heap& get(uint32_t id) const
+    {
+        check(id);
+        return m_heaps[id];
+    }
+
+    void check(uint32_t id) const
+    {
+        if (id >= m_heaps.size() || !m_heaps[id].is_alive)
+        {
+            throw std::exception();
+        }
+    }
+
+    void link_back(uint32_t id)
+    {
+        auto& heap = m_heaps[id];
+        heap.prev = m_tail;
+        heap.next = INVALID_RESIDENCY_ID;
+        if (m_tail != INVALID_RESIDENCY_ID)
+        {
+            m_heaps[m_tail].next = id;
+        }
+        else
+        {
+            m_head = id;
+        }
+        m_tail = id;
+    }
+
+    void unlink(uint32_t id)
+    {
+        auto& heap = m_heaps[id];
+        if (heap.prev != INVALID_RESIDENCY_ID)
+        {
+            m_heaps[heap.prev].next = heap.next;
+        }
+        else
+        {
+            m_head = heap.next;
+        }
+        if (heap.next != INVALID_RESIDENCY_ID)
+        {
+            m_heaps[heap.next].prev = heap.prev;
+        }
+        else
+        {
+            m_tail = heap.prev;
+        }
+        heap.prev = INVALID_RESIDENCY_ID;
+        heap.next = INVALID_RESIDENCY_ID;
+    }
+
+    uint64_t m_budget;
+    uint64_t m_resident_bytes = 0;
+    uint64_t m_evicted_bytes = 0;
+    uint64_t m_made_resident_bytes = 0;
+    std::vector<Heap> m_heaps;
+    std::vector<uint32_t> m_free_ids;
+    // Resident and queued heaps, least recently used first.
+    uint32_t m_head = INVALID_RESIDENCY_ID;
+    uint32_t m_tail = INVALID_RESIDENCY_ID;
+    std::vector<uint32_t> m_queued;
+    Residency_Plan m_plan;
+};
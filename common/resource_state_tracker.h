@@ -0,0 +1,468 @@
+#pragma once
+
+#include "barrier_batcher.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+static constexpr D3D12_BARRIER_SUBRESOURCE_RANGE ALL_SUBRESOURCE_RANGE = {
+    .IndexOrFirstMipLevel = ALL_SUBRESOURCES,
+    .NumMipLevels = 0,
+    .FirstArraySlice = 0,
+    .NumArraySlices = 0,
+    .FirstPlane = 0,
+    .NumPlanes = 0
+};
+
+struct Resource_State
+{
+    D3D12_BARRIER_LAYOUT layout = D3D12_BARRIER_LAYOUT_UNDEFINED;
+    D3D12_BARRIER_SYNC sync = D3D12_BARRIER_SYNC_NONE;
+    D3D12_BARRIER_ACCESS access = D3D12_BARRIER_ACCESS_NO_ACCESS;
+
+    bool operator==(const Resource_State&) const = default;
+};
+
+struct Resource_Dimensions
+{
+    uint32_t mip_levels = 1;
+    uint32_t array_size = 1;
+    uint32_t plane_count = 1;
+    bool is_buffer = false;
+
+    uint32_t get_subresource_count() const { return mip_levels * array_size * plane_count; }
+
+    // Same ordering as D3D12CalcSubresource.
+    uint32_t get_subresource_index(uint32_t mip, uint32_t array_slice, uint32_t plane) const
+    {
+        return mip + array_slice * mip_levels + plane * mip_levels * array_size;
+    }
+
+    D3D12_BARRIER_SUBRESOURCE_RANGE get_full_range() const
+    {
+        return {
+            .IndexOrFirstMipLevel = 0,
+            .NumMipLevels = mip_levels,
+            .FirstArraySlice = 0,
+            .NumArraySlices = array_size,
+            .FirstPlane = 0,
+            .NumPlanes = plane_count
+        };
+    }
+
+    // Expands the ALL_SUBRESOURCES and single subresource index forms into a mip/array/plane range.
+    D3D12_BARRIER_SUBRESOURCE_RANGE normalize(const D3D12_BARRIER_SUBRESOURCE_RANGE& range) const
+    {
+        if (range.IndexOrFirstMipLevel == ALL_SUBRESOURCES)
+        {
+            return get_full_range();
+        }
+        if (range.NumMipLevels == 0)
+        {
+            auto index = range.IndexOrFirstMipLevel;
+            return {
+                .IndexOrFirstMipLevel = index % mip_levels,
+                .NumMipLevels = 1,
+                .FirstArraySlice = (index / mip_levels) % array_size,
+                .NumArraySlices = 1,
+                .FirstPlane = index / (mip_levels * array_size),
+                .NumPlanes = 1
+            };
+        }
+        return range;
+    }
+};
+
+// Per-subresource state of every resource as of the end of the last submitted command list.
+class Resource_State_Registry
+{
+public:
+    struct Entry
+    {
+        Resource_Dimensions dimensions;
+        std::vector<Resource_State> states;
+    };
+
+    void register_resource(ID3D12Resource* resource, Resource_Dimensions dimensions, Resource_State initial_state = {})
+    {
+        m_entries[resource] = { dimensions, std::vector<Resource_State>(dimensions.get_subresource_count(), initial_state) };
+    }
+
+    void unregister_resource(ID3D12Resource* resource)
+    {
+        m_entries.erase(resource);
+    }
+
+    Entry* find(ID3D12Resource* resource)
+    {
+        auto it = m_entries.find(resource);
+        return it != m_entries.end() ? &it->second : nullptr;
+    }
+
+private:
+    std::unordered_map<ID3D12Resource*, Entry> m_entries;
+};
+
+// Tracks the state of every subresource touched by one command list and derives the *Before fields of
+// every barrier from it. Subresources touched for the first time have no known state while recording:
+// - seed_from_registry == true reads it from the registry. Only valid if this list is the next one to be
+//   submitted, i.e. single threaded recording.
+// - otherwise the first transition is not recorded at all. resolve() emits it at submit time into a
+//   patch-up command list that has to execute right before this one.
+template<typename Command_List = ID3D12GraphicsCommandList7>
+class Resource_State_Tracker
+{
+public:
+    Resource_State_Tracker(
+        Resource_State_Registry& registry, Barrier_Batcher<Command_List>& barriers, bool seed_from_registry)
+        : m_registry(registry)
+        , m_barriers(barriers)
+        , m_seed_from_registry(seed_from_registry)
+    {}
+
+    void transition(
+        ID3D12Resource* resource,
+        Resource_State after,
+        D3D12_BARRIER_SUBRESOURCE_RANGE range = ALL_SUBRESOURCE_RANGE)
+    {
+        emit(resource, after, range, Barrier_Kind::Full);
+    }
+
+    // Split barriers. The end has to be issued with the same resource, state and range as the begin.
+    void begin_split(
+        ID3D12Resource* resource,
+        Resource_State after,
+        D3D12_BARRIER_SUBRESOURCE_RANGE range = ALL_SUBRESOURCE_RANGE)
+    {
+        emit(resource, after, range, Barrier_Kind::Split_Begin);
+    }
+
+    void end_split(
+        ID3D12Resource* resource,
+        Resource_State after,
+        D3D12_BARRIER_SUBRESOURCE_RANGE range = ALL_SUBRESOURCE_RANGE)
+    {
+        emit(resource, after, range, Barrier_Kind::Split_End);
+    }
+
+    // Call in submission order. Emits the transitions from the registry's state into the state this list
+    // expects on entry into `patch_barriers` and commits this list's final states to the registry.
+    void resolve(Barrier_Batcher<Command_List>& patch_barriers)
+    {
+        for (auto& [resource, tracked] : m_resources)
+        {
+            auto entry = m_registry.find(resource);
+            if (!entry)
+            {
+                continue;
+            }
+            // Subresource indices are in the plane, slice, mip order append_barriers expects.
+            m_transitions.resize(tracked.subresources.size());
+            for (size_t i = 0; i < tracked.subresources.size(); ++i)
+            {
+                const auto& subresource = tracked.subresources[i];
+                m_transitions[i] = {
+                    .before = entry->states[i],
+                    .after = subresource.entry_state,
+                    .has_barrier = subresource.needs_patch && !(entry->states[i] == subresource.entry_state)
+                };
+            }
+            append_barriers(patch_barriers, resource, tracked.dimensions, tracked.dimensions.get_full_range(), Barrier_Kind::Full);
+        }
+        commit();
+    }
+
+    // Commits the final states without emitting patch-up barriers, for lists recorded with seed_from_registry.
+    void commit()
+    {
+        for (auto& [resource, tracked] : m_resources)
+        {
+            auto entry = m_registry.find(resource);
+            if (!entry)
+            {
+                continue;
+            }
+            for (uint32_t i = 0; i < uint32_t(tracked.subresources.size()); ++i)
+            {
+                if (tracked.subresources[i].is_known)
+                {
+                    entry->states[i] = tracked.subresources[i].state;
+                }
+            }
+        }
+        m_resources.clear();
+    }
+
+private:
+    enum class Barrier_Kind
+    {
+        Full,
+        Split_Begin,
+        Split_End
+    };
+
+    struct Tracked_Subresource
+    {
+        Resource_State state;
+        Resource_State entry_state;
+        Resource_State split_before;
+        bool is_known = false;
+        bool needs_patch = false;
+        bool split_pending = false;
+    };
+
+    struct Tracked_Resource
+    {
+        Resource_Dimensions dimensions;
+        std::vector<Tracked_Subresource> subresources;
+    };
+
+    struct Subresource_Transition
+    {
+        Resource_State before;
+        Resource_State after;
+        bool has_barrier = false;
+    };
+
+    // Subresources sharing one barrier: a mip range in a slice range in a plane range.
+    struct Barrier_Box
+    {
+        uint32_t first_mip;
+        uint32_t mip_count;
+        uint32_t first_slice;
+        uint32_t slice_count;
+        uint32_t first_plane;
+        uint32_t plane_count;
+        Resource_State before;
+        Resource_State after;
+    };
+
+    Tracked_Resource* get_tracked(ID3D12Resource* resource)
+    {
+        auto it = m_resources.find(resource);
+        if (it != m_resources.end())
+        {
+            return &it->second;
+        }
+        auto entry = m_registry.find(resource);
+        if (!entry)
+        {
+            return nullptr;
+        }
+        auto& tracked = m_resources[resource];
+        tracked.dimensions = entry->dimensions;
+        tracked.subresources.resize(entry->states.size());
+        if (m_seed_from_registry)
+        {
+            for (size_t i = 0; i < entry->states.size(); ++i)
+            {
+                tracked.subresources[i].state = entry->states[i];
+                tracked.subresources[i].is_known = true;
+            }
+        }
+        return &tracked;
+    }
+
+    void emit(ID3D12Resource* resource, Resource_State after, D3D12_BARRIER_SUBRESOURCE_RANGE range, Barrier_Kind kind)
+    {
+        auto tracked = get_tracked(resource);
+        if (!tracked)
+        {
+            return;
+        }
+        const auto& dimensions = tracked->dimensions;
+        range = dimensions.is_buffer ? dimensions.get_full_range() : dimensions.normalize(range);
+        m_transitions.clear();
+        for (auto plane = range.FirstPlane; plane < range.FirstPlane + range.NumPlanes; ++plane)
+        {
+            for (auto slice = range.FirstArraySlice; slice < range.FirstArraySlice + range.NumArraySlices; ++slice)
+            {
+                for (auto mip = range.IndexOrFirstMipLevel; mip < range.IndexOrFirstMipLevel + range.NumMipLevels; ++mip)
+                {
+                    auto& subresource = tracked->subresources[dimensions.get_subresource_index(mip, slice, plane)];
+                    auto& transition = m_transitions.emplace_back();
+                    transition.after = after;
+                    if (kind == Barrier_Kind::Split_End)
+                    {
+                        transition.has_barrier = subresource.split_pending;
+                        transition.before = subresource.split_before;
+                        subresource.split_pending = false;
+                    }
+                    else if (!subresource.is_known)
+                    {
+                        // The list starts out in the state of the first transition, resolve() patches it up.
+                        subresource.entry_state = after;
+                        subresource.needs_patch = true;
+                        subresource.is_known = true;
+                    }
+                    else
+                    {
+                        transition.has_barrier = true;
+                        transition.before = subresource.state;
+                        subresource.split_pending = kind == Barrier_Kind::Split_Begin;
+                        subresource.split_before = subresource.state;
+                    }
+                    subresource.state = after;
+                }
+            }
+        }
+        append_barriers(m_barriers, resource, dimensions, range, kind);
+    }
+
+    // Covers the subresources of m_transitions, laid out plane by plane, slice by slice and mip by mip over
+    // `range`, with as few barriers as possible: runs of mips with the same transition, extended over
+    // consecutive slices and then planes with identical runs. A uniform transition of a whole resource
+    // becomes a single barrier on all subresources.
+    void append_barriers(
+        Barrier_Batcher<Command_List>& barriers,
+        ID3D12Resource* resource,
+        const Resource_Dimensions& dimensions,
+        const D3D12_BARRIER_SUBRESOURCE_RANGE& range,
+        Barrier_Kind kind)
+    {
+        auto is_same_box = [](const Barrier_Box& a, const Barrier_Box& b, bool compare_slices) {
+            return a.first_mip == b.first_mip && a.mip_count == b.mip_count
+                && (!compare_slices || (a.first_slice == b.first_slice && a.slice_count == b.slice_count))
+                && a.before == b.before && a.after == b.after;
+        };
+        // Extends the boxes of the previous group by one slice or plane if the new group has the same ones.
+        auto merge_group = [&](size_t& previous_begin, size_t group_begin, bool is_plane) {
+            auto count = m_boxes.size() - group_begin;
+            bool is_same = group_begin - previous_begin == count;
+            for (size_t i = 0; is_same && i < count; ++i)
+            {
+                is_same = is_same_box(m_boxes[previous_begin + i], m_boxes[group_begin + i], is_plane);
+            }
+            if (!is_same)
+            {
+                previous_begin = group_begin;
+                return;
+            }
+            for (size_t i = 0; i < count; ++i)
+            {
+                auto& box = m_boxes[previous_begin + i];
+                (is_plane ? box.plane_count : box.slice_count) += 1;
+            }
+            m_boxes.resize(group_begin);
+        };
+
+        m_boxes.clear();
+        size_t transition = 0;
+        size_t previous_plane_begin = SIZE_MAX;
+        for (uint32_t plane = 0; plane < range.NumPlanes; ++plane)
+        {
+            auto plane_begin = m_boxes.size();
+            size_t previous_slice_begin = SIZE_MAX;
+            for (uint32_t slice = 0; slice < range.NumArraySlices; ++slice)
+            {
+                auto slice_begin = m_boxes.size();
+                for (uint32_t mip = 0; mip < range.NumMipLevels; ++mip)
+                {
+                    const auto& current = m_transitions[transition++];
+                    if (!current.has_barrier)
+                    {
+                        continue;
+                    }
+                    auto first_mip = range.IndexOrFirstMipLevel + mip;
+                    if (m_boxes.size() > slice_begin)
+                    {
+                        auto& last = m_boxes.back();
+                        if (last.first_mip + last.mip_count == first_mip && last.before == current.before && last.after == current.after)
+                        {
+                            last.mip_count += 1;
+                            continue;
+                        }
+                    }
+                    m_boxes.push_back({
+                        .first_mip = first_mip,
+                        .mip_count = 1,
+                        .first_slice = range.FirstArraySlice + slice,
+                        .slice_count = 1,
+                        .first_plane = range.FirstPlane + plane,
+                        .plane_count = 1,
+                        .before = current.before,
+                        .after = current.after
+                    });
+                }
+                if (previous_slice_begin == SIZE_MAX)
+                {
+                    previous_slice_begin = slice_begin;
+                }
+                else
+                {
+                    merge_group(previous_slice_begin, slice_begin, false);
+                }
+            }
+            if (previous_plane_begin == SIZE_MAX)
+            {
+                previous_plane_begin = plane_begin;
+            }
+            else
+            {
+                merge_group(previous_plane_begin, plane_begin, true);
+            }
+        }
+
+        auto full_range = dimensions.get_full_range();
+        for (const auto& box : m_boxes)
+        {
+            D3D12_BARRIER_SUBRESOURCE_RANGE box_range = {
+                .IndexOrFirstMipLevel = box.first_mip,
+                .NumMipLevels = box.mip_count,
+                .FirstArraySlice = box.first_slice,
+                .NumArraySlices = box.slice_count,
+                .FirstPlane = box.first_plane,
+                .NumPlanes = box.plane_count
+            };
+            append_barrier(barriers, resource, dimensions,
+                is_same_subresource_range(box_range, full_range) ? ALL_SUBRESOURCE_RANGE : box_range,
+                box.before, box.after, kind);
+        }
+    }
+
+    static void append_barrier(
+        Barrier_Batcher<Command_List>& barriers,
+        ID3D12Resource* resource,
+        const Resource_Dimensions& dimensions,
+        const D3D12_BARRIER_SUBRESOURCE_RANGE& range,
+        Resource_State before,
+        Resource_State after,
+        Barrier_Kind kind)
+    {
+        auto sync_before = kind == Barrier_Kind::Split_End ? D3D12_BARRIER_SYNC_SPLIT : before.sync;
+        auto sync_after = kind == Barrier_Kind::Split_Begin ? D3D12_BARRIER_SYNC_SPLIT : after.sync;
+        if (dimensions.is_buffer)
+        {
+            barriers.buffer({
+                .SyncBefore = sync_before,
+                .SyncAfter = sync_after,
+                .AccessBefore = before.access,
+                .AccessAfter = after.access,
+                .pResource = resource,
+                .Offset = 0,
+                .Size = UINT64_MAX
+            });
+            return;
+        }
+        barriers.texture({
+            .SyncBefore = sync_before,
+            .SyncAfter = sync_after,
+            .AccessBefore = before.access,
+            .AccessAfter = after.access,
+            .LayoutBefore = before.layout,
+            .LayoutAfter = after.layout,
+            .pResource = resource,
+            .Subresources = range,
+            .Flags = D3D12_TEXTURE_BARRIER_FLAG_NONE
+        });
+    }
+
+    Resource_State_Registry& m_registry;
+    Barrier_Batcher<Command_List>& m_barriers;
+    bool m_seed_from_registry;
+    std::unordered_map<ID3D12Resource*, Tracked_Resource> m_resources;
+    // Scratch space of emit(), resolve() and append_barriers().
+    std::vector<Subresource_Transition> m_transitions;
+    std::vector<Barrier_Box> m_boxes;
+};
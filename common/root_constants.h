@@ -0,0 +1,120 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <span>
+#include <type_traits>
+
+// A root signature holds at most 64 DWORDs, so that also bounds a single constants parameter.
+inline constexpr uint32_t MAX_ROOT_CONSTANTS = 64;
+
+// Structs passed as root constants mirror a HLSL struct of 32 bit members. Checking the member offsets
+// is up to the mirror, see the static_asserts next to Push_Constants in repro_01.
+template<typename T>
+concept Root_Constants = std::is_trivially_copyable_v<T>
+    && std::is_standard_layout_v<T>
+    && sizeof(T) % sizeof(uint32_t) == 0
+    && alignof(T) <= alignof(uint32_t)
+    && sizeof(T) <= MAX_ROOT_CONSTANTS * sizeof(uint32_t);
+
+template<Root_Constants T>
+inline constexpr uint32_t ROOT_CONSTANT_COUNT = uint32_t(sizeof(T) / sizeof(uint32_t));
+
+struct Root_Constant_Range
+{
+    uint32_t first;
+    uint32_t count;
+};
+
+// Shadows the values of one root constants parameter on a command list, so only the DWORDs that changed
+// since the last set are emitted. Invalidate it whenever the root signature is (re)set, as that leaves
+// all root arguments undefined.
+class Root_Constant_Cache
+{
+public:
+    // Stores `values` at `offset` and returns the smallest range that covers every DWORD that differs from
+    // the cached one or was never set. An empty range means there is nothing to emit.
+    Root_Constant_Range update_values(std::span<const uint32_t> values, uint32_t offset = 0)
+    {
+        if (offset > MAX_ROOT_CONSTANTS || values.size() > MAX_ROOT_CONSTANTS - offset)
+        {
+            throw std::exception();
+        }
+        uint64_t changed_mask = 0;
+        for (uint32_t i = 0; i < values.size(); ++i)
+        {
+            auto index = offset + i;
+            auto bit = uint64_t(1) << index;
+            if ((m_valid_mask & bit) == 0 || m_values[index] != values[i])
+            {
+                changed_mask |= bit;
+                m_values[index] = values[i];
+            }
+        }
+        m_valid_mask |= changed_mask;
+        if (changed_mask == 0)
+        {
+            return { 0, 0 };
+        }
+        auto first = uint32_t(std::countr_zero(changed_mask));
+        auto last = uint32_t(63 - std::countl_zero(changed_mask));
+        return { first, last - first + 1 };
+    }
+
+    template<Root_Constants T>
+    Root_Constant_Range update(const T& constants)
+    {
+        std::array<uint32_t, ROOT_CONSTANT_COUNT<T>> values;
+        memcpy(values.data(), &constants, sizeof(T));
+        return update_values(values);
+    }
+
+    void invalidate() { m_valid_mask = 0; }
+
+    // Values of `range` as last stored, the source for the 32 bit constants call.
+    const uint32_t* get_values(Root_Constant_Range range) const { return m_values.data() + range.first; }
+
+private:
+    std::array<uint32_t, MAX_ROOT_CONSTANTS> m_values = {};
+    uint64_t m_valid_mask = 0;
+};
+
+enum class Root_Constants_Bind_Point
+{
+    Compute,
+    Graphics
+};
+
+// Emits the values `cache` holds for `range`, as returned by Root_Constant_Cache::update(). `Command_List`
+// is an ID3D12GraphicsCommandList or anything with its 32 bit constants calls, e.g. a recording mock.
+template<typename Command_List>
+void set_root_constant_range(
+    Command_List* cmd, const Root_Constant_Cache& cache, uint32_t root_parameter_index, Root_Constant_Range range,
+    Root_Constants_Bind_Point bind_point = Root_Constants_Bind_Point::Compute)
+{
+    if (range.count == 0)
+    {
+        return;
+    }
+    if (bind_point == Root_Constants_Bind_Point::Compute)
+    {
+        cmd->SetComputeRoot32BitConstants(root_parameter_index, range.count, cache.get_values(range), range.first);
+    }
+    else
+    {
+        cmd->SetGraphicsRoot32BitConstants(root_parameter_index, range.count, cache.get_values(range), range.first);
+    }
+}
+
+// Sets `constants` on a 32 bit constants root parameter, emitting only the DWORD range that changed since
+// the last call with the same `cache`.
+template<Root_Constants T, typename Command_List>
+void set_root_constants(
+    Command_List* cmd, Root_Constant_Cache& cache, uint32_t root_parameter_index, const T& constants,
+    Root_Constants_Bind_Point bind_point = Root_Constants_Bind_Point::Compute)
+{
+    set_root_constant_range(cmd, cache, root_parameter_index, cache.update(constants), bind_point);
+}
@@ -0,0 +1,348 @@
+#pragma once
+
+#include "hash.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Non-owning view of shader bytecode. Member layout matches D3D12_SHADER_BYTECODE.
+struct Shader_Blob
+{
+    const void* data = nullptr;
+    size_t size = 0;
+
+    bool empty() const { return size == 0; }
+};
+
+// Read-only memory mapping of a whole file. Blobs handed out from it stay valid as long as the mapping lives.
+class Mapped_File
+{
+public:
+    Mapped_File() = default;
+    explicit Mapped_File(const char* path) { open(path); }
+    ~Mapped_File() { close(); }
+
+    Mapped_File(const Mapped_File&) = delete;
+    Mapped_File& operator=(const Mapped_File&) = delete;
+
+    Mapped_File(Mapped_File&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    Mapped_File& operator=(Mapped_File&& other) noexcept
+    {
+        if (this != &other)
+        {
+            close();
+            m_data = std::exchange(other.m_data, nullptr);
+            m_size = std::exchange(other.m_size, 0);
+#if defined(_WIN32)
+            m_file = std::exchange(other.m_file, INVALID_HANDLE_VALUE);
+            m_mapping = std::exchange(other.m_mapping, nullptr);
+#endif
+        }
+        return *this;
+    }
+
+    bool open(const char* path)
+    {
+        close();
+#if defined(_WIN32)
+        m_file = CreateFileA(
+            path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (m_file == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+        LARGE_INTEGER file_size = {};
+        if (!GetFileSizeEx(m_file, &file_size) || file_size.QuadPart == 0)
+        {
+            close();
+            return false;
+        }
+        m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (m_mapping == nullptr)
+        {
+            close();
+            return false;
+        }
+        m_data = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+        if (m_data == nullptr)
+        {
+            close();
+            return false;
+        }
+        m_size = size_t(file_size.QuadPart);
+#else
+        int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            return false;
+        }
+        struct stat file_stat = {};
+        if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        auto mapping = mmap(nullptr, size_t(file_stat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED)
+        {
+            return false;
+        }
+        m_data = mapping;
+        m_size = size_t(file_stat.st_size);
+#endif
+        return true;
+    }
+
+    void close()
+    {
+#if defined(_WIN32)
+        if (m_data)
+        {
+            UnmapViewOfFile(m_data);
+        }
+        if (m_mapping)
+        {
+            CloseHandle(m_mapping);
+        }
+        if (m_file != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(m_file);
+        }
+        m_file = INVALID_HANDLE_VALUE;
+        m_mapping = nullptr;
+#else
+        if (m_data)
+        {
+            munmap(const_cast<void*>(m_data), m_size);
+        }
+#endif
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    bool is_open() const { return m_data != nullptr; }
+    const void* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    Shader_Blob get_blob() const { return { m_data, m_size }; }
+
+private:
+    const void* m_data = nullptr;
+    size_t m_size = 0;
+#if defined(_WIN32)
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+#endif
+};
+
+// Packed shader archive: one file with a header, an index sorted by name hash,
+// a string table with the names and the blobs, each aligned to SHADER_ARCHIVE_BLOB_ALIGNMENT.
+static constexpr uint32_t SHADER_ARCHIVE_MAGIC = 0x52414853; // 'SHAR'
+static constexpr uint32_t SHADER_ARCHIVE_VERSION = 1;
+static constexpr uint64_t SHADER_ARCHIVE_BLOB_ALIGNMENT = 64;
+
+struct Shader_Archive_Header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entry_count;
+    uint32_t string_table_size;
+};
+
+struct Shader_Archive_Entry
+{
+    uint64_t name_hash;
+    uint64_t offset;
+    uint64_t size;
+    uint32_t name_offset;
+    uint32_t name_length;
+};
+
+static_assert(sizeof(Shader_Archive_Header) == 16);
+static_assert(sizeof(Shader_Archive_Entry) == 32);
+
+class Shader_Archive
+{
+public:
+    bool open(const char* path)
+    {
+        m_entries = nullptr;
+        m_entry_count = 0;
+        if (!m_file.open(path) || m_file.size() < sizeof(Shader_Archive_Header))
+        {
+            return false;
+        }
+        auto bytes = static_cast<const uint8_t*>(m_file.data());
+        Shader_Archive_Header header;
+        memcpy(&header, bytes, sizeof(header));
+        uint64_t index_end = sizeof(Shader_Archive_Header)
+            + uint64_t(header.entry_count) * sizeof(Shader_Archive_Entry)
+            + header.string_table_size;
+        if (header.magic != SHADER_ARCHIVE_MAGIC
+            || header.version != SHADER_ARCHIVE_VERSION
+            || index_end > m_file.size())
+        {
+            m_file.close();
+            return false;
+        }
+        m_entries = reinterpret_cast<const Shader_Archive_Entry*>(bytes + sizeof(Shader_Archive_Header));
+        m_entry_count = header.entry_count;
+        m_strings = reinterpret_cast<const char*>(m_entries + m_entry_count);
+        // find() does a binary search, so an unsorted index is as corrupt as an out of bounds entry.
+        // Sizes are compared before offsets, sums of corrupt values could wrap around.
+        for (uint32_t i = 0; i < m_entry_count; ++i)
+        {
+            const auto& entry = m_entries[i];
+            if (entry.size > m_file.size()
+                || entry.offset > m_file.size() - entry.size
+                || uint64_t(entry.name_offset) + entry.name_length > header.string_table_size
+                || (i > 0 && m_entries[i - 1].name_hash > entry.name_hash))
+            {
+                m_entries = nullptr;
+                m_entry_count = 0;
+                m_file.close();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    Shader_Blob find(std::string_view name) const
+    {
+        auto hash = fnv1a_64(name);
+        uint32_t first = 0;
+        uint32_t count = m_entry_count;
+        while (count > 0)
+        {
+            auto step = count / 2;
+            if (m_entries[first + step].name_hash < hash)
+            {
+                first += step + 1;
+                count -= step + 1;
+            }
+            else
+            {
+                count = step;
+            }
+        }
+        for (auto i = first; i < m_entry_count && m_entries[i].name_hash == hash; ++i)
+        {
+            if (get_name(i) == name)
+            {
+                return get_blob(i);
+            }
+        }
+        return {};
+    }
+
+    uint32_t get_entry_count() const { return m_entry_count; }
+
+    std::string_view get_name(uint32_t index) const
+    {
+        return { m_strings + m_entries[index].name_offset, m_entries[index].name_length };
+    }
+
+    Shader_Blob get_blob(uint32_t index) const
+    {
+        return { static_cast<const uint8_t*>(m_file.data()) + m_entries[index].offset, size_t(m_entries[index].size) };
+    }
+
+private:
+    Mapped_File m_file;
+    const Shader_Archive_Entry* m_entries = nullptr;
+    const char* m_strings = nullptr;
+    uint32_t m_entry_count = 0;
+};
+
+struct Shader_Archive_Input
+{
+    std::string name;
+    Shader_Blob blob;
+};
+
+inline bool write_shader_archive(const char* path, const std::vector<Shader_Archive_Input>& inputs)
+{
+    std::vector<std::pair<uint64_t, const Shader_Archive_Input*>> sorted_inputs;
+    sorted_inputs.reserve(inputs.size());
+    for (const auto& input : inputs)
+    {
+        sorted_inputs.push_back({ fnv1a_64(input.name), &input });
+    }
+    std::sort(sorted_inputs.begin(), sorted_inputs.end(), [](const auto& a, const auto& b) {
+        return a.first < b.first;
+    });
+
+    std::string string_table;
+    std::vector<Shader_Archive_Entry> entries;
+    entries.reserve(sorted_inputs.size());
+    for (const auto& [hash, input] : sorted_inputs)
+    {
+        entries.push_back({
+            .name_hash = hash,
+            .offset = 0,
+            .size = input->blob.size,
+            .name_offset = uint32_t(string_table.size()),
+            .name_length = uint32_t(input->name.size())
+        });
+        string_table += input->name;
+    }
+    uint64_t offset = sizeof(Shader_Archive_Header)
+        + entries.size() * sizeof(Shader_Archive_Entry)
+        + string_table.size();
+    for (auto& entry : entries)
+    {
+        offset = (offset + SHADER_ARCHIVE_BLOB_ALIGNMENT - 1) & ~(SHADER_ARCHIVE_BLOB_ALIGNMENT - 1);
+        entry.offset = offset;
+        offset += entry.size;
+    }
+
+    Shader_Archive_Header header = {
+        .magic = SHADER_ARCHIVE_MAGIC,
+        .version = SHADER_ARCHIVE_VERSION,
+        .entry_count = uint32_t(entries.size()),
+        .string_table_size = uint32_t(string_table.size())
+    };
+    std::vector<uint8_t> file_data(offset, 0);
+    memcpy(file_data.data(), &header, sizeof(header));
+    if (!entries.empty())
+    {
+        memcpy(file_data.data() + sizeof(header), entries.data(), entries.size() * sizeof(Shader_Archive_Entry));
+    }
+    memcpy(file_data.data() + sizeof(header) + entries.size() * sizeof(Shader_Archive_Entry),
+        string_table.data(), string_table.size());
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        if (entries[i].size > 0)
+        {
+            memcpy(file_data.data() + entries[i].offset, sorted_inputs[i].second->blob.data, entries[i].size);
+        }
+    }
+
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        return false;
+    }
+    auto written = fwrite(file_data.data(), 1, file_data.size(), file);
+    return fclose(file) == 0 && written == file_data.size();
+}
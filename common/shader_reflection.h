@@ -0,0 +1,259 @@
+#pragma once
+
+#include "compute_dispatch.h"
+#include "shader_blob.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Values of PSVResourceType in the pipeline state validation part of a DXIL container.
+enum class Shader_Resource_Type : uint32_t
+{
+    Invalid,
+    Sampler,
+    CBV,
+    SRV_Typed,
+    SRV_Raw,
+    SRV_Structured,
+    UAV_Typed,
+    UAV_Raw,
+    UAV_Structured,
+    UAV_Structured_With_Counter
+};
+
+// Register range of a bound resource. Heap indexed resources (SM 6.6) don't show up.
+struct Shader_Binding
+{
+    Shader_Resource_Type type;
+    uint32_t space;
+    uint32_t lower_bound;
+    uint32_t upper_bound;
+};
+
+struct Shader_Constant
+{
+    const char* name;
+    const char* type;
+    uint32_t offset;
+};
+
+struct Shader_Constant_Buffer
+{
+    const char* name;
+    uint32_t size;
+    std::span<const Shader_Constant> constants;
+};
+
+// Build time reflection of a compiled shader, see the headers generated by tools/shader_pack.
+struct Shader_Reflection
+{
+    const char* name;
+    const char* entry_point;
+    Thread_Group_Size thread_group_size;
+    std::span<const Shader_Binding> bindings;
+    std::span<const Shader_Constant_Buffer> constant_buffers;
+};
+
+// Lookups for checking C++ mirrors of HLSL structs at compile time, e.g.
+// static_assert(find_shader_constant(SHADER_REFLECTION, "pc", "tex")->offset == offsetof(Push_Constants, tex)).
+constexpr const Shader_Constant_Buffer* find_shader_constant_buffer(
+    const Shader_Reflection& reflection, std::string_view buffer_name)
+{
+    for (const auto& buffer : reflection.constant_buffers)
+    {
+        if (std::string_view(buffer.name) == buffer_name)
+        {
+            return &buffer;
+        }
+    }
+    return nullptr;
+}
+
+constexpr const Shader_Constant* find_shader_constant(
+    const Shader_Reflection& reflection, std::string_view buffer_name, std::string_view constant_name)
+{
+    for (const auto& buffer : reflection.constant_buffers)
+    {
+        if (std::string_view(buffer.name) != buffer_name)
+        {
+            continue;
+        }
+        for (const auto& constant : buffer.constants)
+        {
+            if (std::string_view(constant.name) == constant_name)
+            {
+                return &constant;
+            }
+        }
+    }
+    return nullptr;
+}
+
+// Reads the resource bindings from the PSV0 part of a DXIL container.
+inline bool get_shader_bindings(Shader_Blob shader, std::vector<Shader_Binding>& bindings)
+{
+    static constexpr uint32_t DXBC_MAGIC = 0x43425844; // 'DXBC'
+    static constexpr uint32_t PSV0_FOURCC = 0x30565350; // 'PSV0'
+    static constexpr uint32_t CONTAINER_HEADER_SIZE = 32;
+    bindings.clear();
+    auto bytes = static_cast<const uint8_t*>(shader.data);
+    auto read = [&](size_t offset) {
+        uint32_t value;
+        memcpy(&value, bytes + offset, sizeof(value));
+        return value;
+    };
+    if (shader.size < CONTAINER_HEADER_SIZE || read(0) != DXBC_MAGIC)
+    {
+        return false;
+    }
+    auto part_count = read(28);
+    if ((shader.size - CONTAINER_HEADER_SIZE) / sizeof(uint32_t) < part_count)
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < part_count; ++i)
+    {
+        size_t part_offset = read(CONTAINER_HEADER_SIZE + i * sizeof(uint32_t));
+        if (part_offset > shader.size || shader.size - part_offset < 12 || read(part_offset) != PSV0_FOURCC)
+        {
+            continue;
+        }
+        size_t part_size = read(part_offset + 4);
+        size_t part_end = part_offset + 8 + part_size;
+        size_t offset = part_offset + 12 + size_t(read(part_offset + 8));
+        if (part_size > shader.size - part_offset - 8 || offset + 4 > part_end)
+        {
+            return false;
+        }
+        auto resource_count = read(offset);
+        offset += 4;
+        if (resource_count == 0)
+        {
+            return true;
+        }
+        if (offset + 4 > part_end)
+        {
+            return false;
+        }
+        size_t bind_info_size = read(offset);
+        offset += 4;
+        if (bind_info_size < 4 * sizeof(uint32_t) || (part_end - offset) / bind_info_size < resource_count)
+        {
+            return false;
+        }
+        for (uint32_t r = 0; r < resource_count; ++r, offset += bind_info_size)
+        {
+            bindings.push_back({
+                .type = Shader_Resource_Type(read(offset)),
+                .space = read(offset + 4),
+                .lower_bound = read(offset + 8),
+                .upper_bound = read(offset + 12)
+            });
+        }
+        return true;
+    }
+    return false;
+}
+
+struct Reflected_Constant
+{
+    std::string name;
+    std::string type;
+    uint32_t offset;
+};
+
+struct Reflected_Constant_Buffer
+{
+    std::string name;
+    uint32_t size;
+    std::vector<Reflected_Constant> constants;
+};
+
+// Parses the "Buffer Definitions" comment block of a DXC disassembly listing (-Fc) into the leaf members of
+// every cbuffer. Members of nested structs keep their own name only.
+inline std::vector<Reflected_Constant_Buffer> get_listing_constant_buffers(std::string_view listing)
+{
+    std::vector<Reflected_Constant_Buffer> buffers;
+    bool in_definitions = false;
+    while (!listing.empty())
+    {
+        auto line_end = listing.find('\n');
+        auto line = listing.substr(0, line_end);
+        listing = line_end == std::string_view::npos ? std::string_view() : listing.substr(line_end + 1);
+        if (line.empty() || line[0] != ';')
+        {
+            continue;
+        }
+        auto trim = [](std::string_view text) {
+            auto begin = text.find_first_not_of(" \t\r");
+            auto end = text.find_last_not_of(" \t\r");
+            return begin == std::string_view::npos ? std::string_view() : text.substr(begin, end - begin + 1);
+        };
+        auto content = trim(line.substr(1));
+        if (content == "Buffer Definitions:")
+        {
+            in_definitions = true;
+            continue;
+        }
+        if (!in_definitions)
+        {
+            continue;
+        }
+        if (content == "Resource Bindings:")
+        {
+            break;
+        }
+        if (content.starts_with("cbuffer "))
+        {
+            buffers.push_back({ .name = std::string(trim(content.substr(8))), .size = 0, .constants = {} });
+            continue;
+        }
+        auto comment = content.rfind(';');
+        if (buffers.empty() || comment == std::string_view::npos)
+        {
+            continue;
+        }
+        auto declaration = trim(content.substr(0, comment));
+        if (declaration.ends_with(';'))
+        {
+            declaration.remove_suffix(1);
+        }
+        auto annotation = trim(content.substr(comment + 1));
+        if (!annotation.starts_with("Offset:"))
+        {
+            continue;
+        }
+        auto offset = uint32_t(strtoul(std::string(annotation.substr(7)).c_str(), nullptr, 10));
+        if (declaration.starts_with("}"))
+        {
+            // Closing a struct, the outermost one carries the buffer size.
+            auto size = annotation.find("Size:");
+            if (size != std::string_view::npos)
+            {
+                buffers.back().size = uint32_t(strtoul(std::string(annotation.substr(size + 5)).c_str(), nullptr, 10));
+            }
+            continue;
+        }
+        auto name_begin = declaration.find_last_of(" \t");
+        if (name_begin == std::string_view::npos)
+        {
+            continue;
+        }
+        // Array extents go to the type, "float4 data[2]" becomes data of type float4[2].
+        auto name = declaration.substr(name_begin + 1);
+        auto extents = name.substr(std::min(name.find('['), name.size()));
+        name.remove_suffix(extents.size());
+        buffers.back().constants.push_back({
+            .name = std::string(name),
+            .type = std::string(trim(declaration.substr(0, name_begin))) + std::string(extents),
+            .offset = offset
+        });
+    }
+    return buffers;
+}
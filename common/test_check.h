@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+// Assertions for the portable test executables. A failed check is reported and counted, the test keeps
+// running so one run shows every failure; finish_test() turns the count into the exit code for ctest.
+
+inline uint32_t& get_test_failure_count()
+{
+    static uint32_t count = 0;
+    return count;
+}
+
+#define TEST_CHECK(condition)                                                             \
+    do                                                                                    \
+    {                                                                                     \
+        if (!(condition))                                                                 \
+        {                                                                                 \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            get_test_failure_count() += 1;                                                \
+        }                                                                                 \
+    } while (false)
+
+inline int finish_test()
+{
+    auto failure_count = get_test_failure_count();
+    printf("%s: %u failed checks\n", failure_count == 0 ? "ok" : "FAILED", failure_count);
+    return failure_count == 0 ? 0 : 1;
+}
@@ -0,0 +1,322 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+static constexpr uint32_t INVALID_TLSF_BLOCK = ~0u;
+
+struct Tlsf_Allocation
+{
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    uint32_t block = INVALID_TLSF_BLOCK;
+
+    bool is_valid() const { return block != INVALID_TLSF_BLOCK; }
+};
+
+// Two-level segregated fit allocator over an abstract range of `size` bytes.
+// Only bookkeeping, it never touches the memory it manages. Allocate and free are O(1),
+// freed blocks are merged with their free physical neighbours right away.
+class Tlsf_Allocator
+{
+public:
+    static constexpr uint32_t SL_LOG2 = 4;
+    static constexpr uint32_t SL_COUNT = 1u << SL_LOG2;
+    static constexpr uint32_t FL_COUNT = 64 - SL_LOG2 + 1;
+
+    explicit Tlsf_Allocator(uint64_t size)
+        : m_size(size)
+    {
+        for (auto& sl_heads : m_free_heads)
+        {
+            for (auto& head : sl_heads)
+            {
+                head = INVALID_TLSF_BLOCK;
+            }
+        }
+        if (size > 0)
+        {
+            auto block = create_block(0, size);
+            insert_free(block);
+        }
+    }
+
+    Tlsf_Allocation allocate(uint64_t size, uint64_t alignment = 1)
+    {
+        if (size == 0)
+        {
+            return {};
+        }
+        alignment = alignment > 0 ? alignment : 1;
+        // Most blocks are already aligned, only pay for the worst case padding if that fails.
+        auto block = find_free(size);
+        if (block == INVALID_TLSF_BLOCK || !fits(block, size, alignment))
+        {
+            block = find_free(size + alignment - 1);
+        }
+        if (block == INVALID_TLSF_BLOCK || !fits(block, size, alignment))
+        {
+            return {};
+        }
+        remove_free(block);
+        auto aligned_offset = align(m_blocks[block].offset, alignment);
+        auto padding = aligned_offset - m_blocks[block].offset;
+        if (padding > 0)
+        {
+            // Leading padding stays behind as its own free block.
+            auto padding_block = split(block, padding);
+            std::swap(block, padding_block);
+            insert_free(padding_block);
+        }
+        if (m_blocks[block].size > size)
+        {
+            auto remainder = split(block, size);
+            insert_free(remainder);
+        }
+        m_blocks[block].is_free = false;
+        m_allocated_bytes += m_blocks[block].size;
+        m_allocation_count += 1;
+        return { m_blocks[block].offset, m_blocks[block].size, block };
+    }
+
+    void free(const Tlsf_Allocation& allocation)
+    {
+        auto block = allocation.block;
+        if (block >= m_blocks.size() || m_blocks[block].is_free)
+        {
+            return;
+        }
+        m_allocated_bytes -= m_blocks[block].size;
+        m_allocation_count -= 1;
+        m_blocks[block].is_free = true;
+        auto prev = m_blocks[block].prev_physical;
+        if (prev != INVALID_TLSF_BLOCK && m_blocks[prev].is_free)
+        {
+            remove_free(prev);
+            block = merge(prev, block);
+        }
+        auto next = m_blocks[block].next_physical;
+        if (next != INVALID_TLSF_BLOCK && m_blocks[next].is_free)
+        {
+            remove_free(next);
+            block = merge(block, next);
+        }
+        insert_free(block);
+    }
+
+    uint64_t get_size() const { return m_size; }
+    uint64_t get_allocated_bytes() const { return m_allocated_bytes; }
+    uint64_t get_free_bytes() const { return m_size - m_allocated_bytes; }
+    uint32_t get_allocation_count() const { return m_allocation_count; }
+    bool is_empty() const { return m_allocation_count == 0; }
+
+    uint64_t get_largest_free_block() const
+    {
+        if (m_fl_bitmap == 0)
+        {
+            return 0;
+        }
+        uint32_t fl = 63 - std::countl_zero(m_fl_bitmap);
+        uint64_t largest = 0;
+        for (uint32_t sl = 0; sl < SL_COUNT; ++sl)
+        {
+            for (auto block = m_free_heads[fl][sl]; block != INVALID_TLSF_BLOCK; block = m_blocks[block].next_free)
+            {
+                largest = m_blocks[block].size > largest ? m_blocks[block].size : largest;
+            }
+        }
+        return largest;
+    }
+
+    // Calls `function(Tlsf_Allocation)` for every live allocation in address order, used for defragmentation.
+    template<typename Function>
+    void for_each_allocation(Function&& function) const
+    {
+        for (auto block = m_first_block; block != INVALID_TLSF_BLOCK; block = m_blocks[block].next_physical)
+        {
+            if (!m_blocks[block].is_free)
+            {
+                function(Tlsf_Allocation { m_blocks[block].offset, m_blocks[block].size, block });
+            }
+        }
+    }
+
+private:
+    struct Block
+    {
+        uint64_t offset;
+        uint64_t size;
+        uint32_t prev_physical;
+        uint32_t next_physical;
+        uint32_t prev_free;
+        uint32_t next_free;
+        bool is_free;
+    };
+
+    static uint64_t align(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    static void mapping(uint64_t size, uint32_t& fl, uint32_t& sl)
+    {
+        if (size < SL_COUNT)
+        {
+            fl = 0;
+            sl = uint32_t(size);
+            return;
+        }
+        uint32_t log2 = 63 - std::countl_zero(size);
+        fl = log2 - SL_LOG2 + 1;
+        sl = uint32_t(size >> (log2 - SL_LOG2)) - SL_COUNT;
+    }
+
+    bool fits(uint32_t block, uint64_t size, uint64_t alignment) const
+    {
+        const auto& b = m_blocks[block];
+        return align(b.offset, alignment) + size <= b.offset + b.size;
+    }
+
+    // Good fit: rounds the request up to the next size class so any block found there is large enough.
+    uint32_t find_free(uint64_t size) const
+    {
+        if (size >= SL_COUNT)
+        {
+            uint32_t log2 = 63 - std::countl_zero(size);
+            size += (1ull << (log2 - SL_LOG2)) - 1;
+        }
+        uint32_t fl;
+        uint32_t sl;
+        mapping(size, fl, sl);
+        if (fl >= FL_COUNT)
+        {
+            return INVALID_TLSF_BLOCK;
+        }
+        uint32_t sl_bitmap = m_sl_bitmaps[fl] & (~0u << sl);
+        if (sl_bitmap == 0)
+        {
+            uint64_t fl_bitmap = fl + 1 < 64 ? m_fl_bitmap & (~0ull << (fl + 1)) : 0;
+            if (fl_bitmap == 0)
+            {
+                return INVALID_TLSF_BLOCK;
+            }
+            fl = std::countr_zero(fl_bitmap);
+            sl_bitmap = m_sl_bitmaps[fl];
+        }
+        sl = std::countr_zero(sl_bitmap);
+        return m_free_heads[fl][sl];
+    }
+
+    void insert_free(uint32_t block)
+    {
+        uint32_t fl;
+        uint32_t sl;
+        mapping(m_blocks[block].size, fl, sl);
+        auto& head = m_free_heads[fl][sl];
+        m_blocks[block].is_free = true;
+        m_blocks[block].prev_free = INVALID_TLSF_BLOCK;
+        m_blocks[block].next_free = head;
+        if (head != INVALID_TLSF_BLOCK)
+        {
+            m_blocks[head].prev_free = block;
+        }
+        head = block;
+        m_fl_bitmap |= 1ull << fl;
+        m_sl_bitmaps[fl] |= 1u << sl;
+    }
+
+    void remove_free(uint32_t block)
+    {
+        uint32_t fl;
+        uint32_t sl;
+        mapping(m_blocks[block].size, fl, sl);
+        auto& b = m_blocks[block];
+        if (b.prev_free != INVALID_TLSF_BLOCK)
+        {
+            m_blocks[b.prev_free].next_free = b.next_free;
+        }
+        else
+        {
+            m_free_heads[fl][sl] = b.next_free;
+        }
+        if (b.next_free != INVALID_TLSF_BLOCK)
+        {
+            m_blocks[b.next_free].prev_free = b.prev_free;
+        }
+        if (m_free_heads[fl][sl] == INVALID_TLSF_BLOCK)
+        {
+            m_sl_bitmaps[fl] &= ~(1u << sl);
+            if (m_sl_bitmaps[fl] == 0)
+            {
+                m_fl_bitmap &= ~(1ull << fl);
+            }
+        }
+        b.is_free = false;
+    }
+
+    uint32_t create_block(uint64_t offset, uint64_t size)
+    {
+        Block block = {
+            .offset = offset,
+            .size = size,
+            .prev_physical = INVALID_TLSF_BLOCK,
+            .next_physical = INVALID_TLSF_BLOCK,
+            .prev_free = INVALID_TLSF_BLOCK,
+            .next_free = INVALID_TLSF_BLOCK,
+            .is_free = false
+        };
+        if (!m_unused_blocks.empty())
+        {
+            auto index = m_unused_blocks.back();
+            m_unused_blocks.pop_back();
+            m_blocks[index] = block;
+            return index;
+        }
+        m_blocks.push_back(block);
+        if (m_first_block == INVALID_TLSF_BLOCK)
+        {
+            m_first_block = 0;
+        }
+        return uint32_t(m_blocks.size() - 1);
+    }
+
+    // Splits `block` at `size`, returns the new block covering the rest.
+    uint32_t split(uint32_t block, uint64_t size)
+    {
+        auto remainder = create_block(m_blocks[block].offset + size, m_blocks[block].size - size);
+        m_blocks[block].size = size;
+        m_blocks[remainder].prev_physical = block;
+        m_blocks[remainder].next_physical = m_blocks[block].next_physical;
+        if (m_blocks[remainder].next_physical != INVALID_TLSF_BLOCK)
+        {
+            m_blocks[m_blocks[remainder].next_physical].prev_physical = remainder;
+        }
+        m_blocks[block].next_physical = remainder;
+        return remainder;
+    }
+
+    // Merges `next` into its physical predecessor `block`.
+    uint32_t merge(uint32_t block, uint32_t next)
+    {
+        m_blocks[block].size += m_blocks[next].size;
+        m_blocks[block].next_physical = m_blocks[next].next_physical;
+        if (m_blocks[block].next_physical != INVALID_TLSF_BLOCK)
+        {
+            m_blocks[m_blocks[block].next_physical].prev_physical = block;
+        }
+        m_unused_blocks.push_back(next);
+        return block;
+    }
+
+    uint64_t m_size;
+    uint64_t m_allocated_bytes = 0;
+    uint32_t m_allocation_count = 0;
+    uint32_t m_first_block = INVALID_TLSF_BLOCK;
+    uint64_t m_fl_bitmap = 0;
+    uint32_t m_sl_bitmaps[FL_COUNT] = {};
+    uint32_t m_free_heads[FL_COUNT][SL_COUNT];
+    std::vector<Block> m_blocks;
+    std::vector<uint32_t> m_unused_blocks;
+};
@@ -0,0 +1,209 @@
+#include "compute_dispatch.h"
+#include "test_check.h"
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Group count math and limits, numthreads reflection from DXIL containers built in memory, and the
+// Dispatch_Autotuner's selection, median pick and on-disk cache.
+
+static void test_group_counts()
+{
+    TEST_CHECK(get_dispatch_group_count(0, 8) == 0);
+    TEST_CHECK(get_dispatch_group_count(1, 8) == 1);
+    TEST_CHECK(get_dispatch_group_count(8, 8) == 1);
+    TEST_CHECK(get_dispatch_group_count(9, 8) == 2);
+    TEST_CHECK(get_dispatch_group_count(1920, 64) == 30);
+    TEST_CHECK(get_dispatch_group_count(1080, 16) == 68);
+    // Rounding up must not wrap around for thread counts close to the 32 bit limit.
+    TEST_CHECK(get_dispatch_group_count(UINT32_MAX, 1) == UINT32_MAX);
+    TEST_CHECK(get_dispatch_group_count(UINT32_MAX, 1024) == 4194304);
+    TEST_CHECK(get_dispatch_group_count(UINT32_MAX - 1, 2) == UINT32_MAX / 2);
+
+    // Exhaustive over small sizes: the groups cover every thread and drop none but the last.
+    for (uint32_t group_size = 1; group_size <= 64; ++group_size)
+    {
+        for (uint32_t thread_count = 0; thread_count <= 1024; ++thread_count)
+        {
+            auto group_count = get_dispatch_group_count(thread_count, group_size);
+            TEST_CHECK(uint64_t(group_count) * group_size >= thread_count);
+            TEST_CHECK(group_count == 0 || uint64_t(group_count - 1) * group_size < thread_count);
+        }
+    }
+}
+
+static void test_group_size_limits()
+{
+    TEST_CHECK(is_valid_thread_group_size({ 8, 8, 1 }));
+    TEST_CHECK(is_valid_thread_group_size({ 1024, 1, 1 }));
+    TEST_CHECK(is_valid_thread_group_size({ 1, 1024, 1 }));
+    TEST_CHECK(is_valid_thread_group_size({ 16, 1, 64 }));
+    TEST_CHECK(!is_valid_thread_group_size({ 0, 8, 1 }));
+    TEST_CHECK(!is_valid_thread_group_size({ 8, 8, 0 }));
+    TEST_CHECK(!is_valid_thread_group_size({ 2048, 1, 1 }));
+    TEST_CHECK(!is_valid_thread_group_size({ 1, 1, 65 }));
+    TEST_CHECK(!is_valid_thread_group_size({ 32, 32, 2 }));
+    TEST_CHECK(Thread_Group_Size({ 8, 4, 2 }).get_thread_count() == 64);
+
+    Dispatch_Size dispatch_size;
+    TEST_CHECK(get_dispatch_size(1920, 1080, 1, { 8, 8, 1 }, dispatch_size));
+    TEST_CHECK((dispatch_size == Dispatch_Size { 240, 135, 1 }));
+    TEST_CHECK(get_dispatch_size(100, 1, 33, { 64, 1, 4 }, dispatch_size));
+    TEST_CHECK((dispatch_size == Dispatch_Size { 2, 1, 9 }));
+    TEST_CHECK(get_dispatch_size(0, 0, 0, { 8, 8, 1 }, dispatch_size));
+    TEST_CHECK((dispatch_size == Dispatch_Size { 0, 0, 0 }));
+    TEST_CHECK(!get_dispatch_size(1920, 1080, 1, { 64, 64, 1 }, dispatch_size));
+
+    // The last count that fits the 65535 group limit, and one thread more.
+    TEST_CHECK(get_dispatch_size(65535 * 64, 1, 1, { 64, 1, 1 }, dispatch_size) && dispatch_size.x == 65535);
+    TEST_CHECK(!get_dispatch_size(65535 * 64 + 1, 1, 1, { 64, 1, 1 }, dispatch_size));
+    TEST_CHECK(!get_dispatch_size(1, 65536, 1, { 1, 1, 1 }, dispatch_size));
+    TEST_CHECK(!get_dispatch_size(1, 1, UINT32_MAX, { 1, 1, 64 }, dispatch_size));
+}
+
+static void write_u32(std::vector<uint8_t>& bytes, size_t offset, uint32_t value)
+{
+    memcpy(bytes.data() + offset, &value, sizeof(value));
+}
+
+// A DXBC container holding an unrelated part followed by a PSV0 part with `info_size` bytes of runtime info.
+static std::vector<uint8_t> make_container(Thread_Group_Size group_size, uint8_t stage = 5, uint32_t info_size = 52)
+{
+    static constexpr uint32_t HEADER_SIZE = 32;
+    static constexpr uint32_t PART_COUNT = 2;
+    static constexpr uint32_t OTHER_PART_SIZE = 8;
+    auto other_offset = HEADER_SIZE + PART_COUNT * 4;
+    auto psv_offset = other_offset + 8 + OTHER_PART_SIZE;
+    std::vector<uint8_t> bytes(psv_offset + 8 + 4 + info_size, 0);
+    write_u32(bytes, 0, 0x43425844);
+    write_u32(bytes, 24, uint32_t(bytes.size()));
+    write_u32(bytes, 28, PART_COUNT);
+    write_u32(bytes, HEADER_SIZE, other_offset);
+    write_u32(bytes, HEADER_SIZE + 4, psv_offset);
+    write_u32(bytes, other_offset, 0x30495346); // 'SFI0'
+    write_u32(bytes, other_offset + 4, OTHER_PART_SIZE);
+    write_u32(bytes, psv_offset, 0x30565350);
+    write_u32(bytes, psv_offset + 4, 4 + info_size);
+    write_u32(bytes, psv_offset + 8, info_size);
+    auto info = psv_offset + 12;
+    if (info_size > 24)
+    {
+        bytes[info + 24] = stage;
+    }
+    if (info_size >= 48)
+    {
+        write_u32(bytes, info + 36, group_size.x);
+        write_u32(bytes, info + 40, group_size.y);
+        write_u32(bytes, info + 44, group_size.z);
+    }
+    return bytes;
+}
+
+static void test_reflection()
+{
+    Thread_Group_Size group_size;
+    auto bytes = make_container({ 16, 8, 2 });
+    TEST_CHECK(get_shader_thread_group_size({ bytes.data(), bytes.size() }, group_size));
+    TEST_CHECK((group_size == Thread_Group_Size { 16, 8, 2 }));
+
+    // Other stages, numthreads beyond the limits and runtime info from before PSVRuntimeInfo2.
+    bytes = make_container({ 8, 8, 1 }, 1);
+    TEST_CHECK(!get_shader_thread_group_size({ bytes.data(), bytes.size() }, group_size));
+    bytes = make_container({ 64, 64, 1 });
+    TEST_CHECK(!get_shader_thread_group_size({ bytes.data(), bytes.size() }, group_size));
+    bytes = make_container({ 8, 8, 1 }, 5, 40);
+    TEST_CHECK(!get_shader_thread_group_size({ bytes.data(), bytes.size() }, group_size));
+
+    // Every truncation is rejected without reading past the end.
+    bytes = make_container({ 8, 8, 1 });
+    for (size_t size = 0; size < bytes.size(); ++size)
+    {
+        std::vector<uint8_t> truncated(bytes.begin(), bytes.begin() + size);
+        TEST_CHECK(!get_shader_thread_group_size({ truncated.data(), truncated.size() }, group_size));
+    }
+    // Bad magic, part offsets past the end, a part count larger than the header could hold, a part size
+    // past the end and runtime info larger than its part.
+    auto broken = bytes;
+    broken[0] = 'X';
+    TEST_CHECK(!get_shader_thread_group_size({ broken.data(), broken.size() }, group_size));
+    broken = bytes;
+    write_u32(broken, 36, uint32_t(broken.size()) + 100);
+    TEST_CHECK(!get_shader_thread_group_size({ broken.data(), broken.size() }, group_size));
+    broken = bytes;
+    write_u32(broken, 28, UINT32_MAX);
+    TEST_CHECK(!get_shader_thread_group_size({ broken.data(), broken.size() }, group_size));
+    auto psv_offset = bytes.size() - 8 - 4 - 52;
+    broken = bytes;
+    write_u32(broken, psv_offset + 4, 4 + 52 + 1);
+    TEST_CHECK(!get_shader_thread_group_size({ broken.data(), broken.size() }, group_size));
+    broken = bytes;
+    write_u32(broken, psv_offset + 8, 53);
+    TEST_CHECK(!get_shader_thread_group_size({ broken.data(), broken.size() }, group_size));
+    TEST_CHECK(!get_shader_thread_group_size({}, group_size));
+}
+
+static void test_autotuner()
+{
+    static constexpr uint32_t SAMPLES = 4;
+    const Thread_Group_Size variants[] = { { 8, 8, 1 }, { 16, 16, 1 }, { 32, 8, 1 } };
+    const double times[] = { 30.0, 10.0, 20.0 };
+    auto key = make_dispatch_kernel_key("cs_main");
+    TEST_CHECK(key == make_dispatch_kernel_key("cs_main") && key != make_dispatch_kernel_key("cs_other"));
+
+    Dispatch_Autotuner tuner(0x1234, SAMPLES);
+    // Single variants need no tuning.
+    TEST_CHECK(tuner.select(key, std::span(variants, 1)) == 0);
+    // Round robin until every variant has its samples. One outlier of the fastest variant does not move the median.
+    uint32_t uses[3] = {};
+    for (uint32_t i = 0; i < 3 * SAMPLES; ++i)
+    {
+        TEST_CHECK(!tuner.is_tuned(key));
+        auto variant = tuner.select(key, variants);
+        TEST_CHECK(variant == i % 3);
+        uses[variant] += 1;
+        tuner.report(key, variant, variant == 1 && uses[variant] == 1 ? 1000.0 : times[variant]);
+    }
+    TEST_CHECK(tuner.is_tuned(key) && tuner.is_dirty());
+    Thread_Group_Size best;
+    TEST_CHECK(tuner.find(key, best) && (best == Thread_Group_Size { 16, 16, 1 }));
+    TEST_CHECK(tuner.select(key, variants) == 1);
+    // Reports for unknown kernels or variants are ignored.
+    tuner.report(key, 7, 1.0);
+    tuner.report(key + 1, 0, 1.0);
+    TEST_CHECK(!tuner.is_tuned(key + 1));
+
+    auto directory = std::filesystem::temp_directory_path() / "compute_dispatch_test";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+    auto path = (directory / "dispatch_tuning.bin").string();
+    TEST_CHECK(tuner.save(path.c_str()) && !tuner.is_dirty());
+
+    Dispatch_Autotuner loaded(0x1234, SAMPLES);
+    TEST_CHECK(loaded.load(path.c_str()));
+    TEST_CHECK(loaded.find(key, best) && (best == Thread_Group_Size { 16, 16, 1 }));
+    // Results of another adapter or driver are not used.
+    Dispatch_Autotuner other_device(0x5678, SAMPLES);
+    TEST_CHECK(!other_device.load(path.c_str()) && !other_device.is_tuned(key) && other_device.is_dirty());
+    // A truncated file is rejected.
+    std::filesystem::resize_file(path, sizeof(Dispatch_Tuning_Cache_Header) + sizeof(Dispatch_Tuning_Cache_Entry) - 1);
+    TEST_CHECK(!loaded.load(path.c_str()) && !loaded.is_tuned(key));
+    TEST_CHECK(!loaded.load((directory / "missing.bin").string().c_str()));
+
+    // A changed variant set tunes again.
+    const Thread_Group_Size new_variants[] = { { 8, 8, 1 }, { 32, 32, 1 } };
+    TEST_CHECK(tuner.select(key, new_variants) == 0);
+    TEST_CHECK(!tuner.is_tuned(key));
+    TEST_CHECK(tuner.select(key, new_variants) == 1);
+    std::filesystem::remove_all(directory);
+}
+
+int main()
+{
+    test_group_counts();
+    test_group_size_limits();
+    test_reflection();
+    test_autotuner();
+    return finish_test();
+}
@@ -0,0 +1,65 @@
+#include "copy_scheduler.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <span>
+#include <vector>
+
+// Streaming case of Copy_Scheduler: many small adjacent uploads to several buffers, coalesced and staged
+// until all of them are scheduled. copy_scheduler_test checks the results.
+
+static constexpr uint64_t PAGE_SIZE = 1ull << 20;
+static constexpr uint32_t PAGE_COUNT = 8;
+
+static void run_benchmark()
+{
+    static constexpr uint32_t REQUEST_COUNT = 1u << 16;
+    static constexpr uint64_t REQUEST_SIZE = 128;
+    static constexpr uint32_t BUFFER_COUNT = 16;
+    std::vector<std::vector<uint8_t>> pages(2 * PAGE_COUNT, std::vector<uint8_t>(PAGE_SIZE));
+    std::vector<uint8_t*> page_pointers;
+    for (auto& page : pages)
+    {
+        page_pointers.push_back(page.data());
+    }
+    std::span<uint8_t* const> upload_pages(page_pointers.data(), PAGE_COUNT);
+    std::span<uint8_t* const> readback_pages(page_pointers.data() + PAGE_COUNT, PAGE_COUNT);
+    std::vector<std::vector<uint8_t>> buffers(BUFFER_COUNT, std::vector<uint8_t>(REQUEST_COUNT / BUFFER_COUNT * REQUEST_SIZE));
+    std::vector<uint8_t> data(REQUEST_SIZE, 0xab);
+    double best_ns = 1e300;
+    uint64_t copy_count = 0;
+    uint64_t frame_count = 0;
+    for (uint32_t iteration = 0; iteration < 16; ++iteration)
+    {
+        Copy_Scheduler scheduler({ .page_size = PAGE_SIZE, .max_bytes_per_frame = 2 * PAGE_SIZE },
+            upload_pages, readback_pages);
+        auto begin = std::chrono::steady_clock::now();
+        // Interleaved over the buffers like streamed chunks of several assets arriving together.
+        for (uint32_t i = 0; i < REQUEST_COUNT; ++i)
+        {
+            auto buffer = i % BUFFER_COUNT;
+            scheduler.upload_buffer(&buffers[buffer], (i / BUFFER_COUNT) * REQUEST_SIZE, data);
+        }
+        uint64_t frames = 0;
+        while (scheduler.get_pending_bytes() > 0)
+        {
+            scheduler.build_frame();
+            scheduler.end_frame(frames + 1);
+            scheduler.retire(frames + 1);
+            frames += 1;
+        }
+        auto end = std::chrono::steady_clock::now();
+        best_ns = std::min(best_ns, std::chrono::duration<double, std::nano>(end - begin).count() / REQUEST_COUNT);
+        copy_count = scheduler.get_copy_count();
+        frame_count = frames;
+    }
+    printf("%u uploads of %llu bytes: %6.2f ns per request, %llu copies over %llu frames\n",
+        REQUEST_COUNT, (unsigned long long)REQUEST_SIZE, best_ns, (unsigned long long)copy_count, (unsigned long long)frame_count);
+}
+
+int main()
+{
+    run_benchmark();
+    return 0;
+}
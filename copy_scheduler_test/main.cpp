@@ -0,0 +1,414 @@
+#include "copy_scheduler.h"
+#include "test_check.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <utility>
+#include <vector>
+
+// Copy_Scheduler against a simulated copy queue: coalescing of adjacent and overlapping buffer requests,
+// later uploads winning where they overlap, splitting across pages and frames under the byte budget and
+// readbacks arriving in several callbacks. The last part checks every uploaded byte and every readback
+// of random request streams against a reference that applies the requests one by one.
+
+static constexpr uint64_t PAGE_SIZE = 4096;
+static constexpr uint32_t PAGE_COUNT = 8;
+// Frames the simulated GPU lags behind in the random test, like MAX_FRAMES_IN_FLIGHT.
+static constexpr uint64_t GPU_LATENCY = 2;
+
+struct Simulated_Texture
+{
+    Copy_Texture_Desc desc;
+    std::vector<uint8_t> data;
+};
+
+struct Simulation
+{
+    std::vector<std::vector<uint8_t>> upload_pages = std::vector<std::vector<uint8_t>>(PAGE_COUNT, std::vector<uint8_t>(PAGE_SIZE));
+    std::vector<std::vector<uint8_t>> readback_pages = std::vector<std::vector<uint8_t>>(PAGE_COUNT, std::vector<uint8_t>(PAGE_SIZE));
+    std::vector<uint8_t*> upload_pointers;
+    std::vector<uint8_t*> readback_pointers;
+    std::deque<std::vector<Scheduled_Copy>> in_flight;
+    uint64_t next_value = 1;
+
+    Simulation()
+    {
+        for (uint32_t i = 0; i < PAGE_COUNT; ++i)
+        {
+            upload_pointers.push_back(upload_pages[i].data());
+            readback_pointers.push_back(readback_pages[i].data());
+        }
+    }
+
+    void execute(const Scheduled_Copy& copy)
+    {
+        auto upload_page = upload_pages[copy.page].data();
+        auto readback_page = readback_pages[copy.page].data();
+        switch (copy.kind)
+        {
+        case Copy_Kind::Buffer_Upload:
+            memcpy(static_cast<std::vector<uint8_t>*>(copy.resource)->data() + copy.offset, upload_page + copy.page_offset, copy.size);
+            break;
+        case Copy_Kind::Buffer_Readback:
+            memcpy(readback_page + copy.page_offset, static_cast<std::vector<uint8_t>*>(copy.resource)->data() + copy.offset, copy.size);
+            break;
+        case Copy_Kind::Texture_Upload:
+        {
+            auto& texture = *static_cast<Simulated_Texture*>(copy.resource);
+            for (uint64_t row = 0; row < copy.size; ++row)
+            {
+                memcpy(texture.data.data() + (copy.offset + row) * texture.desc.row_size,
+                    upload_page + copy.page_offset + row * copy.texture.get_row_pitch(), texture.desc.row_size);
+            }
+            break;
+        }
+        }
+    }
+
+    // Records the frame's copies and completes the frame `latency` frames later. The GPU executes a frame's
+    // copies in order at completion, so staging pages the scheduler still owns are read late enough to
+    // catch early reuse. Returns the frame's copies.
+    std::vector<Scheduled_Copy> run_frame(Copy_Scheduler& scheduler, uint64_t latency = 0)
+    {
+        auto copies = scheduler.build_frame();
+        in_flight.emplace_back(copies.begin(), copies.end());
+        scheduler.end_frame(next_value++);
+        auto frame_copies = in_flight.back();
+        while (in_flight.size() > latency)
+        {
+            complete_one(scheduler);
+        }
+        return frame_copies;
+    }
+
+    void complete_one(Copy_Scheduler& scheduler)
+    {
+        for (const auto& copy : in_flight.front())
+        {
+            execute(copy);
+        }
+        in_flight.pop_front();
+        scheduler.retire(next_value - 1 - in_flight.size());
+    }
+
+    void drain(Copy_Scheduler& scheduler)
+    {
+        while (!scheduler.is_idle() || !in_flight.empty())
+        {
+            run_frame(scheduler, GPU_LATENCY);
+            while (in_flight.size() > 0 && scheduler.get_pending_bytes() == 0)
+            {
+                complete_one(scheduler);
+            }
+        }
+    }
+};
+
+static std::vector<uint8_t> make_data(uint64_t size, uint8_t value)
+{
+    return std::vector<uint8_t>(size, value);
+}
+
+static std::vector<uint8_t> make_pattern(uint64_t size, uint32_t seed)
+{
+    std::vector<uint8_t> data(size);
+    for (uint64_t i = 0; i < size; ++i)
+    {
+        data[i] = uint8_t(i * 7 + seed * 31 + (i >> 8));
+    }
+    return data;
+}
+
+// Touching ranges of one resource become one copy in any request order, a gap or another resource
+// starts a new one.
+static void test_adjacent_coalescing()
+{
+    Simulation simulation;
+    Copy_Scheduler scheduler({ .page_size = PAGE_SIZE, .max_bytes_per_frame = 4 * PAGE_SIZE },
+        simulation.upload_pointers, simulation.readback_pointers);
+    std::vector<uint8_t> a(1024), b(1024);
+    auto data = make_pattern(1024, 1);
+    scheduler.upload_buffer(&a, 200, { data.data() + 200, 100 });
+    scheduler.upload_buffer(&b, 0, { data.data(), 64 });
+    scheduler.upload_buffer(&a, 0, { data.data(), 100 });
+    scheduler.upload_buffer(&a, 100, { data.data() + 100, 100 });
+    scheduler.upload_buffer(&a, 400, { data.data() + 400, 100 });
+    scheduler.upload_buffer(&b, 64, { data.data() + 64, 64 });
+    TEST_CHECK(scheduler.get_pending_bytes() == 528);
+
+    auto copies = simulation.run_frame(scheduler);
+    TEST_CHECK(copies.size() == 3);
+    for (const auto& copy : copies)
+    {
+        TEST_CHECK(copy.kind == Copy_Kind::Buffer_Upload && !copy.needs_barrier);
+        TEST_CHECK(copy.page_offset % COPY_BUFFER_PLACEMENT_ALIGNMENT == 0);
+    }
+    auto find_copy = [&](void* resource, uint64_t offset) {
+        for (const auto& copy : copies)
+        {
+            if (copy.resource == resource && copy.offset == offset)
+            {
+                return copy.size;
+            }
+        }
+        return uint64_t(0);
+    };
+    TEST_CHECK(find_copy(&a, 0) == 300);
+    TEST_CHECK(find_copy(&a, 400) == 100);
+    TEST_CHECK(find_copy(&b, 0) == 128);
+    TEST_CHECK(std::equal(a.begin(), a.begin() + 300, data.begin()));
+    TEST_CHECK(std::all_of(a.begin() + 300, a.begin() + 400, [](uint8_t byte) { return byte == 0; }));
+    TEST_CHECK(std::equal(a.begin() + 400, a.begin() + 500, data.begin() + 400));
+    TEST_CHECK(std::equal(b.begin(), b.begin() + 128, data.begin()));
+    TEST_CHECK(scheduler.get_pending_bytes() == 0 && scheduler.is_idle());
+    TEST_CHECK(scheduler.get_request_count() == 6 && scheduler.get_copy_count() == 3);
+}
+
+// Overlapping uploads share one copy, where they overlap the one requested last wins regardless of
+// offset order.
+static void test_later_upload_wins()
+{
+    Simulation simulation;
+    Copy_Scheduler scheduler({ .page_size = PAGE_SIZE, .max_bytes_per_frame = 4 * PAGE_SIZE },
+        simulation.upload_pointers, simulation.readback_pointers);
+    std::vector<uint8_t> buffer(256);
+    scheduler.upload_buffer(&buffer, 0, make_data(100, 0x11));
+    scheduler.upload_buffer(&buffer, 50, make_data(100, 0x22));
+    scheduler.upload_buffer(&buffer, 25, make_data(50, 0x33));
+    auto copies = simulation.run_frame(scheduler);
+    TEST_CHECK(copies.size() == 1);
+    TEST_CHECK(copies.size() == 1 && copies[0].offset == 0 && copies[0].size == 150);
+    for (uint32_t i = 0; i < 256; ++i)
+    {
+        uint8_t expected = i < 25 ? 0x11 : i < 75 ? 0x33 : i < 150 ? 0x22 : 0;
+        TEST_CHECK(buffer[i] == expected);
+    }
+
+    // An upload, a readback and another upload of the same range keep their order: the readback sees the
+    // first upload, and the copies after a change of segment need a barrier.
+    std::vector<uint8_t> read;
+    scheduler.upload_buffer(&buffer, 0, make_data(64, 0x44));
+    scheduler.readback_buffer(&buffer, 0, 64, [&](uint64_t offset, std::span<const uint8_t> data) {
+        TEST_CHECK(offset == read.size());
+        read.insert(read.end(), data.begin(), data.end());
+    });
+    scheduler.upload_buffer(&buffer, 0, make_data(64, 0x55));
+    copies = simulation.run_frame(scheduler);
+    TEST_CHECK(copies.size() == 3);
+    TEST_CHECK(copies.size() == 3 && !copies[0].needs_barrier && copies[1].needs_barrier && copies[2].needs_barrier);
+    TEST_CHECK(read == make_data(64, 0x44));
+    TEST_CHECK(std::all_of(buffer.begin(), buffer.begin() + 64, [](uint8_t byte) { return byte == 0x55; }));
+}
+
+// A request larger than the frame's byte budget continues in the next frames, copies are split at page
+// boundaries and every frame stays within the budget. Requests behind it wait their turn.
+static void test_budget_chunking()
+{
+    static constexpr uint64_t BUDGET = 2 * PAGE_SIZE;
+    Simulation simulation;
+    Copy_Scheduler scheduler({ .page_size = PAGE_SIZE, .max_bytes_per_frame = BUDGET },
+        simulation.upload_pointers, simulation.readback_pointers);
+    std::vector<uint8_t> large(20000), small(64);
+    auto data = make_pattern(large.size(), 2);
+    scheduler.upload_buffer(&large, 0, data);
+    scheduler.upload_buffer(&small, 0, make_data(64, 0x66));
+
+    uint64_t next = 0;
+    uint32_t frame_count = 0;
+    while (scheduler.get_pending_bytes() > 0)
+    {
+        auto copies = simulation.run_frame(scheduler);
+        TEST_CHECK(scheduler.get_frame_bytes() <= BUDGET);
+        uint64_t frame_bytes = 0;
+        for (const auto& copy : copies)
+        {
+            TEST_CHECK(copy.page_offset + copy.size <= PAGE_SIZE);
+            frame_bytes += copy.size;
+            if (copy.resource == &large)
+            {
+                TEST_CHECK(copy.offset == next);
+                next += copy.size;
+            }
+        }
+        TEST_CHECK(frame_bytes == scheduler.get_frame_bytes());
+        frame_count += 1;
+    }
+    TEST_CHECK(next == large.size());
+    // 20000 + 64 bytes at 8192 per frame.
+    TEST_CHECK(frame_count == 3);
+    TEST_CHECK(large == data);
+    TEST_CHECK(small == make_data(64, 0x66));
+
+    // Texture rows are never split, each frame gets as many row pitches as the budget holds.
+    Simulated_Texture texture = {
+        .desc = { .format = 0, .width = 100, .height = 10, .block_size = 1, .row_size = 100 },
+        .data = std::vector<uint8_t>(1000)
+    };
+    Copy_Scheduler texture_scheduler({ .page_size = PAGE_SIZE, .max_bytes_per_frame = 4 * COPY_TEXTURE_PITCH_ALIGNMENT },
+        simulation.upload_pointers, simulation.readback_pointers);
+    auto texels = make_pattern(texture.data.size(), 3);
+    texture_scheduler.upload_texture(&texture, 0, texture.desc, texels);
+    std::vector<uint64_t> row_counts;
+    while (texture_scheduler.get_pending_bytes() > 0)
+    {
+        for (const auto& copy : simulation.run_frame(texture_scheduler))
+        {
+            TEST_CHECK(copy.kind == Copy_Kind::Texture_Upload);
+            TEST_CHECK(copy.page_offset % COPY_TEXTURE_PLACEMENT_ALIGNMENT == 0);
+            row_counts.push_back(copy.size);
+        }
+    }
+    TEST_CHECK((row_counts == std::vector<uint64_t> { 4, 4, 2 }));
+    TEST_CHECK(texture.data == texels);
+}
+
+// Without free pages the schedule stops and resumes once a frame retired.
+static void test_page_exhaustion()
+{
+    Simulation simulation;
+    Copy_Scheduler scheduler({ .page_size = PAGE_SIZE, .max_bytes_per_frame = 16 * PAGE_SIZE },
+        { simulation.upload_pointers.data(), 2 }, simulation.readback_pointers);
+    std::vector<uint8_t> buffer(3 * PAGE_SIZE);
+    auto data = make_pattern(buffer.size(), 4);
+    scheduler.upload_buffer(&buffer, 0, data);
+
+    auto copies = simulation.run_frame(scheduler, 1);
+    TEST_CHECK(copies.size() == 2 && scheduler.get_frame_bytes() == 2 * PAGE_SIZE);
+    // Both pages belong to the frame in flight.
+    copies = simulation.run_frame(scheduler, 1);
+    TEST_CHECK(copies.empty());
+    simulation.complete_one(scheduler);
+    copies = simulation.run_frame(scheduler);
+    TEST_CHECK(copies.size() == 1 && copies[0].offset == 2 * PAGE_SIZE);
+    TEST_CHECK(buffer == data && scheduler.is_idle());
+}
+
+// Readbacks split across pages and frames arrive in several calls, each with the offset into its own
+// request. Coalesced readbacks get only their own range, and nothing arrives before the frame retired.
+static void test_split_readback()
+{
+    Simulation simulation;
+    Copy_Scheduler scheduler({ .page_size = PAGE_SIZE, .max_bytes_per_frame = 2 * PAGE_SIZE },
+        simulation.upload_pointers, simulation.readback_pointers);
+    auto buffer = make_pattern(10000, 5);
+    std::vector<uint8_t> read(buffer.size());
+    std::vector<std::pair<uint64_t, uint64_t>> calls;
+    scheduler.readback_buffer(&buffer, 0, buffer.size(), [&](uint64_t offset, std::span<const uint8_t> data) {
+        calls.push_back({ offset, data.size() });
+        memcpy(read.data() + offset, data.data(), data.size());
+    });
+    std::vector<uint8_t> small_read(50);
+    uint32_t small_calls = 0;
+    scheduler.readback_buffer(&buffer, 9950, 50, [&](uint64_t offset, std::span<const uint8_t> data) {
+        small_calls += 1;
+        memcpy(small_read.data() + offset, data.data(), data.size());
+    });
+
+    // The first frame is in flight: its readbacks are not delivered yet.
+    simulation.run_frame(scheduler, 1);
+    TEST_CHECK(calls.empty());
+    simulation.drain(scheduler);
+    TEST_CHECK((calls == std::vector<std::pair<uint64_t, uint64_t>> { { 0, 4096 }, { 4096, 4096 }, { 8192, 1808 } }));
+    TEST_CHECK(read == buffer);
+    TEST_CHECK(small_calls == 1);
+    TEST_CHECK(std::equal(small_read.begin(), small_read.end(), buffer.begin() + 9950));
+}
+
+// Random request streams with a GPU that lags behind, checked byte for byte against applying every request
+// in order.
+static void test_random_requests()
+{
+    static constexpr uint32_t BUFFER_COUNT = 4;
+    static constexpr uint64_t BUFFER_SIZE = 3 * PAGE_SIZE;
+    Simulation simulation;
+    Copy_Scheduler scheduler({ .page_size = PAGE_SIZE, .max_bytes_per_frame = 2 * PAGE_SIZE },
+        simulation.upload_pointers, simulation.readback_pointers);
+    std::vector<std::vector<uint8_t>> buffers(BUFFER_COUNT, std::vector<uint8_t>(BUFFER_SIZE));
+    std::vector<std::vector<uint8_t>> reference = buffers;
+    Simulated_Texture texture = {
+        .desc = { .format = 0, .width = 64, .height = 100, .block_size = 4, .row_size = 16 * 16 },
+        .data = {}
+    };
+    texture.data.resize(size_t(texture.desc.row_size) * texture.desc.get_row_count());
+    std::vector<uint8_t> texture_reference = texture.data;
+    uint64_t readback_errors = 0;
+    uint64_t readback_bytes = 0;
+    uint64_t expected_readback_bytes = 0;
+
+    std::mt19937_64 random(1234);
+    for (uint32_t frame = 0; frame < 256; ++frame)
+    {
+        auto request_count = random() % 64;
+        for (uint32_t r = 0; r < request_count; ++r)
+        {
+            auto buffer = uint32_t(random() % BUFFER_COUNT);
+            auto kind = random() % 16;
+            // Mostly small uploads next to each other, some overlapping, a few huge ones and readbacks.
+            uint64_t size = kind == 0 ? random() % (2 * PAGE_SIZE) + 1 : random() % 128 + 1;
+            uint64_t offset = (random() % 64 < 48 ? (r * 128) % BUFFER_SIZE : random() % BUFFER_SIZE);
+            size = std::min(size, BUFFER_SIZE - offset);
+            if (size == 0)
+            {
+                continue;
+            }
+            if (kind == 1)
+            {
+                std::vector<uint8_t> expected(reference[buffer].begin() + offset, reference[buffer].begin() + offset + size);
+                expected_readback_bytes += size;
+                scheduler.readback_buffer(&buffers[buffer], offset, size,
+                    [expected = std::move(expected), &readback_errors, &readback_bytes](uint64_t at, std::span<const uint8_t> data) {
+                        readback_bytes += data.size();
+                        if (at + data.size() > expected.size() || memcmp(expected.data() + at, data.data(), data.size()) != 0)
+                        {
+                            readback_errors += 1;
+                        }
+                    });
+                continue;
+            }
+            if (kind == 2 && frame % 8 == 0)
+            {
+                std::vector<uint8_t> data(texture.data.size());
+                for (auto& byte : data)
+                {
+                    byte = uint8_t(random());
+                }
+                texture_reference = data;
+                scheduler.upload_texture(&texture, 0, texture.desc, data);
+                continue;
+            }
+            std::vector<uint8_t> data(size);
+            for (auto& byte : data)
+            {
+                byte = uint8_t(random());
+            }
+            memcpy(reference[buffer].data() + offset, data.data(), size);
+            scheduler.upload_buffer(&buffers[buffer], offset, data);
+        }
+        simulation.run_frame(scheduler, GPU_LATENCY);
+    }
+    simulation.drain(scheduler);
+
+    TEST_CHECK(readback_errors == 0);
+    TEST_CHECK(readback_bytes == expected_readback_bytes);
+    for (uint32_t i = 0; i < BUFFER_COUNT; ++i)
+    {
+        TEST_CHECK(buffers[i] == reference[i]);
+    }
+    TEST_CHECK(texture.data == texture_reference);
+    printf("%llu requests in %llu copies, %llu readback bytes\n",
+        (unsigned long long)scheduler.get_request_count(), (unsigned long long)scheduler.get_copy_count(),
+        (unsigned long long)readback_bytes);
+}
+
+int main()
+{
+    test_adjacent_coalescing();
+    test_later_upload_wins();
+    test_budget_chunking();
+    test_page_exhaustion();
+    test_split_readback();
+    test_random_requests();
+    return finish_test();
+}
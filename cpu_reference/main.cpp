@@ -0,0 +1,220 @@
+#include "command_stream.h"
+#include "cpu_backend.h"
+#include "indirect_arguments.h"
+#include "png_writer.h"
+#include "shader_blob.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CPU_REFERENCE_USE_SSE2 1
+#else
+#define CPU_REFERENCE_USE_SSE2 0
+#endif
+
+// Headless reference of the compute pass in repro_01. Records the same commands, runs them on the CPU
+// backend and writes the UAV out as golden data: <output>.bin holds the raw R32G32B32A32_UINT texels and
+// is what --compare checks bit for bit, <output>.png the low byte of every channel with opaque alpha.
+// With --indirect the push constants and the dispatch come from an argument buffer through the
+// ExecuteIndirect model instead, the output has to stay the same.
+// The golden is cpu_reference_expected_result.bin, not a screenshot like repro_01_expected_result.png: that
+// one shows the 566x566 window, while the texels of the 256x256 UAV can be checked exactly.
+// Usage: cpu_reference [--output <name>] [--compare <golden.bin>] [--repeat <count>] [--indirect]
+
+static constexpr uint32_t TEXTURE_WIDTH = 256;
+static constexpr uint32_t TEXTURE_HEIGHT = 256;
+static constexpr uint32_t TEXEL_SIZE = 4 * sizeof(uint32_t);
+
+// Mirrors Push_Constants in shader.cs.hlsl.
+struct Push_Constants
+{
+    uint32_t tex;
+    uint32_t unused1;
+    uint32_t unused2;
+    uint32_t unused3;
+};
+
+// cs_main of shader.cs.hlsl with its default numthreads, one group per call.
+static void cs_main(const Cpu_Kernel_Context& context, uint32_t group_x, uint32_t group_y, uint32_t group_z)
+{
+    auto constants = context.get_root_constants<Push_Constants>(0);
+    auto texture = context.get_descriptor(constants.tex);
+    if (!texture || texture->texel_size != TEXEL_SIZE)
+    {
+        return;
+    }
+    auto x_begin = group_x * context.group_size.x;
+    auto y_begin = group_y * context.group_size.y;
+    // Group counts are rounded up, skip threads past the edge. Every group_z > 0 thread is outside a 2D texture.
+    if (group_z * context.group_size.z > 0 || x_begin >= texture->width || y_begin >= texture->height)
+    {
+        return;
+    }
+    auto x_end = std::min(x_begin + context.group_size.x, texture->width);
+    auto y_end = std::min(y_begin + context.group_size.y, texture->height);
+    for (auto y = y_begin; y < y_end; ++y)
+    {
+        auto texel = texture->get_row(y) + size_t(x_begin) * TEXEL_SIZE;
+#if CPU_REFERENCE_USE_SSE2
+        auto value = _mm_setr_epi32(int(x_begin), int(y), 0, 0);
+        const auto step = _mm_setr_epi32(1, 0, 0, 0);
+        for (auto x = x_begin; x < x_end; ++x, texel += TEXEL_SIZE)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(texel), value);
+            value = _mm_add_epi32(value, step);
+        }
+#else
+        for (auto x = x_begin; x < x_end; ++x, texel += TEXEL_SIZE)
+        {
+            uint32_t value[4] = { x, y, 0, 0 };
+            memcpy(texel, value, sizeof(value));
+        }
+#endif
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::string output = "cpu_reference";
+    const char* compare_path = nullptr;
+    uint32_t repeat_count = 1;
+    bool use_indirect = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string_view option = argv[i];
+        bool has_value = i + 1 < argc;
+        if (option == "--indirect")
+        {
+            use_indirect = true;
+        }
+        else if (option == "--output" && has_value)
+        {
+            output = argv[++i];
+        }
+        else if (option == "--compare" && has_value)
+        {
+            compare_path = argv[++i];
+        }
+        else if (option == "--repeat" && has_value)
+        {
+            repeat_count = std::max(1u, uint32_t(strtoul(argv[++i], nullptr, 10)));
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    auto texture = make_cpu_texture_2d(TEXTURE_WIDTH, TEXTURE_HEIGHT, TEXEL_SIZE);
+    Cpu_Descriptor_Heap descriptor_heap = { .descriptors = { &texture } };
+    Cpu_Kernel kernel = { .group_size = { 32, 32, 1 }, .function = cs_main };
+    Command_Stream_Objects stream_objects;
+    std::vector<void*> objects = { &descriptor_heap, &kernel, &texture };
+    for (auto object : objects)
+    {
+        stream_objects.get_id(object);
+    }
+
+    // The commands of repro_01's compute pass. Its root signature has no CPU counterpart and barriers are
+    // no-ops on the CPU, so neither is recorded.
+    Command_Stream_Writer writer;
+    writer.begin_list(0);
+    uint32_t heap = stream_objects.get_id(&descriptor_heap);
+    writer.set_descriptor_heaps({ &heap, 1 });
+    writer.set_root_signature(Command_Stream_Bind_Point::Compute, 0);
+    Push_Constants constants = { .tex = 0, .unused1 = 1, .unused2 = 2, .unused3 = 3 };
+    uint32_t constant_values[4];
+    memcpy(constant_values, &constants, sizeof(constants));
+    writer.set_pipeline_state(stream_objects.get_id(&kernel));
+    Dispatch_Size dispatch_size;
+    get_dispatch_size(TEXTURE_WIDTH, TEXTURE_HEIGHT, 1, kernel.group_size, dispatch_size);
+    if (!use_indirect)
+    {
+        writer.set_root_constants(Command_Stream_Bind_Point::Compute, 0, constant_values, 0);
+        writer.dispatch(dispatch_size.x, dispatch_size.y, dispatch_size.z);
+    }
+    writer.end_list();
+
+    // The same constants and dispatch as one indirect command, the count says 1 of up to 4.
+    auto indirect_layout = Indirect_Command_Layout_Builder()
+        .add_constants<Push_Constants>(0)
+        .add_dispatch()
+        .build();
+    std::vector<uint8_t> indirect_arguments(4 * indirect_layout.byte_stride);
+    Indirect_Command_Writer indirect_writer(indirect_layout, indirect_arguments);
+    indirect_writer.write_constants(0, 0, constants);
+    indirect_writer.write_dispatch(0, dispatch_size);
+    uint32_t indirect_count = 1;
+    std::span<const uint8_t> indirect_count_bytes(reinterpret_cast<const uint8_t*>(&indirect_count), sizeof(indirect_count));
+
+    Job_System job_system;
+    Cpu_Backend backend(job_system, objects);
+    double total_ms = 0.0;
+    for (uint32_t i = 0; i < repeat_count; ++i)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        Command_Stream_Reader reader(writer.get_data());
+        while (reader.read_list(backend))
+        {
+        }
+        // Cpu_Backend runs every command as it is read, so executing after the list is the same as in it.
+        if (use_indirect && !execute_indirect_commands(backend, indirect_layout, indirect_arguments, 0, 4, indirect_count_bytes).is_valid())
+        {
+            fprintf(stderr, "Indirect arguments are invalid\n");
+            return 1;
+        }
+        total_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        if (!reader.is_valid())
+        {
+            fprintf(stderr, "Command stream is corrupt\n");
+            return 1;
+        }
+    }
+    printf("%u run(s), %.3f ms per run on %u threads\n", repeat_count, total_ms / repeat_count, job_system.get_thread_count());
+
+    FILE* file = fopen((output + ".bin").c_str(), "wb");
+    bool written = file && fwrite(texture.data.data(), 1, texture.data.size(), file) == texture.data.size();
+    written = file && fclose(file) == 0 && written;
+    std::vector<uint8_t> pixels(size_t(TEXTURE_WIDTH) * TEXTURE_HEIGHT * 4);
+    for (size_t i = 0; i < pixels.size(); ++i)
+    {
+        pixels[i] = i % 4 == 3 ? 255 : texture.data[i * sizeof(uint32_t)];
+    }
+    written = write_png_rgba8((output + ".png").c_str(), TEXTURE_WIDTH, TEXTURE_HEIGHT, pixels) && written;
+    if (!written)
+    {
+        fprintf(stderr, "Failed to write %s.bin/.png\n", output.c_str());
+        return 1;
+    }
+
+    if (compare_path)
+    {
+        Mapped_File golden(compare_path);
+        if (!golden.is_open() || golden.size() != texture.data.size())
+        {
+            fprintf(stderr, "%s is missing or has the wrong size\n", compare_path);
+            return 1;
+        }
+        auto golden_bytes = static_cast<const uint8_t*>(golden.data());
+        for (size_t i = 0; i < texture.data.size(); i += TEXEL_SIZE)
+        {
+            if (memcmp(golden_bytes + i, texture.data.data() + i, TEXEL_SIZE) != 0)
+            {
+                auto texel = i / TEXEL_SIZE;
+                fprintf(stderr, "Mismatch at texel (%zu, %zu)\n", texel % TEXTURE_WIDTH, texel / TEXTURE_WIDTH);
+                return 1;
+            }
+        }
+        printf("Matches %s\n", compare_path);
+    }
+    return 0;
+}
@@ -0,0 +1,108 @@
+#include "cpu_trace.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Measures the cost of CPU_TRACE_SCOPE per scope. Rings are drained between batches so every scope
+// takes the recording path instead of the cheaper dropped one. Costs are reported net of the benchmark
+// loop itself, with the build type, since unoptimized builds call every accessor out of line.
+
+// CMake passes the configuration, empty when CMAKE_BUILD_TYPE is not set.
+#ifndef CPU_TRACE_BENCHMARK_BUILD_TYPE
+#define CPU_TRACE_BENCHMARK_BUILD_TYPE "unknown"
+#endif
+
+static constexpr uint32_t BATCH_SIZE = 1u << 14;
+static constexpr uint32_t BATCH_COUNT = 256;
+
+template<typename Function>
+static double measure_ns_per_iteration(Function&& function)
+{
+    double best_ns = 1e300;
+    for (uint32_t batch = 0; batch < BATCH_COUNT; ++batch)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < BATCH_SIZE; ++i)
+        {
+            function();
+        }
+        auto end = std::chrono::steady_clock::now();
+        auto ns = std::chrono::duration<double, std::nano>(end - begin).count() / BATCH_SIZE;
+        best_ns = ns < best_ns ? ns : best_ns;
+        Cpu_Tracer::get().discard();
+    }
+    return best_ns;
+}
+
+int main()
+{
+    static_assert(BATCH_SIZE <= (1u << Cpu_Tracer::RING_CAPACITY_LOG2));
+    volatile uint64_t sink = 0;
+
+    auto build_type = std::string_view(CPU_TRACE_BENCHMARK_BUILD_TYPE);
+    printf("build type:               %s\n", build_type.empty() ? "none (no optimization flags)" : build_type.data());
+    auto loop_ns = measure_ns_per_iteration([&]() { sink = sink + 1; });
+    printf("loop overhead:            %6.2f ns\n", loop_ns);
+    auto net_ns = [loop_ns](double ns) { return ns > loop_ns ? ns - loop_ns : 0.0; };
+
+    auto ticks_ns = measure_ns_per_iteration([&]() { sink = sink + get_cpu_trace_ticks(); });
+    printf("get_cpu_trace_ticks:      %6.2f ns\n", net_ns(ticks_ns));
+
+    auto scope_ns = measure_ns_per_iteration([&]() {
+        CPU_TRACE_SCOPE("benchmark");
+        sink = sink + 1;
+    });
+    printf("CPU_TRACE_SCOPE:          %6.2f ns\n", net_ns(scope_ns));
+
+    Cpu_Tracer::get().set_enabled(false);
+    auto disabled_ns = measure_ns_per_iteration([&]() {
+        CPU_TRACE_SCOPE("benchmark");
+        sink = sink + 1;
+    });
+    Cpu_Tracer::get().set_enabled(true);
+    printf("CPU_TRACE_SCOPE disabled: %6.2f ns\n", net_ns(disabled_ns));
+
+    // Every thread owns its ring, so scopes on several threads must not slow each other down.
+    auto thread_count = std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() : 2;
+    std::vector<double> thread_ns(thread_count);
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < thread_count; ++t)
+    {
+        threads.emplace_back([&thread_ns, t]() {
+            volatile uint64_t thread_sink = 0;
+            double best_ns = 1e300;
+            for (uint32_t batch = 0; batch < BATCH_COUNT / 16; ++batch)
+            {
+                auto begin = std::chrono::steady_clock::now();
+                for (uint32_t i = 0; i < BATCH_SIZE / 4; ++i)
+                {
+                    CPU_TRACE_SCOPE("benchmark_thread");
+                    thread_sink = thread_sink + 1;
+                }
+                auto end = std::chrono::steady_clock::now();
+                auto ns = std::chrono::duration<double, std::nano>(end - begin).count() / (BATCH_SIZE / 4);
+                best_ns = ns < best_ns ? ns : best_ns;
+            }
+            thread_ns[t] = best_ns;
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    double worst_thread_ns = 0.0;
+    for (auto ns : thread_ns)
+    {
+        worst_thread_ns = ns > worst_thread_ns ? ns : worst_thread_ns;
+    }
+    printf("CPU_TRACE_SCOPE %2u threads: %6.2f ns (slowest thread)\n", thread_count, worst_thread_ns);
+
+    Chrome_Trace trace;
+    Cpu_Tracer::get().export_trace(trace, 0);
+    printf("exported %zu events, %llu dropped\n", trace.get_event_count(),
+        static_cast<unsigned long long>(Cpu_Tracer::get().get_dropped_count()));
+    return 0;
+}
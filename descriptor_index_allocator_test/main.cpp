@@ -0,0 +1,238 @@
+#include "descriptor_index_allocator.h"
+#include "test_check.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Free list, generations and deferred frees of Descriptor_Index_Allocator, then loader threads hammering
+// it through their own Descriptor_Index_Cache while a render thread frees deferred and retires.
+
+static void test_free_list()
+{
+    static constexpr uint32_t CAPACITY = 16;
+    Descriptor_Index_Allocator allocator(CAPACITY);
+    std::vector<Descriptor_Handle> handles;
+    for (uint32_t i = 0; i < CAPACITY; ++i)
+    {
+        handles.push_back(allocator.allocate());
+        TEST_CHECK(handles.back().index == i);
+        TEST_CHECK(allocator.is_alive(handles.back()));
+    }
+    TEST_CHECK(!allocator.allocate().is_valid());
+    TEST_CHECK(allocator.get_allocated_count() == CAPACITY);
+
+    // Freed indices come back most recently freed first, with a new generation.
+    TEST_CHECK(allocator.free(handles[3]));
+    TEST_CHECK(allocator.free(handles[7]));
+    TEST_CHECK(!allocator.is_alive(handles[3]));
+    TEST_CHECK(!allocator.free(handles[3]));
+    TEST_CHECK(allocator.get_allocated_count() == CAPACITY - 2);
+    auto reused = allocator.allocate();
+    TEST_CHECK(reused.index == 7 && reused.generation == handles[7].generation + 1);
+    TEST_CHECK(!allocator.is_alive(handles[7]));
+    TEST_CHECK(allocator.is_alive(reused));
+    TEST_CHECK(allocator.allocate().index == 3);
+    TEST_CHECK(!allocator.free({ .index = CAPACITY, .generation = 1 }));
+    TEST_CHECK(!allocator.is_alive({}));
+}
+
+static void test_deferred_free()
+{
+    Descriptor_Index_Allocator allocator(4);
+    Descriptor_Handle handles[4];
+    for (auto& handle : handles)
+    {
+        handle = allocator.allocate();
+    }
+    TEST_CHECK(allocator.free_deferred(handles[0], 5));
+    TEST_CHECK(allocator.free_deferred(handles[1], 5));
+    TEST_CHECK(allocator.free_deferred(handles[2], 6));
+    // Stale right away, but the indices stay taken until their fence value retires.
+    TEST_CHECK(!allocator.is_alive(handles[0]));
+    TEST_CHECK(!allocator.free_deferred(handles[0], 6));
+    TEST_CHECK(!allocator.allocate().is_valid());
+    allocator.retire(4);
+    TEST_CHECK(!allocator.allocate().is_valid());
+    allocator.retire(5);
+    auto first = allocator.allocate();
+    auto second = allocator.allocate();
+    TEST_CHECK(first.is_valid() && second.is_valid() && first.index != second.index);
+    TEST_CHECK(first.index <= 1 && second.index <= 1);
+    TEST_CHECK(!allocator.allocate().is_valid());
+
+    // An older fence value than one still pending, e.g. from another queue, retires first.
+    TEST_CHECK(allocator.free_deferred(handles[3], 4));
+    TEST_CHECK(!allocator.is_alive(handles[3]));
+    allocator.retire(4);
+    TEST_CHECK(allocator.allocate().index == 3);
+    TEST_CHECK(!allocator.allocate().is_valid());
+    allocator.retire(6);
+    TEST_CHECK(allocator.allocate().index == 2);
+}
+
+// Deferred frees with shuffled fence values: an index comes back exactly when its value retired.
+static void test_unordered_deferred_free()
+{
+    static constexpr uint32_t CAPACITY = 256;
+    std::mt19937 random(4);
+    Descriptor_Index_Allocator allocator(CAPACITY);
+    std::vector<uint64_t> free_values(CAPACITY);
+    for (uint32_t i = 0; i < CAPACITY; ++i)
+    {
+        auto handle = allocator.allocate();
+        TEST_CHECK(handle.index == i);
+        free_values[i] = 1 + random() % 64;
+        TEST_CHECK(allocator.free_deferred(handle, free_values[i]));
+    }
+    for (uint64_t completed = 0; completed <= 64; ++completed)
+    {
+        allocator.retire(completed);
+        // Earlier values were allocated again already, only the ones retiring now are free.
+        uint32_t expected_count = 0;
+        for (auto value : free_values)
+        {
+            expected_count += value == completed ? 1 : 0;
+        }
+        uint32_t count = 0;
+        for (auto handle = allocator.allocate(); handle.is_valid(); handle = allocator.allocate())
+        {
+            TEST_CHECK(free_values[handle.index] == completed);
+            count += 1;
+        }
+        TEST_CHECK(count == expected_count);
+    }
+    TEST_CHECK(allocator.get_allocated_count() == CAPACITY);
+}
+
+static void test_threads()
+{
+    static constexpr uint32_t CAPACITY = 4096;
+    static constexpr uint32_t LOADER_COUNT = 4;
+    static constexpr uint32_t OPERATION_COUNT = 200000;
+    Descriptor_Index_Allocator allocator(CAPACITY);
+    // Owner of every index, 0 while free. Two owners at once means an index was handed out twice.
+    auto owners = std::make_unique<std::atomic<uint32_t>[]>(CAPACITY);
+    std::atomic<uint32_t> double_allocations = 0;
+    std::atomic<uint32_t> stale_handle_errors = 0;
+    auto take = [&](Descriptor_Handle handle, uint32_t owner) {
+        uint32_t expected = 0;
+        if (!owners[handle.index].compare_exchange_strong(expected, owner))
+        {
+            double_allocations += 1;
+        }
+    };
+    auto release = [&](Descriptor_Handle handle) { owners[handle.index].store(0); };
+
+    auto run_loader = [&](uint32_t owner) {
+        Descriptor_Index_Cache cache(allocator);
+        std::mt19937 random(owner);
+        std::vector<Descriptor_Handle> handles;
+        for (uint32_t i = 0; i < OPERATION_COUNT; ++i)
+        {
+            if (handles.size() < 256 && random() % 2 == 0)
+            {
+                auto handle = cache.allocate();
+                if (handle.is_valid())
+                {
+                    take(handle, owner);
+                    handles.push_back(handle);
+                }
+            }
+            else if (!handles.empty())
+            {
+                auto slot = random() % handles.size();
+                auto handle = handles[slot];
+                handles[slot] = handles.back();
+                handles.pop_back();
+                release(handle);
+                if (!cache.free(handle) || allocator.is_alive(handle) || cache.free(handle))
+                {
+                    stale_handle_errors += 1;
+                }
+            }
+        }
+        for (auto handle : handles)
+        {
+            release(handle);
+            cache.free(handle);
+        }
+    };
+
+    // The render thread frees deferred with a frame fence that lags two frames behind.
+    auto run_render_thread = [&]() {
+        static constexpr uint32_t OWNER = LOADER_COUNT + 1;
+        std::mt19937 random(OWNER);
+        std::vector<Descriptor_Handle> handles;
+        for (uint64_t frame = 1; frame <= OPERATION_COUNT / 64; ++frame)
+        {
+            for (uint32_t i = 0; i < 64; ++i)
+            {
+                if (handles.size() < 512 && random() % 2 == 0)
+                {
+                    auto handle = allocator.allocate();
+                    if (handle.is_valid())
+                    {
+                        take(handle, OWNER);
+                        handles.push_back(handle);
+                    }
+                }
+                else if (!handles.empty())
+                {
+                    auto handle = handles.back();
+                    handles.pop_back();
+                    release(handle);
+                    if (!allocator.free_deferred(handle, frame))
+                    {
+                        stale_handle_errors += 1;
+                    }
+                }
+            }
+            if (frame > 2)
+            {
+                allocator.retire(frame - 2);
+            }
+        }
+        for (auto handle : handles)
+        {
+            release(handle);
+            allocator.free(handle);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < LOADER_COUNT; ++i)
+    {
+        threads.emplace_back(run_loader, i + 1);
+    }
+    threads.emplace_back(run_render_thread);
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    allocator.retire(~0ull);
+    TEST_CHECK(double_allocations == 0);
+    TEST_CHECK(stale_handle_errors == 0);
+    TEST_CHECK(allocator.get_allocated_count() == 0);
+    // Every index is on the free list exactly once again.
+    std::vector<bool> seen(CAPACITY);
+    uint32_t allocated = 0;
+    for (auto handle = allocator.allocate(); handle.is_valid(); handle = allocator.allocate())
+    {
+        TEST_CHECK(!seen[handle.index]);
+        seen[handle.index] = true;
+        allocated += 1;
+    }
+    TEST_CHECK(allocated == CAPACITY);
+}
+
+int main()
+{
+    test_free_list();
+    test_deferred_free();
+    test_unordered_deferred_free();
+    test_threads();
+    return finish_test();
+}
@@ -0,0 +1,200 @@
+#include "frame_ring.h"
+#include "test_check.h"
+#include <cstdint>
+#include <exception>
+#include <random>
+#include <vector>
+
+// Frame_Ring against a fake fence the test completes by hand: slot indices cycle, begin_frame only waits
+// when the slot's last value is still pending, a failing wait propagates without retiring the slot, and
+// random GPU progress never lets a slot be reused before its value completed.
+
+class Fake_Fence : public Fence
+{
+public:
+    void signal(uint64_t value) override
+    {
+        signaled_values.push_back(value);
+    }
+
+    uint64_t get_completed_value() override
+    {
+        return completed_value;
+    }
+
+    // Waiting completes the GPU up to `value`, unless the wait is set to fail.
+    void wait(uint64_t value) override
+    {
+        waited_values.push_back(value);
+        if (is_wait_failing)
+        {
+            throw std::exception();
+        }
+        if (completed_value < value)
+        {
+            completed_value = value;
+        }
+    }
+
+    uint64_t completed_value = 0;
+    bool is_wait_failing = false;
+    std::vector<uint64_t> signaled_values;
+    std::vector<uint64_t> waited_values;
+};
+
+static void test_slot_reuse()
+{
+    Fake_Fence fence;
+    Frame_Ring ring(fence, 3);
+    TEST_CHECK(ring.get_frames_in_flight() == 3);
+    TEST_CHECK(ring.get_pending_value() == 1 && ring.get_last_signaled_value() == 0);
+
+    // The first lap only finds unused slots, nothing to wait for.
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        TEST_CHECK(ring.begin_frame() == i);
+        TEST_CHECK(ring.get_pending_value() == i + 1);
+        TEST_CHECK(ring.end_frame() == i + 1);
+    }
+    TEST_CHECK(fence.waited_values.empty());
+    TEST_CHECK((fence.signaled_values == std::vector<uint64_t> { 1, 2, 3 }));
+    TEST_CHECK(ring.get_frame_count() == 3);
+
+    // Slot 0 was signaled with 1, still pending: begin_frame waits for exactly that value.
+    TEST_CHECK(ring.begin_frame() == 0);
+    TEST_CHECK((fence.waited_values == std::vector<uint64_t> { 1 }));
+    TEST_CHECK(ring.get_completed_value() == 1);
+    ring.end_frame();
+
+    // Slot 1 (value 2) already completed on the GPU, no wait.
+    fence.completed_value = 2;
+    TEST_CHECK(ring.begin_frame() == 1);
+    TEST_CHECK(fence.waited_values.size() == 1);
+    TEST_CHECK(ring.get_completed_value() == 2);
+    ring.end_frame();
+
+    // A completed value seen once covers older slots without asking the fence again.
+    fence.completed_value = 5;
+    TEST_CHECK(ring.is_retired(5));
+    fence.completed_value = 0;
+    TEST_CHECK(ring.begin_frame() == 2);
+    TEST_CHECK(fence.waited_values.size() == 1);
+    ring.end_frame();
+
+    // wait_idle waits for the last signaled value only.
+    fence.completed_value = 5;
+    ring.wait_idle();
+    TEST_CHECK((fence.waited_values == std::vector<uint64_t> { 1, 6 }));
+    TEST_CHECK(ring.get_completed_value() == 6);
+    ring.wait_idle();
+    TEST_CHECK(fence.waited_values.size() == 2);
+}
+
+static void test_single_slot()
+{
+    // Zero frames in flight is clamped to one: every frame after the first waits for the previous one.
+    Fake_Fence fence;
+    Frame_Ring ring(fence, 0);
+    TEST_CHECK(ring.get_frames_in_flight() == 1);
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        TEST_CHECK(ring.begin_frame() == 0);
+        ring.end_frame();
+    }
+    TEST_CHECK((fence.waited_values == std::vector<uint64_t> { 1, 2, 3 }));
+}
+
+static void test_failed_wait()
+{
+    Fake_Fence fence;
+    Frame_Ring ring(fence, 2);
+    for (uint32_t i = 0; i < 2; ++i)
+    {
+        ring.begin_frame();
+        ring.end_frame();
+    }
+
+    // D3D12_Fence throws when the event wait fails. The ring must pass that on and keep the slot pending,
+    // otherwise the frame would reuse command allocators the GPU still reads.
+    fence.is_wait_failing = true;
+    bool threw = false;
+    try
+    {
+        ring.begin_frame();
+    }
+    catch (const std::exception&)
+    {
+        threw = true;
+    }
+    TEST_CHECK(threw);
+    TEST_CHECK(ring.get_completed_value() == 0);
+    TEST_CHECK(!ring.is_retired(1));
+
+    threw = false;
+    try
+    {
+        ring.wait_idle();
+    }
+    catch (const std::exception&)
+    {
+        threw = true;
+    }
+    TEST_CHECK(threw);
+    TEST_CHECK(ring.get_completed_value() == 0);
+
+    // Once the wait works again the same slot comes back.
+    fence.is_wait_failing = false;
+    TEST_CHECK(ring.begin_frame() == 0);
+    TEST_CHECK(ring.get_completed_value() == 1);
+    TEST_CHECK(ring.end_frame() == 3);
+}
+
+// Random GPU progress between frames. The fake fence records when each value completed, the slot handed
+// out by begin_frame must have completed the value of the frame that last used it.
+static void test_random_progress()
+{
+    static constexpr uint32_t FRAME_COUNT = 10000;
+    std::mt19937 random(1);
+    for (uint32_t frames_in_flight = 1; frames_in_flight <= 4; ++frames_in_flight)
+    {
+        Fake_Fence fence;
+        Frame_Ring ring(fence, frames_in_flight);
+        std::vector<uint64_t> slot_values(frames_in_flight, 0);
+        uint64_t wait_count = 0;
+        for (uint32_t frame = 0; frame < FRAME_COUNT; ++frame)
+        {
+            auto last_signaled = ring.get_last_signaled_value();
+            if (random() % 2 == 0 && fence.completed_value < last_signaled)
+            {
+                fence.completed_value += 1 + random() % (last_signaled - fence.completed_value);
+            }
+            auto waits_before = fence.waited_values.size();
+            auto completed_before = fence.completed_value;
+            auto slot = ring.begin_frame();
+            TEST_CHECK(slot == frame % frames_in_flight);
+            TEST_CHECK(fence.completed_value >= slot_values[slot]);
+            // A wait only happens when the slot was still pending, and only for the slot's value.
+            bool is_pending = slot_values[slot] > completed_before;
+            TEST_CHECK(fence.waited_values.size() - waits_before == (is_pending ? 1u : 0u));
+            if (is_pending)
+            {
+                TEST_CHECK(fence.waited_values.back() == slot_values[slot]);
+                wait_count += 1;
+            }
+            TEST_CHECK(ring.get_completed_value() <= fence.completed_value);
+            slot_values[slot] = ring.end_frame();
+            TEST_CHECK(ring.get_last_signaled_value() - fence.completed_value <= frames_in_flight);
+        }
+        printf("%u frames in flight: %llu of %u frames waited\n", frames_in_flight, (unsigned long long)wait_count,
+            FRAME_COUNT);
+    }
+}
+
+int main()
+{
+    test_slot_reuse();
+    test_single_slot();
+    test_failed_wait();
+    test_random_progress();
+    return finish_test();
+}
@@ -0,0 +1,447 @@
+#include "gpu_profiler.h"
+#include "test_check.h"
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// The portable half of the GPU profiler: Profiler_Statistics over a wrapping window, Gpu_Profiler handing
+// out scopes and turning resolved query data into results as frame slots are reused, and Chrome_Trace
+// writing JSON that parses back to the names that went in.
+
+static void test_statistics_window()
+{
+    Profiler_Statistics statistics(4);
+    Profiler_Statistics::Summary summary;
+    TEST_CHECK(!statistics.get("pass", summary));
+
+    statistics.add("pass", 10.0);
+    statistics.add("pass", 2.0);
+    TEST_CHECK(statistics.get("pass", summary));
+    TEST_CHECK(summary.sample_count == 2 && summary.last == 2.0);
+    TEST_CHECK(summary.average == 6.0 && summary.minimum == 2.0 && summary.maximum == 10.0);
+
+    // Six samples into a window of four: 10 and 2 fall out, 3, 4, 5 and 1 remain.
+    for (auto value : { 3.0, 4.0, 5.0, 1.0 })
+    {
+        statistics.add("pass", value);
+    }
+    TEST_CHECK(statistics.get("pass", summary));
+    TEST_CHECK(summary.sample_count == 4 && summary.last == 1.0);
+    TEST_CHECK(summary.average == 3.25 && summary.minimum == 1.0 && summary.maximum == 5.0);
+    statistics.add("pass", 7.0);
+    TEST_CHECK(statistics.get("pass", summary));
+    TEST_CHECK(summary.sample_count == 4 && summary.minimum == 1.0 && summary.maximum == 7.0 && summary.average == 4.25);
+
+    // Names are separate series, looked up without building a string.
+    statistics.add(std::string_view("other pass"), 100.0);
+    uint32_t series_count = 0;
+    statistics.for_each([&](std::string_view name, const Profiler_Statistics::Summary& series) {
+        series_count += 1;
+        TEST_CHECK(name == "pass" || (name == "other pass" && series.sample_count == 1 && series.average == 100.0));
+    });
+    TEST_CHECK(series_count == 2);
+    statistics.clear();
+    TEST_CHECK(!statistics.get("pass", summary));
+
+    // A window of 0 still keeps the last sample.
+    Profiler_Statistics single(0);
+    single.add("pass", 1.0);
+    single.add("pass", 9.0);
+    TEST_CHECK(single.get("pass", summary) && summary.sample_count == 1 && summary.average == 9.0);
+}
+
+static void test_profiler_frames()
+{
+    static constexpr uint32_t FRAMES_IN_FLIGHT = 2;
+    static constexpr uint32_t MAX_SCOPES = 3;
+    Gpu_Profiler profiler(FRAMES_IN_FLIGHT, MAX_SCOPES);
+    TEST_CHECK(profiler.get_first_timestamp_query(1) == 2 * MAX_SCOPES);
+    TEST_CHECK(profiler.get_first_statistics_query(1) == MAX_SCOPES);
+
+    // Query data of every slot as the GPU would resolve it, timestamps at 1 MHz.
+    std::vector<uint64_t> timestamps(2 * FRAMES_IN_FLIGHT * MAX_SCOPES, 0);
+    std::vector<Gpu_Pipeline_Statistics> statistics(FRAMES_IN_FLIGHT * MAX_SCOPES, Gpu_Pipeline_Statistics {});
+    auto collect = [&](uint32_t frame_index) {
+        profiler.collect(frame_index,
+            std::span(timestamps).subspan(profiler.get_first_timestamp_query(frame_index), 2 * MAX_SCOPES),
+            std::span(statistics).subspan(profiler.get_first_statistics_query(frame_index), MAX_SCOPES));
+    };
+    Gpu_Clock_Calibration calibration = { .gpu_timestamp = 1000, .gpu_frequency = 1000000, .cpu_time_us = 50.0 };
+
+    profiler.begin_frame(0);
+    TEST_CHECK(profiler.begin_scope("shadows", 0, true) == 0);
+    TEST_CHECK(profiler.begin_scope("async", 1, false) == 1);
+    TEST_CHECK(profiler.begin_scope("lighting", 0, false) == 2);
+    // Full frames drop further scopes instead of writing into the next slot's queries.
+    TEST_CHECK(profiler.begin_scope("overflow", 0, false) == INVALID_GPU_SCOPE);
+    TEST_CHECK(profiler.get_scope_count() == MAX_SCOPES);
+    TEST_CHECK(profiler.has_statistics(0) && !profiler.has_statistics(1));
+
+    // Not resolved yet, nothing to collect.
+    collect(0);
+    TEST_CHECK(profiler.get_results().empty());
+    profiler.end_frame(calibration);
+
+    auto first = profiler.get_first_timestamp_query(0);
+    uint64_t frame_0_timestamps[] = { 1000, 1250, 1100, 1600, 1300, 1300 };
+    std::copy(std::begin(frame_0_timestamps), std::end(frame_0_timestamps), timestamps.begin() + first);
+    statistics[profiler.get_first_statistics_query(0)].cs_invocations = 4096;
+
+    // The next frame records into the other slot while slot 0 is in flight.
+    profiler.begin_frame(1);
+    TEST_CHECK(profiler.get_frame_index() == 1 && profiler.get_scope_count() == 0);
+    TEST_CHECK(profiler.begin_scope("post", 0, false) == 0);
+    profiler.end_frame({ .gpu_timestamp = 0, .gpu_frequency = 2000000, .cpu_time_us = 0.0 });
+    timestamps[profiler.get_first_timestamp_query(1)] = 4000;
+    timestamps[profiler.get_first_timestamp_query(1) + 1] = 5000;
+
+    // Slot 0 retired: its results come back, the slot starts over for the third frame.
+    collect(0);
+    profiler.begin_frame(0);
+    const auto& results = profiler.get_results();
+    TEST_CHECK(results.size() == 3);
+    if (results.size() == 3)
+    {
+        TEST_CHECK(results[0].name == "shadows" && results[0].track == 0);
+        TEST_CHECK(results[0].begin_us == 50.0 && results[0].duration_us == 250.0);
+        TEST_CHECK(results[0].has_statistics && results[0].statistics.cs_invocations == 4096);
+        TEST_CHECK(results[1].name == "async" && results[1].track == 1 && !results[1].has_statistics);
+        TEST_CHECK(results[1].begin_us == 150.0 && results[1].duration_us == 500.0);
+        // An end before or at the begin, as with a reset timestamp counter, is a zero duration.
+        TEST_CHECK(results[2].begin_us == 350.0 && results[2].duration_us == 0.0);
+    }
+    Profiler_Statistics::Summary summary;
+    TEST_CHECK(profiler.get_statistics().get("async", summary) && summary.last == 500.0);
+
+    // Collecting a slot twice does not report its frame again.
+    collect(0);
+    TEST_CHECK(profiler.get_results().size() == 3);
+    TEST_CHECK(profiler.get_statistics().get("async", summary) && summary.sample_count == 1);
+
+    // Slot 1 used its own frequency and calibration.
+    collect(1);
+    TEST_CHECK(profiler.get_results().size() == 1);
+    if (profiler.get_results().size() == 1)
+    {
+        TEST_CHECK(profiler.get_results()[0].begin_us == 2000.0 && profiler.get_results()[0].duration_us == 500.0);
+    }
+
+    // Fewer resolved queries than scopes: only complete pairs and the statistics that exist are used.
+    TEST_CHECK(profiler.begin_scope("a", 0, true) == 0);
+    TEST_CHECK(profiler.begin_scope("b", 0, true) == 1);
+    profiler.end_frame(calibration);
+    profiler.collect(0, std::span(timestamps).subspan(0, 3), std::span(statistics).subspan(0, 0));
+    TEST_CHECK(profiler.get_results().size() == 1);
+    if (profiler.get_results().size() == 1)
+    {
+        TEST_CHECK(profiler.get_results()[0].name == "a" && !profiler.get_results()[0].has_statistics);
+    }
+}
+
+static void test_concurrent_scopes()
+{
+    static constexpr uint32_t THREAD_COUNT = 4;
+    static constexpr uint32_t SCOPES_PER_THREAD = 200;
+    Gpu_Profiler profiler(1, THREAD_COUNT * SCOPES_PER_THREAD - 16);
+    profiler.begin_frame(0);
+    std::vector<std::vector<uint32_t>> scopes(THREAD_COUNT);
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < THREAD_COUNT; ++t)
+    {
+        threads.emplace_back([&, t]() {
+            for (uint32_t i = 0; i < SCOPES_PER_THREAD; ++i)
+            {
+                scopes[t].push_back(profiler.begin_scope("pass " + std::to_string(t), t, false));
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    // Every scope index is handed out once, the ones past the end are refused.
+    std::vector<uint32_t> uses(profiler.get_max_scopes(), 0);
+    uint32_t refused_count = 0;
+    for (const auto& thread_scopes : scopes)
+    {
+        for (auto scope : thread_scopes)
+        {
+            if (scope == INVALID_GPU_SCOPE)
+            {
+                refused_count += 1;
+                continue;
+            }
+            uses[scope] += 1;
+        }
+    }
+    TEST_CHECK(refused_count == 16);
+    TEST_CHECK(std::all_of(uses.begin(), uses.end(), [](uint32_t count) { return count == 1; }));
+    TEST_CHECK(profiler.get_scope_count() == profiler.get_max_scopes());
+}
+
+// Just enough of a JSON parser to check the trace is well formed. Decoded strings are appended to `strings`.
+class Json_Reader
+{
+public:
+    explicit Json_Reader(std::string_view json)
+        : m_json(json)
+    {}
+
+    bool read_document(std::vector<std::string>& strings)
+    {
+        if (!read_value(strings))
+        {
+            return false;
+        }
+        skip_whitespace();
+        return m_position == m_json.size();
+    }
+
+private:
+    void skip_whitespace()
+    {
+        while (m_position < m_json.size() && (m_json[m_position] == ' ' || m_json[m_position] == '\n'
+            || m_json[m_position] == '\r' || m_json[m_position] == '\t'))
+        {
+            m_position += 1;
+        }
+    }
+
+    bool consume(char c)
+    {
+        skip_whitespace();
+        if (m_position < m_json.size() && m_json[m_position] == c)
+        {
+            m_position += 1;
+            return true;
+        }
+        return false;
+    }
+
+    bool read_value(std::vector<std::string>& strings)
+    {
+        skip_whitespace();
+        if (m_position >= m_json.size())
+        {
+            return false;
+        }
+        auto c = m_json[m_position];
+        if (c == '{')
+        {
+            m_position += 1;
+            if (consume('}'))
+            {
+                return true;
+            }
+            do
+            {
+                skip_whitespace();
+                std::string key;
+                if (!read_string(key) || !consume(':') || !read_value(strings))
+                {
+                    return false;
+                }
+            } while (consume(','));
+            return consume('}');
+        }
+        if (c == '[')
+        {
+            m_position += 1;
+            if (consume(']'))
+            {
+                return true;
+            }
+            do
+            {
+                if (!read_value(strings))
+                {
+                    return false;
+                }
+            } while (consume(','));
+            return consume(']');
+        }
+        if (c == '"')
+        {
+            std::string value;
+            if (!read_string(value))
+            {
+                return false;
+            }
+            strings.push_back(std::move(value));
+            return true;
+        }
+        return read_number();
+    }
+
+    bool read_string(std::string& value)
+    {
+        if (m_position >= m_json.size() || m_json[m_position] != '"')
+        {
+            return false;
+        }
+        m_position += 1;
+        while (m_position < m_json.size())
+        {
+            auto c = m_json[m_position++];
+            if (c == '"')
+            {
+                return true;
+            }
+            if (uint8_t(c) < 0x20)
+            {
+                return false;
+            }
+            if (c != '\\')
+            {
+                value += c;
+                continue;
+            }
+            if (m_position >= m_json.size())
+            {
+                return false;
+            }
+            switch (m_json[m_position++])
+            {
+            case '"':
+                value += '"';
+                break;
+            case '\\':
+                value += '\\';
+                break;
+            case '/':
+                value += '/';
+                break;
+            case 'n':
+                value += '\n';
+                break;
+            case 't':
+                value += '\t';
+                break;
+            case 'r':
+                value += '\r';
+                break;
+            case 'b':
+                value += '\b';
+                break;
+            case 'f':
+                value += '\f';
+                break;
+            case 'u':
+            {
+                if (m_position + 4 > m_json.size())
+                {
+                    return false;
+                }
+                // The trace only escapes control characters this way.
+                auto code = std::stoul(std::string(m_json.substr(m_position, 4)), nullptr, 16);
+                if (code >= 0x80)
+                {
+                    return false;
+                }
+                value += char(code);
+                m_position += 4;
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+        return false;
+    }
+
+    bool read_number()
+    {
+        auto begin = m_position;
+        if (m_position < m_json.size() && m_json[m_position] == '-')
+        {
+            m_position += 1;
+        }
+        auto digits = [this]() {
+            auto first = m_position;
+            while (m_position < m_json.size() && m_json[m_position] >= '0' && m_json[m_position] <= '9')
+            {
+                m_position += 1;
+            }
+            return m_position > first;
+        };
+        if (!digits())
+        {
+            return false;
+        }
+        if (m_position < m_json.size() && m_json[m_position] == '.' && (m_position += 1, !digits()))
+        {
+            return false;
+        }
+        return m_position > begin;
+    }
+
+    std::string_view m_json;
+    size_t m_position = 0;
+};
+
+static void test_trace_json()
+{
+    Chrome_Trace trace;
+    TEST_CHECK(trace.get_event_count() == 0);
+    std::vector<std::string> strings;
+    TEST_CHECK(Json_Reader(trace.to_json()).read_document(strings));
+
+    const std::string names[] = {
+        "plain",
+        "quote \" and backslash \\",
+        "new\nline and\ttab",
+        "control \x01 \x1f and \r",
+        "utf-8 \xc3\xa4\xe2\x82\xac",
+        ""
+    };
+    trace.set_process_name(0, "CPU \"main\"");
+    trace.set_thread_name(0, 3, "worker\\3");
+    for (uint32_t i = 0; i < std::size(names); ++i)
+    {
+        trace.add_complete(names[i], "cat\"egory", 1, i, 1234.5 + i, 0.25);
+    }
+    TEST_CHECK(trace.get_event_count() == 2 + std::size(names));
+
+    strings.clear();
+    auto json = trace.to_json();
+    TEST_CHECK(Json_Reader(json).read_document(strings));
+    auto contains = [&](std::string_view value) { return std::find(strings.begin(), strings.end(), value) != strings.end(); };
+    TEST_CHECK(contains("CPU \"main\"") && contains("worker\\3") && contains("cat\"egory"));
+    TEST_CHECK(contains("process_name") && contains("thread_name"));
+    for (const auto& name : names)
+    {
+        TEST_CHECK(contains(name));
+    }
+    TEST_CHECK(json.find("\"ts\":1234.500,\"dur\":0.250") != std::string::npos);
+
+    // A Gpu_Profiler frame lands in the trace as complete events on its track.
+    Gpu_Profiler profiler(1, 2);
+    profiler.begin_frame(0);
+    profiler.begin_scope("gpu \"pass\"", 1, false);
+    profiler.end_frame({ .gpu_timestamp = 0, .gpu_frequency = 1000000, .cpu_time_us = 10.0 });
+    uint64_t timestamps[] = { 5, 25, 0, 0 };
+    profiler.collect(0, timestamps, {});
+    Chrome_Trace gpu_trace;
+    profiler.write_trace(gpu_trace, 7);
+    json = gpu_trace.to_json();
+    strings.clear();
+    TEST_CHECK(gpu_trace.get_event_count() == 1);
+    TEST_CHECK(Json_Reader(json).read_document(strings) && contains("gpu \"pass\"") && contains("gpu"));
+    TEST_CHECK(json.find("\"pid\":7,\"tid\":1,\"ts\":15.000,\"dur\":20.000") != std::string::npos);
+
+    trace.clear();
+    TEST_CHECK(trace.get_event_count() == 0);
+}
+
+int main()
+{
+    test_statistics_window();
+    test_profiler_frames();
+    test_concurrent_scopes();
+    test_trace_json();
+    return finish_test();
+}
@@ -0,0 +1,273 @@
+#include "indirect_arguments.h"
+#include "test_check.h"
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <span>
+#include <vector>
+
+// Indirect command layouts, the CPU writer and the ExecuteIndirect model: signature rules build() has to
+// reject, replay of constants and actions with and without a count buffer, and the streams the model has
+// to refuse before running anything, misaligned offsets, commands or counts out of bounds and dispatches
+// over the group limit. Ends with the per-frame argument allocator.
+
+struct Push_Constants
+{
+    uint32_t values[4];
+};
+
+// Records the calls of a replay: root constants as 'c' (compute) or 'g' (graphics), dispatches as 'd', draws as 'v'.
+struct Recording_Visitor
+{
+    struct Call
+    {
+        char kind;
+        uint32_t root_parameter_index;
+        uint32_t dest_offset;
+        std::vector<uint32_t> values;
+    };
+
+    void set_root_constants(Command_Stream_Bind_Point bind_point, uint32_t root_parameter_index,
+        std::span<const uint32_t> values, uint32_t dest_offset)
+    {
+        calls.push_back({ bind_point == Command_Stream_Bind_Point::Compute ? 'c' : 'g', root_parameter_index,
+            dest_offset, { values.begin(), values.end() } });
+    }
+
+    void dispatch(uint32_t x, uint32_t y, uint32_t z) { calls.push_back({ 'd', 0, 0, { x, y, z } }); }
+
+    void draw(const Indirect_Draw_Arguments& draw)
+    {
+        calls.push_back({ 'v', 0, 0, { draw.vertex_count_per_instance, draw.instance_count } });
+    }
+
+    std::vector<Call> calls;
+};
+
+template<typename Function>
+static bool throws(Function&& function)
+{
+    try
+    {
+        function();
+    }
+    catch (const std::exception&)
+    {
+        return true;
+    }
+    return false;
+}
+
+static Indirect_Command_Layout make_dispatch_layout(uint32_t byte_stride = 0)
+{
+    return Indirect_Command_Layout_Builder()
+        .add_constants<Push_Constants>(1)
+        .add_dispatch()
+        .set_byte_stride(byte_stride)
+        .build();
+}
+
+static void test_layouts()
+{
+    auto layout = make_dispatch_layout();
+    TEST_CHECK(layout.arguments.size() == 2 && layout.is_compute() && layout.needs_root_signature());
+    TEST_CHECK(layout.arguments[0].byte_offset == 0 && layout.arguments[1].byte_offset == 16);
+    TEST_CHECK(layout.byte_stride == 16 + sizeof(Dispatch_Size));
+    TEST_CHECK(make_dispatch_layout(64).byte_stride == 64);
+
+    auto draw = Indirect_Command_Layout_Builder().add_draw_indexed().build();
+    TEST_CHECK(!draw.is_compute() && !draw.needs_root_signature());
+    TEST_CHECK(draw.byte_stride == sizeof(Indirect_Draw_Indexed_Arguments));
+
+    // Invalid signatures: no arguments, no action, an action that isn't last or a second action,
+    // empty or out of range constants, and strides that are too small or not DWORD multiples.
+    TEST_CHECK(throws([] { Indirect_Command_Layout_Builder().build(); }));
+    TEST_CHECK(throws([] { Indirect_Command_Layout_Builder().add_constants(0, 0, 4).build(); }));
+    TEST_CHECK(throws([] { Indirect_Command_Layout_Builder().add_dispatch().add_constants(0, 0, 4).build(); }));
+    TEST_CHECK(throws([] { Indirect_Command_Layout_Builder().add_draw().add_dispatch().build(); }));
+    TEST_CHECK(throws([] { Indirect_Command_Layout_Builder().add_constants(0, 0, 0).add_dispatch().build(); }));
+    TEST_CHECK(throws([] { Indirect_Command_Layout_Builder().add_constants(0, MAX_ROOT_CONSTANTS - 1, 2).add_dispatch().build(); }));
+    TEST_CHECK(throws([] { Indirect_Command_Layout_Builder().add_constants(0, MAX_ROOT_CONSTANTS + 1, 1).add_dispatch().build(); }));
+    TEST_CHECK(!throws([] { Indirect_Command_Layout_Builder().add_constants(0, MAX_ROOT_CONSTANTS - 1, 1).add_dispatch().build(); }));
+    TEST_CHECK(throws([] { make_dispatch_layout(24); }));
+    TEST_CHECK(throws([] { make_dispatch_layout(30); }));
+}
+
+static void test_writer()
+{
+    auto layout = make_dispatch_layout();
+    std::vector<uint8_t> commands(2 * layout.byte_stride + 3);
+    Indirect_Command_Writer writer(layout, commands);
+    TEST_CHECK(writer.get_command_capacity() == 2);
+    writer.write_constants(1, 0, Push_Constants { { 1, 2, 3, 4 } });
+    writer.write_dispatch(1, { 5, 6, 7 });
+    uint32_t values[7];
+    memcpy(values, commands.data() + layout.byte_stride, sizeof(values));
+    TEST_CHECK(values[0] == 1 && values[3] == 4 && values[4] == 5 && values[6] == 7);
+
+    // Wrong argument types, wrong value counts and commands past the capacity.
+    TEST_CHECK(throws([&] { writer.write_draw(0, {}); }));
+    TEST_CHECK(throws([&] { writer.write_constant_values(0, 1, std::vector<uint32_t>(3)); }));
+    TEST_CHECK(throws([&] { writer.write_constant_values(0, 0, std::vector<uint32_t>(3)); }));
+    TEST_CHECK(throws([&] { writer.write_dispatch(2, { 1, 1, 1 }); }));
+}
+
+static void test_execute()
+{
+    auto layout = make_dispatch_layout(32);
+    std::vector<uint8_t> arguments(3 * layout.byte_stride);
+    Indirect_Command_Writer writer(layout, arguments);
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        writer.write_constants(i, 0, Push_Constants { { i, 10 + i, 20 + i, 30 + i } });
+        writer.write_dispatch(i, { 1 + i, 2, 3 });
+    }
+
+    Recording_Visitor visitor;
+    auto result = execute_indirect_commands(visitor, layout, arguments, 0, 3);
+    TEST_CHECK(result.is_valid() && result.command == 3);
+    TEST_CHECK(visitor.calls.size() == 6);
+    for (uint32_t i = 0; i < 3 && visitor.calls.size() == 6; ++i)
+    {
+        const auto& constants = visitor.calls[2 * i];
+        TEST_CHECK(constants.kind == 'c' && constants.root_parameter_index == 1 && constants.dest_offset == 0);
+        TEST_CHECK((constants.values == std::vector<uint32_t> { i, 10 + i, 20 + i, 30 + i }));
+        TEST_CHECK(visitor.calls[2 * i + 1].kind == 'd');
+        TEST_CHECK((visitor.calls[2 * i + 1].values == std::vector<uint32_t> { 1 + i, 2, 3 }));
+    }
+
+    // The count buffer lowers the number of commands, never raises it past max_command_count.
+    std::vector<uint8_t> count(12, 0);
+    uint32_t count_value = 2;
+    memcpy(count.data() + 8, &count_value, sizeof(count_value));
+    visitor.calls.clear();
+    result = execute_indirect_commands(visitor, layout, arguments, 0, 3, count, 8);
+    TEST_CHECK(result.is_valid() && result.command == 2 && visitor.calls.size() == 4);
+    count_value = 100;
+    memcpy(count.data() + 8, &count_value, sizeof(count_value));
+    TEST_CHECK(validate_indirect_commands(layout, arguments, 0, 3, count, 8).command == 3);
+    count_value = 0;
+    memcpy(count.data() + 8, &count_value, sizeof(count_value));
+    visitor.calls.clear();
+    result = execute_indirect_commands(visitor, layout, arguments, 0, 3, count, 8);
+    TEST_CHECK(result.is_valid() && result.command == 0 && visitor.calls.empty());
+
+    // Commands starting at an offset, the last one only needs its arguments and not the stride padding.
+    std::vector<uint8_t> shifted(4 + layout.byte_stride + layout.get_action().byte_offset + sizeof(Dispatch_Size));
+    memcpy(shifted.data() + 4, arguments.data(), shifted.size() - 4);
+    TEST_CHECK(validate_indirect_commands(layout, shifted, 4, 2).command == 2);
+
+    // Draws go to draw(), a visitor without a call for an argument skips it.
+    auto draw_layout = Indirect_Command_Layout_Builder().add_draw().build();
+    std::vector<uint8_t> draws(draw_layout.byte_stride);
+    Indirect_Command_Writer(draw_layout, draws).write_draw(0, { 3, 2, 0, 0 });
+    visitor.calls.clear();
+    TEST_CHECK(execute_indirect_commands(visitor, draw_layout, draws, 0, 1).is_valid());
+    TEST_CHECK(visitor.calls.size() == 1 && visitor.calls[0].kind == 'v' && visitor.calls[0].values[0] == 3);
+    struct Dispatch_Only
+    {
+        uint32_t dispatch_count = 0;
+        void dispatch(uint32_t, uint32_t, uint32_t) { dispatch_count += 1; }
+    } dispatch_only;
+    TEST_CHECK(execute_indirect_commands(dispatch_only, draw_layout, draws, 0, 1).is_valid());
+    TEST_CHECK(execute_indirect_commands(dispatch_only, layout, arguments, 0, 3).is_valid());
+    TEST_CHECK(dispatch_only.dispatch_count == 3);
+}
+
+// Invalid streams report the error and the failing command and run nothing, not even the valid commands
+// before it.
+static void test_invalid_streams()
+{
+    auto layout = make_dispatch_layout();
+    std::vector<uint8_t> arguments(4 * layout.byte_stride);
+    Indirect_Command_Writer writer(layout, arguments);
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        writer.write_constants(i, 0, Push_Constants { { i, i, i, i } });
+        writer.write_dispatch(i, { 1, 1, 1 });
+    }
+    std::vector<uint8_t> count(8, 0);
+    uint32_t count_value = 4;
+    memcpy(count.data(), &count_value, sizeof(count_value));
+    Recording_Visitor visitor;
+    auto check_error = [&](Indirect_Result result, Indirect_Error error, uint32_t command) {
+        TEST_CHECK(result.error == error && result.command == command && !result.is_valid());
+        TEST_CHECK(visitor.calls.empty());
+    };
+
+    // Misaligned argument and count offsets.
+    check_error(execute_indirect_commands(visitor, layout, arguments, 2, 1), Indirect_Error::Misaligned_Offset, 0);
+    check_error(execute_indirect_commands(visitor, layout, arguments, 0, 1, count, 2), Indirect_Error::Misaligned_Offset, 0);
+
+    // More commands than the buffer holds, an offset past its end, and counts outside the count buffer.
+    check_error(execute_indirect_commands(visitor, layout, arguments, 0, 5), Indirect_Error::Out_Of_Bounds, 4);
+    check_error(execute_indirect_commands(visitor, layout, arguments, layout.byte_stride, 4), Indirect_Error::Out_Of_Bounds, 3);
+    check_error(execute_indirect_commands(visitor, layout, arguments, arguments.size() + 4, 1), Indirect_Error::Out_Of_Bounds, 0);
+    check_error(execute_indirect_commands(visitor, layout, arguments, 0, 4, count, 8), Indirect_Error::Out_Of_Bounds, 0);
+    check_error(execute_indirect_commands(visitor, layout, arguments, 0, 4, count, 12), Indirect_Error::Out_Of_Bounds, 0);
+    check_error(execute_indirect_commands(visitor, layout, arguments, 0, 4, std::span(count.data(), 3)), Indirect_Error::Out_Of_Bounds, 0);
+    // A count that is in range for max_command_count but not for the buffer.
+    count_value = 5;
+    memcpy(count.data(), &count_value, sizeof(count_value));
+    check_error(execute_indirect_commands(visitor, layout, arguments, 0, 8, count), Indirect_Error::Out_Of_Bounds, 4);
+    // Zero commands never touch the arguments, even at an offset past the end.
+    TEST_CHECK(validate_indirect_commands(layout, arguments, arguments.size() + 4, 0).is_valid());
+
+    // Dispatches over COMPUTE_MAX_GROUP_COUNT in any dimension, the limit itself is fine.
+    writer.write_dispatch(3, { COMPUTE_MAX_GROUP_COUNT, COMPUTE_MAX_GROUP_COUNT, COMPUTE_MAX_GROUP_COUNT });
+    TEST_CHECK(validate_indirect_commands(layout, arguments, 0, 4).is_valid());
+    for (uint32_t dimension = 0; dimension < 3; ++dimension)
+    {
+        Dispatch_Size dispatch_size = { 1, 1, 1 };
+        (dimension == 0 ? dispatch_size.x : dimension == 1 ? dispatch_size.y : dispatch_size.z) = COMPUTE_MAX_GROUP_COUNT + 1;
+        writer.write_dispatch(2, dispatch_size);
+        check_error(execute_indirect_commands(visitor, layout, arguments, 0, 4), Indirect_Error::Dispatch_Too_Large, 2);
+    }
+    // Commands past the count aren't executed, so they aren't validated either.
+    count_value = 2;
+    memcpy(count.data(), &count_value, sizeof(count_value));
+    TEST_CHECK(execute_indirect_commands(visitor, layout, arguments, 0, 4, count).command == 2);
+}
+
+static void test_argument_allocator()
+{
+    auto layout = make_dispatch_layout();
+    Indirect_Argument_Allocator allocator(1024);
+    // 16 bytes of count plus 10 commands of 28 bytes, three fit into the ring.
+    std::vector<Indirect_Argument_Allocation> allocations;
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        auto allocation = allocator.allocate(layout, 10);
+        TEST_CHECK(allocation.is_valid() && allocation.max_command_count == 10);
+        TEST_CHECK(allocation.count_offset % INDIRECT_ARGUMENT_ALIGNMENT == 0);
+        TEST_CHECK(allocation.argument_offset == allocation.count_offset + INDIRECT_ARGUMENT_ALIGNMENT);
+        TEST_CHECK(allocation.argument_offset + 10 * layout.byte_stride <= 1024);
+        allocations.push_back(allocation);
+    }
+    TEST_CHECK(!allocator.allocate(layout, 10).is_valid());
+    auto count_offsets = allocator.take_count_offsets();
+    TEST_CHECK(count_offsets.size() == 3);
+    for (uint32_t i = 0; i < 3 && count_offsets.size() == 3; ++i)
+    {
+        TEST_CHECK(count_offsets[i] == allocations[i].count_offset);
+    }
+    TEST_CHECK(allocator.take_count_offsets().empty());
+
+    // Space comes back once the frame retired.
+    allocator.end_frame(1);
+    allocator.retire(0);
+    TEST_CHECK(!allocator.allocate(layout, 10).is_valid());
+    allocator.retire(1);
+    TEST_CHECK(allocator.allocate(layout, 10).is_valid());
+    TEST_CHECK(allocator.take_count_offsets().size() == 1);
+}
+
+int main()
+{
+    test_layouts();
+    test_writer();
+    test_execute();
+    test_invalid_streams();
+    test_argument_allocator();
+    return finish_test();
+}
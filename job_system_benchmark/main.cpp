@@ -0,0 +1,184 @@
+#include "job_system.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// Throughput and latency of Job_System: tiny jobs submitted from the main thread and fanned out from
+// inside jobs, the delay from submit() until a job starts, and pass-sized jobs against running them
+// serially. Also checks that every thread gets its own thread index.
+
+static constexpr uint32_t JOB_COUNT = 1u << 17;
+static constexpr uint32_t LATENCY_SAMPLE_COUNT = 2000;
+static constexpr uint32_t PASS_COUNT = 64;
+
+using Clock = std::chrono::steady_clock;
+
+static double get_ms(Clock::time_point begin, Clock::time_point end)
+{
+    return std::chrono::duration<double, std::milli>(end - begin).count();
+}
+
+// About `iterations` times a few nanoseconds of work the optimizer can't remove.
+static uint64_t spin(uint64_t iterations)
+{
+    uint64_t value = iterations;
+    for (uint64_t i = 0; i < iterations; ++i)
+    {
+        value = value * 6364136223846793005ull + 1442695040888963407ull;
+    }
+    return value;
+}
+
+int main()
+{
+    Job_System job_system(Job_System::get_default_worker_count(), 2);
+    printf("%u workers, %u thread indices\n", job_system.get_worker_count(), job_system.get_thread_count());
+    bool success = true;
+    std::atomic<uint64_t> executed = 0;
+
+    // Tiny jobs pushed by the main thread into the shared queue.
+    {
+        Job_Counter counter;
+        auto begin = Clock::now();
+        for (uint32_t i = 0; i < JOB_COUNT; ++i)
+        {
+            job_system.submit([&executed]() { executed.fetch_add(1, std::memory_order_relaxed); }, &counter);
+        }
+        job_system.wait(counter);
+        auto ms = get_ms(begin, Clock::now());
+        success = success && executed == JOB_COUNT;
+        printf("submit from main:   %8.0f jobs/ms\n", JOB_COUNT / ms);
+    }
+
+    // Jobs that submit their children into the worker's own queue, idle workers steal them.
+    {
+        static constexpr uint32_t PARENT_COUNT = 256;
+        executed = 0;
+        Job_Counter counter;
+        auto begin = Clock::now();
+        for (uint32_t i = 0; i < PARENT_COUNT; ++i)
+        {
+            job_system.submit([&]() {
+                for (uint32_t j = 0; j < JOB_COUNT / PARENT_COUNT; ++j)
+                {
+                    job_system.submit([&executed]() { executed.fetch_add(1, std::memory_order_relaxed); }, &counter);
+                }
+            }, &counter);
+        }
+        job_system.wait(counter);
+        auto ms = get_ms(begin, Clock::now());
+        success = success && executed == JOB_COUNT;
+        printf("fan out from jobs:  %8.0f jobs/ms\n", JOB_COUNT / ms);
+    }
+
+    // Delay until a single job starts, with the workers idle in between like at the start of a frame.
+    {
+        std::vector<double> start_us;
+        std::vector<double> round_trip_us;
+        for (uint32_t i = 0; i < LATENCY_SAMPLE_COUNT; ++i)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+            Job_Counter counter;
+            Clock::time_point started;
+            auto submitted = Clock::now();
+            job_system.submit([&started]() { started = Clock::now(); }, &counter);
+            job_system.wait(counter);
+            auto done = Clock::now();
+            start_us.push_back(get_ms(submitted, started) * 1000.0);
+            round_trip_us.push_back(get_ms(submitted, done) * 1000.0);
+        }
+        std::sort(start_us.begin(), start_us.end());
+        std::sort(round_trip_us.begin(), round_trip_us.end());
+        auto percentile = [](const std::vector<double>& values, double p) { return values[size_t(p * (values.size() - 1))]; };
+        printf("submit to start:    p50 %6.1f us, p99 %6.1f us\n", percentile(start_us, 0.5), percentile(start_us, 0.99));
+        printf("submit and wait:    p50 %6.1f us, p99 %6.1f us\n", percentile(round_trip_us, 0.5), percentile(round_trip_us, 0.99));
+    }
+
+    // Independent passes of roughly 50 us each, like recording a frame.
+    {
+        static constexpr uint64_t PASS_ITERATIONS = 20000;
+        std::vector<uint64_t> results(PASS_COUNT);
+        auto serial_begin = Clock::now();
+        for (uint32_t i = 0; i < PASS_COUNT; ++i)
+        {
+            results[i] = spin(PASS_ITERATIONS + i);
+        }
+        auto serial_ms = get_ms(serial_begin, Clock::now());
+        std::vector<uint64_t> parallel_results(PASS_COUNT);
+        Job_Counter counter;
+        auto parallel_begin = Clock::now();
+        for (uint32_t i = 0; i < PASS_COUNT; ++i)
+        {
+            job_system.submit([&parallel_results, i]() { parallel_results[i] = spin(PASS_ITERATIONS + i); }, &counter);
+        }
+        job_system.wait(counter);
+        auto parallel_ms = get_ms(parallel_begin, Clock::now());
+        success = success && results == parallel_results;
+        printf("%u passes:          serial %.2f ms, jobs %.2f ms, %.2fx\n", PASS_COUNT, serial_ms, parallel_ms, serial_ms / parallel_ms);
+    }
+
+    // Every worker, the main thread and each registered thread has its own index.
+    {
+        std::vector<std::atomic<uint32_t>> uses(job_system.get_thread_count());
+        Job_Counter counter;
+        for (uint32_t i = 0; i < 1024; ++i)
+        {
+            job_system.submit([&uses]() { uses[Job_System::get_thread_index()].fetch_add(1); }, &counter);
+        }
+        // The main thread helps while waiting, so its jobs land in index 0 together with the workers'.
+        job_system.wait(counter);
+        uint32_t job_uses = 0;
+        for (uint32_t i = 0; i <= job_system.get_worker_count(); ++i)
+        {
+            job_uses += uses[i];
+        }
+        std::atomic<bool> is_registration_ok = true;
+        std::vector<std::thread> threads;
+        for (uint32_t i = 0; i < 2; ++i)
+        {
+            threads.emplace_back([&]() {
+                auto index = job_system.register_thread();
+                is_registration_ok = is_registration_ok && index == Job_System::get_thread_index() && index > job_system.get_worker_count();
+                uses[index].fetch_add(1);
+            });
+        }
+        // A third thread is over the limit, an unregistered one has no index at all.
+        threads.emplace_back([&]() {
+            bool is_unregistered_rejected = false;
+            try
+            {
+                Job_System::get_thread_index();
+            }
+            catch (const std::exception&)
+            {
+                is_unregistered_rejected = true;
+            }
+            is_registration_ok = is_registration_ok && is_unregistered_rejected;
+        });
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+        bool is_over_limit_rejected = false;
+        std::thread([&]() {
+            try
+            {
+                job_system.register_thread();
+            }
+            catch (const std::exception&)
+            {
+                is_over_limit_rejected = true;
+            }
+        }).join();
+        auto extra_begin = job_system.get_worker_count() + 1;
+        success = success && is_registration_ok && is_over_limit_rejected
+            && job_uses == 1024 && uses[extra_begin] == 1 && uses[extra_begin + 1] == 1;
+    }
+
+    printf("%s\n", success ? "ok" : "FAILED");
+    return success ? 0 : 1;
+}
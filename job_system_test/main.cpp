@@ -0,0 +1,109 @@
+#include "job_system.h"
+#include "test_check.h"
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+// Job_System counters with jobs that throw: wait() still returns once every job ran, rethrows the first
+// exception, and the counter works again afterwards. Exceptions from the main thread's own share of the
+// jobs and from workers take the same path.
+
+static constexpr uint32_t JOB_COUNT = 4096;
+
+static void test_counter()
+{
+    Job_System job_system(3);
+    std::atomic<uint32_t> executed = 0;
+    Job_Counter counter;
+    TEST_CHECK(counter.is_done());
+    for (uint32_t i = 0; i < JOB_COUNT; ++i)
+    {
+        job_system.submit([&executed]() { executed.fetch_add(1, std::memory_order_relaxed); }, &counter);
+    }
+    job_system.wait(counter);
+    TEST_CHECK(counter.is_done() && executed == JOB_COUNT);
+}
+
+static void test_throwing_jobs()
+{
+    for (uint32_t worker_count : { 0u, 1u, 3u })
+    {
+        Job_System job_system(worker_count);
+        std::atomic<uint32_t> executed = 0;
+        Job_Counter counter;
+        for (uint32_t i = 0; i < JOB_COUNT; ++i)
+        {
+            job_system.submit([&executed, i]() {
+                executed.fetch_add(1, std::memory_order_relaxed);
+                if (i % 97 == 5)
+                {
+                    throw std::runtime_error(std::to_string(i));
+                }
+            }, &counter);
+        }
+        // Every job runs even though some throw, and the waiter gets one of the exceptions.
+        bool threw = false;
+        try
+        {
+            job_system.wait(counter);
+        }
+        catch (const std::runtime_error& error)
+        {
+            threw = std::stoul(error.what()) % 97 == 5;
+        }
+        TEST_CHECK(threw);
+        TEST_CHECK(counter.is_done() && executed == JOB_COUNT);
+
+        // The exception was handed out, the same counter waits cleanly for the next batch.
+        for (uint32_t i = 0; i < JOB_COUNT; ++i)
+        {
+            job_system.submit([&executed]() { executed.fetch_add(1, std::memory_order_relaxed); }, &counter);
+        }
+        threw = false;
+        try
+        {
+            job_system.wait(counter);
+        }
+        catch (const std::exception&)
+        {
+            threw = true;
+        }
+        TEST_CHECK(!threw);
+        TEST_CHECK(executed == 2 * JOB_COUNT);
+    }
+}
+
+// A job that throws while its children are still queued on the same counter.
+static void test_nested()
+{
+    Job_System job_system(2);
+    std::atomic<uint32_t> executed = 0;
+    Job_Counter counter;
+    job_system.submit([&]() {
+        for (uint32_t i = 0; i < JOB_COUNT; ++i)
+        {
+            job_system.submit([&executed]() { executed.fetch_add(1, std::memory_order_relaxed); }, &counter);
+        }
+        throw std::runtime_error("parent");
+    }, &counter);
+    bool threw = false;
+    try
+    {
+        job_system.wait(counter);
+    }
+    catch (const std::runtime_error&)
+    {
+        threw = true;
+    }
+    TEST_CHECK(threw);
+    TEST_CHECK(counter.is_done() && executed == JOB_COUNT);
+}
+
+int main()
+{
+    test_counter();
+    test_throwing_jobs();
+    test_nested();
+    return finish_test();
+}
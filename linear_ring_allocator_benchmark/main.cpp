@@ -0,0 +1,250 @@
+#include "linear_ring_allocator.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Allocation cost of Linear_Ring_Allocator in the frame loop of the upload ring: constant buffer sized
+// allocations on one thread and contended from several recording threads, against the same bump behind
+// a mutex, and the space lost to padding with mixed sizes. A simulated GPU retires frames GPU_LATENCY
+// frames late and every allocation is checked against the bytes still in flight.
+
+static constexpr uint64_t CAPACITY = 4ull << 20;
+// Frames the simulated GPU lags behind, like MAX_FRAMES_IN_FLIGHT.
+static constexpr uint64_t GPU_LATENCY = 2;
+static constexpr uint32_t FRAME_COUNT = 256;
+static constexpr uint64_t CONSTANTS_SIZE = 256;
+static constexpr uint32_t THREAD_COUNT = 4;
+
+using Clock = std::chrono::steady_clock;
+
+static double get_ns(Clock::time_point begin, Clock::time_point end)
+{
+    return std::chrono::duration<double, std::nano>(end - begin).count();
+}
+
+// Bytes owned by frames the simulated GPU has not completed yet.
+class Ownership_Check
+{
+public:
+    explicit Ownership_Check(uint64_t capacity)
+        : m_frames(capacity, 0)
+    {}
+
+    bool claim(uint64_t offset, uint64_t size, uint64_t frame, uint64_t completed_frame)
+    {
+        if (offset + size > m_frames.size())
+        {
+            return false;
+        }
+        for (uint64_t i = offset; i < offset + size; ++i)
+        {
+            if (m_frames[i] > completed_frame)
+            {
+                return false;
+            }
+            m_frames[i] = frame;
+        }
+        return true;
+    }
+
+private:
+    std::vector<uint64_t> m_frames;
+};
+
+// Runs FRAME_COUNT frames that each call `allocate_frame(frame)`, retiring frames GPU_LATENCY late.
+template<typename Allocate_Frame>
+static void run_frames(Linear_Ring_Allocator& allocator, Allocate_Frame allocate_frame)
+{
+    for (uint64_t frame = 1; frame <= FRAME_COUNT; ++frame)
+    {
+        allocator.retire(frame > GPU_LATENCY ? frame - GPU_LATENCY - 1 : 0);
+        allocate_frame(frame);
+        allocator.end_frame(frame);
+    }
+}
+
+int main()
+{
+    bool success = true;
+
+    // One thread, constant buffers only, with every allocation checked against the frames in flight.
+    {
+        static constexpr uint32_t ALLOCATIONS_PER_FRAME = 4096;
+        Linear_Ring_Allocator allocator(CAPACITY);
+        Ownership_Check ownership(CAPACITY);
+        uint64_t failed = 0;
+        run_frames(allocator, [&](uint64_t frame) {
+            auto completed_frame = frame > GPU_LATENCY ? frame - GPU_LATENCY - 1 : 0;
+            for (uint32_t i = 0; i < ALLOCATIONS_PER_FRAME; ++i)
+            {
+                auto offset = allocator.allocate(CONSTANTS_SIZE, CONSTANTS_SIZE);
+                failed += offset == INVALID_RING_OFFSET;
+                success = success && (offset == INVALID_RING_OFFSET || ownership.claim(offset, CONSTANTS_SIZE, frame, completed_frame));
+            }
+        });
+        success = success && failed == 0;
+
+        Linear_Ring_Allocator timed_allocator(CAPACITY);
+        uint64_t checksum = 0;
+        auto begin = Clock::now();
+        run_frames(timed_allocator, [&](uint64_t) {
+            for (uint32_t i = 0; i < ALLOCATIONS_PER_FRAME; ++i)
+            {
+                checksum += timed_allocator.allocate(CONSTANTS_SIZE, CONSTANTS_SIZE);
+            }
+        });
+        auto ns = get_ns(begin, Clock::now());
+        printf("1 thread:           %6.2f ns per allocation (checksum %llu)\n",
+            ns / (double(FRAME_COUNT) * ALLOCATIONS_PER_FRAME), (unsigned long long)checksum);
+    }
+
+    // Recording threads allocating at the same time, lock-free against a mutex around the same bump.
+    // Each thread times its own loop once all are started, a frame costs as much as its slowest thread.
+    {
+        static constexpr uint32_t ALLOCATIONS_PER_THREAD = 1024;
+        auto run_threads = [](auto allocate) {
+            std::atomic<uint32_t> ready = 0;
+            std::vector<double> thread_ns(THREAD_COUNT);
+            std::vector<std::thread> threads;
+            for (uint32_t t = 0; t < THREAD_COUNT; ++t)
+            {
+                threads.emplace_back([&, t]() {
+                    ready.fetch_add(1);
+                    while (ready.load() < THREAD_COUNT)
+                    {
+                        std::this_thread::yield();
+                    }
+                    auto begin = Clock::now();
+                    for (uint32_t i = 0; i < ALLOCATIONS_PER_THREAD; ++i)
+                    {
+                        allocate(t);
+                    }
+                    thread_ns[t] = get_ns(begin, Clock::now());
+                });
+            }
+            for (auto& thread : threads)
+            {
+                thread.join();
+            }
+            return *std::max_element(thread_ns.begin(), thread_ns.end());
+        };
+
+        Linear_Ring_Allocator allocator(CAPACITY);
+        std::vector<std::vector<uint64_t>> offsets(THREAD_COUNT, std::vector<uint64_t>(ALLOCATIONS_PER_THREAD));
+        std::vector<uint32_t> counts(THREAD_COUNT);
+        Ownership_Check ownership(CAPACITY);
+        double ns = 0.0;
+        run_frames(allocator, [&](uint64_t frame) {
+            std::fill(counts.begin(), counts.end(), 0);
+            ns += run_threads([&](uint32_t t) { offsets[t][counts[t]++] = allocator.allocate(CONSTANTS_SIZE, CONSTANTS_SIZE); });
+            auto completed_frame = frame > GPU_LATENCY ? frame - GPU_LATENCY - 1 : 0;
+            for (const auto& thread_offsets : offsets)
+            {
+                for (auto offset : thread_offsets)
+                {
+                    success = success && offset != INVALID_RING_OFFSET && ownership.claim(offset, CONSTANTS_SIZE, frame, completed_frame);
+                }
+            }
+        });
+
+        std::mutex mutex;
+        uint64_t head = 0;
+        double mutex_ns = 0.0;
+        for (uint32_t frame = 0; frame < FRAME_COUNT; ++frame)
+        {
+            mutex_ns += run_threads([&](uint32_t) {
+                std::scoped_lock lock(mutex);
+                head = (head + CONSTANTS_SIZE) % CAPACITY;
+            });
+        }
+        auto allocation_count = double(FRAME_COUNT) * THREAD_COUNT * ALLOCATIONS_PER_THREAD;
+        printf("%u threads:          %6.2f ns per allocation, mutex %6.2f ns\n", THREAD_COUNT, ns / allocation_count, mutex_ns / allocation_count);
+    }
+
+    // Mixed sizes and alignments like instance data, constants and texture staging.
+    {
+        struct Request
+        {
+            uint64_t size;
+            uint64_t alignment;
+        };
+        std::mt19937 random(7);
+        std::vector<Request> requests;
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            switch (random() % 4)
+            {
+            case 0:
+                requests.push_back({ 16 + random() % 1024, 16 });
+                break;
+            case 1:
+                requests.push_back({ CONSTANTS_SIZE, CONSTANTS_SIZE });
+                break;
+            case 2:
+                requests.push_back({ 64 + random() % 4096, 256 });
+                break;
+            default:
+                requests.push_back({ 512 + random() % 16384, 512 });
+                break;
+            }
+        }
+        Linear_Ring_Allocator allocator(CAPACITY);
+        Ownership_Check ownership(CAPACITY);
+        uint64_t requested = 0;
+        uint64_t failed = 0;
+        uint64_t peak_used = 0;
+        run_frames(allocator, [&](uint64_t frame) {
+            auto completed_frame = frame > GPU_LATENCY ? frame - GPU_LATENCY - 1 : 0;
+            for (const auto& request : requests)
+            {
+                auto offset = allocator.allocate(request.size, request.alignment);
+                if (offset == INVALID_RING_OFFSET)
+                {
+                    failed += 1;
+                    continue;
+                }
+                requested += request.size;
+                success = success && offset % request.alignment == 0
+                    && ownership.claim(offset, request.size, frame, completed_frame);
+            }
+            peak_used = std::max(peak_used, allocator.get_used_bytes());
+        });
+
+        Linear_Ring_Allocator timed_allocator(CAPACITY);
+        uint64_t checksum = 0;
+        auto begin = Clock::now();
+        run_frames(timed_allocator, [&](uint64_t) {
+            for (const auto& request : requests)
+            {
+                checksum += timed_allocator.allocate(request.size, request.alignment);
+            }
+        });
+        auto ns = get_ns(begin, Clock::now());
+        printf("mixed sizes:        %6.2f ns per allocation, %.2f%% padding, peak %.1f%% of the ring, %llu failed (checksum %llu)\n",
+            ns / (double(FRAME_COUNT) * requests.size()), 100.0 * allocator.get_wasted_bytes() / (requested + allocator.get_wasted_bytes()),
+            100.0 * peak_used / CAPACITY, (unsigned long long)failed, (unsigned long long)checksum);
+        success = success && failed == 0;
+    }
+
+    // A full ring fails instead of overwriting frames in flight, and recovers once they retire.
+    {
+        Linear_Ring_Allocator allocator(4 * CONSTANTS_SIZE);
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            success = success && allocator.allocate(CONSTANTS_SIZE, CONSTANTS_SIZE) != INVALID_RING_OFFSET;
+        }
+        allocator.end_frame(1);
+        success = success && allocator.allocate(CONSTANTS_SIZE, CONSTANTS_SIZE) == INVALID_RING_OFFSET;
+        allocator.retire(1);
+        success = success && allocator.allocate(CONSTANTS_SIZE, CONSTANTS_SIZE) == 0;
+    }
+
+    printf("%s\n", success ? "ok" : "FAILED");
+    return success ? 0 : 1;
+}
@@ -0,0 +1,93 @@
+#include "pipeline_cache.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <random>
+#include <vector>
+
+// Measures the startup cost the cache adds in front of PSO creation: keying every pipeline, loading
+// the cache file and looking up every blob. Driver compilation is what it saves and can't be
+// measured without a device.
+
+static constexpr uint32_t PIPELINE_COUNT = 1024;
+static constexpr uint32_t RUN_COUNT = 8;
+
+template<typename Function>
+static double measure_best_ms(Function&& function)
+{
+    double best_ms = 1e300;
+    for (uint32_t run = 0; run < RUN_COUNT; ++run)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        function();
+        auto end = std::chrono::steady_clock::now();
+        auto ms = std::chrono::duration<double, std::milli>(end - begin).count();
+        best_ms = ms < best_ms ? ms : best_ms;
+    }
+    return best_ms;
+}
+
+int main()
+{
+    std::mt19937_64 random(42);
+    auto make_bytes = [&](size_t size) {
+        std::vector<uint8_t> bytes(size);
+        for (auto& byte : bytes)
+        {
+            byte = uint8_t(random());
+        }
+        return bytes;
+    };
+    // One root signature shared by all pipelines, shaders of a few KiB and driver blobs a few times larger.
+    auto root_signature = make_bytes(512);
+    std::vector<std::vector<uint8_t>> shaders;
+    std::vector<std::vector<uint8_t>> driver_blobs;
+    uint64_t cache_bytes = 0;
+    for (uint32_t i = 0; i < PIPELINE_COUNT; ++i)
+    {
+        shaders.push_back(make_bytes(2048 + random() % 16384));
+        driver_blobs.push_back(make_bytes(shaders.back().size() * 3));
+        cache_bytes += driver_blobs.back().size();
+    }
+
+    std::vector<uint64_t> keys(PIPELINE_COUNT);
+    auto key_ms = measure_best_ms([&]() {
+        for (uint32_t i = 0; i < PIPELINE_COUNT; ++i)
+        {
+            keys[i] = make_compute_pipeline_key(
+                { root_signature.data(), root_signature.size() }, { shaders[i].data(), shaders[i].size() }, 0, 0);
+        }
+    });
+
+    auto device_hash = get_pipeline_cache_device_hash({ 0x1002, 0x744c, 0, 0xc8, 0x001f000100000000ull });
+    auto path = (std::filesystem::temp_directory_path() / "pipeline_cache_benchmark.bin").string();
+    Pipeline_Cache cache(device_hash);
+    for (uint32_t i = 0; i < PIPELINE_COUNT; ++i)
+    {
+        cache.store(keys[i], driver_blobs[i].data(), driver_blobs[i].size());
+    }
+    auto save_ms = measure_best_ms([&]() { cache.save(path.c_str()); });
+
+    bool success = true;
+    volatile uint64_t sink = 0;
+    auto load_ms = measure_best_ms([&]() {
+        Pipeline_Cache loaded(device_hash);
+        success = success && loaded.load(path.c_str());
+        for (uint32_t i = 0; i < PIPELINE_COUNT; ++i)
+        {
+            auto blob = loaded.find(keys[i]);
+            success = success && blob.size == driver_blobs[i].size();
+            sink = sink + blob.size;
+        }
+    });
+    std::filesystem::remove(path);
+
+    printf("%u pipelines, %.1f MiB of driver blobs, best of %u runs\n",
+        PIPELINE_COUNT, cache_bytes / double(1 << 20), RUN_COUNT);
+    printf("keying:          %8.3f ms\n", key_ms);
+    printf("save:            %8.3f ms\n", save_ms);
+    printf("load and lookup: %8.3f ms\n", load_ms);
+    printf("%s\n", success ? "ok" : "FAILED");
+    return success ? 0 : 1;
+}
@@ -0,0 +1,157 @@
+#include "pipeline_cache.h"
+#include "test_check.h"
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Keying, device invalidation and the on-disk container of Pipeline_Cache.
+
+static const Pipeline_Cache_Device_Id DEVICE_ID = {
+    .vendor_id = 0x10de,
+    .device_id = 0x2684,
+    .subsys_id = 0x16f31043,
+    .revision = 0xa1,
+    .driver_version = 0x001f000f0e0b0d12ull
+};
+
+static std::vector<uint8_t> make_bytes(uint32_t size, uint8_t seed)
+{
+    std::vector<uint8_t> bytes(size);
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        bytes[i] = uint8_t(seed + i * 7);
+    }
+    return bytes;
+}
+
+static std::vector<uint8_t> read_file(const std::string& path)
+{
+    Mapped_File file(path.c_str());
+    auto bytes = static_cast<const uint8_t*>(file.data());
+    return { bytes, bytes + file.size() };
+}
+
+static void write_file(const std::string& path, const std::vector<uint8_t>& bytes)
+{
+    FILE* file = fopen(path.c_str(), "wb");
+    fwrite(bytes.data(), 1, bytes.size(), file);
+    fclose(file);
+}
+
+static void test_keys()
+{
+    auto root_signature = make_bytes(64, 1);
+    auto cs = make_bytes(256, 2);
+    Shader_Blob root_signature_blob = { root_signature.data(), root_signature.size() };
+    Shader_Blob cs_blob = { cs.data(), cs.size() };
+    auto key = make_compute_pipeline_key(root_signature_blob, cs_blob, 0, 0);
+    TEST_CHECK(key == make_compute_pipeline_key(root_signature_blob, cs_blob, 0, 0));
+    TEST_CHECK(key != make_compute_pipeline_key(root_signature_blob, cs_blob, 1, 0));
+    TEST_CHECK(key != make_compute_pipeline_key(root_signature_blob, cs_blob, 0, 1));
+    // Sizes are part of the key, moving bytes between root signature and shader changes it.
+    TEST_CHECK(key != make_compute_pipeline_key(
+        { root_signature.data(), root_signature.size() - 1 }, { cs.data(), cs.size() }, 0, 0));
+    cs[100] ^= 1;
+    TEST_CHECK(key != make_compute_pipeline_key(root_signature_blob, cs_blob, 0, 0));
+
+    auto device_hash = get_pipeline_cache_device_hash(DEVICE_ID);
+    auto new_driver = DEVICE_ID;
+    new_driver.driver_version += 1;
+    auto other_adapter = DEVICE_ID;
+    other_adapter.device_id += 1;
+    TEST_CHECK(device_hash != get_pipeline_cache_device_hash(new_driver));
+    TEST_CHECK(device_hash != get_pipeline_cache_device_hash(other_adapter));
+}
+
+static void test_round_trip(const std::string& path)
+{
+    auto device_hash = get_pipeline_cache_device_hash(DEVICE_ID);
+    Pipeline_Cache cache(device_hash);
+    TEST_CHECK(!cache.load(path.c_str()));
+    TEST_CHECK(!cache.is_dirty());
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        auto blob = make_bytes(100 + i * 33, uint8_t(i));
+        cache.store(i, blob.data(), blob.size());
+    }
+    auto empty_blob = make_bytes(0, 0);
+    cache.store(100, empty_blob.data(), 0);
+    TEST_CHECK(cache.is_dirty());
+    TEST_CHECK(cache.save(path.c_str()));
+    TEST_CHECK(!cache.is_dirty());
+
+    Pipeline_Cache loaded(device_hash);
+    TEST_CHECK(loaded.load(path.c_str()));
+    TEST_CHECK(!loaded.is_dirty());
+    TEST_CHECK(loaded.get_entry_count() == 17);
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        auto expected = make_bytes(100 + i * 33, uint8_t(i));
+        auto blob = loaded.find(i);
+        TEST_CHECK(blob.size == expected.size() && memcmp(blob.data, expected.data(), blob.size) == 0);
+    }
+    TEST_CHECK(loaded.find(100).empty());
+    TEST_CHECK(loaded.find(1000).empty());
+
+    // Erasing a rejected blob marks the cache for rewriting, erasing a missing key does not.
+    loaded.erase(1000);
+    TEST_CHECK(!loaded.is_dirty());
+    loaded.erase(3);
+    TEST_CHECK(loaded.is_dirty());
+    TEST_CHECK(loaded.find(3).empty());
+}
+
+static void test_invalidation(const std::string& path, const std::string& corrupt_path)
+{
+    auto device_hash = get_pipeline_cache_device_hash(DEVICE_ID);
+    auto new_driver = DEVICE_ID;
+    new_driver.driver_version += 1;
+    Pipeline_Cache other_driver(get_pipeline_cache_device_hash(new_driver));
+    TEST_CHECK(!other_driver.load(path.c_str()));
+    TEST_CHECK(other_driver.get_entry_count() == 0);
+    TEST_CHECK(other_driver.is_dirty());
+
+    auto bytes = read_file(path);
+    // Truncated in the middle of a blob and in the middle of an entry header.
+    for (auto size : { bytes.size() - 1, sizeof(Pipeline_Cache_Header) + sizeof(Pipeline_Cache_Entry) / 2 })
+    {
+        write_file(corrupt_path, { bytes.begin(), bytes.begin() + size });
+        Pipeline_Cache cache(device_hash);
+        TEST_CHECK(!cache.load(corrupt_path.c_str()));
+        TEST_CHECK(cache.get_entry_count() == 0);
+    }
+    // A flipped blob byte fails the content hash.
+    auto flipped = bytes;
+    flipped.back() ^= 0x40;
+    write_file(corrupt_path, flipped);
+    Pipeline_Cache flipped_cache(device_hash);
+    TEST_CHECK(!flipped_cache.load(corrupt_path.c_str()));
+    // A blob size past the end of the file must not be read.
+    auto oversized = bytes;
+    uint64_t huge_size = ~0ull - 8;
+    memcpy(oversized.data() + sizeof(Pipeline_Cache_Header) + offsetof(Pipeline_Cache_Entry, size), &huge_size, 8);
+    write_file(corrupt_path, oversized);
+    Pipeline_Cache oversized_cache(device_hash);
+    TEST_CHECK(!oversized_cache.load(corrupt_path.c_str()));
+    // A different format version is dropped as a whole.
+    auto old_version = bytes;
+    old_version[offsetof(Pipeline_Cache_Header, version)] += 1;
+    write_file(corrupt_path, old_version);
+    Pipeline_Cache old_version_cache(device_hash);
+    TEST_CHECK(!old_version_cache.load(corrupt_path.c_str()));
+}
+
+int main()
+{
+    auto directory = std::filesystem::temp_directory_path() / "pipeline_cache_test";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+    auto path = (directory / "pipeline_cache.bin").string();
+    auto corrupt_path = (directory / "corrupt.bin").string();
+    test_keys();
+    test_round_trip(path);
+    test_invalidation(path, corrupt_path);
+    std::filesystem::remove_all(directory);
+    return finish_test();
+}
@@ -0,0 +1,349 @@
+#include "present_pacer.h"
+#include "test_check.h"
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// Present_Pacer on a simulated clock, GPU and display. The GPU runs submitted frames back to back, the
+// display shows presented frames at the next vblank (or as soon as they are done without vsync), and the
+// latency waitable blocks while `max_frame_latency` frames are queued for display. Checks frame intervals,
+// input-to-display latency, tearing, resizes, minimizing and the latency wait timeout.
+
+static constexpr uint64_t REFRESH_PERIOD_US = 16667;
+static constexpr uint32_t FRAMES_IN_FLIGHT = 2;
+
+struct Simulation
+{
+    uint64_t now_us = 0;
+    uint64_t gpu_free_us = 0;
+    // GPU completion of the last submitted work, and per signaled fence value.
+    uint64_t last_gpu_done_us = 0;
+    std::vector<uint64_t> fence_done_us = { 0 };
+};
+
+class Sim_Clock : public Present_Clock
+{
+public:
+    explicit Sim_Clock(Simulation& simulation)
+        : m_simulation(simulation)
+    {}
+
+    uint64_t get_time_us() override { return m_simulation.now_us; }
+
+private:
+    Simulation& m_simulation;
+};
+
+class Sim_Fence : public Fence
+{
+public:
+    explicit Sim_Fence(Simulation& simulation)
+        : m_simulation(simulation)
+    {}
+
+    void signal(uint64_t value) override
+    {
+        TEST_CHECK(value == m_simulation.fence_done_us.size());
+        m_simulation.fence_done_us.push_back(m_simulation.last_gpu_done_us);
+    }
+
+    uint64_t get_completed_value() override
+    {
+        uint64_t value = 0;
+        while (value + 1 < m_simulation.fence_done_us.size() && m_simulation.fence_done_us[value + 1] <= m_simulation.now_us)
+        {
+            value += 1;
+        }
+        return value;
+    }
+
+    void wait(uint64_t value) override
+    {
+        TEST_CHECK(value < m_simulation.fence_done_us.size());
+        m_simulation.now_us = std::max(m_simulation.now_us, m_simulation.fence_done_us[value]);
+        wait_count += 1;
+    }
+
+    uint32_t wait_count = 0;
+
+private:
+    Simulation& m_simulation;
+};
+
+class Sim_Target : public Present_Target
+{
+public:
+    Sim_Target(Simulation& simulation, Sim_Fence& fence, uint32_t max_frame_latency, bool is_tearing_supported)
+        : m_simulation(simulation)
+        , m_fence(fence)
+        , m_max_frame_latency(max_frame_latency)
+        , m_is_tearing_supported(is_tearing_supported)
+    {}
+
+    bool wait_for_frame_latency(uint32_t timeout_ms) override
+    {
+        if (is_stuck)
+        {
+            m_simulation.now_us += uint64_t(timeout_ms) * 1000;
+            return false;
+        }
+        auto& now = m_simulation.now_us;
+        while (!m_queued.empty() && m_queued.front() <= now)
+        {
+            m_queued.pop_front();
+        }
+        while (m_queued.size() >= m_max_frame_latency)
+        {
+            now = std::max(now, m_queued.front());
+            m_queued.pop_front();
+        }
+        return true;
+    }
+
+    void present(uint32_t sync_interval, bool allow_tearing) override
+    {
+        auto ready = m_simulation.last_gpu_done_us;
+        if (sync_interval > 0)
+        {
+            // The next vblank after the frame is done and the previous one had its refresh.
+            auto earliest = std::max(ready, m_last_display_us + (m_present_count > 0 ? REFRESH_PERIOD_US : 0));
+            last_display_us = (earliest + REFRESH_PERIOD_US - 1) / REFRESH_PERIOD_US * REFRESH_PERIOD_US;
+        }
+        else
+        {
+            last_display_us = std::max(ready, m_last_display_us);
+        }
+        m_last_display_us = last_display_us;
+        m_queued.push_back(last_display_us);
+        last_sync_interval = sync_interval;
+        last_allow_tearing = allow_tearing;
+        m_present_count += 1;
+    }
+
+    void resize(uint32_t width, uint32_t height) override
+    {
+        // Every frame that used the old back buffers has to be done.
+        TEST_CHECK(m_fence.get_completed_value() + 1 == m_simulation.fence_done_us.size());
+        resized_width = width;
+        resized_height = height;
+        resize_count += 1;
+    }
+
+    bool is_tearing_supported() const override { return m_is_tearing_supported; }
+
+    uint64_t last_display_us = 0;
+    uint32_t last_sync_interval = 0;
+    bool last_allow_tearing = false;
+    uint32_t resized_width = 0;
+    uint32_t resized_height = 0;
+    uint32_t resize_count = 0;
+    bool is_stuck = false;
+
+private:
+    Simulation& m_simulation;
+    Sim_Fence& m_fence;
+    uint32_t m_max_frame_latency;
+    bool m_is_tearing_supported;
+    std::deque<uint64_t> m_queued;
+    uint64_t m_last_display_us = 0;
+    uint64_t m_present_count = 0;
+};
+
+struct Frame_Times
+{
+    uint64_t cpu_us;
+    uint64_t gpu_us;
+};
+
+struct Run_Result
+{
+    // Of the last frame, once the simulation settled.
+    uint64_t frame_interval_us;
+    uint64_t latency_us;
+    uint64_t max_latency_us;
+};
+
+// One simulated app with its swapchain, frame ring and pacer.
+struct App
+{
+    App(const Present_Settings& settings, bool is_tearing_supported = true)
+        : fence(simulation)
+        , target(simulation, fence, settings.max_frame_latency, is_tearing_supported)
+        , frame_ring(fence, FRAMES_IN_FLIGHT)
+        , pacer(target, clock, frame_ring, settings, 1280, 720)
+    {}
+
+    // The frame loop of repro_01: pace, sample input, wait for the frame slot, record, submit, present.
+    Present_Frame run_frame(Frame_Times times, uint64_t* latency_us = nullptr)
+    {
+        auto result = pacer.begin_frame();
+        if (result == Present_Frame::Skip)
+        {
+            return result;
+        }
+        auto input_us = simulation.now_us;
+        frame_ring.begin_frame();
+        simulation.now_us += times.cpu_us;
+        auto gpu_begin = std::max(simulation.now_us, simulation.gpu_free_us);
+        simulation.gpu_free_us = gpu_begin + times.gpu_us;
+        simulation.last_gpu_done_us = simulation.gpu_free_us;
+        pacer.present();
+        frame_ring.end_frame();
+        if (latency_us)
+        {
+            *latency_us = target.last_display_us - input_us;
+        }
+        return result;
+    }
+
+    Run_Result run(Frame_Times times, uint32_t frame_count = 120)
+    {
+        Run_Result result = {};
+        for (uint32_t i = 0; i < frame_count; ++i)
+        {
+            uint64_t latency_us = 0;
+            run_frame(times, &latency_us);
+            if (i >= frame_count / 2)
+            {
+                result.max_latency_us = std::max(result.max_latency_us, latency_us);
+            }
+            result.latency_us = latency_us;
+        }
+        result.frame_interval_us = pacer.get_frame_interval_us();
+        return result;
+    }
+
+    Simulation simulation;
+    Sim_Clock clock { simulation };
+    Sim_Fence fence;
+    Sim_Target target;
+    Frame_Ring frame_ring;
+    Present_Pacer pacer;
+};
+
+static void test_vsync()
+{
+    // CPU and GPU well within a refresh: one frame per vblank, shown one refresh after its input.
+    {
+        App app({ .max_frame_latency = 1, .vsync = true });
+        auto result = app.run({ .cpu_us = 2000, .gpu_us = 5000 });
+        TEST_CHECK(result.frame_interval_us == REFRESH_PERIOD_US);
+        TEST_CHECK(result.max_latency_us <= REFRESH_PERIOD_US);
+        TEST_CHECK(app.target.last_sync_interval == 1 && !app.target.last_allow_tearing);
+        TEST_CHECK(app.pacer.get_present_count() == 120 && app.pacer.get_latency_timeout_count() == 0);
+        // The CPU spends most of the frame in the latency wait, not in the frame ring.
+        TEST_CHECK(app.pacer.get_latency_wait_us() > REFRESH_PERIOD_US / 2);
+    }
+    // A deeper queue shows the same frames, only later.
+    {
+        App app({ .max_frame_latency = 3, .vsync = true });
+        auto result = app.run({ .cpu_us = 2000, .gpu_us = 5000 });
+        TEST_CHECK(result.frame_interval_us == REFRESH_PERIOD_US);
+        TEST_CHECK(result.latency_us == 3 * REFRESH_PERIOD_US);
+    }
+    // GPU bound past one refresh: every other vblank.
+    {
+        App app({ .max_frame_latency = 1, .vsync = true });
+        auto result = app.run({ .cpu_us = 2000, .gpu_us = 25000 });
+        TEST_CHECK(result.frame_interval_us == 2 * REFRESH_PERIOD_US);
+        TEST_CHECK(result.max_latency_us <= 2 * REFRESH_PERIOD_US);
+    }
+}
+
+static void test_no_vsync()
+{
+    // Frame latency 1 serializes CPU and GPU, a second queued frame lets them overlap.
+    {
+        App app({ .max_frame_latency = 1, .vsync = false, .allow_tearing = true });
+        auto result = app.run({ .cpu_us = 2000, .gpu_us = 5000 });
+        TEST_CHECK(result.frame_interval_us == 7000);
+        TEST_CHECK(result.latency_us == 7000);
+        TEST_CHECK(app.target.last_sync_interval == 0 && app.target.last_allow_tearing);
+    }
+    {
+        App app({ .max_frame_latency = 2, .vsync = false, .allow_tearing = true });
+        auto result = app.run({ .cpu_us = 2000, .gpu_us = 5000 });
+        TEST_CHECK(result.frame_interval_us == 5000);
+        TEST_CHECK(result.latency_us == 10000);
+    }
+    // Tearing only where the swapchain supports it, and never with vsync.
+    {
+        App app({ .max_frame_latency = 1, .vsync = false, .allow_tearing = true }, false);
+        app.run({ .cpu_us = 1000, .gpu_us = 1000 }, 4);
+        TEST_CHECK(app.target.last_sync_interval == 0 && !app.target.last_allow_tearing);
+        App disallowed({ .max_frame_latency = 1, .vsync = false, .allow_tearing = false });
+        disallowed.run({ .cpu_us = 1000, .gpu_us = 1000 }, 4);
+        TEST_CHECK(!disallowed.target.last_allow_tearing);
+        disallowed.pacer.set_vsync(true);
+        disallowed.run({ .cpu_us = 1000, .gpu_us = 1000 }, 4);
+        TEST_CHECK(disallowed.target.last_sync_interval == 1 && disallowed.pacer.get_settings().vsync);
+    }
+}
+
+static void test_resize_and_minimize()
+{
+    App app({ .max_frame_latency = 2, .vsync = true });
+    Frame_Times times = { .cpu_us = 3000, .gpu_us = 12000 };
+    app.run(times, 10);
+
+    // A dragged border sends many sizes between two frames, only the last one is applied.
+    for (uint32_t width = 1281; width < 1400; ++width)
+    {
+        app.pacer.request_resize(width, 800);
+    }
+    TEST_CHECK(app.target.resize_count == 0);
+    TEST_CHECK(app.run_frame(times) == Present_Frame::Render_Resized);
+    TEST_CHECK(app.target.resize_count == 1 && app.target.resized_width == 1399 && app.target.resized_height == 800);
+    TEST_CHECK(app.pacer.get_width() == 1399 && app.pacer.get_resize_count() == 1);
+    TEST_CHECK(app.run_frame(times) == Present_Frame::Render);
+    // Resized back to the current size before a frame: nothing to do.
+    app.pacer.request_resize(1000, 1000);
+    app.pacer.request_resize(1399, 800);
+    TEST_CHECK(app.run_frame(times) == Present_Frame::Render && app.target.resize_count == 1);
+
+    // Minimized: frames are skipped without waiting or presenting, restoring at the old size is no resize.
+    auto present_count = app.pacer.get_present_count();
+    auto now_us = app.simulation.now_us;
+    app.pacer.request_resize(0, 0);
+    for (uint32_t i = 0; i < 5; ++i)
+    {
+        TEST_CHECK(app.run_frame(times) == Present_Frame::Skip);
+    }
+    TEST_CHECK(app.simulation.now_us == now_us && app.pacer.get_present_count() == present_count);
+    app.pacer.request_resize(1399, 800);
+    TEST_CHECK(app.run_frame(times) == Present_Frame::Render && app.target.resize_count == 1);
+    // Restored at a new size.
+    app.pacer.request_resize(0, 0);
+    TEST_CHECK(app.run_frame(times) == Present_Frame::Skip);
+    app.pacer.request_resize(640, 480);
+    TEST_CHECK(app.run_frame(times) == Present_Frame::Render_Resized && app.target.resize_count == 2);
+    // Rendering goes on at the refresh rate afterwards.
+    auto result = app.run(times, 20);
+    TEST_CHECK(result.frame_interval_us == REFRESH_PERIOD_US);
+}
+
+static void test_latency_timeout()
+{
+    App app({ .max_frame_latency = 1, .vsync = true });
+    app.run({ .cpu_us = 1000, .gpu_us = 1000 }, 4);
+    // A swapchain that never releases the waitable, e.g. a hung display: the frame goes on after the timeout.
+    app.target.is_stuck = true;
+    auto now_us = app.simulation.now_us;
+    TEST_CHECK(app.run_frame({ .cpu_us = 1000, .gpu_us = 1000 }) == Present_Frame::Render);
+    TEST_CHECK(app.pacer.get_latency_timeout_count() == 1);
+    TEST_CHECK(app.pacer.get_latency_wait_us() == uint64_t(Present_Pacer::FRAME_LATENCY_TIMEOUT_MS) * 1000);
+    TEST_CHECK(app.simulation.now_us >= now_us + uint64_t(Present_Pacer::FRAME_LATENCY_TIMEOUT_MS) * 1000);
+    app.target.is_stuck = false;
+    app.run({ .cpu_us = 1000, .gpu_us = 1000 }, 4);
+    TEST_CHECK(app.pacer.get_latency_timeout_count() == 1);
+}
+
+int main()
+{
+    test_vsync();
+    test_no_vsync();
+    test_resize_and_minimize();
+    test_latency_timeout();
+    return finish_test();
+}
@@ -0,0 +1,321 @@
+#include "queue_planner.h"
+#include "test_check.h"
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// Queue_Planner::plan on hand-built cases, then 20000 random graphs: every plan has to pass validate(), and
+// validate() itself is compared with a reachability check on randomly broken plans.
+
+static Queue_Plan_Input make_input(Queue_Type queue, std::vector<uint32_t> dependencies = {})
+{
+    return { queue, std::move(dependencies) };
+}
+
+static void test_single_queue()
+{
+    std::vector<Queue_Plan_Input> inputs = {
+        make_input(Queue_Type::Direct),
+        make_input(Queue_Type::Direct, { 0 }),
+        make_input(Queue_Type::Direct, { 0, 1 })
+    };
+    auto plan = Queue_Planner::plan(inputs);
+    TEST_CHECK(Queue_Planner::validate(inputs, plan));
+    TEST_CHECK(plan.pass_counts[uint32_t(Queue_Type::Direct)] == 3);
+    for (uint32_t p = 0; p < 3; ++p)
+    {
+        TEST_CHECK(plan.passes[p].queue == Queue_Type::Direct && plan.passes[p].value == p + 1);
+        TEST_CHECK(plan.passes[p].waits.empty());
+        // Only the last pass signals, for the frame end.
+        TEST_CHECK(plan.passes[p].signal == (p == 2));
+    }
+}
+
+static void test_async_queues()
+{
+    // 1 runs on compute next to 2, 3 joins them. 4 wants the copy queue but nothing can overlap it.
+    std::vector<Queue_Plan_Input> inputs = {
+        make_input(Queue_Type::Direct),
+        make_input(Queue_Type::Compute, { 0 }),
+        make_input(Queue_Type::Direct, { 0 }),
+        make_input(Queue_Type::Direct, { 1, 2 }),
+        make_input(Queue_Type::Copy, { 3 })
+    };
+    auto plan = Queue_Planner::plan(inputs);
+    TEST_CHECK(Queue_Planner::validate(inputs, plan));
+    TEST_CHECK(plan.passes[1].queue == Queue_Type::Compute);
+    TEST_CHECK(plan.passes[4].queue == Queue_Type::Direct);
+    TEST_CHECK(plan.pass_counts[uint32_t(Queue_Type::Compute)] == 1);
+    TEST_CHECK(plan.pass_counts[uint32_t(Queue_Type::Copy)] == 0);
+    // Compute waits for the direct queue to get past pass 0, direct waits for compute before pass 3.
+    TEST_CHECK(plan.passes[1].waits.size() == 1 && plan.passes[1].waits[0].queue == Queue_Type::Direct && plan.passes[1].waits[0].value == 1);
+    TEST_CHECK(plan.passes[0].signal);
+    TEST_CHECK(plan.passes[3].waits.size() == 1 && plan.passes[3].waits[0].queue == Queue_Type::Compute && plan.passes[3].waits[0].value == 1);
+    TEST_CHECK(plan.passes[1].signal);
+    TEST_CHECK(plan.passes[2].waits.empty() && !plan.passes[2].signal);
+}
+
+static void test_transitive_waits()
+{
+    // 3 on copy depends on 1 (compute) and 2 (direct). 2 already waited for 1, so one wait on direct covers both.
+    // 4 on direct depends on 1 again, which it knows about through 2's wait.
+    std::vector<Queue_Plan_Input> inputs = {
+        make_input(Queue_Type::Direct),
+        make_input(Queue_Type::Compute),
+        make_input(Queue_Type::Direct, { 1 }),
+        make_input(Queue_Type::Copy, { 1, 2 }),
+        make_input(Queue_Type::Direct, { 1 }),
+        make_input(Queue_Type::Direct)
+    };
+    auto plan = Queue_Planner::plan(inputs);
+    TEST_CHECK(Queue_Planner::validate(inputs, plan));
+    TEST_CHECK(plan.passes[1].queue == Queue_Type::Compute && plan.passes[3].queue == Queue_Type::Copy);
+    TEST_CHECK(plan.passes[2].waits.size() == 1);
+    TEST_CHECK(plan.passes[3].waits.size() == 1 && plan.passes[3].waits[0].queue == Queue_Type::Direct);
+    TEST_CHECK(plan.passes[4].waits.empty());
+}
+
+static void test_validate_rejects()
+{
+    std::vector<Queue_Plan_Input> inputs = {
+        make_input(Queue_Type::Direct),
+        make_input(Queue_Type::Compute, { 0 }),
+        make_input(Queue_Type::Direct),
+        make_input(Queue_Type::Direct, { 1 })
+    };
+    auto plan = Queue_Planner::plan(inputs);
+    TEST_CHECK(Queue_Planner::validate(inputs, plan));
+
+    // Missing wait: pass 3 may start before pass 1 finished.
+    auto broken = plan;
+    broken.passes[3].waits.clear();
+    TEST_CHECK(!Queue_Planner::validate(inputs, broken));
+    // The waited value is never signaled, the direct queue hangs.
+    broken = plan;
+    broken.passes[1].signal = false;
+    TEST_CHECK(!Queue_Planner::validate(inputs, broken));
+    // Two queues waiting on each other.
+    broken = plan;
+    broken.passes[0].waits.push_back({ Queue_Type::Compute, 1 });
+    TEST_CHECK(!Queue_Planner::validate(inputs, broken));
+    // Values have to count the passes of each queue.
+    broken = plan;
+    broken.passes[2].value = 5;
+    TEST_CHECK(!Queue_Planner::validate(inputs, broken));
+    broken = plan;
+    broken.passes.pop_back();
+    TEST_CHECK(!Queue_Planner::validate(inputs, broken));
+}
+
+// Independent of validate(): happens-before as reachability over queue order and wait edges, where a wait
+// is released by the first signaling pass at or after its value. Returns false on cycles or waits that
+// never complete, or if a dependency does not reach its dependent.
+static bool is_plan_correct(const std::vector<Queue_Plan_Input>& inputs, const Queue_Plan& plan)
+{
+    auto pass_count = uint32_t(plan.passes.size());
+    std::vector<uint32_t> queue_passes[QUEUE_TYPE_COUNT];
+    for (uint32_t p = 0; p < pass_count; ++p)
+    {
+        queue_passes[uint32_t(plan.passes[p].queue)].push_back(p);
+    }
+    std::vector<std::vector<uint32_t>> edges(pass_count);
+    std::vector<uint32_t> in_degree(pass_count, 0);
+    for (uint32_t q = 0; q < QUEUE_TYPE_COUNT; ++q)
+    {
+        for (size_t i = 1; i < queue_passes[q].size(); ++i)
+        {
+            edges[queue_passes[q][i - 1]].push_back(queue_passes[q][i]);
+            in_degree[queue_passes[q][i]] += 1;
+        }
+    }
+    for (uint32_t p = 0; p < pass_count; ++p)
+    {
+        for (const auto& wait : plan.passes[p].waits)
+        {
+            const auto& passes = queue_passes[uint32_t(wait.queue)];
+            uint32_t signaler = ~0u;
+            for (size_t i = wait.value > 0 ? size_t(wait.value - 1) : 0; i < passes.size() && signaler == ~0u; ++i)
+            {
+                signaler = plan.passes[passes[i]].signal ? passes[i] : signaler;
+            }
+            if (signaler == ~0u)
+            {
+                return false;
+            }
+            edges[signaler].push_back(p);
+            in_degree[p] += 1;
+        }
+    }
+    std::vector<uint32_t> ready;
+    for (uint32_t p = 0; p < pass_count; ++p)
+    {
+        if (in_degree[p] == 0)
+        {
+            ready.push_back(p);
+        }
+    }
+    uint32_t visited = 0;
+    while (!ready.empty())
+    {
+        auto p = ready.back();
+        ready.pop_back();
+        visited += 1;
+        for (auto s : edges[p])
+        {
+            if (--in_degree[s] == 0)
+            {
+                ready.push_back(s);
+            }
+        }
+    }
+    if (visited != pass_count)
+    {
+        return false;
+    }
+    for (uint32_t p = 0; p < pass_count; ++p)
+    {
+        std::vector<bool> reached(pass_count, false);
+        std::vector<uint32_t> stack = { p };
+        reached[p] = true;
+        while (!stack.empty())
+        {
+            auto current = stack.back();
+            stack.pop_back();
+            for (auto s : edges[current])
+            {
+                if (!reached[s])
+                {
+                    reached[s] = true;
+                    stack.push_back(s);
+                }
+            }
+        }
+        for (uint32_t q = 0; q < pass_count; ++q)
+        {
+            for (auto dependency : inputs[q].dependencies)
+            {
+                if (dependency == p && !reached[q])
+                {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+static void test_random_graphs()
+{
+    static constexpr uint32_t GRAPH_COUNT = 20000;
+    std::mt19937 random(12);
+    uint64_t async_pass_count = 0;
+    uint64_t wait_count = 0;
+    uint64_t broken_count = 0;
+    for (uint32_t g = 0; g < GRAPH_COUNT; ++g)
+    {
+        auto pass_count = 1 + random() % 32;
+        auto dependency_chance = 1 + random() % 6;
+        std::vector<Queue_Plan_Input> inputs(pass_count);
+        for (uint32_t p = 0; p < pass_count; ++p)
+        {
+            inputs[p].preferred_queue = Queue_Type(random() % QUEUE_TYPE_COUNT);
+            for (uint32_t d = 0; d < p; ++d)
+            {
+                if (random() % 16 < dependency_chance)
+                {
+                    inputs[p].dependencies.push_back(d);
+                }
+            }
+        }
+        auto plan = Queue_Planner::plan(inputs);
+        TEST_CHECK(Queue_Planner::validate(inputs, plan));
+        TEST_CHECK(is_plan_correct(inputs, plan));
+
+        uint64_t last_waits[QUEUE_TYPE_COUNT][QUEUE_TYPE_COUNT] = {};
+        for (uint32_t p = 0; p < pass_count; ++p)
+        {
+            const auto& pass = plan.passes[p];
+            auto q = uint32_t(pass.queue);
+            TEST_CHECK(pass.queue == inputs[p].preferred_queue || pass.queue == Queue_Type::Direct);
+            async_pass_count += pass.queue != Queue_Type::Direct;
+            for (const auto& wait : pass.waits)
+            {
+                auto o = uint32_t(wait.queue);
+                // Never on the own queue, and a queue never waits twice for what it already knows.
+                TEST_CHECK(o != q);
+                TEST_CHECK(wait.value > last_waits[q][o]);
+                last_waits[q][o] = wait.value;
+                wait_count += 1;
+            }
+            // Every waited value is signaled by exactly that pass.
+            for (const auto& wait : pass.waits)
+            {
+                bool is_signaled = false;
+                for (const auto& other : plan.passes)
+                {
+                    is_signaled = is_signaled || (other.queue == wait.queue && other.value == wait.value && other.signal);
+                }
+                TEST_CHECK(is_signaled);
+            }
+        }
+        for (uint32_t q = 0; q < QUEUE_TYPE_COUNT; ++q)
+        {
+            for (const auto& pass : plan.passes)
+            {
+                TEST_CHECK(uint32_t(pass.queue) != q || pass.value != plan.pass_counts[q] || pass.signal);
+            }
+        }
+
+        // Break the plan at random and compare validate() with the reachability check.
+        auto broken = plan;
+        switch (random() % 3)
+        {
+        case 0:
+        {
+            std::vector<std::pair<uint32_t, size_t>> waits;
+            for (uint32_t p = 0; p < pass_count; ++p)
+            {
+                for (size_t w = 0; w < broken.passes[p].waits.size(); ++w)
+                {
+                    waits.push_back({ p, w });
+                }
+            }
+            if (!waits.empty())
+            {
+                auto [p, w] = waits[random() % waits.size()];
+                broken.passes[p].waits.erase(broken.passes[p].waits.begin() + w);
+            }
+            break;
+        }
+        case 1:
+            broken.passes[random() % pass_count].signal = false;
+            break;
+        default:
+        {
+            auto& pass = broken.passes[random() % pass_count];
+            auto o = Queue_Type(random() % QUEUE_TYPE_COUNT);
+            if (o != pass.queue && broken.pass_counts[uint32_t(o)] > 0)
+            {
+                pass.waits.push_back({ o, 1 + random() % broken.pass_counts[uint32_t(o)] });
+            }
+            break;
+        }
+        }
+        auto is_correct = is_plan_correct(inputs, broken);
+        TEST_CHECK(Queue_Planner::validate(inputs, broken) == is_correct);
+        broken_count += !is_correct;
+    }
+    printf("%u graphs, %llu passes moved to async queues, %llu waits, %llu broken plans rejected\n", GRAPH_COUNT,
+        (unsigned long long)async_pass_count, (unsigned long long)wait_count, (unsigned long long)broken_count);
+    TEST_CHECK(async_pass_count > 0 && wait_count > 0 && broken_count > 0);
+}
+
+int main()
+{
+    test_single_queue();
+    test_async_queues();
+    test_transitive_waits();
+    test_validate_rejects();
+    test_random_graphs();
+    return finish_test();
+}
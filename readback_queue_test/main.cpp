@@ -0,0 +1,277 @@
+#include "readback_queue.h"
+#include "test_check.h"
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <vector>
+
+// Readback_Queue through request, submit, update and release against a simulated fence: polling,
+// callbacks, completion order, stale tickets and giving up requests before they completed. The last part
+// runs random frames where a simulated copy lands in the slot at completion, so a slot handed out again
+// while still in flight shows up as foreign data.
+
+static void test_polling()
+{
+    Readback_Queue queue(2);
+    auto ticket = queue.request();
+    TEST_CHECK(ticket.is_valid());
+    TEST_CHECK(queue.get_state(ticket.slot) == Readback_Queue::Slot_State::Recorded);
+    TEST_CHECK(queue.get_free_slot_count() == 1);
+    // Recorded but not submitted, no completed value makes it ready.
+    queue.update(~0ull);
+    TEST_CHECK(queue.try_get(ticket) == INVALID_READBACK_SLOT);
+
+    queue.submit(3);
+    TEST_CHECK(queue.get_state(ticket.slot) == Readback_Queue::Slot_State::In_Flight);
+    queue.update(2);
+    TEST_CHECK(!queue.is_ready(ticket));
+    queue.update(3);
+    TEST_CHECK(queue.is_ready(ticket));
+    TEST_CHECK(queue.try_get(ticket) == ticket.slot);
+    // Ready requests without a callback wait for the consumer.
+    queue.update(4);
+    TEST_CHECK(queue.try_get(ticket) == ticket.slot);
+    queue.release(ticket);
+    TEST_CHECK(queue.get_state(ticket.slot) == Readback_Queue::Slot_State::Free);
+    TEST_CHECK(queue.get_free_slot_count() == 2);
+    TEST_CHECK(queue.try_get(ticket) == INVALID_READBACK_SLOT);
+}
+
+static void test_callbacks_and_order()
+{
+    Readback_Queue queue(4);
+    std::vector<uint32_t> completed;
+    Readback_Ticket tickets[3];
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        tickets[i] = queue.request([&completed, i](uint32_t) { completed.push_back(i); });
+        queue.submit(i + 1);
+    }
+    queue.update(2);
+    TEST_CHECK((completed == std::vector<uint32_t> { 0, 1 }));
+    // Callback requests are released right after the callback returned.
+    TEST_CHECK(queue.get_state(tickets[0].slot) == Readback_Queue::Slot_State::Free);
+    TEST_CHECK(!queue.is_ready(tickets[1]));
+    TEST_CHECK(queue.get_state(tickets[2].slot) == Readback_Queue::Slot_State::In_Flight);
+    queue.update(2);
+    TEST_CHECK(completed.size() == 2);
+    queue.update(10);
+    TEST_CHECK((completed == std::vector<uint32_t> { 0, 1, 2 }));
+    TEST_CHECK(queue.get_free_slot_count() == 4);
+
+    // The callback gets the slot the copy was recorded into.
+    uint32_t callback_slot = INVALID_READBACK_SLOT;
+    auto ticket = queue.request([&callback_slot](uint32_t slot) { callback_slot = slot; });
+    queue.submit(11);
+    queue.update(11);
+    TEST_CHECK(callback_slot == ticket.slot);
+}
+
+static void test_exhaustion_and_stale_tickets()
+{
+    Readback_Queue queue(3);
+    std::vector<Readback_Ticket> tickets;
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        tickets.push_back(queue.request());
+        TEST_CHECK(tickets.back().is_valid());
+    }
+    TEST_CHECK(!queue.request().is_valid());
+    queue.submit(1);
+    queue.update(1);
+    queue.release(tickets[1]);
+    auto reused = queue.request();
+    TEST_CHECK(reused.slot == tickets[1].slot && reused.generation == tickets[1].generation + 1);
+    // A stale ticket neither reads nor releases the new request in its slot.
+    queue.release(tickets[1]);
+    TEST_CHECK(queue.get_state(reused.slot) == Readback_Queue::Slot_State::Recorded);
+    queue.submit(2);
+    queue.update(2);
+    TEST_CHECK(queue.try_get(tickets[1]) == INVALID_READBACK_SLOT);
+    TEST_CHECK(queue.try_get(reused) == reused.slot);
+    TEST_CHECK(!queue.is_ready({}));
+    queue.release({});
+    queue.release({ .slot = 3, .generation = 0 });
+    TEST_CHECK(queue.get_free_slot_count() == 0);
+}
+
+static void test_release_in_flight()
+{
+    Readback_Queue queue(2);
+    bool callback_ran = false;
+    auto polled = queue.request();
+    auto with_callback = queue.request([&callback_ran](uint32_t) { callback_ran = true; });
+    queue.submit(5);
+    queue.release(polled);
+    queue.release(with_callback);
+    // The GPU still writes both slots, they must not be handed out before the copies completed.
+    TEST_CHECK(queue.get_state(polled.slot) == Readback_Queue::Slot_State::In_Flight);
+    TEST_CHECK(queue.get_state(with_callback.slot) == Readback_Queue::Slot_State::In_Flight);
+    TEST_CHECK(queue.get_free_slot_count() == 0);
+    TEST_CHECK(!queue.request().is_valid());
+    queue.update(4);
+    TEST_CHECK(queue.get_free_slot_count() == 0);
+    queue.update(5);
+    TEST_CHECK(queue.get_free_slot_count() == 2);
+    TEST_CHECK(!callback_ran);
+    TEST_CHECK(queue.try_get(polled) == INVALID_READBACK_SLOT);
+
+    // Released before it was even submitted: it still goes out with the next submit and frees on completion.
+    auto recorded = queue.request();
+    queue.release(recorded);
+    TEST_CHECK(queue.get_state(recorded.slot) == Readback_Queue::Slot_State::Recorded);
+    queue.submit(6);
+    TEST_CHECK(queue.get_state(recorded.slot) == Readback_Queue::Slot_State::In_Flight);
+    queue.update(6);
+    TEST_CHECK(queue.get_state(recorded.slot) == Readback_Queue::Slot_State::Free);
+    TEST_CHECK(queue.get_free_slot_count() == 2);
+}
+
+static void test_release_from_callback()
+{
+    Readback_Queue queue(2);
+    Readback_Ticket ticket;
+    ticket = queue.request([&](uint32_t) { queue.release(ticket); });
+    queue.submit(1);
+    queue.update(1);
+    // Released once, not pushed onto the free list a second time by update().
+    TEST_CHECK(queue.get_free_slot_count() == 2);
+    auto first = queue.request();
+    auto second = queue.request();
+    TEST_CHECK(first.is_valid() && second.is_valid() && first.slot != second.slot);
+    TEST_CHECK(!queue.request().is_valid());
+}
+
+// Frames with random requests, a GPU that completes them GPU_LATENCY frames late by writing the request's
+// id into its slot, and consumers that poll, use callbacks or give up early.
+static void test_simulated_frames()
+{
+    static constexpr uint32_t SLOT_COUNT = 8;
+    static constexpr uint64_t GPU_LATENCY = 2;
+    static constexpr uint32_t FRAME_COUNT = 20000;
+
+    struct Pending
+    {
+        Readback_Ticket ticket;
+        uint64_t id;
+        uint64_t fence_value;
+        bool released;
+    };
+
+    Readback_Queue queue(SLOT_COUNT);
+    std::mt19937 random(1);
+    std::vector<uint64_t> slot_data(SLOT_COUNT, 0);
+    // Copies recorded per frame, the GPU writes them when the frame's fence value completes.
+    std::deque<std::vector<std::pair<uint32_t, uint64_t>>> gpu_frames;
+    std::vector<Pending> polled;
+    uint64_t next_id = 1;
+    uint64_t callback_count = 0;
+    uint64_t requested_callback_count = 0;
+    uint64_t read_count = 0;
+    uint64_t full_count = 0;
+
+    for (uint64_t fence_value = 1; fence_value <= FRAME_COUNT + GPU_LATENCY; ++fence_value)
+    {
+        // The GPU finishes the frame GPU_LATENCY frames back, then the CPU sees its fence value.
+        uint64_t completed = fence_value > GPU_LATENCY + 1 ? fence_value - GPU_LATENCY - 1 : 0;
+        if (!gpu_frames.empty() && fence_value > GPU_LATENCY + 1)
+        {
+            for (auto [slot, id] : gpu_frames.front())
+            {
+                slot_data[slot] = id;
+            }
+            gpu_frames.pop_front();
+        }
+        queue.update(completed);
+
+        for (auto& pending : polled)
+        {
+            if (pending.released)
+            {
+                continue;
+            }
+            auto slot = queue.try_get(pending.ticket);
+            TEST_CHECK((slot != INVALID_READBACK_SLOT) == (pending.fence_value <= completed));
+            if (slot != INVALID_READBACK_SLOT)
+            {
+                TEST_CHECK(slot_data[slot] == pending.id);
+                read_count += 1;
+                // Sometimes the consumer keeps the data for a few frames before releasing it.
+                if (random() % 3 != 0)
+                {
+                    queue.release(pending.ticket);
+                    pending.released = true;
+                }
+            }
+            else if (random() % 8 == 0)
+            {
+                queue.release(pending.ticket);
+                pending.released = true;
+            }
+        }
+        std::erase_if(polled, [](const Pending& pending) { return pending.released; });
+
+        gpu_frames.emplace_back();
+        if (fence_value <= FRAME_COUNT)
+        {
+            auto request_count = random() % 4;
+            for (uint32_t i = 0; i < request_count; ++i)
+            {
+                auto id = next_id++;
+                Readback_Ticket ticket;
+                if (random() % 2 == 0)
+                {
+                    ticket = queue.request([&, id, fence_value](uint32_t slot) {
+                        TEST_CHECK(slot_data[slot] == id);
+                        TEST_CHECK(queue.get_state(slot) == Readback_Queue::Slot_State::Ready);
+                        callback_count += 1;
+                    });
+                    requested_callback_count += ticket.is_valid();
+                }
+                else
+                {
+                    ticket = queue.request();
+                    if (ticket.is_valid())
+                    {
+                        polled.push_back({ ticket, id, fence_value, false });
+                    }
+                }
+                if (!ticket.is_valid())
+                {
+                    full_count += 1;
+                    continue;
+                }
+                gpu_frames.back().push_back({ ticket.slot, id });
+            }
+        }
+        queue.submit(fence_value);
+
+        // Every slot is accounted for: free, or held by a recorded, in flight or ready request.
+        uint32_t free_count = 0;
+        for (uint32_t slot = 0; slot < SLOT_COUNT; ++slot)
+        {
+            free_count += queue.get_state(slot) == Readback_Queue::Slot_State::Free;
+        }
+        TEST_CHECK(free_count == queue.get_free_slot_count());
+    }
+    // Drain: the rest completes, then only the polled requests nobody released still hold slots.
+    queue.update(~0ull);
+    for (auto& pending : polled)
+    {
+        queue.release(pending.ticket);
+    }
+    TEST_CHECK(queue.get_free_slot_count() == SLOT_COUNT);
+    TEST_CHECK(callback_count == requested_callback_count);
+    TEST_CHECK(read_count > 0 && full_count > 0);
+}
+
+int main()
+{
+    test_polling();
+    test_callbacks_and_order();
+    test_exhaustion_and_stale_tickets();
+    test_release_in_flight();
+    test_release_from_callback();
+    test_simulated_frames();
+    return finish_test();
+}
@@ -0,0 +1,448 @@
+#include "render_graph.h"
+#include "test_check.h"
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+// Render_Graph::compile on small hand-built graphs for culling, scheduling, barriers and transient
+// aliasing, then on random graphs whose results are checked against the declared accesses.
+
+static std::vector<uint32_t> get_order(const Compiled_Render_Graph& compiled)
+{
+    std::vector<uint32_t> order;
+    for (const auto& pass : compiled.passes)
+    {
+        order.push_back(pass.pass);
+    }
+    return order;
+}
+
+static void test_culling()
+{
+    Render_Graph graph;
+    auto backbuffer = graph.import_resource("backbuffer");
+    auto unused = graph.create_resource("unused", 256, 256);
+    auto shadow = graph.create_resource("shadow", 256, 256);
+    auto log = graph.create_resource("log", 256, 256);
+    auto unused_pass = graph.add_pass("unused", Render_Graph_Pass_Type::Compute);
+    graph.write(unused_pass, unused, Resource_Usage::Unordered_Access);
+    auto shadow_pass = graph.add_pass("shadow", Render_Graph_Pass_Type::Graphics);
+    graph.write(shadow_pass, shadow, Resource_Usage::Depth_Write);
+    auto log_pass = graph.add_pass("log", Render_Graph_Pass_Type::Compute);
+    graph.write(log_pass, log, Resource_Usage::Unordered_Access);
+    auto readback_pass = graph.add_pass("readback", Render_Graph_Pass_Type::Copy);
+    graph.read(readback_pass, log, Resource_Usage::Copy_Source);
+    graph.set_side_effects(readback_pass);
+    auto main_pass = graph.add_pass("main", Render_Graph_Pass_Type::Graphics);
+    graph.read(main_pass, shadow, Resource_Usage::Shader_Read);
+    graph.write(main_pass, backbuffer, Resource_Usage::Render_Target);
+    // Reads the unused resource after everything that matters, still contributes to nothing.
+    auto late_pass = graph.add_pass("late", Render_Graph_Pass_Type::Compute);
+    graph.read(late_pass, unused, Resource_Usage::Shader_Read);
+
+    Compiled_Render_Graph compiled;
+    graph.compile(compiled);
+    auto order = get_order(compiled);
+    TEST_CHECK(order.size() == 4);
+    for (auto culled : { unused_pass, late_pass })
+    {
+        TEST_CHECK(std::find(order.begin(), order.end(), culled.index) == order.end());
+    }
+    for (auto kept : { shadow_pass, log_pass, readback_pass, main_pass })
+    {
+        TEST_CHECK(std::find(order.begin(), order.end(), kept.index) != order.end());
+    }
+    // Culled passes leave no memory behind.
+    TEST_CHECK(compiled.transient_offsets[unused.index] == INVALID_TRANSIENT_OFFSET);
+
+    // A write is a read-modify-write, the writer before it stays live.
+    Render_Graph chain;
+    auto target = chain.import_resource("target");
+    auto first = chain.add_pass("first", Render_Graph_Pass_Type::Graphics);
+    chain.write(first, target, Resource_Usage::Render_Target);
+    auto second = chain.add_pass("second", Render_Graph_Pass_Type::Graphics);
+    chain.write(second, target, Resource_Usage::Render_Target);
+    chain.compile(compiled);
+    TEST_CHECK((get_order(compiled) == std::vector<uint32_t> { first.index, second.index }));
+}
+
+static void test_scheduling()
+{
+    // b depends on a, c is independent. c is moved between them so a's barrier has work to overlap with.
+    Render_Graph graph;
+    auto output = graph.import_resource("output");
+    auto temp = graph.create_resource("temp", 1024, 256);
+    auto other = graph.import_resource("other");
+    auto a = graph.add_pass("a", Render_Graph_Pass_Type::Compute);
+    graph.write(a, temp, Resource_Usage::Unordered_Access);
+    auto b = graph.add_pass("b", Render_Graph_Pass_Type::Compute);
+    graph.read(b, temp, Resource_Usage::Shader_Read);
+    graph.write(b, output, Resource_Usage::Unordered_Access);
+    auto c = graph.add_pass("c", Render_Graph_Pass_Type::Graphics);
+    graph.write(c, other, Resource_Usage::Render_Target);
+    Compiled_Render_Graph compiled;
+    graph.compile(compiled);
+    TEST_CHECK((get_order(compiled) == std::vector<uint32_t> { a.index, c.index, b.index }));
+    TEST_CHECK((compiled.passes[2].dependencies == std::vector<uint32_t> { 0 }));
+    TEST_CHECK(compiled.passes[1].dependencies.empty());
+
+    // Write after read: the second writer waits for the reader even though it does not read itself.
+    Render_Graph war;
+    auto shared = war.import_resource("shared");
+    auto result = war.import_resource("result");
+    auto writer = war.add_pass("writer", Render_Graph_Pass_Type::Compute);
+    war.write(writer, shared, Resource_Usage::Unordered_Access);
+    auto reader = war.add_pass("reader", Render_Graph_Pass_Type::Compute);
+    war.read(reader, shared, Resource_Usage::Shader_Read);
+    war.write(reader, result, Resource_Usage::Unordered_Access);
+    auto overwriter = war.add_pass("overwriter", Render_Graph_Pass_Type::Copy);
+    war.write(overwriter, shared, Resource_Usage::Copy_Dest);
+    war.compile(compiled);
+    TEST_CHECK((get_order(compiled) == std::vector<uint32_t> { writer.index, reader.index, overwriter.index }));
+    TEST_CHECK((compiled.passes[2].dependencies == std::vector<uint32_t> { 0, 1 }));
+}
+
+static void test_barriers()
+{
+    Render_Graph graph;
+    auto texture = graph.import_resource("texture", { Resource_Usage::Shader_Read, RENDER_GRAPH_STAGE_GRAPHICS | RENDER_GRAPH_STAGE_COMPUTE });
+    auto target = graph.import_resource("target", { Resource_Usage::Present, RENDER_GRAPH_STAGE_NONE });
+    auto untouched = graph.import_resource("untouched", { Resource_Usage::Copy_Source, RENDER_GRAPH_STAGE_COPY });
+    auto first_write = graph.add_pass("first write", Render_Graph_Pass_Type::Compute);
+    graph.write(first_write, texture, Resource_Usage::Unordered_Access);
+    auto second_write = graph.add_pass("second write", Render_Graph_Pass_Type::Compute);
+    graph.write(second_write, texture, Resource_Usage::Unordered_Access);
+    auto graphics_read = graph.add_pass("graphics read", Render_Graph_Pass_Type::Graphics);
+    graph.read(graphics_read, texture, Resource_Usage::Shader_Read);
+    graph.write(graphics_read, target, Resource_Usage::Render_Target);
+    auto compute_read = graph.add_pass("compute read", Render_Graph_Pass_Type::Compute);
+    graph.read(compute_read, texture, Resource_Usage::Shader_Read);
+    graph.write(compute_read, target, Resource_Usage::Unordered_Access);
+    // Read then write in one pass counts as the write.
+    graph.read(compute_read, target, Resource_Usage::Shader_Read);
+
+    Compiled_Render_Graph compiled;
+    graph.compile(compiled);
+    TEST_CHECK((get_order(compiled) == std::vector<uint32_t> { 0, 1, 2, 3 }));
+    auto find_barrier = [&](uint32_t position, Render_Graph_Resource_Handle resource) -> const Render_Graph_Barrier* {
+        for (const auto& barrier : compiled.passes[position].barriers)
+        {
+            if (barrier.resource == resource.index)
+            {
+                return &barrier;
+            }
+        }
+        return nullptr;
+    };
+    auto first = find_barrier(0, texture);
+    TEST_CHECK(first && first->is_external && !first->is_discard);
+    TEST_CHECK(first && first->after == (Resource_Access { Resource_Usage::Unordered_Access, RENDER_GRAPH_STAGE_COMPUTE }));
+    // Back to back UAV writes still get a barrier between them.
+    auto second = find_barrier(1, texture);
+    TEST_CHECK(second && !second->is_external && second->before == first->after && second->after == first->after);
+    // Both reads share one barrier covering the graphics and the compute stage.
+    auto read = find_barrier(2, texture);
+    TEST_CHECK(read && read->after == (Resource_Access { Resource_Usage::Shader_Read, RENDER_GRAPH_STAGE_GRAPHICS | RENDER_GRAPH_STAGE_COMPUTE }));
+    TEST_CHECK(find_barrier(3, texture) == nullptr);
+    TEST_CHECK(std::binary_search(compiled.passes[3].dependencies.begin(), compiled.passes[3].dependencies.end(), 2u));
+    auto target_write = find_barrier(3, target);
+    TEST_CHECK(target_write && target_write->before.usage == Resource_Usage::Render_Target);
+    TEST_CHECK(target_write && target_write->after.usage == Resource_Usage::Unordered_Access);
+
+    // Final transitions: none for the texture, whose last access already is the requested one, the
+    // target goes to Present and the untouched resource is transitioned from its external state.
+    TEST_CHECK(compiled.final_barriers.size() == 2);
+    for (const auto& barrier : compiled.final_barriers)
+    {
+        if (barrier.resource == target.index)
+        {
+            TEST_CHECK(!barrier.is_external && barrier.after.usage == Resource_Usage::Present);
+        }
+        else
+        {
+            TEST_CHECK(barrier.resource == untouched.index && barrier.is_external);
+        }
+    }
+    TEST_CHECK(compiled.final_accesses[target.index].usage == Resource_Usage::Present);
+    TEST_CHECK(compiled.final_accesses[texture.index].stages == (RENDER_GRAPH_STAGE_GRAPHICS | RENDER_GRAPH_STAGE_COMPUTE));
+}
+
+static void test_aliasing()
+{
+    Render_Graph graph;
+    auto output = graph.import_resource("output");
+    auto a = graph.create_resource("a", 4096, 1024);
+    auto b = graph.create_resource("b", 4096, 1024);
+    auto c = graph.create_resource("c", 2048, 4096);
+    auto other_group = graph.create_resource("other group", 4096, 1024, 1);
+    auto write_a = graph.add_pass("write a", Render_Graph_Pass_Type::Graphics);
+    graph.write(write_a, a, Resource_Usage::Render_Target);
+    auto a_to_b = graph.add_pass("a to b", Render_Graph_Pass_Type::Compute);
+    graph.read(a_to_b, a, Resource_Usage::Shader_Read);
+    graph.write(a_to_b, b, Resource_Usage::Unordered_Access);
+    // a is dead from here on, c can take its memory.
+    auto b_to_c = graph.add_pass("b to c", Render_Graph_Pass_Type::Compute);
+    graph.read(b_to_c, b, Resource_Usage::Shader_Read);
+    graph.write(b_to_c, c, Resource_Usage::Unordered_Access);
+    graph.write(b_to_c, other_group, Resource_Usage::Unordered_Access);
+    auto resolve = graph.add_pass("resolve", Render_Graph_Pass_Type::Copy);
+    graph.read(resolve, c, Resource_Usage::Copy_Source);
+    graph.read(resolve, other_group, Resource_Usage::Copy_Source);
+    graph.write(resolve, output, Resource_Usage::Copy_Dest);
+
+    Compiled_Render_Graph compiled;
+    graph.compile(compiled);
+    TEST_CHECK(compiled.passes.size() == 4);
+    auto offset_a = compiled.transient_offsets[a.index];
+    auto offset_b = compiled.transient_offsets[b.index];
+    auto offset_c = compiled.transient_offsets[c.index];
+    TEST_CHECK(offset_a != offset_b);
+    TEST_CHECK(offset_c % 4096 == 0);
+    TEST_CHECK(offset_c == offset_a);
+    TEST_CHECK(compiled.memory_group_sizes.size() == 2);
+    TEST_CHECK(compiled.memory_group_sizes[0] == 8192);
+    TEST_CHECK(compiled.memory_group_sizes[1] == 4096);
+    TEST_CHECK(compiled.transient_offsets[output.index] == INVALID_TRANSIENT_OFFSET);
+
+    // c's first barrier discards and waits for the stage that last used a's memory.
+    const Render_Graph_Barrier* discard = nullptr;
+    for (const auto& barrier : compiled.passes[2].barriers)
+    {
+        discard = barrier.resource == c.index ? &barrier : discard;
+    }
+    TEST_CHECK(discard && discard->is_discard && discard->before.usage == Resource_Usage::Undefined);
+    TEST_CHECK(discard && discard->before.stages == RENDER_GRAPH_STAGE_COMPUTE);
+    TEST_CHECK(std::binary_search(compiled.passes[2].dependencies.begin(), compiled.passes[2].dependencies.end(), 1u));
+}
+
+// Random graphs checked against their declarations: culling, hazard order, barrier chains and memory.
+static void test_random_graphs()
+{
+    static constexpr uint32_t GRAPH_COUNT = 2000;
+    std::mt19937 random(3);
+    Compiled_Render_Graph compiled;
+    for (uint32_t g = 0; g < GRAPH_COUNT; ++g)
+    {
+        struct Declared_Access
+        {
+            uint32_t pass;
+            uint32_t resource;
+            Resource_Usage usage;
+            bool is_write;
+        };
+        static constexpr Resource_Usage READS[] = { Resource_Usage::Shader_Read, Resource_Usage::Copy_Source, Resource_Usage::Indirect_Argument };
+        static constexpr Resource_Usage WRITES[] = { Resource_Usage::Unordered_Access, Resource_Usage::Render_Target, Resource_Usage::Copy_Dest };
+
+        Render_Graph graph;
+        auto resource_count = 1 + random() % 8;
+        std::vector<bool> imported(resource_count);
+        std::vector<uint64_t> sizes(resource_count, 0);
+        std::vector<uint64_t> alignments(resource_count, 1);
+        std::vector<uint32_t> groups(resource_count, 0);
+        for (uint32_t r = 0; r < resource_count; ++r)
+        {
+            imported[r] = random() % 4 == 0;
+            if (imported[r])
+            {
+                graph.import_resource("imported");
+            }
+            else
+            {
+                sizes[r] = 256 * (1 + random() % 16);
+                alignments[r] = 256u << (random() % 3);
+                groups[r] = random() % 2;
+                graph.create_resource("transient", sizes[r], alignments[r], groups[r]);
+            }
+        }
+        auto pass_count = 1 + random() % 24;
+        std::vector<Declared_Access> accesses;
+        std::vector<bool> side_effects(pass_count);
+        for (uint32_t p = 0; p < pass_count; ++p)
+        {
+            auto pass = graph.add_pass("pass", Render_Graph_Pass_Type(random() % 3));
+            side_effects[p] = random() % 8 == 0;
+            if (side_effects[p])
+            {
+                graph.set_side_effects(pass);
+            }
+            std::vector<bool> used(resource_count, false);
+            auto access_count = random() % 4;
+            for (uint32_t i = 0; i < access_count; ++i)
+            {
+                auto r = uint32_t(random() % resource_count);
+                if (used[r])
+                {
+                    continue;
+                }
+                used[r] = true;
+                bool is_write = random() % 2 == 0;
+                auto usage = is_write ? WRITES[random() % 3] : READS[random() % 3];
+                accesses.push_back({ p, r, usage, is_write });
+                if (is_write)
+                {
+                    graph.write(pass, { r }, usage);
+                }
+                else
+                {
+                    graph.read(pass, { r }, usage);
+                }
+            }
+        }
+        graph.compile(compiled);
+
+        // Reference culling: outputs and, transitively, the last writer before each of a live pass's accesses.
+        std::vector<bool> live(pass_count, false);
+        for (int p = int(pass_count) - 1; p >= 0; --p)
+        {
+            bool is_output = side_effects[p];
+            for (const auto& access : accesses)
+            {
+                is_output = is_output || (access.pass == uint32_t(p) && access.is_write && imported[access.resource]);
+            }
+            live[p] = live[p] || is_output;
+            if (!live[p])
+            {
+                continue;
+            }
+            for (const auto& access : accesses)
+            {
+                if (access.pass != uint32_t(p))
+                {
+                    continue;
+                }
+                for (int q = p - 1; q >= 0; --q)
+                {
+                    bool writes = false;
+                    for (const auto& other : accesses)
+                    {
+                        writes = writes || (other.pass == uint32_t(q) && other.resource == access.resource && other.is_write);
+                    }
+                    if (writes)
+                    {
+                        live[q] = true;
+                        break;
+                    }
+                }
+            }
+        }
+        std::vector<uint32_t> positions(pass_count, INVALID_RENDER_GRAPH_INDEX);
+        for (uint32_t i = 0; i < compiled.passes.size(); ++i)
+        {
+            TEST_CHECK(positions[compiled.passes[i].pass] == INVALID_RENDER_GRAPH_INDEX);
+            positions[compiled.passes[i].pass] = i;
+        }
+        for (uint32_t p = 0; p < pass_count; ++p)
+        {
+            TEST_CHECK(live[p] == (positions[p] != INVALID_RENDER_GRAPH_INDEX));
+        }
+
+        // Conflicting accesses of live passes keep their declaration order, and dependencies point backwards.
+        for (const auto& a : accesses)
+        {
+            for (const auto& b : accesses)
+            {
+                if (a.pass < b.pass && a.resource == b.resource && (a.is_write || b.is_write) && live[a.pass] && live[b.pass])
+                {
+                    TEST_CHECK(positions[a.pass] < positions[b.pass]);
+                }
+            }
+        }
+        for (uint32_t i = 0; i < compiled.passes.size(); ++i)
+        {
+            for (auto dependency : compiled.passes[i].dependencies)
+            {
+                TEST_CHECK(dependency < i);
+            }
+        }
+
+        // Barrier chains: every live access is covered by a barrier into its usage and stage, each barrier
+        // starts where the previous one of its resource ended.
+        std::vector<Resource_Access> current(resource_count);
+        std::vector<uint32_t> first_use(resource_count, INVALID_RENDER_GRAPH_INDEX);
+        std::vector<uint32_t> last_use(resource_count, 0);
+        for (uint32_t i = 0; i < compiled.passes.size(); ++i)
+        {
+            const auto& pass = compiled.passes[i];
+            for (const auto& barrier : pass.barriers)
+            {
+                auto r = barrier.resource;
+                bool is_first = first_use[r] == INVALID_RENDER_GRAPH_INDEX;
+                TEST_CHECK(barrier.is_external == (is_first && imported[r]));
+                TEST_CHECK(barrier.is_discard == (is_first && !imported[r]));
+                TEST_CHECK(is_first || barrier.before == current[r]);
+                current[r] = barrier.after;
+            }
+            auto stage = uint32_t(1u << uint32_t(graph.get_pass_type(pass.pass)));
+            for (const auto& access : accesses)
+            {
+                if (access.pass != pass.pass)
+                {
+                    continue;
+                }
+                TEST_CHECK(current[access.resource].usage == access.usage);
+                TEST_CHECK((current[access.resource].stages & stage) != 0);
+                if (first_use[access.resource] == INVALID_RENDER_GRAPH_INDEX)
+                {
+                    first_use[access.resource] = i;
+                }
+                last_use[access.resource] = i;
+            }
+        }
+
+        // Passes every compiled pass runs after, directly or through other dependencies.
+        std::vector<std::vector<bool>> runs_after(compiled.passes.size(), std::vector<bool>(compiled.passes.size(), false));
+        for (uint32_t i = 0; i < compiled.passes.size(); ++i)
+        {
+            for (auto dependency : compiled.passes[i].dependencies)
+            {
+                runs_after[i][dependency] = true;
+                for (uint32_t j = 0; j < dependency; ++j)
+                {
+                    runs_after[i][j] = runs_after[i][j] || runs_after[dependency][j];
+                }
+            }
+        }
+
+        // Transients alive at the same time never share memory, and every offset is aligned. A transient
+        // reusing another one's memory runs after the other's last use.
+        for (uint32_t r = 0; r < resource_count; ++r)
+        {
+            auto offset = compiled.transient_offsets[r];
+            TEST_CHECK((offset != INVALID_TRANSIENT_OFFSET) == (!imported[r] && first_use[r] != INVALID_RENDER_GRAPH_INDEX));
+            if (offset == INVALID_TRANSIENT_OFFSET)
+            {
+                continue;
+            }
+            TEST_CHECK(offset % alignments[r] == 0);
+            TEST_CHECK(offset + sizes[r] <= compiled.memory_group_sizes[groups[r]]);
+            for (uint32_t other = r + 1; other < resource_count; ++other)
+            {
+                auto other_offset = compiled.transient_offsets[other];
+                if (other_offset == INVALID_TRANSIENT_OFFSET || groups[other] != groups[r])
+                {
+                    continue;
+                }
+                bool lifetimes_overlap = first_use[r] <= last_use[other] && first_use[other] <= last_use[r];
+                bool memory_overlaps = offset < other_offset + sizes[other] && other_offset < offset + sizes[r];
+                TEST_CHECK(!(lifetimes_overlap && memory_overlaps));
+                if (memory_overlaps && !lifetimes_overlap)
+                {
+                    auto [before, after] = last_use[r] < first_use[other] ? std::pair(r, other) : std::pair(other, r);
+                    TEST_CHECK(runs_after[first_use[after]][last_use[before]]);
+                }
+            }
+        }
+    }
+}
+
+int main()
+{
+    test_culling();
+    test_scheduling();
+    test_barriers();
+    test_aliasing();
+    test_random_graphs();
+    return finish_test();
+}
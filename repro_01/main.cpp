@@ -1,33 +1,70 @@
-#include <../include/d3d12.h>
+#include "cpu_trace.h"
+#include "d3d12_bindless_heap.h"
+#include "d3d12_command_list_pool.h"
+#include "d3d12_common.h"
+#include "d3d12_compute_dispatch.h"
+#include "d3d12_fence.h"
+#include "d3d12_gpu_profiler.h"
+#include "d3d12_indirect.h"
+#include "d3d12_memory_allocator.h"
+#include "d3d12_pipeline_cache.h"
+#include "d3d12_queue_set.h"
+#include "d3d12_readback_ring.h"
+#include "d3d12_render_graph.h"
+#include "d3d12_residency_manager.h"
+#include "d3d12_root_signature_registry.h"
+#include "d3d12_swapchain.h"
+#include "d3d12_upload_ring.h"
+#include "job_system.h"
+#include "resource_state_tracker.h"
+#include "root_constants.h"
+#include "shader_blob.h"
+#if defined(HAS_SHADER_REFLECTION)
+#include "shaders_reflection.h"
+#endif
 #include <array>
+#include <cstddef>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <dxgi1_6.h>
-#include <exception>
-#include <fstream>
+#include <span>
+#include <string_view>
 #include <vector>
-#include <wrl.h>
-
-using Microsoft::WRL::ComPtr;
 
 extern "C" __declspec(dllexport) const uint32_t D3D12SDKVersion = 610;
 extern "C" __declspec(dllexport) extern const char* D3D12SDKPath = ".\\D3D12\\";
 
-ID3D12Device* device_ref;
-void throw_if_failed(HRESULT hr)
+// Mirrors Push_Constants in shader.cs.hlsl.
+struct Push_Constants
 {
-    if (device_ref)
-    {
-        auto device_removal_hr = device_ref->GetDeviceRemovedReason();
-        if (FAILED(device_removal_hr))
-        {
-            printf("Device Removal HRESULT: %u\n", device_removal_hr);
-        }
-    }
-    if (FAILED(hr))
-    {
-        throw std::exception();
-    }
-}
+    uint32_t tex;
+    uint32_t unused1;
+    uint32_t unused2;
+    uint32_t unused3;
+};
+static_assert(sizeof(Push_Constants) == 16);
+static_assert(offsetof(Push_Constants, tex) == 0);
+#if defined(HAS_SHADER_REFLECTION)
+static_assert(find_shader_constant_buffer(SHADER_REFLECTION, "pc")->size == sizeof(Push_Constants));
+static_assert(find_shader_constant(SHADER_REFLECTION, "pc", "tex")->offset == offsetof(Push_Constants, tex));
+static_assert(find_shader_constant(SHADER_REFLECTION, "pc", "unused3")->offset == offsetof(Push_Constants, unused3));
+#endif
+
+// Mirrors Frame_Constants in shader.cs.hlsl, bound as a root CBV from the upload ring.
+struct Frame_Constants
+{
+    uint32_t frame_number;
+    uint32_t width;
+    uint32_t height;
+    uint32_t unused;
+};
+static_assert(sizeof(Frame_Constants) == 16);
+#if defined(HAS_SHADER_REFLECTION)
+static_assert(find_shader_constant_buffer(SHADER_REFLECTION, "fc")->size == sizeof(Frame_Constants));
+static_assert(find_shader_constant(SHADER_REFLECTION, "fc", "width")->offset == offsetof(Frame_Constants, width));
+static_assert(find_shader_constant(SHADER_REFLECTION, "fc", "height")->offset == offsetof(Frame_Constants, height));
+#endif
 
 static bool window_alive = false;
 static uint32_t window_width = 0;
@@ -107,50 +144,9 @@ HWND create_window(uint32_t width, uint32_t height, const char* title)
     return result;
 }
 
-DWORD d3d12_queue_wait_idle(ID3D12Device* device, ID3D12CommandQueue* queue)
-{
-    DWORD result = WAIT_FAILED;
-    ComPtr<ID3D12Fence> fence;
-    throw_if_failed(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&fence)));
-    throw_if_failed(queue->Signal(fence.Get(), 1));
-    if (fence->GetCompletedValue() < 1)
-    {
-        HANDLE event_handle = CreateEvent(NULL, FALSE, FALSE, NULL);
-        throw_if_failed(fence->SetEventOnCompletion(1, event_handle));
-        if (event_handle != 0)
-        {
-            result = WaitForSingleObject(event_handle, INFINITE);
-            CloseHandle(event_handle);
-        }
-    }
-    else
-    {
-        result = WAIT_OBJECT_0;
-    }
-    return result;
-}
-
-std::vector<uint8_t> read_binary_file(const char* path)
-{
-    std::vector<uint8_t> result;
-    std::ifstream file(path, std::ios::binary);
-    file.unsetf(std::ios::skipws);
-    std::streampos file_size;
-    file.seekg(0, std::ios::end);
-    file_size = file.tellg();
-    file.seekg(0, std::ios::beg);
-    result.reserve(file_size);
-    result.insert(
-        result.begin(),
-        std::istream_iterator<uint8_t>(file),
-        std::istream_iterator<uint8_t>());
-    file.close();
-    return result;
-}
-
 int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[])
 {
-    static constexpr uint32_t MAX_SWAPCHAIN_BUFFERS = 2;
+    static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 2;
 
     HWND window = create_window(1280, 720, "D3D12 Renderdoc Crash Repro");
     ComPtr<IDXGIFactory7> factory;
@@ -174,110 +170,112 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[])
         .NodeMask = 0
     };
     throw_if_failed(device->CreateCommandQueue(&queue_desc, IID_PPV_ARGS(&queue)));
-    ComPtr<ID3D12DescriptorHeap> rtv_descriptor_heap;
-    D3D12_DESCRIPTOR_HEAP_DESC rtv_descriptor_heap_desc = {
-        .Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV,
-        .NumDescriptors = MAX_SWAPCHAIN_BUFFERS,
-        .Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE,
-        .NodeMask = 0
-    };
-    throw_if_failed(device->CreateDescriptorHeap(&rtv_descriptor_heap_desc, IID_PPV_ARGS(&rtv_descriptor_heap)));
-    ComPtr<IDXGISwapChain1> swapchain1;
-    DXGI_SWAP_CHAIN_DESC1 swapchain_desc = {
-        .Format = DXGI_FORMAT_R8G8B8A8_UNORM,
-        .SampleDesc = { .Count = 1, .Quality = 0 },
-        .BufferCount = MAX_SWAPCHAIN_BUFFERS,
-        .Scaling = DXGI_SCALING_STRETCH,
-        .SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD,
-        .AlphaMode = DXGI_ALPHA_MODE_UNSPECIFIED,
-        .Flags = 0
-    };
-    throw_if_failed(factory->CreateSwapChainForHwnd(queue.Get(), window, &swapchain_desc, nullptr, nullptr, &swapchain1));
-    ComPtr<IDXGISwapChain4> swapchain;
-    throw_if_failed(swapchain1->QueryInterface(IID_PPV_ARGS(&swapchain)));
-    std::array<ComPtr<ID3D12Resource>, MAX_SWAPCHAIN_BUFFERS> swapchain_buffers = {};
-    std::array<D3D12_CPU_DESCRIPTOR_HANDLE, MAX_SWAPCHAIN_BUFFERS> swapchain_descriptors = {};
-    for (uint32_t i = 0; i < MAX_SWAPCHAIN_BUFFERS; ++i)
-    {
-        swapchain->GetBuffer(i, IID_PPV_ARGS(&swapchain_buffers[i]));
-        auto descriptor_handle = rtv_descriptor_heap->GetCPUDescriptorHandleForHeapStart();
-        auto increment = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
-        descriptor_handle.ptr += i * increment;
-        D3D12_RENDER_TARGET_VIEW_DESC rtv_desc = {
-            .Format = DXGI_FORMAT_R8G8B8A8_UNORM,
-            .ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2D,
-            .Texture2D = {
-                .MipSlice = 0,
-                .PlaneSlice = 0
-            }
-        };
-        device->CreateRenderTargetView(swapchain_buffers[i].Get(), &rtv_desc, descriptor_handle);
-        swapchain_descriptors[i] = descriptor_handle;
-    }
+    Resource_State_Registry resource_states;
+    Present_Settings present_settings = {};
+    D3D12_Swapchain swapchain(
+        factory.Get(), device.Get(), queue.Get(), window, window_width, window_height,
+        present_settings, DXGI_FORMAT_R8G8B8A8_UNORM, &resource_states);
 
-    ComPtr<ID3D12CommandAllocator> cmd_allocator;
-    throw_if_failed(device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&cmd_allocator)));
-    ComPtr<ID3D12GraphicsCommandList7> cmd;
-    throw_if_failed(device->CreateCommandList1(0, D3D12_COMMAND_LIST_TYPE_DIRECT, D3D12_COMMAND_LIST_FLAG_NONE, IID_PPV_ARGS(&cmd)));
+    D3D12_Fence queue_fence(device.Get(), queue.Get());
+    Frame_Ring frame_ring(queue_fence, MAX_FRAMES_IN_FLIGHT);
+    Steady_Present_Clock present_clock;
+    Present_Pacer present_pacer(swapchain, present_clock, frame_ring, present_settings, window_width, window_height);
+    Job_System job_system;
+    D3D12_Queue_Set queues(device.Get(), queue.Get());
+    D3D12_Command_List_Pool cmd_pools[QUEUE_TYPE_COUNT] = {
+        { device.Get(), D3D12_COMMAND_LIST_TYPE_DIRECT, job_system.get_thread_count(), MAX_FRAMES_IN_FLIGHT },
+        { device.Get(), D3D12_COMMAND_LIST_TYPE_COMPUTE, job_system.get_thread_count(), MAX_FRAMES_IN_FLIGHT },
+        { device.Get(), D3D12_COMMAND_LIST_TYPE_COPY, job_system.get_thread_count(), MAX_FRAMES_IN_FLIGHT }
+    };
 
-    ComPtr<ID3D12RootSignature> rootsig;
+    D3D12_Root_Signature_Registry root_signatures(device.Get());
+    D3D12_Root_Signature rootsig;
     {
-        ComPtr<ID3DBlob> rootsig_error_blob;
-        ComPtr<ID3DBlob> rootsig_blob;
-
-        D3D12_ROOT_PARAMETER1 global_rootsig_param = {
-            .ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS,
-            .Constants = {
-                .ShaderRegister = 0,
-                .RegisterSpace = 0,
-                .Num32BitValues = 4
+        D3D12_ROOT_PARAMETER1 global_rootsig_params[] = {
+            {
+                .ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS,
+                .Constants = {
+                    .ShaderRegister = 0,
+                    .RegisterSpace = 0,
+                    .Num32BitValues = ROOT_CONSTANT_COUNT<Push_Constants>
+                },
+                .ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL
             },
-            .ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL
+            {
+                .ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV,
+                .Descriptor = {
+                    .ShaderRegister = 1,
+                    .RegisterSpace = 0,
+                    .Flags = D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC
+                },
+                .ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL
+            }
         };
         D3D12_VERSIONED_ROOT_SIGNATURE_DESC versioned_rootsig_desc = {
             .Version = D3D_ROOT_SIGNATURE_VERSION_1_1,
             .Desc_1_2 = {
-                .NumParameters = 1,
-                .pParameters = &global_rootsig_param,
+                .NumParameters = UINT(std::size(global_rootsig_params)),
+                .pParameters = global_rootsig_params,
                 .NumStaticSamplers = 0,
                 .pStaticSamplers = nullptr,
                 .Flags = D3D12_ROOT_SIGNATURE_FLAG_CBV_SRV_UAV_HEAP_DIRECTLY_INDEXED
                     | D3D12_ROOT_SIGNATURE_FLAG_SAMPLER_HEAP_DIRECTLY_INDEXED
             }
         };
-        throw_if_failed(D3D12SerializeVersionedRootSignature(&versioned_rootsig_desc, &rootsig_blob, &rootsig_error_blob));
-        throw_if_failed(device->CreateRootSignature(
-            0, rootsig_blob->GetBufferPointer(), rootsig_blob->GetBufferSize(), IID_PPV_ARGS(&rootsig)));
+        rootsig = root_signatures.get_or_create(versioned_rootsig_desc);
     }
 
-    ComPtr<ID3D12PipelineState> compute_pso;
+    static constexpr const char* PIPELINE_CACHE_PATH = "pipeline_cache.bin";
+    Pipeline_Cache pipeline_cache(get_pipeline_cache_device_hash(get_pipeline_cache_device_id(adapter.Get())));
+    pipeline_cache.load(PIPELINE_CACHE_PATH);
+    // Prefer the archive from the shader build, shader.bin is the default variant and the others are
+    // optional builds with different numthreads.
+    Shader_Archive shader_archive;
+    std::vector<Mapped_File> shader_files;
+    std::vector<Shader_Blob> shaders;
+    std::vector<Thread_Group_Size> shader_group_sizes;
+#if defined(HAS_SHADER_REFLECTION)
+    if (shader_archive.open("shaders.bin"))
     {
-        auto shader = read_binary_file("shader.bin");
-        D3D12_COMPUTE_PIPELINE_STATE_DESC pso_desc = {
-            .pRootSignature = rootsig.Get(),
-            .CS = {
-                .pShaderBytecode = shader.data(),
-                .BytecodeLength = shader.size()
-            },
-            .NodeMask = 0,
-            .CachedPSO = {
-                .pCachedBlob = nullptr,
-                .CachedBlobSizeInBytes = 0
-            },
-            .Flags = D3D12_PIPELINE_STATE_FLAG_NONE
-        };
-        throw_if_failed(device->CreateComputePipelineState(&pso_desc, IID_PPV_ARGS(&compute_pso)));
+        for (const auto& reflection : SHADER_REFLECTIONS)
+        {
+            auto shader = shader_archive.find(reflection.name);
+            if (std::string_view(reflection.entry_point) == "cs_main" && !shader.empty())
+            {
+                shaders.push_back(shader);
+                shader_group_sizes.push_back(reflection.thread_group_size);
+            }
+        }
+    }
+#endif
+    if (shaders.empty())
+    {
+        for (auto path : { "shader.bin", "shader_8x8.bin", "shader_16x16.bin", "shader_64x4.bin" })
+        {
+            Mapped_File shader(path);
+            if (shader.is_open())
+            {
+                shaders.push_back({ shader.data(), shader.size() });
+                shader_files.push_back(std::move(shader));
+            }
+        }
+    }
+    if (shaders.empty())
+    {
+        throw std::exception();
+    }
+    D3D12_Compute_Kernel compute_kernel(
+        device.Get(), pipeline_cache, "cs_main", rootsig.root_signature, rootsig.blob, shaders, shader_group_sizes);
+    shader_files.clear();
+    if (pipeline_cache.is_dirty())
+    {
+        pipeline_cache.save(PIPELINE_CACHE_PATH);
     }
 
-    ComPtr<ID3D12DescriptorHeap> descriptor_heap;
-    D3D12_DESCRIPTOR_HEAP_DESC descriptor_heap_desc = {
-        .Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV,
-        .NumDescriptors = D3D12_MAX_SHADER_VISIBLE_DESCRIPTOR_HEAP_SIZE_TIER_2,
-        .Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE,
-        .NodeMask = 0
-    };
-    throw_if_failed(device->CreateDescriptorHeap(&descriptor_heap_desc, IID_PPV_ARGS(&descriptor_heap)));
+    D3D12_Bindless_Heap descriptor_heap(
+        device.Get(), D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, D3D12_MAX_SHADER_VISIBLE_DESCRIPTOR_HEAP_SIZE_TIER_2);
 
+    D3D12_Memory_Allocator memory_allocator(device.Get());
     ComPtr<ID3D12Resource> resource;
     D3D12_RESOURCE_DESC1 res_desc = {
         .Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D,
@@ -296,17 +294,11 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[])
             .Depth = 0
         }
     };
-    D3D12_HEAP_PROPERTIES heap_props = {
-        .Type = D3D12_HEAP_TYPE_DEFAULT,
-        .CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
-        .MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN,
-        .CreationNodeMask = 0,
-        .VisibleNodeMask = 0
-    };
-    throw_if_failed(device->CreateCommittedResource3(
-        &heap_props, D3D12_HEAP_FLAG_NONE, &res_desc, D3D12_BARRIER_LAYOUT_UNDEFINED,
-        nullptr, nullptr, 0, nullptr, IID_PPV_ARGS(&resource)));
-    D3D12_CPU_DESCRIPTOR_HANDLE resource_handle = descriptor_heap->GetCPUDescriptorHandleForHeapStart();
+    D3D12_Allocation resource_allocation;
+    resource = memory_allocator.create_resource(
+        D3D12_HEAP_TYPE_DEFAULT, res_desc, D3D12_BARRIER_LAYOUT_UNDEFINED, nullptr, resource_allocation);
+    auto resource_descriptor = descriptor_heap.get_allocator().allocate();
+    D3D12_CPU_DESCRIPTOR_HANDLE resource_handle = descriptor_heap.get_cpu_handle(resource_descriptor);
     D3D12_UNORDERED_ACCESS_VIEW_DESC uav_desc = {
         .Format = DXGI_FORMAT_R32G32B32A32_UINT,
         .ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D,
@@ -317,90 +309,298 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[])
     };
     device->CreateUnorderedAccessView(resource.Get(), nullptr, &uav_desc, resource_handle);
 
+    resource_states.register_resource(resource.Get(), { .mip_levels = 1, .array_size = 1, .plane_count = 1 });
+    D3D12_Residency_Manager residency(device.Get(), adapter.Get());
+    auto resource_residency = residency.track(
+        resource_allocation.heap, resource_allocation.heap->GetDesc().SizeInBytes, DXGI_MEMORY_SEGMENT_GROUP_LOCAL);
+    std::array<ID3D12CommandQueue*, QUEUE_TYPE_COUNT> all_queues = {};
+    for (uint32_t i = 0; i < QUEUE_TYPE_COUNT; ++i)
+    {
+        all_queues[i] = queues.get_queue(Queue_Type(i));
+    }
+    D3D12_Render_Graph render_graph(device.Get(), memory_allocator, resource_states);
+    D3D12_Gpu_Profiler gpu_profiler(device.Get(), queue.Get(), MAX_FRAMES_IN_FLIGHT);
+    // Per-frame constants, a frame's region is reused once the frame fence passed it.
+    D3D12_Upload_Ring upload_ring(device.Get(), 64 * 1024);
+
+    // cs_main runs through ExecuteIndirect: its push constants and group count are a command staged in
+    // the upload ring and copied into the argument buffer by a copy pass, the way a GPU emitter would write it.
+    auto dispatch_layout = Indirect_Command_Layout_Builder()
+        .add_constants<Push_Constants>(0)
+        .add_dispatch()
+        .build();
+    auto dispatch_signature = create_command_signature(device.Get(), dispatch_layout, rootsig.root_signature);
+    D3D12_Indirect_Argument_Buffer indirect_arguments(device.Get(), 4 * 1024);
+    resource_states.register_resource(indirect_arguments.get_resource(), { .is_buffer = true });
+
+    // Every READBACK_INTERVAL frames the texture is copied back and compared with what cs_main writes,
+    // the same data cpu_reference produces.
+    static constexpr uint32_t READBACK_INTERVAL = 64;
+    D3D12_PLACED_SUBRESOURCE_FOOTPRINT readback_footprint;
+    uint64_t readback_size = 0;
+    device->GetCopyableFootprints1(&res_desc, 0, 1, 0, &readback_footprint, nullptr, nullptr, &readback_size);
+    D3D12_Readback_Ring readback_ring(device.Get(), MAX_FRAMES_IN_FLIGHT, readback_size);
+    uint32_t readback_count = 0;
+    uint32_t readback_mismatch_count = 0;
+    auto check_readback = [&](std::span<const std::byte> data) {
+        readback_count += 1;
+        const auto& footprint = readback_footprint.Footprint;
+        for (uint32_t y = 0; y < footprint.Height; ++y)
+        {
+            for (uint32_t x = 0; x < footprint.Width; ++x)
+            {
+                uint32_t texel[4];
+                memcpy(texel, data.data() + size_t(y) * footprint.RowPitch + size_t(x) * sizeof(texel), sizeof(texel));
+                readback_mismatch_count += texel[0] != x || texel[1] != y || texel[2] != 0 || texel[3] != 0;
+            }
+        }
+    };
+
+    static constexpr const char* DISPATCH_TUNING_PATH = "dispatch_tuning.bin";
+    Dispatch_Autotuner dispatch_autotuner(get_pipeline_cache_device_hash(get_pipeline_cache_device_id(adapter.Get())));
+    dispatch_autotuner.load(DISPATCH_TUNING_PATH);
+    std::array<uint32_t, MAX_FRAMES_IN_FLIGHT> dispatch_variants = {};
+
+    // Frames [0, TRACE_FRAME_COUNT) are written to a trace from both sides, later ones only feed the
+    // profiler statistics. The CPU tracer holds the previous frame's scopes when a frame begins, the GPU
+    // profiler the results of the frame MAX_FRAMES_IN_FLIGHT back.
+    static constexpr uint32_t TRACE_FRAME_COUNT = 256;
+    auto is_traced_frame = [](int64_t frame) { return frame >= 0 && frame < TRACE_FRAME_COUNT; };
+    static constexpr uint32_t TRACE_CPU_PID = 0;
+    static constexpr uint32_t TRACE_GPU_PID = 1;
+    Chrome_Trace trace;
+    trace.set_process_name(TRACE_CPU_PID, "CPU");
+    Cpu_Tracer::get().set_thread_name("Main thread");
+    D3D12_Gpu_Profiler::set_trace_names(trace, TRACE_GPU_PID);
+    uint32_t frame_number = 0;
+
     while (window_alive)
     {
-        MSG msg;
-        ZeroMemory(&msg, sizeof(MSG));
-        while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+        if (is_traced_frame(int64_t(frame_number) - 1))
+        {
+            Cpu_Tracer::get().export_trace(trace, TRACE_CPU_PID);
+        }
+        else
+        {
+            Cpu_Tracer::get().discard();
+        }
+        CPU_TRACE_SCOPE("frame");
+        {
+            CPU_TRACE_SCOPE("pump messages");
+            MSG msg;
+            ZeroMemory(&msg, sizeof(MSG));
+            while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+            {
+                TranslateMessage(&msg);
+                DispatchMessage(&msg);
+            }
+        }
+        present_pacer.request_resize(window_width, window_height);
+        {
+            CPU_TRACE_SCOPE("wait for swapchain");
+            if (present_pacer.begin_frame() == Present_Frame::Skip)
+            {
+                WaitMessage();
+                continue;
+            }
+        }
+        uint32_t frame_index;
+        {
+            CPU_TRACE_SCOPE("wait for frame");
+            frame_index = frame_ring.begin_frame();
+        }
+        gpu_profiler.begin_frame(frame_index);
+        for (const auto& result : gpu_profiler.get_results())
+        {
+            if (result.name == "cs_main")
+            {
+                compute_kernel.report(dispatch_autotuner, dispatch_variants[frame_index], result.duration_us);
+            }
+        }
+        auto dispatch_variant = compute_kernel.select(dispatch_autotuner);
+        dispatch_variants[frame_index] = dispatch_variant;
+        if (is_traced_frame(int64_t(frame_number) - MAX_FRAMES_IN_FLIGHT))
+        {
+            gpu_profiler.write_trace(trace, TRACE_GPU_PID);
+        }
+        descriptor_heap.get_allocator().retire(frame_ring.get_completed_value());
+        readback_ring.update(frame_ring.get_completed_value());
+        render_graph.retire(frame_ring.get_completed_value());
+        upload_ring.retire(frame_ring.get_completed_value());
+        indirect_arguments.retire(frame_ring.get_completed_value());
+        auto frame_constants = upload_ring.allocate_constants(Frame_Constants {
+            .frame_number = frame_number,
+            .width = uint32_t(res_desc.Width),
+            .height = res_desc.Height,
+            .unused = 0
+        });
+        if (!frame_constants.is_valid())
+        {
+            throw std::exception();
+        }
+        auto dispatch_arguments = indirect_arguments.allocate(dispatch_layout, 1);
+        auto dispatch_upload_size = INDIRECT_ARGUMENT_ALIGNMENT + dispatch_layout.byte_stride;
+        auto dispatch_upload = upload_ring.allocate(dispatch_upload_size, INDIRECT_ARGUMENT_ALIGNMENT);
+        if (!dispatch_arguments.is_valid() || !dispatch_upload.is_valid())
+        {
+            throw std::exception();
+        }
+        {
+            // Same layout as the allocation: the count, then the commands INDIRECT_ARGUMENT_ALIGNMENT bytes later.
+            auto upload_bytes = static_cast<uint8_t*>(dispatch_upload.cpu_address);
+            uint32_t command_count = 1;
+            memcpy(upload_bytes, &command_count, sizeof(command_count));
+            Dispatch_Size dispatch_size;
+            if (!get_dispatch_size(uint32_t(res_desc.Width), res_desc.Height, 1,
+                compute_kernel.get_variant(dispatch_variant).group_size, dispatch_size))
+            {
+                throw std::exception();
+            }
+            Indirect_Command_Writer writer(
+                dispatch_layout, { upload_bytes + INDIRECT_ARGUMENT_ALIGNMENT, dispatch_layout.byte_stride });
+            writer.write_constants(0, 0, Push_Constants {
+                .tex = resource_descriptor.index,
+                .unused1 = 1,
+                .unused2 = 2,
+                .unused3 = 3
+            });
+            writer.write_dispatch(0, dispatch_size);
+        }
+        // The copy below writes the count, nothing to zero.
+        indirect_arguments.get_allocator().take_count_offsets();
+        for (auto& cmd_pool : cmd_pools)
         {
-            TranslateMessage(&msg);
-            DispatchMessage(&msg);
+            cmd_pool.begin_frame(frame_index);
         }
-        d3d12_queue_wait_idle(device.Get(), queue.Get());
-        cmd_allocator->Reset();
-        cmd->Reset(cmd_allocator.Get(), nullptr);
-        auto descriptor_heaps = descriptor_heap.Get();
-        cmd->SetDescriptorHeaps(1, &descriptor_heaps);
+        auto current_image = swapchain.get_current_buffer_index();
 
-        D3D12_TEXTURE_BARRIER resbar = {
-            .SyncBefore = D3D12_BARRIER_SYNC_NONE,
-            .SyncAfter = D3D12_BARRIER_SYNC_COMPUTE_SHADING,
-            .AccessBefore = D3D12_BARRIER_ACCESS_NO_ACCESS,
-            .AccessAfter = D3D12_BARRIER_ACCESS_UNORDERED_ACCESS,
-            .LayoutBefore = D3D12_BARRIER_LAYOUT_UNDEFINED,
-            .LayoutAfter = D3D12_BARRIER_LAYOUT_UNORDERED_ACCESS,
-            .pResource = resource.Get(),
-            .Subresources = {
-                .IndexOrFirstMipLevel = 0,
-                .NumMipLevels = 1,
-                .FirstArraySlice = 0,
-                .NumArraySlices = 1,
-                .FirstPlane = 0,
-                .NumPlanes = 1
-            },
-            .Flags = D3D12_TEXTURE_BARRIER_FLAG_NONE
-        };
-        D3D12_BARRIER_GROUP resbargrp = {
-            .Type = D3D12_BARRIER_TYPE_TEXTURE,
-            .NumBarriers = 1,
-            .pTextureBarriers = &resbar
-        };
-        cmd->Barrier(1, &resbargrp);
-        cmd->SetComputeRootSignature(rootsig.Get());
-        cmd->SetGraphicsRootSignature(rootsig.Get());
-        cmd->SetPipelineState(compute_pso.Get());
-        uint32_t constant_data[4] = { 0, 1, 2, 3 };
-        cmd->SetComputeRoot32BitConstants(0, 4, &constant_data, 0);
-        cmd->Dispatch(8, 8, 1);
-        auto current_image = swapchain->GetCurrentBackBufferIndex();
-        D3D12_TEXTURE_BARRIER scbar = {
-            .SyncBefore = D3D12_BARRIER_SYNC_NONE,
-            .SyncAfter = D3D12_BARRIER_SYNC_RENDER_TARGET,
-            .AccessBefore = D3D12_BARRIER_ACCESS_NO_ACCESS,
-            .AccessAfter = D3D12_BARRIER_ACCESS_RENDER_TARGET,
-            .LayoutBefore = D3D12_BARRIER_LAYOUT_UNDEFINED,
-            .LayoutAfter = D3D12_BARRIER_LAYOUT_RENDER_TARGET,
-            .pResource = swapchain_buffers[current_image].Get(),
-            .Subresources = {
-                .IndexOrFirstMipLevel = 0,
-                .NumMipLevels = 1,
-                .FirstArraySlice = 0,
-                .NumArraySlices = 1,
-                .FirstPlane = 0,
-                .NumPlanes = 1
-            },
-            .Flags = D3D12_TEXTURE_BARRIER_FLAG_NONE
-        };
-        D3D12_BARRIER_GROUP scbargrp = {
-            .Type = D3D12_BARRIER_TYPE_TEXTURE,
-            .NumBarriers = 1,
-            .pTextureBarriers = &scbar
-        };
-        cmd->Barrier(1, &scbargrp);
-        float cc[4] = { 1.0f, 0.0f, 0.0f, 0.0f };
-        cmd->ClearRenderTargetView(swapchain_descriptors[current_image], cc, 0, nullptr);
-        scbar.SyncBefore = scbar.SyncAfter;
-        scbar.SyncAfter = D3D12_BARRIER_SYNC_NONE;
-        scbar.AccessBefore = scbar.AccessAfter;
-        scbar.AccessAfter = D3D12_BARRIER_ACCESS_NO_ACCESS;
-        scbar.LayoutBefore = scbar.LayoutAfter;
-        scbar.LayoutAfter = D3D12_BARRIER_LAYOUT_PRESENT;
-        cmd->Barrier(1, &scbargrp);
-        cmd->Close();
-        ID3D12CommandList* submitcmd = cmd.Get();
-        queue->ExecuteCommandLists(1, &submitcmd);
-        swapchain->Present(0, 0);
+        render_graph.begin();
+        auto uav_texture = render_graph.import_resource("uav_texture", resource.Get());
+        auto argument_buffer = render_graph.import_resource("indirect_arguments", indirect_arguments.get_resource());
+        auto backbuffer = render_graph.import_resource("backbuffer", swapchain.get_buffer(current_image), {
+            .usage = Resource_Usage::Present,
+            .stages = RENDER_GRAPH_STAGE_NONE
+        });
+        auto upload_arguments_pass = render_graph.add_pass("upload arguments", Render_Graph_Pass_Type::Copy, [&](ID3D12GraphicsCommandList7* cmd) {
+            cmd->CopyBufferRegion(
+                indirect_arguments.get_resource(), dispatch_arguments.count_offset,
+                dispatch_upload.resource, dispatch_upload.offset, dispatch_upload_size);
+        });
+        render_graph.write(upload_arguments_pass, argument_buffer, Resource_Usage::Copy_Dest);
+        auto compute_pass = render_graph.add_pass("compute", Render_Graph_Pass_Type::Compute, [&](ID3D12GraphicsCommandList7* cmd) {
+            D3D12_Command_State_Cache<> state(cmd);
+            state.set_descriptor_heaps(descriptor_heap.get());
+            state.set_compute_root_signature(rootsig.root_signature);
+            if (cmd->GetType() == D3D12_COMMAND_LIST_TYPE_DIRECT)
+            {
+                state.set_graphics_root_signature(rootsig.root_signature);
+            }
+            cmd->SetComputeRootConstantBufferView(1, frame_constants.gpu_address);
+            state.set_pipeline_state(compute_kernel.get_variant(dispatch_variant).pso.Get());
+            D3D12_Gpu_Profile_Scope scope(gpu_profiler, cmd, "cs_main");
+            // Sets the push constants too, the state cache does not see them.
+            indirect_arguments.execute(cmd, dispatch_signature.Get(), dispatch_arguments);
+        });
+        render_graph.read(compute_pass, argument_buffer, Resource_Usage::Indirect_Argument);
+        render_graph.write(compute_pass, uav_texture, Resource_Usage::Unordered_Access);
+        auto clear_pass = render_graph.add_pass("clear", Render_Graph_Pass_Type::Graphics, [&](ID3D12GraphicsCommandList7* cmd) {
+            float cc[4] = { 1.0f, 0.0f, 0.0f, 0.0f };
+            cmd->ClearRenderTargetView(swapchain.get_descriptor(current_image), cc, 0, nullptr);
+        });
+        render_graph.write(clear_pass, backbuffer, Resource_Usage::Render_Target);
+        // The slot is taken here on the frame thread, the pass only records the copy on a worker.
+        // Without a free slot this readback is skipped, the next interval tries again.
+        Readback_Ticket readback_ticket;
+        if (frame_number % READBACK_INTERVAL == 0)
+        {
+            readback_ticket = readback_ring.request_texture(readback_footprint, check_readback);
+        }
+        if (readback_ticket.is_valid())
+        {
+            auto readback_pass = render_graph.add_pass("readback", Render_Graph_Pass_Type::Copy, [&](ID3D12GraphicsCommandList7* cmd) {
+                readback_ring.record_texture_copy(cmd, readback_ticket, resource.Get(), 0, readback_footprint);
+            });
+            render_graph.read(readback_pass, uav_texture, Resource_Usage::Copy_Source);
+            render_graph.set_side_effects(readback_pass);
+        }
+        {
+            CPU_TRACE_SCOPE("compile graph");
+            render_graph.compile(true);
+        }
+
+        std::vector<ID3D12CommandList*> cmds(render_graph.get_scheduled_pass_count());
+        Job_Counter passes_recorded;
+        for (uint32_t i = 0; i < cmds.size(); ++i)
+        {
+            job_system.submit([&, i]() {
+                CPU_TRACE_SCOPE("record pass");
+                auto& cmd_pool = cmd_pools[uint32_t(render_graph.get_scheduled_pass_queue(i))];
+                auto cmd = cmd_pool.acquire(Job_System::get_thread_index());
+                {
+                    D3D12_Gpu_Profile_Scope scope(gpu_profiler, cmd, render_graph.get_scheduled_pass_name(i), true);
+                    render_graph.record_pass(i, cmd);
+                }
+                throw_if_failed(cmd->Close());
+                cmds[i] = cmd;
+            }, &passes_recorded);
+        }
+        {
+            CPU_TRACE_SCOPE("wait for recording");
+            job_system.wait(passes_recorded);
+        }
+
+        auto join_cmd = cmd_pools[uint32_t(Queue_Type::Direct)].acquire(Job_System::get_thread_index());
+        if (render_graph.needs_final_command_list())
+        {
+            render_graph.record_final_barriers(join_cmd);
+        }
+        gpu_profiler.resolve(join_cmd);
+        throw_if_failed(join_cmd->Close());
+        {
+            CPU_TRACE_SCOPE("submit");
+            // Passes of any queue may touch the texture, the frame fence covers them all.
+            residency.use(resource_residency, frame_ring.get_pending_value());
+            residency.prepare_submit(all_queues, frame_ring.get_completed_value());
+            queues.submit(render_graph.get_queue_plan(), cmds, join_cmd);
+            readback_ring.submit(frame_ring.get_pending_value());
+        }
+        {
+            CPU_TRACE_SCOPE("present");
+            present_pacer.present();
+        }
+        render_graph.end(frame_ring.get_pending_value());
+        upload_ring.end_frame(frame_ring.get_pending_value());
+        indirect_arguments.end_frame(frame_ring.get_pending_value());
+        frame_ring.end_frame();
+        frame_number += 1;
+    }
+    {
+        CPU_TRACE_SCOPE("wait idle");
+        frame_ring.wait_idle();
+    }
+    readback_ring.update(frame_ring.get_completed_value());
+    // The frames still in flight at exit go into the trace like any other, GPU results oldest slot first.
+    if (is_traced_frame(int64_t(frame_number) - 1))
+    {
+        Cpu_Tracer::get().export_trace(trace, TRACE_CPU_PID);
+    }
+    for (uint32_t i = 1; i <= MAX_FRAMES_IN_FLIGHT; ++i)
+    {
+        gpu_profiler.begin_frame((frame_ring.get_frame_index() + i) % MAX_FRAMES_IN_FLIGHT);
+        if (is_traced_frame(int64_t(frame_number) - MAX_FRAMES_IN_FLIGHT + i - 1))
+        {
+            gpu_profiler.write_trace(trace, TRACE_GPU_PID);
+        }
+    }
+    trace.write("trace.json");
+    if (dispatch_autotuner.is_dirty())
+    {
+        dispatch_autotuner.save(DISPATCH_TUNING_PATH);
+    }
+    if (readback_mismatch_count > 0)
+    {
+        fprintf(stderr, "%u texels differed from cs_main's output in %u readbacks\n", readback_mismatch_count, readback_count);
+        return 1;
     }
-    d3d12_queue_wait_idle(device.Get(), queue.Get());
     return 0;
 }
@@ -1,57 +1,19 @@
-#include <../include/d3d12.h>
+#include "d3d12_command_recorder.h"
+#include "d3d12_common.h"
+#include "d3d12_copy_engine.h"
+#include "d3d12_fence.h"
+#include "d3d12_swapchain.h"
+#include "resource_state_tracker.h"
 #include <array>
 #include <cstdint>
 #include <dxgi1_6.h>
-#include <exception>
 #include <fstream>
+#include <string>
 #include <vector>
-#include <wrl.h>
-
-using Microsoft::WRL::ComPtr;
 
 extern "C" __declspec(dllexport) const uint32_t D3D12SDKVersion = 618;
 extern "C" __declspec(dllexport) extern const char* D3D12SDKPath = ".\\D3D12\\";
 
-ID3D12Device* device_ref;
-void throw_if_failed(HRESULT hr)
-{
-    if (device_ref)
-    {
-        auto device_removal_hr = device_ref->GetDeviceRemovedReason();
-        if (FAILED(device_removal_hr))
-        {
-            printf("Device Removal HRESULT: %u\n", device_removal_hr);
-        }
-    }
-    if (FAILED(hr))
-    {
-        throw std::exception();
-    }
-}
-
-DWORD d3d12_queue_wait_idle(ID3D12Device* device, ID3D12CommandQueue* queue)
-{
-    DWORD result = WAIT_FAILED;
-    ComPtr<ID3D12Fence> fence;
-    throw_if_failed(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&fence)));
-    throw_if_failed(queue->Signal(fence.Get(), 1));
-    if (fence->GetCompletedValue() < 1)
-    {
-        HANDLE event_handle = CreateEvent(NULL, FALSE, FALSE, NULL);
-        throw_if_failed(fence->SetEventOnCompletion(1, event_handle));
-        if (event_handle != 0)
-        {
-            result = WaitForSingleObject(event_handle, INFINITE);
-            CloseHandle(event_handle);
-        }
-    }
-    else
-    {
-        result = WAIT_OBJECT_0;
-    }
-    return result;
-}
-
 static bool window_alive = false;
 static uint32_t window_width = 0;
 static uint32_t window_height = 0;
@@ -132,7 +94,7 @@ HWND create_window(uint32_t width, uint32_t height, const char* title)
 
 int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[])
 {
-    static constexpr uint32_t MAX_SWAPCHAIN_BUFFERS = 2;
+    static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 2;
 
     HWND window = create_window(1280, 720, "D3D12 Renderdoc Crash Repro");
     ComPtr<IDXGIFactory7> factory;
@@ -156,49 +118,21 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[])
         .NodeMask = 0
     };
     throw_if_failed(device->CreateCommandQueue(&queue_desc, IID_PPV_ARGS(&queue)));
-    ComPtr<ID3D12DescriptorHeap> rtv_descriptor_heap;
-    D3D12_DESCRIPTOR_HEAP_DESC rtv_descriptor_heap_desc = {
-        .Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV,
-        .NumDescriptors = MAX_SWAPCHAIN_BUFFERS,
-        .Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE,
-        .NodeMask = 0
-    };
-    throw_if_failed(device->CreateDescriptorHeap(&rtv_descriptor_heap_desc, IID_PPV_ARGS(&rtv_descriptor_heap)));
-    ComPtr<IDXGISwapChain1> swapchain1;
-    DXGI_SWAP_CHAIN_DESC1 swapchain_desc = {
-        .Format = DXGI_FORMAT_R8G8B8A8_UNORM,
-        .SampleDesc = {.Count = 1, .Quality = 0 },
-        .BufferCount = MAX_SWAPCHAIN_BUFFERS,
-        .Scaling = DXGI_SCALING_STRETCH,
-        .SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD,
-        .AlphaMode = DXGI_ALPHA_MODE_UNSPECIFIED,
-        .Flags = 0
-    };
-    throw_if_failed(factory->CreateSwapChainForHwnd(queue.Get(), window, &swapchain_desc, nullptr, nullptr, &swapchain1));
-    ComPtr<IDXGISwapChain4> swapchain;
-    throw_if_failed(swapchain1->QueryInterface(IID_PPV_ARGS(&swapchain)));
-    std::array<ComPtr<ID3D12Resource>, MAX_SWAPCHAIN_BUFFERS> swapchain_buffers = {};
-    std::array<D3D12_CPU_DESCRIPTOR_HANDLE, MAX_SWAPCHAIN_BUFFERS> swapchain_descriptors = {};
-    for (uint32_t i = 0; i < MAX_SWAPCHAIN_BUFFERS; ++i)
+    Resource_State_Registry resource_states;
+    Present_Settings present_settings = {};
+    D3D12_Swapchain swapchain(
+        factory.Get(), device.Get(), queue.Get(), window, window_width, window_height,
+        present_settings, DXGI_FORMAT_R8G8B8A8_UNORM, &resource_states);
+
+    D3D12_Fence queue_fence(device.Get(), queue.Get());
+    Frame_Ring frame_ring(queue_fence, MAX_FRAMES_IN_FLIGHT);
+    Steady_Present_Clock present_clock;
+    Present_Pacer present_pacer(swapchain, present_clock, frame_ring, present_settings, window_width, window_height);
+    std::array<ComPtr<ID3D12CommandAllocator>, MAX_FRAMES_IN_FLIGHT> cmd_allocators = {};
+    for (auto& cmd_allocator : cmd_allocators)
     {
-        swapchain->GetBuffer(i, IID_PPV_ARGS(&swapchain_buffers[i]));
-        auto descriptor_handle = rtv_descriptor_heap->GetCPUDescriptorHandleForHeapStart();
-        auto increment = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
-        descriptor_handle.ptr += i * increment;
-        D3D12_RENDER_TARGET_VIEW_DESC rtv_desc = {
-            .Format = DXGI_FORMAT_R8G8B8A8_UNORM,
-            .ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2D,
-            .Texture2D = {
-                .MipSlice = 0,
-                .PlaneSlice = 0
-            }
-        };
-        device->CreateRenderTargetView(swapchain_buffers[i].Get(), &rtv_desc, descriptor_handle);
-        swapchain_descriptors[i] = descriptor_handle;
+        throw_if_failed(device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&cmd_allocator)));
     }
-
-    ComPtr<ID3D12CommandAllocator> cmd_allocator;
-    throw_if_failed(device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&cmd_allocator)));
     ComPtr<ID3D12GraphicsCommandList7> cmd;
     throw_if_failed(device->CreateCommandList1(0, D3D12_COMMAND_LIST_TYPE_DIRECT, D3D12_COMMAND_LIST_FLAG_NONE, IID_PPV_ARGS(&cmd)));
 
@@ -252,6 +186,32 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[])
 
     // END RELEVANT SECTION
 
+    // Fills both halves the frames alternate between. The two uploads are adjacent and go out as one copy.
+    D3D12_Copy_Engine copy_engine(device.Get(), { .page_size = 64 * 1024, .max_bytes_per_frame = 64 * 1024 }, 1, 0, MAX_FRAMES_IN_FLIGHT);
+    std::array<uint8_t, 128> initial_data = {};
+    for (uint32_t half = 0; half < 2; ++half)
+    {
+        initial_data.fill(uint8_t(half + 1));
+        copy_engine.get_scheduler().upload_buffer(gpu_resource.Get(), 128 * half, initial_data);
+    }
+    copy_engine.wait(queue.Get(), copy_engine.submit());
+
+    // The first frames are logged to commands.bin, D3D12_Command_Replayer re-issues them by object name.
+    static constexpr uint64_t CAPTURE_FRAME_COUNT = 64;
+    Command_Stream_Objects stream_objects;
+    stream_objects.set_name(gpu_resource.Get(), "gpu_resource");
+    stream_objects.set_name(readback_resource.Get(), "readback_resource");
+    // Resizing recreates the buffers, frames recorded before keep the ids of the old ones.
+    auto name_swapchain_buffers = [&]() {
+        for (uint32_t i = 0; i < swapchain.get_buffer_count(); ++i)
+        {
+            stream_objects.set_name(swapchain.get_buffer(i), "swapchain_buffer_" + std::to_string(i));
+        }
+    };
+    name_swapchain_buffers();
+    Command_Stream_Writer stream_writer;
+    D3D12_Command_Recorder recorder(stream_objects);
+    uint64_t captured_frame_count = 0;
 
     while (window_alive)
     {
@@ -262,59 +222,61 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[])
             TranslateMessage(&msg);
             DispatchMessage(&msg);
         }
-        d3d12_queue_wait_idle(device.Get(), queue.Get());
+        present_pacer.request_resize(window_width, window_height);
+        auto present_frame = present_pacer.begin_frame();
+        if (present_frame == Present_Frame::Skip)
+        {
+            WaitMessage();
+            continue;
+        }
+        if (present_frame == Present_Frame::Render_Resized)
+        {
+            name_swapchain_buffers();
+        }
+        auto frame_index = frame_ring.begin_frame();
+        auto& cmd_allocator = cmd_allocators[frame_index];
         cmd_allocator->Reset();
         cmd->Reset(cmd_allocator.Get(), nullptr);
+        recorder.begin(cmd.Get(), captured_frame_count < CAPTURE_FRAME_COUNT ? &stream_writer : nullptr);
+        Barrier_Batcher barriers(&recorder);
+        Resource_State_Tracker state_tracker(resource_states, barriers, true);
 
 
         // START RELEVANT SECTION
         static uint64_t frame = 0;
 
-        cmd->CopyBufferRegion(readback_resource.Get(), 0, gpu_resource.Get(), 128 * (frame % 2), 128);
+        recorder.CopyBufferRegion(readback_resource.Get(), 0, gpu_resource.Get(), 128 * (frame % 2), 128);
 
         frame += 1;
         // END RELEVANT SECTION
 
 
-        auto current_image = swapchain->GetCurrentBackBufferIndex();
-        D3D12_TEXTURE_BARRIER scbar = {
-            .SyncBefore = D3D12_BARRIER_SYNC_NONE,
-            .SyncAfter = D3D12_BARRIER_SYNC_RENDER_TARGET,
-            .AccessBefore = D3D12_BARRIER_ACCESS_NO_ACCESS,
-            .AccessAfter = D3D12_BARRIER_ACCESS_RENDER_TARGET,
-            .LayoutBefore = D3D12_BARRIER_LAYOUT_UNDEFINED,
-            .LayoutAfter = D3D12_BARRIER_LAYOUT_RENDER_TARGET,
-            .pResource = swapchain_buffers[current_image].Get(),
-            .Subresources = {
-                .IndexOrFirstMipLevel = 0,
-                .NumMipLevels = 1,
-                .FirstArraySlice = 0,
-                .NumArraySlices = 1,
-                .FirstPlane = 0,
-                .NumPlanes = 1
-            },
-            .Flags = D3D12_TEXTURE_BARRIER_FLAG_NONE
-        };
-        D3D12_BARRIER_GROUP scbargrp = {
-            .Type = D3D12_BARRIER_TYPE_TEXTURE,
-            .NumBarriers = 1,
-            .pTextureBarriers = &scbar
-        };
-        cmd->Barrier(1, &scbargrp);
+        auto current_image = swapchain.get_current_buffer_index();
+        state_tracker.transition(swapchain.get_buffer(current_image), {
+            .layout = D3D12_BARRIER_LAYOUT_RENDER_TARGET,
+            .sync = D3D12_BARRIER_SYNC_RENDER_TARGET,
+            .access = D3D12_BARRIER_ACCESS_RENDER_TARGET
+        });
+        barriers.flush();
         float cc[4] = { 1.0f, 0.0f, 0.0f, 0.0f };
-        cmd->ClearRenderTargetView(swapchain_descriptors[current_image], cc, 0, nullptr);
-        scbar.SyncBefore = scbar.SyncAfter;
-        scbar.SyncAfter = D3D12_BARRIER_SYNC_NONE;
-        scbar.AccessBefore = scbar.AccessAfter;
-        scbar.AccessAfter = D3D12_BARRIER_ACCESS_NO_ACCESS;
-        scbar.LayoutBefore = scbar.LayoutAfter;
-        scbar.LayoutAfter = D3D12_BARRIER_LAYOUT_PRESENT;
-        cmd->Barrier(1, &scbargrp);
+        cmd->ClearRenderTargetView(swapchain.get_descriptor(current_image), cc, 0, nullptr);
+        state_tracker.transition(swapchain.get_buffer(current_image), {
+            .layout = D3D12_BARRIER_LAYOUT_PRESENT,
+            .sync = D3D12_BARRIER_SYNC_NONE,
+            .access = D3D12_BARRIER_ACCESS_NO_ACCESS
+        });
+        barriers.flush();
+        recorder.end();
+        captured_frame_count += 1;
         cmd->Close();
         ID3D12CommandList* submitcmd = cmd.Get();
         queue->ExecuteCommandLists(1, &submitcmd);
-        swapchain->Present(0, 0);
+        state_tracker.commit();
+        present_pacer.present();
+        frame_ring.end_frame();
     }
-    d3d12_queue_wait_idle(device.Get(), queue.Get());
+    frame_ring.wait_idle();
+    copy_engine.wait_idle();
+    save_command_stream("commands.bin", stream_objects, stream_writer.get_data());
     return 0;
 }
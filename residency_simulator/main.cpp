@@ -0,0 +1,290 @@
+#include "residency_policy.h"
+#include <algorithm>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Replays an allocation trace through Residency_Policy against a GPU that lags GPU_LATENCY frames and
+// checks every plan: heaps used by a frame are resident when it is submitted, evicted heaps were idle,
+// and the budget is only exceeded while every resident heap is busy.
+// Trace lines: "budget <bytes>", "add <heap> <bytes>", "remove <heap>", "use <heap>", "frame". Lines
+// starting with '#' are comments.
+// Without a trace file a scene streaming through a working set with two budget changes is generated,
+// --write <file> saves it for replaying with other policies.
+// Usage: residency_simulator [<trace>] [--write <file>]
+
+static constexpr uint64_t GPU_LATENCY = 2;
+static constexpr uint64_t MIB = 1ull << 20;
+
+struct Trace_Event
+{
+    std::string op;
+    uint64_t heap = 0;
+    uint64_t value = 0;
+};
+
+static std::vector<Trace_Event> generate_trace()
+{
+    static constexpr uint32_t HEAP_COUNT = 64;
+    static constexpr uint32_t FRAME_COUNT = 900;
+    static constexpr uint32_t WINDOW = 20;
+    std::vector<Trace_Event> trace;
+    trace.push_back({ "budget", 0, 2048 * MIB });
+    uint64_t next_heap = 0;
+    std::vector<uint64_t> heaps;
+    for (uint32_t i = 0; i < HEAP_COUNT; ++i)
+    {
+        heaps.push_back(next_heap);
+        trace.push_back({ "add", next_heap++, (i % 3 + 1) * 32 * MIB });
+    }
+    for (uint32_t frame = 0; frame < FRAME_COUNT; ++frame)
+    {
+        // Budget changes as other applications come and go.
+        if (frame == 300)
+        {
+            trace.push_back({ "budget", 0, 1024 * MIB });
+        }
+        if (frame == 600)
+        {
+            trace.push_back({ "budget", 0, 3072 * MIB });
+        }
+        // A few heaps every frame, plus a window sliding over the rest like a camera moving through a level.
+        static constexpr uint32_t RING = HEAP_COUNT - 4;
+        auto window_begin = (frame / 8) % RING;
+        // Streaming replaces a heap now and then. Removed heaps must be idle, the one a window length
+        // behind left the window long ago.
+        if (frame % 50 == 49)
+        {
+            auto& heap = heaps[(window_begin + RING - WINDOW) % RING];
+            trace.push_back({ "remove", heap, 0 });
+            heap = next_heap;
+            trace.push_back({ "add", next_heap++, 64 * MIB });
+        }
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            trace.push_back({ "use", heaps[RING + i], 0 });
+        }
+        for (uint32_t i = 0; i < WINDOW; ++i)
+        {
+            trace.push_back({ "use", heaps[(window_begin + i) % RING], 0 });
+        }
+        trace.push_back({ "frame", 0, 0 });
+    }
+    return trace;
+}
+
+static bool read_trace(const char* path, std::vector<Trace_Event>& trace)
+{
+    FILE* file = fopen(path, "r");
+    if (!file)
+    {
+        return false;
+    }
+    char op[16];
+    bool success = true;
+    while (success && fscanf(file, "%15s", op) == 1)
+    {
+        if (op[0] == '#')
+        {
+            // The rest of the line, if any, and its newline.
+            (void)fscanf(file, "%*[^\n]");
+            continue;
+        }
+        Trace_Event event = { op, 0, 0 };
+        if (event.op == "budget")
+        {
+            success = fscanf(file, "%" SCNu64, &event.value) == 1;
+        }
+        else if (event.op == "add")
+        {
+            success = fscanf(file, "%" SCNu64 " %" SCNu64, &event.heap, &event.value) == 2;
+        }
+        else if (event.op == "remove" || event.op == "use")
+        {
+            success = fscanf(file, "%" SCNu64, &event.heap) == 1;
+        }
+        else
+        {
+            success = event.op == "frame";
+        }
+        trace.push_back(event);
+    }
+    fclose(file);
+    return success;
+}
+
+static bool write_trace(const char* path, const std::vector<Trace_Event>& trace)
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+    {
+        return false;
+    }
+    for (const auto& event : trace)
+    {
+        if (event.op == "budget")
+        {
+            fprintf(file, "budget %" PRIu64 "\n", event.value);
+        }
+        else if (event.op == "add")
+        {
+            fprintf(file, "add %" PRIu64 " %" PRIu64 "\n", event.heap, event.value);
+        }
+        else if (event.op == "frame")
+        {
+            fprintf(file, "frame\n");
+        }
+        else
+        {
+            fprintf(file, "%s %" PRIu64 "\n", event.op.c_str(), event.heap);
+        }
+    }
+    return fclose(file) == 0;
+}
+
+struct Simulated_Heap
+{
+    uint32_t id;
+    uint64_t last_use;
+    bool is_used_this_frame;
+};
+
+int main(int argc, char* argv[])
+{
+    const char* trace_path = nullptr;
+    const char* write_path = nullptr;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string option = argv[i];
+        if (option == "--write" && i + 1 < argc)
+        {
+            write_path = argv[++i];
+        }
+        else if (!trace_path && option.rfind("--", 0) != 0)
+        {
+            trace_path = argv[i];
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+    std::vector<Trace_Event> trace;
+    if (trace_path && !read_trace(trace_path, trace))
+    {
+        fprintf(stderr, "Can't read %s\n", trace_path);
+        return 1;
+    }
+    if (!trace_path)
+    {
+        trace = generate_trace();
+    }
+    if (write_path && !write_trace(write_path, trace))
+    {
+        fprintf(stderr, "Can't write %s\n", write_path);
+        return 1;
+    }
+
+    Residency_Policy policy;
+    std::unordered_map<uint64_t, Simulated_Heap> heaps;
+    // Fence value n is the frame n, it completes GPU_LATENCY frames after its submission.
+    uint64_t frame = 1;
+    uint64_t violations = 0;
+    uint64_t over_budget_frames = 0;
+    uint64_t peak_over_budget = 0;
+    auto get_completed = [&]() { return frame > GPU_LATENCY ? frame - GPU_LATENCY - 1 : 0; };
+    auto report = [&](const char* message, uint64_t heap) {
+        if (violations++ < 16)
+        {
+            fprintf(stderr, "frame %" PRIu64 ", heap %" PRIu64 ": %s\n", frame, heap, message);
+        }
+    };
+    for (const auto& event : trace)
+    {
+        if (event.op == "budget")
+        {
+            policy.set_budget(event.value);
+        }
+        else if (event.op == "add")
+        {
+            heaps[event.heap] = { .id = policy.add(event.value), .last_use = 0, .is_used_this_frame = false };
+        }
+        else if (event.op == "remove" || event.op == "use")
+        {
+            auto it = heaps.find(event.heap);
+            if (it == heaps.end())
+            {
+                report("unknown heap in trace", event.heap);
+                continue;
+            }
+            if (event.op == "remove")
+            {
+                if (it->second.last_use > get_completed())
+                {
+                    report("trace removes a busy heap", event.heap);
+                }
+                policy.remove(it->second.id);
+                heaps.erase(it);
+                continue;
+            }
+            policy.use(it->second.id, frame);
+            it->second.last_use = frame;
+            it->second.is_used_this_frame = true;
+        }
+        else if (event.op == "frame")
+        {
+            auto completed = get_completed();
+            const auto& plan = policy.plan(completed);
+            std::unordered_map<uint32_t, uint64_t> heap_by_id;
+            for (const auto& [heap, state] : heaps)
+            {
+                heap_by_id[state.id] = heap;
+            }
+            for (auto id : plan.evict)
+            {
+                if (heaps[heap_by_id[id]].last_use > completed)
+                {
+                    report("evicted while busy", heap_by_id[id]);
+                }
+            }
+            uint64_t resident_bytes = 0;
+            bool has_idle_resident = false;
+            for (auto& [heap, state] : heaps)
+            {
+                if (state.is_used_this_frame && !policy.is_resident(state.id))
+                {
+                    report("used but not resident", heap);
+                }
+                if (policy.is_resident(state.id))
+                {
+                    resident_bytes += policy.get_size(state.id);
+                    has_idle_resident = has_idle_resident || state.last_use <= completed;
+                }
+                state.is_used_this_frame = false;
+            }
+            if (resident_bytes != policy.get_resident_bytes())
+            {
+                report("resident bytes out of sync", 0);
+            }
+            if (policy.get_over_budget_bytes() > 0)
+            {
+                over_budget_frames += 1;
+                peak_over_budget = std::max(peak_over_budget, policy.get_over_budget_bytes());
+                if (has_idle_resident)
+                {
+                    report("over budget with idle heaps resident", 0);
+                }
+            }
+            frame += 1;
+        }
+    }
+    printf("%s: %" PRIu64 " frames, %" PRIu64 " violations\n", violations == 0 ? "ok" : "FAILED", frame - 1, violations);
+    printf("evicted %.0f MiB, made resident %.0f MiB, over budget in %" PRIu64 " frames by up to %.0f MiB\n",
+        policy.get_evicted_bytes() / double(MIB), policy.get_made_resident_bytes() / double(MIB),
+        over_budget_frames, peak_over_budget / double(MIB));
+    return violations == 0 ? 0 : 1;
+}
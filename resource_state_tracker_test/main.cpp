@@ -0,0 +1,249 @@
+#include "resource_state_tracker.h"
+#include "test_check.h"
+#include <cstdint>
+#include <vector>
+
+// Drives Resource_State_Tracker over mip, array and plane ranges and checks the barriers that reach the
+// command list: derived *Before fields, how transitions are merged into ranges, and the Barrier call count.
+
+struct Recording_Command_List
+{
+    uint32_t call_count = 0;
+    std::vector<D3D12_TEXTURE_BARRIER> texture_barriers;
+    std::vector<D3D12_BUFFER_BARRIER> buffer_barriers;
+
+    void Barrier(uint32_t group_count, const D3D12_BARRIER_GROUP* groups)
+    {
+        call_count += 1;
+        for (uint32_t i = 0; i < group_count; ++i)
+        {
+            if (groups[i].Type == D3D12_BARRIER_TYPE_TEXTURE)
+            {
+                texture_barriers.insert(texture_barriers.end(), groups[i].pTextureBarriers, groups[i].pTextureBarriers + groups[i].NumBarriers);
+            }
+            else if (groups[i].Type == D3D12_BARRIER_TYPE_BUFFER)
+            {
+                buffer_barriers.insert(buffer_barriers.end(), groups[i].pBufferBarriers, groups[i].pBufferBarriers + groups[i].NumBarriers);
+            }
+        }
+    }
+
+    void clear()
+    {
+        call_count = 0;
+        texture_barriers.clear();
+        buffer_barriers.clear();
+    }
+};
+
+static const Resource_State SHADER_RESOURCE = {
+    D3D12_BARRIER_LAYOUT_SHADER_RESOURCE, D3D12_BARRIER_SYNC_COMPUTE_SHADING, D3D12_BARRIER_ACCESS_SHADER_RESOURCE
+};
+static const Resource_State UNORDERED_ACCESS = {
+    D3D12_BARRIER_LAYOUT_UNORDERED_ACCESS, D3D12_BARRIER_SYNC_COMPUTE_SHADING, D3D12_BARRIER_ACCESS_UNORDERED_ACCESS
+};
+static const Resource_State COPY_SOURCE = {
+    D3D12_BARRIER_LAYOUT_COPY_SOURCE, D3D12_BARRIER_SYNC_COPY, D3D12_BARRIER_ACCESS_COPY_SOURCE
+};
+static const Resource_State COPY_DEST = {
+    D3D12_BARRIER_LAYOUT_COPY_DEST, D3D12_BARRIER_SYNC_COPY, D3D12_BARRIER_ACCESS_COPY_DEST
+};
+
+static ID3D12Resource* fake_resource(uintptr_t id)
+{
+    return reinterpret_cast<ID3D12Resource*>(id * 0x100);
+}
+
+static D3D12_BARRIER_SUBRESOURCE_RANGE make_range(
+    uint32_t first_mip, uint32_t mip_count, uint32_t first_slice, uint32_t slice_count, uint32_t first_plane = 0, uint32_t plane_count = 1)
+{
+    return { first_mip, mip_count, first_slice, slice_count, first_plane, plane_count };
+}
+
+static bool is_barrier(const D3D12_TEXTURE_BARRIER& barrier, Resource_State before, Resource_State after, D3D12_BARRIER_SUBRESOURCE_RANGE range)
+{
+    return barrier.LayoutBefore == before.layout && barrier.LayoutAfter == after.layout
+        && barrier.SyncBefore == before.sync && barrier.SyncAfter == after.sync
+        && barrier.AccessBefore == before.access && barrier.AccessAfter == after.access
+        && is_same_subresource_range(barrier.Subresources, range);
+}
+
+static void test_cube_map()
+{
+    static constexpr Resource_Dimensions CUBE = { .mip_levels = 4, .array_size = 6 };
+    Resource_State_Registry registry;
+    auto cube = fake_resource(1);
+    registry.register_resource(cube, CUBE, SHADER_RESOURCE);
+    Recording_Command_List cmd;
+    Barrier_Batcher<Recording_Command_List> barriers(&cmd);
+    Resource_State_Tracker<Recording_Command_List> tracker(registry, barriers, true);
+
+    // A uniform transition of all 24 subresources is one barrier on all subresources.
+    tracker.transition(cube, UNORDERED_ACCESS);
+    barriers.flush();
+    TEST_CHECK(cmd.call_count == 1 && cmd.texture_barriers.size() == 1);
+    TEST_CHECK(cmd.texture_barriers.size() == 1 && is_barrier(cmd.texture_barriers[0], SHADER_RESOURCE, UNORDERED_ACCESS, ALL_SUBRESOURCE_RANGE));
+
+    // Mip 0 of every face is one barrier over the six slices.
+    cmd.clear();
+    tracker.transition(cube, COPY_SOURCE, make_range(0, 1, 0, 6));
+    barriers.flush();
+    TEST_CHECK(cmd.texture_barriers.size() == 1 && is_barrier(cmd.texture_barriers[0], UNORDERED_ACCESS, COPY_SOURCE, make_range(0, 1, 0, 6)));
+
+    // Back to SRV: mip 0 and mips 1-3 come from different states, one barrier each across all faces.
+    cmd.clear();
+    tracker.transition(cube, SHADER_RESOURCE);
+    barriers.flush();
+    TEST_CHECK(cmd.call_count == 1 && cmd.texture_barriers.size() == 2);
+    if (cmd.texture_barriers.size() == 2)
+    {
+        TEST_CHECK(is_barrier(cmd.texture_barriers[0], COPY_SOURCE, SHADER_RESOURCE, make_range(0, 1, 0, 6)));
+        TEST_CHECK(is_barrier(cmd.texture_barriers[1], UNORDERED_ACCESS, SHADER_RESOURCE, make_range(1, 3, 0, 6)));
+    }
+
+    // A slice range of all mips, then a single face in the single subresource index form.
+    cmd.clear();
+    tracker.transition(cube, COPY_DEST, make_range(0, 4, 2, 3));
+    tracker.transition(cube, UNORDERED_ACCESS, { CUBE.get_subresource_index(2, 4, 0), 0, 0, 0, 0, 0 });
+    barriers.flush();
+    TEST_CHECK(cmd.texture_barriers.size() == 2);
+    if (cmd.texture_barriers.size() == 2)
+    {
+        TEST_CHECK(is_barrier(cmd.texture_barriers[0], SHADER_RESOURCE, COPY_DEST, make_range(0, 4, 2, 3)));
+        TEST_CHECK(is_barrier(cmd.texture_barriers[1], COPY_DEST, UNORDERED_ACCESS, make_range(2, 1, 4, 1)));
+    }
+
+    // Slices 0-1 SRV, 2-3 COPY_DEST, 4 COPY_DEST with mip 2 UAV, 5 SRV: runs merge over equal neighbours only.
+    cmd.clear();
+    tracker.transition(cube, COPY_SOURCE);
+    barriers.flush();
+    TEST_CHECK(cmd.texture_barriers.size() == 6);
+    if (cmd.texture_barriers.size() == 6)
+    {
+        TEST_CHECK(is_barrier(cmd.texture_barriers[0], SHADER_RESOURCE, COPY_SOURCE, make_range(0, 4, 0, 2)));
+        TEST_CHECK(is_barrier(cmd.texture_barriers[1], COPY_DEST, COPY_SOURCE, make_range(0, 4, 2, 2)));
+        TEST_CHECK(is_barrier(cmd.texture_barriers[2], COPY_DEST, COPY_SOURCE, make_range(0, 2, 4, 1)));
+        TEST_CHECK(is_barrier(cmd.texture_barriers[3], UNORDERED_ACCESS, COPY_SOURCE, make_range(2, 1, 4, 1)));
+        TEST_CHECK(is_barrier(cmd.texture_barriers[4], COPY_DEST, COPY_SOURCE, make_range(3, 1, 4, 1)));
+        TEST_CHECK(is_barrier(cmd.texture_barriers[5], SHADER_RESOURCE, COPY_SOURCE, make_range(0, 4, 5, 1)));
+    }
+
+    // Final states go to the registry, the next list starts from them.
+    tracker.commit();
+    auto entry = registry.find(cube);
+    TEST_CHECK(entry && entry->states[CUBE.get_subresource_index(3, 5, 0)] == COPY_SOURCE);
+    Resource_State_Tracker<Recording_Command_List> next_tracker(registry, barriers, true);
+    cmd.clear();
+    next_tracker.transition(cube, SHADER_RESOURCE);
+    barriers.flush();
+    TEST_CHECK(cmd.texture_barriers.size() == 1 && is_barrier(cmd.texture_barriers[0], COPY_SOURCE, SHADER_RESOURCE, ALL_SUBRESOURCE_RANGE));
+}
+
+static void test_planes()
+{
+    static constexpr Resource_Dimensions DEPTH_STENCIL = { .mip_levels = 2, .array_size = 2, .plane_count = 2 };
+    Resource_State_Registry registry;
+    auto depth = fake_resource(1);
+    registry.register_resource(depth, DEPTH_STENCIL, COPY_DEST);
+    Recording_Command_List cmd;
+    Barrier_Batcher<Recording_Command_List> barriers(&cmd);
+    Resource_State_Tracker<Recording_Command_List> tracker(registry, barriers, true);
+
+    tracker.transition(depth, SHADER_RESOURCE, make_range(0, 2, 0, 2, 1, 1));
+    barriers.flush();
+    TEST_CHECK(cmd.texture_barriers.size() == 1 && is_barrier(cmd.texture_barriers[0], COPY_DEST, SHADER_RESOURCE, make_range(0, 2, 0, 2, 1, 1)));
+
+    // Both planes with the same mip 1 pattern merge over planes, not into all subresources.
+    cmd.clear();
+    tracker.transition(depth, UNORDERED_ACCESS, make_range(1, 1, 0, 2, 0, 2));
+    barriers.flush();
+    TEST_CHECK(cmd.texture_barriers.size() == 2);
+    cmd.clear();
+    tracker.transition(depth, COPY_SOURCE, make_range(1, 1, 0, 2, 0, 2));
+    barriers.flush();
+    TEST_CHECK(cmd.texture_barriers.size() == 1 && is_barrier(cmd.texture_barriers[0], UNORDERED_ACCESS, COPY_SOURCE, make_range(1, 1, 0, 2, 0, 2)));
+}
+
+static void test_split_and_buffers()
+{
+    Resource_State_Registry registry;
+    auto texture = fake_resource(1);
+    auto buffer = fake_resource(2);
+    auto untracked = fake_resource(3);
+    registry.register_resource(texture, { .mip_levels = 3, .array_size = 1 }, UNORDERED_ACCESS);
+    registry.register_resource(buffer, { .is_buffer = true }, COPY_DEST);
+    Recording_Command_List cmd;
+    Barrier_Batcher<Recording_Command_List> barriers(&cmd);
+    Resource_State_Tracker<Recording_Command_List> tracker(registry, barriers, true);
+
+    tracker.begin_split(texture, SHADER_RESOURCE);
+    barriers.flush();
+    TEST_CHECK(cmd.texture_barriers.size() == 1);
+    if (cmd.texture_barriers.size() == 1)
+    {
+        TEST_CHECK(cmd.texture_barriers[0].SyncBefore == UNORDERED_ACCESS.sync);
+        TEST_CHECK(cmd.texture_barriers[0].SyncAfter == D3D12_BARRIER_SYNC_SPLIT);
+        TEST_CHECK(cmd.texture_barriers[0].LayoutAfter == SHADER_RESOURCE.layout);
+    }
+    cmd.clear();
+    tracker.end_split(texture, SHADER_RESOURCE);
+    // A second end has nothing pending.
+    tracker.end_split(texture, SHADER_RESOURCE);
+    barriers.flush();
+    TEST_CHECK(cmd.call_count == 1 && cmd.texture_barriers.size() == 1);
+    if (cmd.texture_barriers.size() == 1)
+    {
+        TEST_CHECK(cmd.texture_barriers[0].SyncBefore == D3D12_BARRIER_SYNC_SPLIT);
+        TEST_CHECK(cmd.texture_barriers[0].SyncAfter == SHADER_RESOURCE.sync);
+        TEST_CHECK(cmd.texture_barriers[0].LayoutBefore == UNORDERED_ACCESS.layout);
+        TEST_CHECK(is_same_subresource_range(cmd.texture_barriers[0].Subresources, ALL_SUBRESOURCE_RANGE));
+    }
+
+    // Buffers ignore the range, resources the registry doesn't know are left alone.
+    cmd.clear();
+    tracker.transition(buffer, SHADER_RESOURCE, make_range(1, 1, 0, 1));
+    tracker.transition(untracked, SHADER_RESOURCE);
+    barriers.flush();
+    TEST_CHECK(cmd.texture_barriers.empty() && cmd.buffer_barriers.size() == 1);
+    if (cmd.buffer_barriers.size() == 1)
+    {
+        TEST_CHECK(cmd.buffer_barriers[0].AccessBefore == COPY_DEST.access);
+        TEST_CHECK(cmd.buffer_barriers[0].AccessAfter == SHADER_RESOURCE.access);
+    }
+}
+
+static void test_resolve()
+{
+    static constexpr Resource_Dimensions ARRAY = { .mip_levels = 2, .array_size = 4 };
+    Resource_State_Registry registry;
+    auto texture = fake_resource(1);
+    registry.register_resource(texture, ARRAY, SHADER_RESOURCE);
+    Recording_Command_List cmd;
+    Barrier_Batcher<Recording_Command_List> barriers(&cmd);
+    Resource_State_Tracker<Recording_Command_List> tracker(registry, barriers, false);
+
+    // Without seeding the first transition only sets the entry state, the second one derives from it.
+    tracker.transition(texture, UNORDERED_ACCESS);
+    tracker.transition(texture, COPY_SOURCE, make_range(0, 1, 0, 4));
+    barriers.flush();
+    TEST_CHECK(cmd.texture_barriers.size() == 1 && is_barrier(cmd.texture_barriers[0], UNORDERED_ACCESS, COPY_SOURCE, make_range(0, 1, 0, 4)));
+
+    Recording_Command_List patch_cmd;
+    Barrier_Batcher<Recording_Command_List> patch_barriers(&patch_cmd);
+    tracker.resolve(patch_barriers);
+    patch_barriers.flush();
+    TEST_CHECK(patch_cmd.call_count == 1 && patch_cmd.texture_barriers.size() == 1);
+    TEST_CHECK(patch_cmd.texture_barriers.size() == 1 && is_barrier(patch_cmd.texture_barriers[0], SHADER_RESOURCE, UNORDERED_ACCESS, ALL_SUBRESOURCE_RANGE));
+    auto entry = registry.find(texture);
+    TEST_CHECK(entry && entry->states[ARRAY.get_subresource_index(0, 3, 0)] == COPY_SOURCE);
+    TEST_CHECK(entry && entry->states[ARRAY.get_subresource_index(1, 3, 0)] == UNORDERED_ACCESS);
+}
+
+int main()
+{
+    test_cube_map();
+    test_planes();
+    test_split_and_buffers();
+    test_resolve();
+    return finish_test();
+}
@@ -0,0 +1,164 @@
+#include "root_constants.h"
+#include "test_check.h"
+#include <cstdint>
+#include <vector>
+
+// set_root_constants() against a command list mock that records every 32 bit constants call: the first
+// set emits the whole struct, unchanged sets emit nothing, changes emit the smallest covering DWORD range
+// with the new values, and a root signature change (invalidate) emits everything again.
+
+struct Constants_Call
+{
+    Root_Constants_Bind_Point bind_point;
+    uint32_t root_parameter_index;
+    uint32_t first;
+    std::vector<uint32_t> values;
+};
+
+class Recording_Command_List
+{
+public:
+    void SetComputeRoot32BitConstants(uint32_t root_parameter_index, uint32_t count, const void* values, uint32_t first)
+    {
+        record(Root_Constants_Bind_Point::Compute, root_parameter_index, count, values, first);
+    }
+
+    void SetGraphicsRoot32BitConstants(uint32_t root_parameter_index, uint32_t count, const void* values, uint32_t first)
+    {
+        record(Root_Constants_Bind_Point::Graphics, root_parameter_index, count, values, first);
+    }
+
+    std::vector<Constants_Call> calls;
+
+private:
+    void record(Root_Constants_Bind_Point bind_point, uint32_t root_parameter_index, uint32_t count, const void* values, uint32_t first)
+    {
+        auto dwords = static_cast<const uint32_t*>(values);
+        calls.push_back({ bind_point, root_parameter_index, first, { dwords, dwords + count } });
+    }
+};
+
+struct Draw_Constants
+{
+    uint32_t texture;
+    uint32_t sampler;
+    float scale[2];
+    uint32_t flags;
+    uint32_t frame;
+};
+
+struct Too_Large
+{
+    uint32_t values[MAX_ROOT_CONSTANTS + 1];
+};
+
+struct Odd_Size
+{
+    uint8_t values[6];
+};
+
+struct Wide_Member
+{
+    double value;
+};
+
+static_assert(Root_Constants<Draw_Constants>);
+static_assert(ROOT_CONSTANT_COUNT<Draw_Constants> == 6);
+static_assert(!Root_Constants<Too_Large>);
+static_assert(!Root_Constants<Odd_Size>);
+static_assert(!Root_Constants<Wide_Member>);
+
+static bool is_call(const Constants_Call& call, Root_Constants_Bind_Point bind_point, uint32_t root_parameter_index,
+    uint32_t first, const std::vector<uint32_t>& values)
+{
+    return call.bind_point == bind_point && call.root_parameter_index == root_parameter_index && call.first == first
+        && call.values == values;
+}
+
+static void test_changed_ranges()
+{
+    Recording_Command_List cmd;
+    Root_Constant_Cache cache;
+    Draw_Constants constants = { .texture = 7, .sampler = 2, .scale = { 1.0f, 0.5f }, .flags = 0, .frame = 1 };
+    set_root_constants(&cmd, cache, 3, constants);
+    TEST_CHECK(cmd.calls.size() == 1);
+    TEST_CHECK(is_call(cmd.calls[0], Root_Constants_Bind_Point::Compute, 3, 0, { 7, 2, 0x3f800000, 0x3f000000, 0, 1 }));
+
+    // Same values, nothing to emit.
+    set_root_constants(&cmd, cache, 3, constants);
+    TEST_CHECK(cmd.calls.size() == 1);
+
+    // One member, one DWORD at its offset.
+    constants.frame = 2;
+    set_root_constants(&cmd, cache, 3, constants);
+    TEST_CHECK(cmd.calls.size() == 2 && is_call(cmd.calls[1], Root_Constants_Bind_Point::Compute, 3, 5, { 2 }));
+
+    // Two members apart: one call covering both, the unchanged DWORDs between them are sent as cached.
+    constants.sampler = 4;
+    constants.flags = 9;
+    set_root_constants(&cmd, cache, 3, constants);
+    TEST_CHECK(cmd.calls.size() == 3 && is_call(cmd.calls[2], Root_Constants_Bind_Point::Compute, 3, 1, { 4, 0x3f800000, 0x3f000000, 9 }));
+
+    // Setting a value back is a change too.
+    constants.texture = 7;
+    constants.sampler = 2;
+    set_root_constants(&cmd, cache, 3, constants, Root_Constants_Bind_Point::Graphics);
+    TEST_CHECK(cmd.calls.size() == 4 && is_call(cmd.calls[3], Root_Constants_Bind_Point::Graphics, 3, 1, { 2 }));
+
+    // A new root signature leaves the arguments undefined, everything goes out again.
+    cache.invalidate();
+    set_root_constants(&cmd, cache, 3, constants);
+    TEST_CHECK(cmd.calls.size() == 5 && is_call(cmd.calls[4], Root_Constants_Bind_Point::Compute, 3, 0, { 7, 2, 0x3f800000, 0x3f000000, 9, 2 }));
+}
+
+static void test_cache_values()
+{
+    Root_Constant_Cache cache;
+    uint32_t values[] = { 1, 2, 3 };
+    auto range = cache.update_values(values, 10);
+    TEST_CHECK(range.first == 10 && range.count == 3);
+    TEST_CHECK(cache.get_values(range)[0] == 1 && cache.get_values(range)[2] == 3);
+    // Writes next to the known DWORDs only cover what was never set or changed.
+    uint32_t overlapping[] = { 3, 4 };
+    range = cache.update_values(overlapping, 12);
+    TEST_CHECK(range.first == 13 && range.count == 1 && *cache.get_values(range) == 4);
+    range = cache.update_values(std::span<const uint32_t>(), 5);
+    TEST_CHECK(range.count == 0);
+
+    // The last DWORD of the 64 is usable, anything past it throws.
+    uint32_t last = 5;
+    range = cache.update_values({ &last, 1 }, MAX_ROOT_CONSTANTS - 1);
+    TEST_CHECK(range.first == MAX_ROOT_CONSTANTS - 1 && range.count == 1);
+    bool threw = false;
+    try
+    {
+        cache.update_values(values, MAX_ROOT_CONSTANTS - 2);
+    }
+    catch (const std::exception&)
+    {
+        threw = true;
+    }
+    TEST_CHECK(threw);
+    threw = false;
+    try
+    {
+        cache.update_values({}, MAX_ROOT_CONSTANTS + 1);
+    }
+    catch (const std::exception&)
+    {
+        threw = true;
+    }
+    TEST_CHECK(threw);
+
+    // An empty range emits nothing.
+    Recording_Command_List cmd;
+    set_root_constant_range(&cmd, cache, 0, { 0, 0 });
+    TEST_CHECK(cmd.calls.empty());
+}
+
+int main()
+{
+    test_changed_ranges();
+    test_cache_values();
+    return finish_test();
+}
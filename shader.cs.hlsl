@@ -1,5 +1,16 @@
 // Compile with dxc.exe -T cs_6_6 -E cs_main -HV 2021 -Zpr -no-legacy-cbuf-layout -enable-16bit-types -Fo shader.bin shader.cs.hlsl
+// and update shader.bin.sha256, or build the update_shader_bin target which does both.
+// Optional numthreads variants for the dispatch autotuner, e.g.
+// dxc.exe ... -D GROUP_SIZE_X=8 -D GROUP_SIZE_Y=8 -Fo shader_8x8.bin shader.cs.hlsl
 
+#ifndef GROUP_SIZE_X
+#define GROUP_SIZE_X 32
+#endif
+#ifndef GROUP_SIZE_Y
+#define GROUP_SIZE_Y 32
+#endif
+
+// Mirrored by Push_Constants in repro_01/main.cpp, keep the layout in sync.
 struct Push_Constants
 {
     uint tex;
@@ -9,9 +20,24 @@ struct Push_Constants
 };
 ConstantBuffer<Push_Constants> pc : register(b0, space0);
 
-[numthreads(32, 32, 1)]
+// Mirrored by Frame_Constants in repro_01/main.cpp, written to the upload ring once per frame.
+struct Frame_Constants
+{
+    uint frame_number;
+    uint width;
+    uint height;
+    uint unused;
+};
+ConstantBuffer<Frame_Constants> fc : register(b1, space0);
+
+[numthreads(GROUP_SIZE_X, GROUP_SIZE_Y, 1)]
 void cs_main(uint3 id : SV_DispatchThreadID)
 {
     RWTexture2D<uint4> texture = ResourceDescriptorHeap[pc.tex];
+    // Group counts are rounded up, skip threads past the edge.
+    if (any(id.xy >= uint2(fc.width, fc.height)))
+    {
+        return;
+    }
     texture[id.xy] = uint4(id.xyz, 0);
 }
@@ -0,0 +1,166 @@
+#include "shader_blob.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+// Compares loading shaders one file at a time through the old std::istream_iterator path, through
+// Mapped_File, and through a single Shader_Archive. Checks that every path returns the same bytes and
+// that corrupt archives are rejected at open.
+
+static constexpr uint32_t SHADER_COUNT = 32;
+static constexpr uint32_t RUN_COUNT = 4;
+
+// The loader repro_01 used before Mapped_File.
+static std::vector<uint8_t> read_binary_file(const char* path)
+{
+    std::vector<uint8_t> result;
+    std::ifstream file(path, std::ios::binary);
+    file.unsetf(std::ios::skipws);
+    std::streampos file_size;
+    file.seekg(0, std::ios::end);
+    file_size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    result.reserve(file_size);
+    result.insert(
+        result.begin(),
+        std::istream_iterator<uint8_t>(file),
+        std::istream_iterator<uint8_t>());
+    file.close();
+    return result;
+}
+
+static bool write_file(const std::string& path, const void* data, size_t size)
+{
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file)
+    {
+        return false;
+    }
+    auto written = fwrite(data, 1, size, file);
+    return fclose(file) == 0 && written == size;
+}
+
+template<typename Function>
+static double measure_best_ms(Function&& function)
+{
+    double best_ms = 1e300;
+    for (uint32_t run = 0; run < RUN_COUNT; ++run)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        function();
+        auto end = std::chrono::steady_clock::now();
+        auto ms = std::chrono::duration<double, std::milli>(end - begin).count();
+        best_ms = ms < best_ms ? ms : best_ms;
+    }
+    return best_ms;
+}
+
+static bool is_same(Shader_Blob blob, const std::vector<uint8_t>& expected)
+{
+    return blob.size == expected.size() && memcmp(blob.data, expected.data(), expected.size()) == 0;
+}
+
+// Patches one entry of a copy of the archive and checks that open() rejects it.
+static bool is_rejected(const std::string& archive_path, const std::string& corrupt_path, uint32_t entry_index,
+    uint64_t Shader_Archive_Entry::* field, uint64_t value)
+{
+    auto bytes = read_binary_file(archive_path.c_str());
+    Shader_Archive_Entry entry;
+    auto entry_offset = sizeof(Shader_Archive_Header) + entry_index * sizeof(Shader_Archive_Entry);
+    memcpy(&entry, bytes.data() + entry_offset, sizeof(entry));
+    entry.*field = value;
+    memcpy(bytes.data() + entry_offset, &entry, sizeof(entry));
+    Shader_Archive archive;
+    return write_file(corrupt_path, bytes.data(), bytes.size()) && !archive.open(corrupt_path.c_str());
+}
+
+int main()
+{
+    auto directory = std::filesystem::temp_directory_path() / "shader_blob_benchmark";
+    std::filesystem::create_directories(directory);
+    std::mt19937_64 random(42);
+    std::vector<std::vector<uint8_t>> shaders(SHADER_COUNT);
+    std::vector<std::string> names;
+    std::vector<std::string> paths;
+    std::vector<Shader_Archive_Input> inputs;
+    uint64_t total_bytes = 0;
+    for (uint32_t i = 0; i < SHADER_COUNT; ++i)
+    {
+        // DXIL blobs are a few to a few hundred KiB.
+        shaders[i].resize(4096 + random() % (256u << 10));
+        for (auto& byte : shaders[i])
+        {
+            byte = uint8_t(random());
+        }
+        total_bytes += shaders[i].size();
+        names.push_back("shader_" + std::to_string(i));
+        paths.push_back((directory / (names.back() + ".bin")).string());
+        if (!write_file(paths.back(), shaders[i].data(), shaders[i].size()))
+        {
+            fprintf(stderr, "Can't write %s\n", paths.back().c_str());
+            return 1;
+        }
+    }
+    for (uint32_t i = 0; i < SHADER_COUNT; ++i)
+    {
+        inputs.push_back({ .name = names[i], .blob = { shaders[i].data(), shaders[i].size() } });
+    }
+    auto archive_path = (directory / "shaders.bin").string();
+    if (!write_shader_archive(archive_path.c_str(), inputs))
+    {
+        fprintf(stderr, "Can't write %s\n", archive_path.c_str());
+        return 1;
+    }
+
+    bool success = true;
+    volatile uint64_t sink = 0;
+    auto read_ms = measure_best_ms([&]() {
+        for (uint32_t i = 0; i < SHADER_COUNT; ++i)
+        {
+            auto data = read_binary_file(paths[i].c_str());
+            success = success && data == shaders[i];
+            sink = sink + data.size();
+        }
+    });
+    auto mapped_ms = measure_best_ms([&]() {
+        for (uint32_t i = 0; i < SHADER_COUNT; ++i)
+        {
+            Mapped_File file(paths[i].c_str());
+            success = success && is_same(file.get_blob(), shaders[i]);
+            sink = sink + file.size();
+        }
+    });
+    auto archive_ms = measure_best_ms([&]() {
+        Shader_Archive archive;
+        success = success && archive.open(archive_path.c_str());
+        for (uint32_t i = 0; i < SHADER_COUNT; ++i)
+        {
+            auto blob = archive.find(names[i]);
+            success = success && is_same(blob, shaders[i]);
+            sink = sink + blob.size;
+        }
+    });
+    printf("%u shaders, %.1f MiB, best of %u runs\n", SHADER_COUNT, total_bytes / double(1 << 20), RUN_COUNT);
+    printf("read_binary_file: %8.2f ms\n", read_ms);
+    printf("Mapped_File:      %8.2f ms\n", mapped_ms);
+    printf("Shader_Archive:   %8.2f ms\n", archive_ms);
+
+    // An offset near 2^64 wraps offset + size around, an out of order name hash breaks the binary search.
+    auto corrupt_path = (directory / "corrupt.bin").string();
+    bool rejects_wrap = is_rejected(archive_path, corrupt_path, 1, &Shader_Archive_Entry::offset, ~0ull - 16);
+    bool rejects_size = is_rejected(archive_path, corrupt_path, 1, &Shader_Archive_Entry::size, ~0ull);
+    bool rejects_unsorted = is_rejected(archive_path, corrupt_path, 0, &Shader_Archive_Entry::name_hash, ~0ull);
+    printf("corrupt archives rejected: offset wrap %s, size %s, unsorted index %s\n",
+        rejects_wrap ? "yes" : "no", rejects_size ? "yes" : "no", rejects_unsorted ? "yes" : "no");
+    success = success && rejects_wrap && rejects_size && rejects_unsorted;
+
+    std::filesystem::remove_all(directory);
+    printf("%s\n", success ? "ok" : "FAILED");
+    return success ? 0 : 1;
+}
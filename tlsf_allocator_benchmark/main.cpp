@@ -0,0 +1,132 @@
+#include "tlsf_allocator.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+// Cost of Tlsf_Allocator at the sizes D3D12_Memory_Allocator sees: a 256 MB heap with placed resources of
+// 64 KB to 4 MB at 64 KB alignment, and one with small buffers of mixed sizes and alignments. Each run
+// keeps a working set live and replaces random allocations, reporting the time per allocate/free pair,
+// the failure rate and how fragmented the free space ends up.
+
+static constexpr uint64_t KB = 1024;
+static constexpr uint64_t MB = 1024 * KB;
+static constexpr uint32_t OPERATION_COUNT = 2000000;
+
+using Clock = std::chrono::steady_clock;
+
+static double get_ns(Clock::time_point begin, Clock::time_point end)
+{
+    return std::chrono::duration<double, std::nano>(end - begin).count();
+}
+
+struct Request
+{
+    uint64_t size;
+    uint64_t alignment;
+};
+
+// Runs OPERATION_COUNT replacements of a random live allocation after filling the heap with `live_count`
+// requests. The requests are generated up front so the timed loop only runs the allocator.
+static bool run(const char* name, uint64_t heap_size, uint32_t live_count, const std::vector<Request>& requests)
+{
+    std::mt19937 random(7);
+    std::vector<uint32_t> victims(OPERATION_COUNT);
+    for (auto& victim : victims)
+    {
+        victim = random() % live_count;
+    }
+    Tlsf_Allocator allocator(heap_size);
+    std::vector<Tlsf_Allocation> live(live_count);
+    uint64_t failed = 0;
+    for (uint32_t i = 0; i < live_count; ++i)
+    {
+        const auto& request = requests[i % requests.size()];
+        live[i] = allocator.allocate(request.size, request.alignment);
+        failed += live[i].is_valid() ? 0 : 1;
+    }
+
+    auto begin = Clock::now();
+    for (uint32_t i = 0; i < OPERATION_COUNT; ++i)
+    {
+        auto& allocation = live[victims[i]];
+        allocator.free(allocation);
+        const auto& request = requests[i % requests.size()];
+        allocation = allocator.allocate(request.size, request.alignment);
+        failed += allocation.is_valid() ? 0 : 1;
+    }
+    auto ns = get_ns(begin, Clock::now());
+
+    // Whatever is live has to be disjoint and inside the heap.
+    bool success = true;
+    std::vector<Tlsf_Allocation> sorted;
+    for (const auto& allocation : live)
+    {
+        if (allocation.is_valid())
+        {
+            sorted.push_back(allocation);
+        }
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.offset < b.offset; });
+    for (size_t i = 1; i < sorted.size(); ++i)
+    {
+        success = success && sorted[i - 1].offset + sorted[i - 1].size <= sorted[i].offset;
+    }
+    success = success && (sorted.empty() || sorted.back().offset + sorted.back().size <= heap_size);
+    success = success && allocator.get_allocation_count() == sorted.size();
+
+    auto free_bytes = allocator.get_free_bytes();
+    printf("%-14s %6.1f ns per free + allocate, %5.2f%% failed, %5.1f%% used, largest free block %5.1f%% of the free bytes\n",
+        name, ns / OPERATION_COUNT, 100.0 * failed / (OPERATION_COUNT + live_count),
+        100.0 * allocator.get_allocated_bytes() / heap_size,
+        free_bytes > 0 ? 100.0 * allocator.get_largest_free_block() / free_bytes : 100.0);
+
+    // Freeing the rest coalesces everything back into one block.
+    for (const auto& allocation : live)
+    {
+        allocator.free(allocation);
+    }
+    return success && allocator.is_empty() && allocator.get_largest_free_block() == heap_size;
+}
+
+int main()
+{
+    bool success = true;
+    std::mt19937 random(3);
+
+    // Textures and buffers placed in a default heap: multiples of 64 KB, a few large ones.
+    {
+        std::vector<Request> requests(4096);
+        for (auto& request : requests)
+        {
+            auto pages = random() % 8 == 0 ? 16 + random() % 48 : 1 + random() % 8;
+            request = { pages * 64 * KB, 64 * KB };
+        }
+        success = run("placed", 256 * MB, 384, requests) && success;
+    }
+
+    // Small buffers with sizes from bytes to a few KB and alignments from 1 to 4 KB.
+    {
+        std::vector<Request> requests(4096);
+        for (auto& request : requests)
+        {
+            request = { 1 + random() % (8 * KB), 1ull << (random() % 13) };
+        }
+        success = run("small buffers", 16 * MB, 4096, requests) && success;
+    }
+
+    // Near full: the working set takes most of the heap, so frees and allocations keep splitting and merging.
+    {
+        std::vector<Request> requests(4096);
+        for (auto& request : requests)
+        {
+            request = { (1 + random() % 16) * 64 * KB, 64 * KB };
+        }
+        success = run("near full", 64 * MB, 110, requests) && success;
+    }
+
+    printf("%s\n", success ? "ok" : "FAILED");
+    return success ? 0 : 1;
+}
@@ -0,0 +1,208 @@
+#include "test_check.h"
+#include "tlsf_allocator.h"
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <vector>
+
+// Tlsf_Allocator bookkeeping: edge cases of allocate and free, then random allocate/free sequences with
+// mixed sizes and alignments checked against a shadow map of the live allocations. Every step checks that
+// allocations stay in range, aligned and disjoint, that the counters match, and that free space is fully
+// coalesced: the largest free block has to be the largest gap between live allocations.
+
+static constexpr uint64_t KB = 1024;
+static constexpr uint64_t MB = 1024 * KB;
+
+static void test_edge_cases()
+{
+    Tlsf_Allocator allocator(64 * KB);
+    TEST_CHECK(allocator.is_empty() && allocator.get_free_bytes() == 64 * KB);
+    TEST_CHECK(allocator.get_largest_free_block() == 64 * KB);
+    TEST_CHECK(!allocator.allocate(0).is_valid());
+    TEST_CHECK(!allocator.allocate(64 * KB + 1).is_valid());
+
+    auto whole = allocator.allocate(64 * KB);
+    TEST_CHECK(whole.is_valid() && whole.offset == 0 && whole.size == 64 * KB);
+    TEST_CHECK(allocator.get_largest_free_block() == 0 && !allocator.allocate(1).is_valid());
+    allocator.free(whole);
+    TEST_CHECK(allocator.is_empty() && allocator.get_largest_free_block() == 64 * KB);
+
+    // Double frees and invalid allocations are ignored.
+    allocator.free(whole);
+    allocator.free({});
+    TEST_CHECK(allocator.get_allocation_count() == 0 && allocator.get_free_bytes() == 64 * KB);
+
+    // Leading padding of an aligned allocation stays free and is found by later small allocations.
+    auto small = allocator.allocate(100);
+    auto aligned = allocator.allocate(4 * KB, 4 * KB);
+    TEST_CHECK(small.offset == 0 && aligned.offset == 4 * KB);
+    auto filler = allocator.allocate(2 * KB);
+    TEST_CHECK(filler.is_valid() && filler.offset == 100);
+    // Non power of two alignments work too.
+    auto odd = allocator.allocate(10, 3000);
+    TEST_CHECK(odd.is_valid() && odd.offset % 3000 == 0);
+    allocator.free(aligned);
+    allocator.free(small);
+    allocator.free(odd);
+    allocator.free(filler);
+    TEST_CHECK(allocator.is_empty() && allocator.get_largest_free_block() == 64 * KB);
+
+    // The largest alignment that fits exactly: the whole range at offset 0.
+    auto exact = allocator.allocate(64 * KB, 64 * KB);
+    TEST_CHECK(exact.is_valid() && exact.offset == 0);
+    allocator.free(exact);
+
+    Tlsf_Allocator empty(0);
+    TEST_CHECK(!empty.allocate(1).is_valid() && empty.get_largest_free_block() == 0);
+}
+
+// Freeing the middle of three allocations last merges both neighbours into one block.
+static void test_coalescing()
+{
+    Tlsf_Allocator allocator(3 * KB);
+    auto a = allocator.allocate(KB);
+    auto b = allocator.allocate(KB);
+    auto c = allocator.allocate(KB);
+    TEST_CHECK(a.offset == 0 && b.offset == KB && c.offset == 2 * KB);
+    allocator.free(a);
+    allocator.free(c);
+    TEST_CHECK(allocator.get_largest_free_block() == KB);
+    TEST_CHECK(!allocator.allocate(2 * KB).is_valid());
+    allocator.free(b);
+    TEST_CHECK(allocator.get_largest_free_block() == 3 * KB);
+    TEST_CHECK(allocator.allocate(3 * KB).is_valid());
+}
+
+// Checks the allocator against the live allocations, keyed by offset.
+static void check_state(const Tlsf_Allocator& allocator, const std::map<uint64_t, Tlsf_Allocation>& live)
+{
+    uint64_t allocated_bytes = 0;
+    uint64_t largest_gap = 0;
+    uint64_t end = 0;
+    for (const auto& [offset, entry] : live)
+    {
+        TEST_CHECK(offset >= end);
+        largest_gap = std::max(largest_gap, offset - end);
+        end = offset + entry.size;
+        allocated_bytes += entry.size;
+    }
+    TEST_CHECK(end <= allocator.get_size());
+    largest_gap = std::max(largest_gap, allocator.get_size() - end);
+    TEST_CHECK(allocator.get_allocation_count() == live.size());
+    TEST_CHECK(allocator.get_allocated_bytes() == allocated_bytes);
+    // A gap split into several free blocks would show up as a smaller largest block.
+    TEST_CHECK(allocator.get_largest_free_block() == largest_gap);
+
+    auto it = live.begin();
+    allocator.for_each_allocation([&](const Tlsf_Allocation& allocation) {
+        TEST_CHECK(it != live.end() && it->first == allocation.offset && it->second.block == allocation.block);
+        if (it != live.end())
+        {
+            ++it;
+        }
+    });
+    TEST_CHECK(it == live.end());
+}
+
+static void test_random_sequences()
+{
+    static constexpr uint32_t SEQUENCE_COUNT = 40;
+    static constexpr uint32_t OPERATION_COUNT = 4000;
+    std::mt19937_64 random(9);
+    uint64_t failed_count = 0;
+    uint64_t allocation_count = 0;
+    for (uint32_t sequence = 0; sequence < SEQUENCE_COUNT; ++sequence)
+    {
+        // Small heaps fill up and fragment, large ones mostly don't.
+        uint64_t heap_size = (sequence % 4 == 0 ? 256 * KB : 8 * MB) + random() % 4096;
+        Tlsf_Allocator allocator(heap_size);
+        std::map<uint64_t, Tlsf_Allocation> live;
+        std::vector<uint64_t> live_offsets;
+        for (uint32_t operation = 0; operation < OPERATION_COUNT; ++operation)
+        {
+            // Biased towards allocating in the first half and freeing in the second, so the heap fills up and drains.
+            bool is_allocate = live.empty() || random() % 100 < (operation < OPERATION_COUNT / 2 ? 65u : 35u);
+            if (is_allocate)
+            {
+                uint64_t size;
+                switch (random() % 4)
+                {
+                case 0:
+                    size = 1 + random() % 256;
+                    break;
+                case 1:
+                    size = 64 * KB * (1 + random() % 4);
+                    break;
+                default:
+                    size = 1 + random() % (64 * KB);
+                    break;
+                }
+                uint64_t alignment = random() % 3 == 0 ? 1 : 1ull << (random() % 17);
+                auto allocation = allocator.allocate(size, alignment);
+                if (!allocation.is_valid())
+                {
+                    // A failure is only allowed if no gap holds the request with any alignment padding. Good
+                    // fit rounds that up to the next size class, a sixteenth of the size above it.
+                    auto needed = size + alignment - 1;
+                    needed += needed / Tlsf_Allocator::SL_COUNT + 1;
+                    uint64_t end = 0;
+                    bool fits = false;
+                    auto check_gap = [&](uint64_t gap_begin, uint64_t gap_end) {
+                        fits = fits || gap_end - gap_begin >= needed;
+                    };
+                    for (const auto& [offset, entry] : live)
+                    {
+                        check_gap(end, offset);
+                        end = offset + entry.size;
+                    }
+                    check_gap(end, heap_size);
+                    TEST_CHECK(!fits);
+                    failed_count += 1;
+                }
+                else
+                {
+                    TEST_CHECK(allocation.offset % alignment == 0);
+                    TEST_CHECK(allocation.size == size);
+                    TEST_CHECK(allocation.offset + allocation.size <= heap_size);
+                    TEST_CHECK(live.find(allocation.offset) == live.end());
+                    live[allocation.offset] = allocation;
+                    live_offsets.push_back(allocation.offset);
+                    allocation_count += 1;
+                }
+            }
+            else
+            {
+                auto index = random() % live_offsets.size();
+                auto offset = live_offsets[index];
+                live_offsets[index] = live_offsets.back();
+                live_offsets.pop_back();
+                allocator.free(live[offset]);
+                live.erase(offset);
+            }
+            check_state(allocator, live);
+        }
+
+        // Freeing everything in random order leaves one block covering the whole range. Good fit can't
+        // hand out all of it when the size is between two classes, so only the block is checked.
+        std::shuffle(live_offsets.begin(), live_offsets.end(), random);
+        for (auto offset : live_offsets)
+        {
+            allocator.free(live[offset]);
+            live.erase(offset);
+        }
+        check_state(allocator, live);
+        TEST_CHECK(allocator.is_empty() && allocator.get_free_bytes() == heap_size);
+        TEST_CHECK(allocator.get_largest_free_block() == heap_size);
+    }
+    printf("%llu allocations, %llu failed for lack of space\n", (unsigned long long)allocation_count,
+        (unsigned long long)failed_count);
+}
+
+int main()
+{
+    test_edge_cases();
+    test_coalescing();
+    test_random_sequences();
+    return finish_test();
+}
@@ -0,0 +1,182 @@
+#include "shader_reflection.h"
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Packs compiled shaders into one Shader_Archive and writes their reflection as a C++ header.
+// Usage: shader_pack <archive> <header> (<name> <entry point> <bytecode> <listing>)...
+
+struct Shader_Input
+{
+    std::string name;
+    std::string entry_point;
+    Mapped_File bytecode;
+    Mapped_File listing;
+};
+
+static std::string get_identifier(const std::string& name)
+{
+    std::string identifier;
+    for (auto c : name)
+    {
+        identifier += std::isalnum(uint8_t(c)) ? char(std::toupper(uint8_t(c))) : '_';
+    }
+    if (identifier.empty() || std::isdigit(uint8_t(identifier[0])))
+    {
+        identifier = "_" + identifier;
+    }
+    return identifier;
+}
+
+static std::string get_string_literal(const std::string& value)
+{
+    std::string literal = "\"";
+    for (auto c : value)
+    {
+        if (c == '"' || c == '\\')
+        {
+            literal += '\\';
+        }
+        literal += c;
+    }
+    return literal + "\"";
+}
+
+static const char* get_resource_type_name(Shader_Resource_Type type)
+{
+    switch (type)
+    {
+    case Shader_Resource_Type::Sampler: return "Sampler";
+    case Shader_Resource_Type::CBV: return "CBV";
+    case Shader_Resource_Type::SRV_Typed: return "SRV_Typed";
+    case Shader_Resource_Type::SRV_Raw: return "SRV_Raw";
+    case Shader_Resource_Type::SRV_Structured: return "SRV_Structured";
+    case Shader_Resource_Type::UAV_Typed: return "UAV_Typed";
+    case Shader_Resource_Type::UAV_Raw: return "UAV_Raw";
+    case Shader_Resource_Type::UAV_Structured: return "UAV_Structured";
+    case Shader_Resource_Type::UAV_Structured_With_Counter: return "UAV_Structured_With_Counter";
+    default: return "Invalid";
+    }
+}
+
+static bool write_reflection(const std::string& header, Shader_Input& input, std::string& all_reflections, std::string& code)
+{
+    Shader_Blob blob = { input.bytecode.data(), input.bytecode.size() };
+    auto identifier = get_identifier(input.name);
+    Thread_Group_Size group_size = { 0, 0, 0 };
+    bool is_compute = get_shader_thread_group_size(blob, group_size);
+    std::vector<Shader_Binding> bindings;
+    if (!get_shader_bindings(blob, bindings))
+    {
+        fprintf(stderr, "%s: %s has no pipeline state validation data\n", header.c_str(), input.name.c_str());
+        return false;
+    }
+    auto buffers = get_listing_constant_buffers(
+        { static_cast<const char*>(input.listing.data()), input.listing.size() });
+
+    code += "\n// " + input.name + "\n";
+    if (!bindings.empty())
+    {
+        code += "inline constexpr Shader_Binding " + identifier + "_BINDINGS[] = {\n";
+        for (const auto& binding : bindings)
+        {
+            code += "    { Shader_Resource_Type::" + std::string(get_resource_type_name(binding.type))
+                + ", " + std::to_string(binding.space)
+                + ", " + std::to_string(binding.lower_bound)
+                + ", " + std::to_string(binding.upper_bound) + " },\n";
+        }
+        code += "};\n";
+    }
+    std::string buffer_list;
+    for (const auto& buffer : buffers)
+    {
+        auto buffer_identifier = identifier + "_" + get_identifier(buffer.name);
+        std::string constants = "{}";
+        if (!buffer.constants.empty())
+        {
+            code += "inline constexpr Shader_Constant " + buffer_identifier + "_CONSTANTS[] = {\n";
+            for (const auto& constant : buffer.constants)
+            {
+                code += "    { " + get_string_literal(constant.name) + ", " + get_string_literal(constant.type)
+                    + ", " + std::to_string(constant.offset) + " },\n";
+            }
+            code += "};\n";
+            constants = buffer_identifier + "_CONSTANTS";
+        }
+        buffer_list += "    { " + get_string_literal(buffer.name) + ", " + std::to_string(buffer.size) + ", " + constants + " },\n";
+    }
+    if (!buffer_list.empty())
+    {
+        code += "inline constexpr Shader_Constant_Buffer " + identifier + "_CONSTANT_BUFFERS[] = {\n" + buffer_list + "};\n";
+    }
+    code += "inline constexpr Shader_Reflection " + identifier + "_REFLECTION = {\n"
+        "    .name = " + get_string_literal(input.name) + ",\n"
+        "    .entry_point = " + get_string_literal(input.entry_point) + ",\n"
+        "    .thread_group_size = { " + std::to_string(is_compute ? group_size.x : 0)
+            + ", " + std::to_string(is_compute ? group_size.y : 0)
+            + ", " + std::to_string(is_compute ? group_size.z : 0) + " },\n"
+        "    .bindings = " + (bindings.empty() ? std::string("{}") : identifier + "_BINDINGS") + ",\n"
+        "    .constant_buffers = " + (buffer_list.empty() ? std::string("{}") : identifier + "_CONSTANT_BUFFERS") + "\n"
+        "};\n";
+    all_reflections += "    " + identifier + "_REFLECTION,\n";
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3 || (argc - 3) % 4 != 0)
+    {
+        fprintf(stderr, "usage: shader_pack <archive> <header> (<name> <entry point> <bytecode> <listing>)...\n");
+        return 1;
+    }
+    std::string archive = argv[1];
+    std::string header = argv[2];
+    std::vector<Shader_Input> inputs;
+    for (int i = 3; i < argc; i += 4)
+    {
+        Shader_Input input = { argv[i], argv[i + 1], Mapped_File(argv[i + 2]), Mapped_File(argv[i + 3]) };
+        if (!input.bytecode.is_open() || !input.listing.is_open())
+        {
+            fprintf(stderr, "shader_pack: can't read %s or %s\n", argv[i + 2], argv[i + 3]);
+            return 1;
+        }
+        inputs.push_back(std::move(input));
+    }
+
+    std::string code = "// Generated by shader_pack, do not edit.\n#pragma once\n\n#include \"shader_reflection.h\"\n";
+    std::string all_reflections;
+    std::vector<Shader_Archive_Input> archive_inputs;
+    for (auto& input : inputs)
+    {
+        if (!write_reflection(header, input, all_reflections, code))
+        {
+            return 1;
+        }
+        archive_inputs.push_back({ input.name, { input.bytecode.data(), input.bytecode.size() } });
+    }
+    if (!all_reflections.empty())
+    {
+        code += "\ninline constexpr Shader_Reflection SHADER_REFLECTIONS[] = {\n" + all_reflections + "};\n";
+    }
+
+    if (!write_shader_archive(archive.c_str(), archive_inputs))
+    {
+        fprintf(stderr, "shader_pack: can't write %s\n", archive.c_str());
+        return 1;
+    }
+    FILE* file = fopen(header.c_str(), "wb");
+    if (!file)
+    {
+        fprintf(stderr, "shader_pack: can't write %s\n", header.c_str());
+        return 1;
+    }
+    auto written = fwrite(code.data(), 1, code.size(), file);
+    if (fclose(file) != 0 || written != code.size())
+    {
+        fprintf(stderr, "shader_pack: can't write %s\n", header.c_str());
+        return 1;
+    }
+    return 0;
+}